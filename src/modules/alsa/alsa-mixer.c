@@ -25,6 +25,7 @@
 #endif
 
 #include <sys/types.h>
+#include <errno.h>
 #include <asoundlib.h>
 #include <math.h>
 
@@ -3824,7 +3825,7 @@ fail:
 }
 
 static void mapping_paths_probe(pa_alsa_mapping *m, pa_alsa_profile *profile,
-                                pa_alsa_direction_t direction) {
+                                pa_alsa_direction_t direction, int card_index) {
 
     pa_alsa_path *p;
     void *state;
@@ -3848,9 +3849,15 @@ static void mapping_paths_probe(pa_alsa_mapping *m, pa_alsa_profile *profile,
     if (!ps)
         return; /* No paths */
 
-    pa_assert(pcm_handle);
+    /* Without an open PCM, i.e. when the profiles are restored from
+     * the cache, we go straight for the card's mixer */
+    if (pcm_handle)
+        mixer_handle = pa_alsa_open_mixer_for_pcm(pcm_handle, NULL, &hctl_handle);
+    else {
+        pa_assert(card_index >= 0);
+        mixer_handle = pa_alsa_open_mixer(card_index, NULL, &hctl_handle);
+    }
 
-    mixer_handle = pa_alsa_open_mixer_for_pcm(pcm_handle, NULL, &hctl_handle);
     if (!mixer_handle || !hctl_handle) {
          /* Cannot open mixer, remove all entries */
         while (pa_hashmap_steal_first(ps->paths));
@@ -4367,7 +4374,11 @@ static void paths_drop_unsupported(pa_hashmap* h) {
     }
 }
 
-void pa_alsa_profile_set_probe(
+static pa_bool_t pcm_busy(void) {
+    return errno == EBUSY || errno == EAGAIN;
+}
+
+pa_bool_t pa_alsa_profile_set_probe(
         pa_alsa_profile_set *ps,
         const char *dev_id,
         const pa_sample_spec *ss,
@@ -4377,13 +4388,14 @@ void pa_alsa_profile_set_probe(
     void *state;
     pa_alsa_profile *p, *last = NULL;
     pa_alsa_mapping *m;
+    pa_bool_t complete = TRUE;
 
     pa_assert(ps);
     pa_assert(dev_id);
     pa_assert(ss);
 
     if (ps->probed)
-        return;
+        return TRUE;
 
     PA_HASHMAP_FOREACH(p, ps->profiles, state) {
         uint32_t idx;
@@ -4407,6 +4419,11 @@ void pa_alsa_profile_set_probe(
                                                            SND_PCM_STREAM_PLAYBACK,
                                                            default_n_fragments,
                                                            default_fragment_size_msec))) {
+                        if (pcm_busy()) {
+                            pa_log_debug("%s is busy, the result is incomplete.", m->name);
+                            complete = FALSE;
+                        }
+
                         p->supported = FALSE;
                         break;
                     }
@@ -4423,6 +4440,11 @@ void pa_alsa_profile_set_probe(
                                                           SND_PCM_STREAM_CAPTURE,
                                                           default_n_fragments,
                                                           default_fragment_size_msec))) {
+                        if (pcm_busy()) {
+                            pa_log_debug("%s is busy, the result is incomplete.", m->name);
+                            complete = FALSE;
+                        }
+
                         p->supported = FALSE;
                         break;
                     }
@@ -4439,12 +4461,12 @@ void pa_alsa_profile_set_probe(
         if (p->output_mappings)
             PA_IDXSET_FOREACH(m, p->output_mappings, idx)
                 if (m->output_pcm)
-                    mapping_paths_probe(m, p, PA_ALSA_DIRECTION_OUTPUT);
+                    mapping_paths_probe(m, p, PA_ALSA_DIRECTION_OUTPUT, -1);
 
         if (p->input_mappings)
             PA_IDXSET_FOREACH(m, p->input_mappings, idx)
                 if (m->input_pcm)
-                    mapping_paths_probe(m, p, PA_ALSA_DIRECTION_INPUT);
+                    mapping_paths_probe(m, p, PA_ALSA_DIRECTION_INPUT, -1);
     }
 
     /* Clean up */
@@ -4456,6 +4478,79 @@ void pa_alsa_profile_set_probe(
     paths_drop_unsupported(ps->output_paths);
 
     ps->probed = TRUE;
+
+    return complete;
+}
+
+int pa_alsa_profile_set_probe_cached(
+        pa_alsa_profile_set *ps,
+        const char *dev_id,
+        const char *supported) {
+
+    void *state;
+    pa_alsa_profile *p;
+    pa_alsa_mapping *m;
+    const char *split_state = NULL;
+    char *name;
+    int card_index;
+
+    pa_assert(ps);
+    pa_assert(dev_id);
+    pa_assert(supported);
+
+    if (ps->probed)
+        return 0;
+
+    /* The profile set configuration might have changed since */
+    while ((name = pa_split_spaces(supported, &split_state))) {
+        pa_bool_t known = !!pa_hashmap_get(ps->profiles, name);
+
+        if (!known)
+            pa_log_debug("Cached profile %s doesn't exist anymore.", name);
+
+        pa_xfree(name);
+
+        if (!known)
+            return -1;
+    }
+
+    if ((card_index = snd_card_get_index(dev_id)) < 0)
+        return -1;
+
+    PA_HASHMAP_FOREACH(p, ps->profiles, state) {
+        uint32_t idx;
+
+        /* Profiles marked supported in the config file stay supported */
+        if (!p->supported)
+            p->supported = pa_str_in_list_spaces(p->name, supported);
+
+        if (!p->supported)
+            continue;
+
+        pa_log_debug("Profile %s supported (cached).", p->name);
+
+        /* This is what profile_finalize_probing() would have counted */
+        if (p->output_mappings)
+            PA_IDXSET_FOREACH(m, p->output_mappings, idx) {
+                m->supported++;
+                mapping_paths_probe(m, p, PA_ALSA_DIRECTION_OUTPUT, card_index);
+            }
+
+        if (p->input_mappings)
+            PA_IDXSET_FOREACH(m, p->input_mappings, idx) {
+                m->supported++;
+                mapping_paths_probe(m, p, PA_ALSA_DIRECTION_INPUT, card_index);
+            }
+    }
+
+    pa_alsa_profile_set_drop_unsupported(ps);
+
+    paths_drop_unsupported(ps->input_paths);
+    paths_drop_unsupported(ps->output_paths);
+
+    ps->probed = TRUE;
+
+    return 0;
 }
 
 void pa_alsa_profile_set_dump(pa_alsa_profile_set *ps) {
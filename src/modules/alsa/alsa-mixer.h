@@ -320,7 +320,14 @@ void pa_alsa_decibel_fix_dump(pa_alsa_decibel_fix *db_fix);
 pa_alsa_mapping *pa_alsa_mapping_get(pa_alsa_profile_set *ps, const char *name);
 
 pa_alsa_profile_set* pa_alsa_profile_set_new(const char *fname, const pa_channel_map *bonus);
-void pa_alsa_profile_set_probe(pa_alsa_profile_set *ps, const char *dev_id, const pa_sample_spec *ss, unsigned default_n_fragments, unsigned default_fragment_size_msec);
+/* Returns FALSE if some PCM was busy, so that profiles may have been
+ * dropped although they are supported */
+pa_bool_t pa_alsa_profile_set_probe(pa_alsa_profile_set *ps, const char *dev_id, const pa_sample_spec *ss, unsigned default_n_fragments, unsigned default_fragment_size_msec);
+/* Instead of opening all PCMs, takes the space separated list of
+ * supported profiles from an earlier pa_alsa_profile_set_probe(). Only
+ * the mixer paths are probed. Returns -1 without touching the profile set
+ * if the list doesn't match it anymore. */
+int pa_alsa_profile_set_probe_cached(pa_alsa_profile_set *ps, const char *dev_id, const char *supported);
 void pa_alsa_profile_set_free(pa_alsa_profile_set *s);
 void pa_alsa_profile_set_dump(pa_alsa_profile_set *s);
 void pa_alsa_profile_set_drop_unsupported(pa_alsa_profile_set *s);
@@ -53,6 +53,7 @@
 #include <pulsecore/thread-mq.h>
 #include <pulsecore/rtpoll.h>
 #include <pulsecore/time-smoother.h>
+#include <pulsecore/wakeup-predictor.h>
 
 #include <modules/reserve-wrap.h>
 
@@ -78,6 +79,9 @@
 #define TSCHED_MIN_SLEEP_USEC (10*PA_USEC_PER_MSEC)                /* 10ms  -- Sleep at least 10ms on each iteration */
 #define TSCHED_MIN_WAKEUP_USEC (4*PA_USEC_PER_MSEC)                /* 4ms   -- Wakeup at least this long before the buffer runs empty*/
 
+#define TSCHED_PREDICT_PPM 999900                                  /* 99.99% -- Size the watermark so that this many wakeups are in time */
+#define TSCHED_PREDICT_HEADROOM_USEC (2*PA_USEC_PER_MSEC)          /* 2ms   -- On top of what the wakeup predictor asks for */
+
 #define SMOOTHER_WINDOW_USEC  (10*PA_USEC_PER_SEC)                 /* 10s   -- smoother windows size */
 #define SMOOTHER_ADJUST_USEC  (1*PA_USEC_PER_SEC)                  /* 1s    -- smoother adjust time */
 
@@ -129,6 +133,12 @@ struct userdata {
     pa_usec_t watermark_dec_not_before;
     pa_usec_t min_latency_ref;
 
+    /* What we learned about our wakeups on this device */
+    pa_wakeup_predictor *wakeup_predictor;
+    pa_usec_t wakeup_late;
+    pa_bool_t wakeup_sampled, watermark_predicted;
+    pa_usec_t watermark_predict_not_before;
+
     pa_memchunk memchunk;
 
     char *device_name;  /* name of the PCM device */
@@ -387,6 +397,42 @@ restart:
     u->watermark_dec_not_before = now + TSCHED_WATERMARK_VERIFY_AFTER_USEC;
 }
 
+/* Called after each timer wakeup with what it cost us: moves the
+ * watermark to what the wakeup predictor says we need, instead of
+ * waiting for underruns or long stretches of comfort */
+static void predict_watermark(struct userdata *u, pa_usec_t work) {
+    size_t old_watermark, target;
+    pa_usec_t margin;
+
+    pa_assert(u);
+    pa_assert(u->use_tsched);
+
+    pa_wakeup_predictor_add(u->wakeup_predictor, u->wakeup_late, work);
+
+    if (!pa_wakeup_predictor_get_margin(u->wakeup_predictor, &margin))
+        return;
+
+    u->watermark_predicted = TRUE;
+
+    target = pa_usec_to_bytes(margin + TSCHED_PREDICT_HEADROOM_USEC, &u->sink->sample_spec);
+    old_watermark = u->tsched_watermark;
+
+    /* Going up we do right away, before it turns into an underrun.
+     * Going down we don't do for a while after a real underrun. */
+    if (target > u->tsched_watermark)
+        u->tsched_watermark = target;
+    else if (target < u->tsched_watermark && pa_rtclock_now() >= u->watermark_predict_not_before)
+        u->tsched_watermark = target;
+    else
+        return;
+
+    fix_tsched_watermark(u);
+
+    if (old_watermark != u->tsched_watermark)
+        pa_log_info("Predicted wakeup watermark is %0.2f ms",
+                    (double) pa_bytes_to_usec(u->tsched_watermark, &u->sink->sample_spec) / PA_USEC_PER_MSEC);
+}
+
 static void hw_sleep_time(struct userdata *u, pa_usec_t *sleep_usec, pa_usec_t*process_usec) {
     pa_usec_t usec, wm;
 
@@ -426,8 +472,10 @@ static int try_recover(struct userdata *u, const char *call, int err) {
 
     pa_assert(err != -EAGAIN);
 
-    if (err == -EPIPE)
+    if (err == -EPIPE) {
         pa_log_debug("%s: Buffer underrun!", call);
+        pa_telemetry_record(u->sink->telemetry, PA_TELEMETRY_XRUN, 0);
+    }
 
     if (err == -ESTRPIPE)
         pa_log_debug("%s: System suspended!", call);
@@ -463,11 +511,16 @@ static size_t check_left_to_play(struct userdata *u, size_t n_bytes, pa_bool_t o
         PA_DEBUG_TRAP;
 #endif
 
-        if (!u->first && !u->after_rewind)
+        if (!u->first && !u->after_rewind) {
             if (pa_log_ratelimit(PA_LOG_INFO))
                 pa_log_info("Underrun!");
+
+            pa_telemetry_record(u->sink->telemetry, PA_TELEMETRY_XRUN, pa_bytes_to_usec(n_bytes - u->hwbuf_size, &u->sink->sample_spec));
+        }
     }
 
+    pa_telemetry_record(u->sink->telemetry, PA_TELEMETRY_BUFFER_FILL, pa_bytes_to_usec(left_to_play, &u->sink->sample_spec));
+
 #ifdef DEBUG_TIMING
     pa_log_debug("%0.2f ms left to play; inc threshold = %0.2f ms; dec threshold = %0.2f ms",
                  (double) pa_bytes_to_usec(left_to_play, &u->sink->sample_spec) / PA_USEC_PER_MSEC,
@@ -479,16 +532,37 @@ static size_t check_left_to_play(struct userdata *u, size_t n_bytes, pa_bool_t o
         pa_bool_t reset_not_before = TRUE;
 
         if (!u->first && !u->after_rewind) {
-            if (underrun || left_to_play < u->watermark_inc_threshold)
+
+            if (on_timeout) {
+                pa_usec_t left, wm;
+
+                /* How much of the watermark was gone by the time we
+                 * got here */
+                left = pa_bytes_to_usec(left_to_play, &u->sink->sample_spec);
+                wm = pa_bytes_to_usec(u->tsched_watermark, &u->sink->sample_spec);
+                u->wakeup_late = wm > left ? wm - left : 0;
+
+                if (underrun)
+                    u->wakeup_late = wm + pa_bytes_to_usec(n_bytes - u->hwbuf_size, &u->sink->sample_spec);
+                u->wakeup_sampled = TRUE;
+            }
+
+            if (underrun || left_to_play < u->watermark_inc_threshold) {
                 increase_watermark(u);
-            else if (left_to_play > u->watermark_dec_threshold) {
+
+                /* Only an actual underrun proves the prediction wrong,
+                 * running low on the threshold alone doesn't */
+                if (underrun)
+                    u->watermark_predict_not_before = pa_rtclock_now() + TSCHED_WATERMARK_VERIFY_AFTER_USEC;
+            } else if (left_to_play > u->watermark_dec_threshold) {
                 reset_not_before = FALSE;
 
                 /* We decrease the watermark only if have actually
                  * been woken up by a timeout. If something else woke
-                 * us up it's too easy to fulfill the deadlines... */
+                 * us up it's too easy to fulfill the deadlines... Once
+                 * the wakeup predictor has an opinion it takes over. */
 
-                if (on_timeout)
+                if (on_timeout && !u->watermark_predicted)
                     decrease_watermark(u);
             }
         }
@@ -610,9 +684,10 @@ static int mmap_write(struct userdata *u, pa_usec_t *sleep_usec, pa_bool_t polle
                 return r;
             }
 
-            /* Make sure that if these memblocks need to be copied they will fit into one slot */
-            if (frames > pa_mempool_block_size_max(u->core->mempool)/u->frame_size)
-                frames = pa_mempool_block_size_max(u->core->mempool)/u->frame_size;
+            /* We render straight into the whole mmap area, however
+             * large: if the monitor source is recorded from, the sink
+             * hands it copies in slot sized pieces rather than
+             * references to the DMA area. */
 
             if (!after_avail && frames == 0)
                 break;
@@ -1737,9 +1812,14 @@ static void thread_func(void *userdata) {
         /* Render some data and write it to the dsp */
         if (PA_SINK_IS_OPENED(u->sink->thread_info.state)) {
             int work_done;
-            pa_usec_t sleep_usec = 0;
+            pa_usec_t sleep_usec = 0, work_start = 0;
             pa_bool_t on_timeout = pa_rtpoll_timer_elapsed(u->rtpoll);
 
+            if (on_timeout) {
+                pa_telemetry_record(u->sink->telemetry, PA_TELEMETRY_WAKEUP_LATENESS, pa_rtpoll_timer_lateness(u->rtpoll));
+                work_start = pa_rtclock_now();
+            }
+
             if (PA_UNLIKELY(u->sink->thread_info.rewind_requested))
                 if (process_rewind(u) < 0)
                         goto fail;
@@ -1752,6 +1832,11 @@ static void thread_func(void *userdata) {
             if (work_done < 0)
                 goto fail;
 
+            if (u->wakeup_sampled) {
+                predict_watermark(u, pa_rtclock_now() - work_start);
+                u->wakeup_sampled = FALSE;
+            }
+
 /*             pa_log_debug("work_done = %i", work_done); */
 
             if (work_done) {
@@ -2143,6 +2228,8 @@ pa_sink *pa_alsa_sink_new(pa_module *m, pa_modargs *ma, const char*driver, pa_ca
             TRUE);
     u->smoother_interval = SMOOTHER_MIN_INTERVAL;
 
+    u->wakeup_predictor = pa_wakeup_predictor_new(TSCHED_PREDICT_PPM);
+
     /* use ucm */
     if (mapping && mapping->ucm_context.ucm)
         u->ucm_context = &mapping->ucm_context;
@@ -2481,6 +2568,9 @@ static void userdata_free(struct userdata *u) {
     if (u->smoother)
         pa_smoother_free(u->smoother);
 
+    if (u->wakeup_predictor)
+        pa_wakeup_predictor_free(u->wakeup_predictor);
+
     if (u->formats)
         pa_idxset_free(u->formats, (pa_free2_cb_t) pa_format_info_free2, NULL);
 
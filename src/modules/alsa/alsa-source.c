@@ -48,6 +48,7 @@
 #include <pulsecore/thread-mq.h>
 #include <pulsecore/rtpoll.h>
 #include <pulsecore/time-smoother.h>
+#include <pulsecore/wakeup-predictor.h>
 
 #include <modules/reserve-wrap.h>
 
@@ -71,6 +72,9 @@
 #define TSCHED_MIN_SLEEP_USEC (10*PA_USEC_PER_MSEC)                /* 10ms */
 #define TSCHED_MIN_WAKEUP_USEC (4*PA_USEC_PER_MSEC)                /* 4ms */
 
+#define TSCHED_PREDICT_PPM 999900                                  /* 99.99% */
+#define TSCHED_PREDICT_HEADROOM_USEC (2*PA_USEC_PER_MSEC)          /* 2ms */
+
 #define SMOOTHER_WINDOW_USEC  (10*PA_USEC_PER_SEC)                 /* 10s */
 #define SMOOTHER_ADJUST_USEC  (1*PA_USEC_PER_SEC)                  /* 1s */
 
@@ -118,6 +122,11 @@ struct userdata {
     pa_usec_t watermark_dec_not_before;
     pa_usec_t min_latency_ref;
 
+    pa_wakeup_predictor *wakeup_predictor;
+    pa_usec_t wakeup_late;
+    pa_bool_t wakeup_sampled, watermark_predicted;
+    pa_usec_t watermark_predict_not_before;
+
     char *device_name;  /* name of the PCM device */
     char *control_device; /* name of the control device */
 
@@ -361,6 +370,38 @@ restart:
     u->watermark_dec_not_before = now + TSCHED_WATERMARK_VERIFY_AFTER_USEC;
 }
 
+/* See alsa-sink.c */
+static void predict_watermark(struct userdata *u, pa_usec_t work) {
+    size_t old_watermark, target;
+    pa_usec_t margin;
+
+    pa_assert(u);
+    pa_assert(u->use_tsched);
+
+    pa_wakeup_predictor_add(u->wakeup_predictor, u->wakeup_late, work);
+
+    if (!pa_wakeup_predictor_get_margin(u->wakeup_predictor, &margin))
+        return;
+
+    u->watermark_predicted = TRUE;
+
+    target = pa_usec_to_bytes(margin + TSCHED_PREDICT_HEADROOM_USEC, &u->source->sample_spec);
+    old_watermark = u->tsched_watermark;
+
+    if (target > u->tsched_watermark)
+        u->tsched_watermark = target;
+    else if (target < u->tsched_watermark && pa_rtclock_now() >= u->watermark_predict_not_before)
+        u->tsched_watermark = target;
+    else
+        return;
+
+    fix_tsched_watermark(u);
+
+    if (old_watermark != u->tsched_watermark)
+        pa_log_info("Predicted wakeup watermark is %0.2f ms",
+                    (double) pa_bytes_to_usec(u->tsched_watermark, &u->source->sample_spec) / PA_USEC_PER_MSEC);
+}
+
 static void hw_sleep_time(struct userdata *u, pa_usec_t *sleep_usec, pa_usec_t*process_usec) {
     pa_usec_t wm, usec;
 
@@ -400,8 +441,10 @@ static int try_recover(struct userdata *u, const char *call, int err) {
 
     pa_assert(err != -EAGAIN);
 
-    if (err == -EPIPE)
+    if (err == -EPIPE) {
         pa_log_debug("%s: Buffer overrun!", call);
+        pa_telemetry_record(u->source->telemetry, PA_TELEMETRY_XRUN, 0);
+    }
 
     if (err == -ESTRPIPE)
         pa_log_debug("%s: System suspended!", call);
@@ -439,8 +482,12 @@ static size_t check_left_to_record(struct userdata *u, size_t n_bytes, pa_bool_t
 
         if (pa_log_ratelimit(PA_LOG_INFO))
             pa_log_info("Overrun!");
+
+        pa_telemetry_record(u->source->telemetry, PA_TELEMETRY_XRUN, pa_bytes_to_usec(n_bytes - rec_space, &u->source->sample_spec));
     }
 
+    pa_telemetry_record(u->source->telemetry, PA_TELEMETRY_BUFFER_FILL, pa_bytes_to_usec(n_bytes, &u->source->sample_spec));
+
 #ifdef DEBUG_TIMING
     pa_log_debug("%0.2f ms left to record", (double) pa_bytes_to_usec(left_to_record, &u->source->sample_spec) / PA_USEC_PER_MSEC);
 #endif
@@ -448,16 +495,33 @@ static size_t check_left_to_record(struct userdata *u, size_t n_bytes, pa_bool_t
     if (u->use_tsched) {
         pa_bool_t reset_not_before = TRUE;
 
-        if (overrun || left_to_record < u->watermark_inc_threshold)
+        if (on_timeout) {
+            pa_usec_t left, wm;
+
+            left = pa_bytes_to_usec(left_to_record, &u->source->sample_spec);
+            wm = pa_bytes_to_usec(u->tsched_watermark, &u->source->sample_spec);
+            u->wakeup_late = wm > left ? wm - left : 0;
+
+            if (overrun)
+                u->wakeup_late = wm + pa_bytes_to_usec(n_bytes - rec_space, &u->source->sample_spec);
+            u->wakeup_sampled = TRUE;
+        }
+
+        if (overrun || left_to_record < u->watermark_inc_threshold) {
             increase_watermark(u);
-        else if (left_to_record > u->watermark_dec_threshold) {
+
+            /* Only an actual overrun proves the prediction wrong,
+             * running low on the threshold alone doesn't */
+            if (overrun)
+                u->watermark_predict_not_before = pa_rtclock_now() + TSCHED_WATERMARK_VERIFY_AFTER_USEC;
+        } else if (left_to_record > u->watermark_dec_threshold) {
             reset_not_before = FALSE;
 
             /* We decrease the watermark only if have actually
              * been woken up by a timeout. If something else woke
              * us up it's too easy to fulfill the deadlines... */
 
-            if (on_timeout)
+            if (on_timeout && !u->watermark_predicted)
                 decrease_watermark(u);
         }
 
@@ -1462,9 +1526,14 @@ static void thread_func(void *userdata) {
         /* Read some data and pass it to the sources */
         if (PA_SOURCE_IS_OPENED(u->source->thread_info.state)) {
             int work_done;
-            pa_usec_t sleep_usec = 0;
+            pa_usec_t sleep_usec = 0, work_start = 0;
             pa_bool_t on_timeout = pa_rtpoll_timer_elapsed(u->rtpoll);
 
+            if (on_timeout) {
+                pa_telemetry_record(u->source->telemetry, PA_TELEMETRY_WAKEUP_LATENESS, pa_rtpoll_timer_lateness(u->rtpoll));
+                work_start = pa_rtclock_now();
+            }
+
             if (u->first) {
                 pa_log_info("Starting capture.");
                 snd_pcm_start(u->pcm_handle);
@@ -1482,6 +1551,11 @@ static void thread_func(void *userdata) {
             if (work_done < 0)
                 goto fail;
 
+            if (u->wakeup_sampled) {
+                predict_watermark(u, pa_rtclock_now() - work_start);
+                u->wakeup_sampled = FALSE;
+            }
+
 /*             pa_log_debug("work_done = %i", work_done); */
 
             if (work_done)
@@ -1833,6 +1907,8 @@ pa_source *pa_alsa_source_new(pa_module *m, pa_modargs *ma, const char*driver, p
             TRUE);
     u->smoother_interval = SMOOTHER_MIN_INTERVAL;
 
+    u->wakeup_predictor = pa_wakeup_predictor_new(TSCHED_PREDICT_PPM);
+
     /* use ucm */
     if (mapping && mapping->ucm_context.ucm)
         u->ucm_context = &mapping->ucm_context;
@@ -2138,6 +2214,9 @@ static void userdata_free(struct userdata *u) {
     if (u->smoother)
         pa_smoother_free(u->smoother);
 
+    if (u->wakeup_predictor)
+        pa_wakeup_predictor_free(u->wakeup_predictor);
+
     if (u->rates)
         pa_xfree(u->rates);
 
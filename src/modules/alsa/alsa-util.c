@@ -25,6 +25,7 @@
 #endif
 
 #include <sys/types.h>
+#include <errno.h>
 #include <asoundlib.h>
 
 #include <pulse/sample.h>
@@ -732,6 +733,7 @@ snd_pcm_t *pa_alsa_open_by_device_string(
 fail:
     pa_xfree(d);
 
+    errno = -err;
     return NULL;
 }
 
@@ -751,6 +753,7 @@ snd_pcm_t *pa_alsa_open_by_template(
 
     snd_pcm_t *pcm_handle;
     char **i;
+    int busy = 0, err = ENOENT;
 
     for (i = template; *i; i++) {
         char *d;
@@ -770,12 +773,19 @@ snd_pcm_t *pa_alsa_open_by_template(
                 use_tsched,
                 require_exact_channel_number);
 
+        err = errno;
         pa_xfree(d);
 
         if (pcm_handle)
             return pcm_handle;
+
+        if (err == EBUSY || err == EAGAIN)
+            busy = err;
     }
 
+    /* If one of the devices was merely busy, that's what matters to
+     * the caller */
+    errno = busy ? busy : err;
     return NULL;
 }
 
@@ -79,7 +79,7 @@ snd_pcm_t *pa_alsa_open_by_device_id_mapping(
         pa_bool_t *use_tsched,            /* modified at return */
         pa_alsa_mapping *mapping);
 
-/* Opens the explicit ALSA device */
+/* Opens the explicit ALSA device, sets errno on failure */
 snd_pcm_t *pa_alsa_open_by_device_string(
         const char *dir,
         char **dev,                       /* modified at return */
@@ -93,7 +93,8 @@ snd_pcm_t *pa_alsa_open_by_device_string(
         pa_bool_t *use_tsched,            /* modified at return */
         pa_bool_t require_exact_channel_number);
 
-/* Opens the explicit ALSA device with a fallback list */
+/* Opens the explicit ALSA device with a fallback list, sets errno on
+ * failure, to EBUSY or EAGAIN if any of the devices was busy */
 snd_pcm_t *pa_alsa_open_by_template(
         char **template,
         const char *dev_id,
@@ -23,12 +23,21 @@
 #include <config.h>
 #endif
 
+#include <errno.h>
+#include <sys/utsname.h>
+
+#include <pulse/rtclock.h>
+#include <pulse/timeval.h>
 #include <pulse/xmalloc.h>
 
+#include <pulsecore/core-error.h>
 #include <pulsecore/core-util.h>
+#include <pulsecore/database.h>
 #include <pulsecore/i18n.h>
 #include <pulsecore/modargs.h>
 #include <pulsecore/queue.h>
+#include <pulsecore/strbuf.h>
+#include <pulsecore/tagstruct.h>
 
 #include <modules/reserve-wrap.h>
 
@@ -71,6 +80,7 @@ PA_MODULE_USAGE(
         "profile_set=<profile set configuration file> "
         "paths_dir=<directory containing the path configuration files> "
         "use_ucm=<load use case manager> "
+        "probe_cache=<remember which profiles the card supports across restarts?> "
 );
 
 static const char* const valid_modargs[] = {
@@ -98,11 +108,14 @@ static const char* const valid_modargs[] = {
     "profile_set",
     "paths_dir",
     "use_ucm",
+    "probe_cache",
     NULL
 };
 
 #define DEFAULT_DEVICE_ID "0"
 
+#define PROBE_CACHE_VERSION 1
+
 struct userdata {
     pa_core *core;
     pa_module *module;
@@ -645,10 +658,182 @@ static pa_hook_result_t source_output_move_finish_hook_callback(
     return source_output_put_hook_callback (c, source_output, u);
 }
 
+/* Identifies the card; the same model on another slot gives the same
+ * results, so the card index is left out */
+static char *probe_cache_key(struct userdata *u, const char *profile_set_fn) {
+    char *driver, *name = NULL, *key;
+
+    driver = pa_alsa_get_driver_name(u->alsa_card_index);
+    snd_card_get_longname(u->alsa_card_index, &name);
+
+    key = pa_sprintf_malloc("%s:%s:%s",
+                            pa_strnull(driver),
+                            name ? pa_strip(name) : "(null)",
+                            profile_set_fn ? profile_set_fn : "default");
+
+    pa_xfree(driver);
+    free(name);
+
+    return key;
+}
+
+/* Anything that may change the probing results without changing the
+ * card: our profile definitions, the kernel driver and the parameters we
+ * probe with */
+static char *probe_cache_stamp(pa_core *c) {
+    struct utsname un;
+
+    if (uname(&un) < 0)
+        return NULL;
+
+    return pa_sprintf_malloc("%s %s %s %s %u %u %u",
+                             PACKAGE_VERSION, un.release, un.version,
+                             pa_sample_format_to_string(c->default_sample_spec.format),
+                             c->default_sample_spec.rate,
+                             c->default_n_fragments,
+                             c->default_fragment_size_msec);
+}
+
+static char *probe_cache_read(pa_database *db, const char *key, const char *stamp, pa_usec_t *probe_usec) {
+    pa_datum k, data;
+    pa_tagstruct *t;
+    uint8_t version;
+    const char *s, *supported;
+    uint64_t usec;
+    char *r = NULL;
+
+    k.data = (char*) key;
+    k.size = strlen(key);
+
+    pa_zero(data);
+
+    if (!pa_database_get(db, &k, &data))
+        return NULL;
+
+    t = pa_tagstruct_new(data.data, data.size);
+
+    if (pa_tagstruct_getu8(t, &version) < 0 ||
+        version != PROBE_CACHE_VERSION ||
+        pa_tagstruct_gets(t, &s) < 0 || !s ||
+        pa_tagstruct_gets(t, &supported) < 0 || !supported ||
+        pa_tagstruct_getu64(t, &usec) < 0 ||
+        !pa_tagstruct_eof(t)) {
+
+        pa_log_debug("Probe cache contains invalid data for key: %s", key);
+        goto finish;
+    }
+
+    if (!pa_streq(s, stamp)) {
+        pa_log_debug("Probe cache for %s is outdated.", key);
+        goto finish;
+    }
+
+    r = pa_xstrdup(supported);
+    *probe_usec = (pa_usec_t) usec;
+
+finish:
+    pa_tagstruct_free(t);
+    pa_datum_free(&data);
+
+    return r;
+}
+
+static void probe_cache_write(pa_database *db, const char *key, const char *stamp, pa_alsa_profile_set *ps, pa_usec_t probe_usec) {
+    pa_datum k, data;
+    pa_tagstruct *t;
+    pa_strbuf *buf;
+    pa_alsa_profile *p;
+    void *state;
+    char *supported;
+
+    /* What survived probing is what is supported */
+    buf = pa_strbuf_new();
+    PA_HASHMAP_FOREACH(p, ps->profiles, state)
+        pa_strbuf_printf(buf, "%s%s", pa_strbuf_isempty(buf) ? "" : " ", p->name);
+    supported = pa_strbuf_tostring_free(buf);
+
+    t = pa_tagstruct_new(NULL, 0);
+    pa_tagstruct_putu8(t, PROBE_CACHE_VERSION);
+    pa_tagstruct_puts(t, stamp);
+    pa_tagstruct_puts(t, supported);
+    pa_tagstruct_putu64(t, probe_usec);
+
+    k.data = (char*) key;
+    k.size = strlen(key);
+
+    data.data = (void*) pa_tagstruct_data(t, &data.size);
+
+    if (pa_database_set(db, &k, &data, TRUE) < 0 || pa_database_sync(db) < 0)
+        pa_log_warn("Failed to update the probe cache for %s.", key);
+
+    pa_tagstruct_free(t);
+    pa_xfree(supported);
+}
+
+/* Opening every PCM of every profile is by far the slowest part of
+ * bringing up a card, so the outcome is remembered across restarts.
+ * A busy PCM makes its profiles look unsupported, so such an outcome is
+ * not remembered. A stale entry can be flushed with probe_cache=no. */
+static void probe_profile_set(struct userdata *u, const char *profile_set_fn, pa_bool_t use_cache) {
+    pa_database *db = NULL;
+    char *dbfn = NULL, *key = NULL, *stamp = NULL, *supported = NULL;
+    pa_usec_t start, probe_usec = 0;
+
+    if (u->profile_set->probed)
+        return;
+
+    start = pa_rtclock_now();
+
+    if ((dbfn = pa_state_path("alsa-probe-cache", TRUE))) {
+        if (!(db = pa_database_open(dbfn, TRUE)))
+            pa_log_debug("Failed to open probe cache '%s': %s", dbfn, pa_cstrerror(errno));
+        pa_xfree(dbfn);
+    }
+
+    if (db && (stamp = probe_cache_stamp(u->core))) {
+        key = probe_cache_key(u, profile_set_fn);
+
+        if (use_cache)
+            supported = probe_cache_read(db, key, stamp, &probe_usec);
+    }
+
+    if (supported &&
+        pa_alsa_profile_set_probe_cached(u->profile_set, u->device_id, supported) >= 0) {
+
+        pa_log_info("Restored profiles of card %s from the probe cache in %0.1f ms, probing took %0.1f ms.",
+                    u->device_id,
+                    (double) (pa_rtclock_now() - start) / PA_USEC_PER_MSEC,
+                    (double) probe_usec / PA_USEC_PER_MSEC);
+    } else {
+        pa_bool_t complete;
+
+        complete = pa_alsa_profile_set_probe(u->profile_set, u->device_id, &u->core->default_sample_spec,
+                                             u->core->default_n_fragments, u->core->default_fragment_size_msec);
+
+        probe_usec = pa_rtclock_now() - start;
+        pa_log_info("Probed profiles of card %s in %0.1f ms.", u->device_id, (double) probe_usec / PA_USEC_PER_MSEC);
+
+        /* A card that doesn't work at all is better probed again, and so
+         * is one that was busy */
+        if (!complete)
+            pa_log_info("Some PCMs of card %s were busy, not caching the probe result.", u->device_id);
+        else if (key && !pa_hashmap_isempty(u->profile_set->profiles))
+            probe_cache_write(db, key, stamp, u->profile_set, probe_usec);
+    }
+
+    if (db)
+        pa_database_close(db);
+
+    pa_xfree(key);
+    pa_xfree(stamp);
+    pa_xfree(supported);
+}
+
 int pa__init(pa_module *m) {
     pa_card_new_data data;
     pa_modargs *ma;
     pa_bool_t ignore_dB = FALSE;
+    pa_bool_t probe_cache = TRUE;
     struct userdata *u;
     pa_reserve_wrapper *reserve = NULL;
     const char *description;
@@ -670,6 +855,11 @@ int pa__init(pa_module *m) {
         goto fail;
     }
 
+    if (pa_modargs_get_value_boolean(ma, "probe_cache", &probe_cache) < 0) {
+        pa_log("Failed to parse probe_cache argument.");
+        goto fail;
+    }
+
     m->userdata = u = pa_xnew0(struct userdata, 1);
     u->core = m->core;
     u->module = m;
@@ -743,15 +933,17 @@ int pa__init(pa_module *m) {
         }
 
         u->profile_set = pa_alsa_profile_set_new(fn, &u->core->default_channel_map);
+    }
+
+    if (!u->profile_set) {
         pa_xfree(fn);
+        goto fail;
     }
 
     u->profile_set->ignore_dB = ignore_dB;
 
-    if (!u->profile_set)
-        goto fail;
-
-    pa_alsa_profile_set_probe(u->profile_set, u->device_id, &m->core->default_sample_spec, m->core->default_n_fragments, m->core->default_fragment_size_msec);
+    probe_profile_set(u, fn, probe_cache);
+    pa_xfree(fn);
     pa_alsa_profile_set_dump(u->profile_set);
 
     pa_card_new_data_init(&data);
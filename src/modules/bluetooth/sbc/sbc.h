@@ -64,6 +64,14 @@ extern "C" {
 #define SBC_LE			0x00
 #define SBC_BE			0x01
 
+/* sbc_init() flags: keep the encoder away from CPU specific optimizations,
+ * e.g. to compare them against the generic C code */
+#define SBC_FLAG_NO_MMX		0x01
+#define SBC_FLAG_NO_SSE2	0x02
+#define SBC_FLAG_NO_AVX2	0x04
+#define SBC_FLAG_NO_ARM		0x08
+#define SBC_FLAG_NO_SIMD	0x0f
+
 struct sbc_struct {
 	unsigned long flags;
 
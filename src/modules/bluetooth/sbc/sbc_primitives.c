@@ -33,6 +33,8 @@
 
 #include "sbc_primitives.h"
 #include "sbc_primitives_mmx.h"
+#include "sbc_primitives_sse2.h"
+#include "sbc_primitives_avx2.h"
 #include "sbc_primitives_iwmmxt.h"
 #include "sbc_primitives_neon.h"
 #include "sbc_primitives_armv6.h"
@@ -519,7 +521,7 @@ static int sbc_calc_scalefactors_j(
 /*
  * Detect CPU features and setup function pointers
  */
-void sbc_init_primitives(struct sbc_encoder_state *state)
+void sbc_init_primitives(struct sbc_encoder_state *state, unsigned long flags)
 {
 	/* Default implementation for analyze functions */
 	state->sbc_analyze_4b_4s = sbc_analyze_4b_4s_simd;
@@ -536,12 +538,23 @@ void sbc_init_primitives(struct sbc_encoder_state *state)
 	state->sbc_calc_scalefactors_j = sbc_calc_scalefactors_j;
 	state->implementation_info = "Generic C";
 
-	/* X86/AMD64 optimizations */
+	/* X86/AMD64 optimizations, each one overrides the previous ones */
 #ifdef SBC_BUILD_WITH_MMX_SUPPORT
-	sbc_init_primitives_mmx(state);
+	if (!(flags & SBC_FLAG_NO_MMX))
+		sbc_init_primitives_mmx(state);
+#endif
+#ifdef SBC_BUILD_WITH_SSE2_SUPPORT
+	if (!(flags & SBC_FLAG_NO_SSE2))
+		sbc_init_primitives_sse2(state);
+#endif
+#ifdef SBC_BUILD_WITH_AVX2_SUPPORT
+	if (!(flags & SBC_FLAG_NO_AVX2))
+		sbc_init_primitives_avx2(state);
 #endif
 
 	/* ARM optimizations */
+	if (flags & SBC_FLAG_NO_ARM)
+		return;
 #ifdef SBC_BUILD_WITH_ARMV6_SUPPORT
 	sbc_init_primitives_armv6(state);
 #endif
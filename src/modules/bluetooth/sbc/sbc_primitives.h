@@ -73,8 +73,9 @@ struct sbc_encoder_state {
 /*
  * Initialize pointers to the functions which are the basic "building bricks"
  * of SBC codec. Best implementation is selected based on target CPU
- * capabilities.
+ * capabilities, minus the ones disabled by SBC_FLAG_NO_* flags.
  */
-void sbc_init_primitives(struct sbc_encoder_state *encoder_state);
+void sbc_init_primitives(struct sbc_encoder_state *encoder_state,
+						unsigned long flags);
 
 #endif
@@ -0,0 +1,155 @@
+/*
+ *
+ *  Bluetooth low-complexity, subband codec (SBC) library
+ *
+ *
+ *  This library is free software; you can redistribute it and/or
+ *  modify it under the terms of the GNU Lesser General Public
+ *  License as published by the Free Software Foundation; either
+ *  version 2.1 of the License, or (at your option) any later version.
+ *
+ *  This library is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ *  Lesser General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Lesser General Public
+ *  License along with this library; if not, write to the Free Software
+ *  Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+ *
+ */
+
+#include <stdint.h>
+#include <limits.h>
+#include "sbc.h"
+#include "sbc_math.h"
+#include "sbc_tables.h"
+
+#include "sbc_primitives_avx2.h"
+
+/*
+ * AVX2 optimizations
+ *
+ * Only the analysis filters are done here, scale factors are left to
+ * the SSE2 code: with at most eight subbands per block there is little
+ * to gain from wider registers there.
+ */
+
+#ifdef SBC_BUILD_WITH_AVX2_SUPPORT
+
+#include <immintrin.h>
+
+#define SBC_AVX2 __attribute__((target("avx2")))
+
+static SBC_AVX2 inline __m256i sbc_load2_avx2(const void *lo, const void *hi)
+{
+	return _mm256_inserti128_si256(_mm256_castsi128_si256(
+			_mm_loadu_si128((const __m128i *) lo)),
+			_mm_loadu_si128((const __m128i *) hi), 1);
+}
+
+/*
+ * A block of the 4 subbands filter only fills half of a register, so two
+ * neighbouring blocks (one odd, one even) are analyzed side by side, one
+ * in each 128-bit lane. All shuffles used operate within lanes.
+ */
+static SBC_AVX2 inline void sbc_analyze_four_x2_avx2(
+			const int16_t *in_odd, const int16_t *in_even,
+			int32_t *out_odd, int32_t *out_even)
+{
+	const FIXED_T *odd = analysis_consts_fixed4_simd_odd;
+	const FIXED_T *even = analysis_consts_fixed4_simd_even;
+	__m256i t1, t2;
+	int hop;
+
+	/* low pass polyphase filter */
+	t1 = _mm256_set1_epi32(1 << (SBC_PROTO_FIXED4_SCALE - 1));
+	for (hop = 0; hop < 40; hop += 8)
+		t1 = _mm256_add_epi32(t1, _mm256_madd_epi16(
+			sbc_load2_avx2(in_odd + hop, in_even + hop),
+			sbc_load2_avx2(odd + hop, even + hop)));
+
+	/* scaling */
+	t2 = _mm256_packs_epi32(_mm256_srai_epi32(t1, SBC_PROTO_FIXED4_SCALE),
+				_mm256_setzero_si256());
+
+	/* do the cos transform */
+	t1 = _mm256_add_epi32(
+		_mm256_madd_epi16(_mm256_shuffle_epi32(t2, 0x00),
+			sbc_load2_avx2(odd + 40, even + 40)),
+		_mm256_madd_epi16(_mm256_shuffle_epi32(t2, 0x55),
+			sbc_load2_avx2(odd + 48, even + 48)));
+
+	_mm_storeu_si128((__m128i *) out_odd, _mm256_castsi256_si128(t1));
+	_mm_storeu_si128((__m128i *) out_even,
+				_mm256_extracti128_si256(t1, 1));
+}
+
+/* One block of the 8 subbands filter fills a whole register */
+static SBC_AVX2 inline void sbc_analyze_eight_avx2(const int16_t *in,
+					int32_t *out, const FIXED_T *consts)
+{
+	__m256i t1;
+	__m128i t2;
+	int hop, i;
+
+	/* low pass polyphase filter */
+	t1 = _mm256_set1_epi32(1 << (SBC_PROTO_FIXED8_SCALE - 1));
+	for (hop = 0; hop < 80; hop += 16)
+		t1 = _mm256_add_epi32(t1, _mm256_madd_epi16(
+			_mm256_loadu_si256((const __m256i *) (in + hop)),
+			_mm256_loadu_si256((const __m256i *) (consts + hop))));
+
+	/* scaling */
+	t1 = _mm256_srai_epi32(t1, SBC_PROTO_FIXED8_SCALE);
+	t2 = _mm_packs_epi32(_mm256_castsi256_si128(t1),
+				_mm256_extracti128_si256(t1, 1));
+
+	/* do the cos transform, one pair of inputs at a time */
+	t1 = _mm256_setzero_si256();
+	for (i = 0; i < 4; i++) {
+		t1 = _mm256_add_epi32(t1, _mm256_madd_epi16(
+			_mm256_broadcastd_epi32(t2),
+			_mm256_loadu_si256((const __m256i *)
+					(consts + 80 + i * 16))));
+		t2 = _mm_srli_si128(t2, 4);
+	}
+
+	_mm256_storeu_si256((__m256i *) out, t1);
+}
+
+static SBC_AVX2 void sbc_analyze_4b_4s_avx2(int16_t *x, int32_t *out,
+						int out_stride)
+{
+	/* Analyze blocks */
+	sbc_analyze_four_x2_avx2(x + 12, x + 8, out, out + out_stride);
+	out += 2 * out_stride;
+	sbc_analyze_four_x2_avx2(x + 4, x + 0, out, out + out_stride);
+}
+
+static SBC_AVX2 void sbc_analyze_4b_8s_avx2(int16_t *x, int32_t *out,
+						int out_stride)
+{
+	/* Analyze blocks */
+	sbc_analyze_eight_avx2(x + 24, out, analysis_consts_fixed8_simd_odd);
+	out += out_stride;
+	sbc_analyze_eight_avx2(x + 16, out, analysis_consts_fixed8_simd_even);
+	out += out_stride;
+	sbc_analyze_eight_avx2(x + 8, out, analysis_consts_fixed8_simd_odd);
+	out += out_stride;
+	sbc_analyze_eight_avx2(x + 0, out, analysis_consts_fixed8_simd_even);
+}
+
+void sbc_init_primitives_avx2(struct sbc_encoder_state *state)
+{
+	/* This also checks that the OS saves the AVX register state */
+	__builtin_cpu_init();
+
+	if (__builtin_cpu_supports("avx2")) {
+		state->sbc_analyze_4b_4s = sbc_analyze_4b_4s_avx2;
+		state->sbc_analyze_4b_8s = sbc_analyze_4b_8s_avx2;
+		state->implementation_info = "AVX2";
+	}
+}
+
+#endif
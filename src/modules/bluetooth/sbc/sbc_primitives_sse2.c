@@ -0,0 +1,268 @@
+/*
+ *
+ *  Bluetooth low-complexity, subband codec (SBC) library
+ *
+ *
+ *  This library is free software; you can redistribute it and/or
+ *  modify it under the terms of the GNU Lesser General Public
+ *  License as published by the Free Software Foundation; either
+ *  version 2.1 of the License, or (at your option) any later version.
+ *
+ *  This library is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ *  Lesser General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Lesser General Public
+ *  License along with this library; if not, write to the Free Software
+ *  Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+ *
+ */
+
+#include <stdint.h>
+#include <limits.h>
+#include "sbc.h"
+#include "sbc_math.h"
+#include "sbc_tables.h"
+
+#include "sbc_primitives_sse2.h"
+
+/*
+ * SSE2 optimizations
+ */
+
+#ifdef SBC_BUILD_WITH_SSE2_SUPPORT
+
+#include <emmintrin.h>
+
+#define SBC_SSE2 __attribute__((target("sse2")))
+
+/*
+ * The same pairwise multiply-accumulate scheme as the MMX code, but with
+ * twice the register width: one pmaddwd covers four output subbands.
+ */
+static SBC_SSE2 inline void sbc_analyze_four_sse2(const int16_t *in,
+					int32_t *out, const FIXED_T *consts)
+{
+	__m128i t1, t2, p0, p1;
+	int hop;
+
+	/* low pass polyphase filter */
+	t1 = _mm_set1_epi32(1 << (SBC_PROTO_FIXED4_SCALE - 1));
+	for (hop = 0; hop < 40; hop += 8)
+		t1 = _mm_add_epi32(t1, _mm_madd_epi16(
+			_mm_loadu_si128((const __m128i *) (in + hop)),
+			_mm_loadu_si128((const __m128i *) (consts + hop))));
+
+	/* scaling */
+	t2 = _mm_packs_epi32(_mm_srai_epi32(t1, SBC_PROTO_FIXED4_SCALE),
+				_mm_setzero_si128());
+
+	/* do the cos transform, one pair of inputs at a time */
+	p0 = _mm_shuffle_epi32(t2, 0x00);
+	p1 = _mm_shuffle_epi32(t2, 0x55);
+	t1 = _mm_add_epi32(
+		_mm_madd_epi16(p0,
+			_mm_loadu_si128((const __m128i *) (consts + 40))),
+		_mm_madd_epi16(p1,
+			_mm_loadu_si128((const __m128i *) (consts + 48))));
+
+	_mm_storeu_si128((__m128i *) out, t1);
+}
+
+static SBC_SSE2 inline void sbc_analyze_eight_sse2(const int16_t *in,
+					int32_t *out, const FIXED_T *consts)
+{
+	__m128i t1[2], t2, p;
+	int hop, i;
+
+	/* low pass polyphase filter */
+	t1[0] = t1[1] = _mm_set1_epi32(1 << (SBC_PROTO_FIXED8_SCALE - 1));
+	for (hop = 0; hop < 80; hop += 16) {
+		t1[0] = _mm_add_epi32(t1[0], _mm_madd_epi16(
+			_mm_loadu_si128((const __m128i *) (in + hop)),
+			_mm_loadu_si128((const __m128i *) (consts + hop))));
+		t1[1] = _mm_add_epi32(t1[1], _mm_madd_epi16(
+			_mm_loadu_si128((const __m128i *) (in + hop + 8)),
+			_mm_loadu_si128((const __m128i *) (consts + hop + 8))));
+	}
+
+	/* scaling */
+	t2 = _mm_packs_epi32(_mm_srai_epi32(t1[0], SBC_PROTO_FIXED8_SCALE),
+				_mm_srai_epi32(t1[1], SBC_PROTO_FIXED8_SCALE));
+
+	/* do the cos transform, one pair of inputs at a time */
+	t1[0] = t1[1] = _mm_setzero_si128();
+	for (i = 0; i < 4; i++) {
+		switch (i) {
+		case 0: p = _mm_shuffle_epi32(t2, 0x00); break;
+		case 1: p = _mm_shuffle_epi32(t2, 0x55); break;
+		case 2: p = _mm_shuffle_epi32(t2, 0xaa); break;
+		default: p = _mm_shuffle_epi32(t2, 0xff); break;
+		}
+
+		t1[0] = _mm_add_epi32(t1[0], _mm_madd_epi16(p,
+			_mm_loadu_si128((const __m128i *)
+					(consts + 80 + i * 16))));
+		t1[1] = _mm_add_epi32(t1[1], _mm_madd_epi16(p,
+			_mm_loadu_si128((const __m128i *)
+					(consts + 80 + i * 16 + 8))));
+	}
+
+	_mm_storeu_si128((__m128i *) out, t1[0]);
+	_mm_storeu_si128((__m128i *) (out + 4), t1[1]);
+}
+
+static SBC_SSE2 void sbc_analyze_4b_4s_sse2(int16_t *x, int32_t *out,
+						int out_stride)
+{
+	/* Analyze blocks */
+	sbc_analyze_four_sse2(x + 12, out, analysis_consts_fixed4_simd_odd);
+	out += out_stride;
+	sbc_analyze_four_sse2(x + 8, out, analysis_consts_fixed4_simd_even);
+	out += out_stride;
+	sbc_analyze_four_sse2(x + 4, out, analysis_consts_fixed4_simd_odd);
+	out += out_stride;
+	sbc_analyze_four_sse2(x + 0, out, analysis_consts_fixed4_simd_even);
+}
+
+static SBC_SSE2 void sbc_analyze_4b_8s_sse2(int16_t *x, int32_t *out,
+						int out_stride)
+{
+	/* Analyze blocks */
+	sbc_analyze_eight_sse2(x + 24, out, analysis_consts_fixed8_simd_odd);
+	out += out_stride;
+	sbc_analyze_eight_sse2(x + 16, out, analysis_consts_fixed8_simd_even);
+	out += out_stride;
+	sbc_analyze_eight_sse2(x + 8, out, analysis_consts_fixed8_simd_odd);
+	out += out_stride;
+	sbc_analyze_eight_sse2(x + 0, out, analysis_consts_fixed8_simd_even);
+}
+
+/*
+ * Returns fabs(x) - 1 for nonzero x and 0 for zero x in every lane,
+ * without branches (same trick as in the MMX code)
+ */
+static SBC_SSE2 inline __m128i sbc_abs_minus_one_sse2(__m128i x)
+{
+	const __m128i zero = _mm_setzero_si128();
+
+	x = _mm_add_epi32(x, _mm_cmpgt_epi32(x, zero));
+	return _mm_xor_si128(x, _mm_cmpgt_epi32(zero, x));
+}
+
+static SBC_SSE2 inline void sbc_store_scalefactors_sse2(__m128i x,
+						uint32_t *scale_factor)
+{
+	uint32_t SBC_ALIGNED t[4];
+	int i;
+
+	_mm_store_si128((__m128i *) t, x);
+	for (i = 0; i < 4; i++)
+		scale_factor[i] = (31 - SCALE_OUT_BITS) - __builtin_clz(t[i]);
+}
+
+static SBC_SSE2 void sbc_calc_scalefactors_sse2(
+	int32_t sb_sample_f[16][2][8],
+	uint32_t scale_factor[2][8],
+	int blocks, int channels, int subbands)
+{
+	int ch, sb, blk;
+
+	for (ch = 0; ch < channels; ch++) {
+		for (sb = 0; sb < subbands; sb += 4) {
+			__m128i x = _mm_set1_epi32(1 << SCALE_OUT_BITS);
+
+			for (blk = 0; blk < blocks; blk++)
+				x = _mm_or_si128(x, sbc_abs_minus_one_sse2(
+					_mm_loadu_si128((const __m128i *)
+						&sb_sample_f[blk][ch][sb])));
+
+			sbc_store_scalefactors_sse2(x, &scale_factor[ch][sb]);
+		}
+	}
+}
+
+/*
+ * Scale factors for left/right and mid/side are calculated for four
+ * subbands at once, the joint stereo decision is then made per subband.
+ */
+static SBC_SSE2 int sbc_calc_scalefactors_j_sse2(
+	int32_t sb_sample_f[16][2][8],
+	uint32_t scale_factor[2][8],
+	int blocks, int subbands)
+{
+	int32_t SBC_ALIGNED sb_sample_j[16][2][8];
+	uint32_t scale_factor_j[2][8];
+	int blk, sb, joint = 0;
+
+	for (sb = 0; sb < subbands; sb += 4) {
+		__m128i x = _mm_set1_epi32(1 << SCALE_OUT_BITS);
+		__m128i y = x, xj = x, yj = x;
+
+		for (blk = 0; blk < blocks; blk++) {
+			__m128i l = _mm_loadu_si128((const __m128i *)
+						&sb_sample_f[blk][0][sb]);
+			__m128i r = _mm_loadu_si128((const __m128i *)
+						&sb_sample_f[blk][1][sb]);
+			__m128i m = _mm_add_epi32(_mm_srai_epi32(l, 1),
+						_mm_srai_epi32(r, 1));
+			__m128i s = _mm_sub_epi32(_mm_srai_epi32(l, 1),
+						_mm_srai_epi32(r, 1));
+
+			_mm_store_si128((__m128i *) &sb_sample_j[blk][0][sb], m);
+			_mm_store_si128((__m128i *) &sb_sample_j[blk][1][sb], s);
+
+			x = _mm_or_si128(x, sbc_abs_minus_one_sse2(l));
+			y = _mm_or_si128(y, sbc_abs_minus_one_sse2(r));
+			xj = _mm_or_si128(xj, sbc_abs_minus_one_sse2(m));
+			yj = _mm_or_si128(yj, sbc_abs_minus_one_sse2(s));
+		}
+
+		sbc_store_scalefactors_sse2(x, &scale_factor[0][sb]);
+		sbc_store_scalefactors_sse2(y, &scale_factor[1][sb]);
+		sbc_store_scalefactors_sse2(xj, &scale_factor_j[0][sb]);
+		sbc_store_scalefactors_sse2(yj, &scale_factor_j[1][sb]);
+	}
+
+	/* last subband does not use joint stereo */
+	for (sb = 0; sb < subbands - 1; sb++) {
+		/* decide whether to use joint stereo for this subband */
+		if ((scale_factor[0][sb] + scale_factor[1][sb]) >
+				scale_factor_j[0][sb] + scale_factor_j[1][sb]) {
+			joint |= 1 << (subbands - 1 - sb);
+			scale_factor[0][sb] = scale_factor_j[0][sb];
+			scale_factor[1][sb] = scale_factor_j[1][sb];
+			for (blk = 0; blk < blocks; blk++) {
+				sb_sample_f[blk][0][sb] = sb_sample_j[blk][0][sb];
+				sb_sample_f[blk][1][sb] = sb_sample_j[blk][1][sb];
+			}
+		}
+	}
+
+	/* bitmask with the information about subbands using joint stereo */
+	return joint;
+}
+
+static int check_sse2_support(void)
+{
+#ifdef __amd64__
+	return 1; /* SSE2 is part of the x86-64 base instruction set */
+#else
+	__builtin_cpu_init();
+	return __builtin_cpu_supports("sse2");
+#endif
+}
+
+void sbc_init_primitives_sse2(struct sbc_encoder_state *state)
+{
+	if (check_sse2_support()) {
+		state->sbc_analyze_4b_4s = sbc_analyze_4b_4s_sse2;
+		state->sbc_analyze_4b_8s = sbc_analyze_4b_8s_sse2;
+		state->sbc_calc_scalefactors = sbc_calc_scalefactors_sse2;
+		state->sbc_calc_scalefactors_j = sbc_calc_scalefactors_j_sse2;
+		state->implementation_info = "SSE2";
+	}
+}
+
+#endif
@@ -2038,9 +2038,112 @@ void pa__done(pa_module*m) {
 #ifdef ECHO_CANCEL_TEST
 /*
  * Stand-alone test program for running in the canceller on pre-recorded files.
+ *
+ * Besides writing out the cancelled stream, this reports the time spent in
+ * the canceller per second of audio, the worst per-block processing time and
+ * the echo return loss enhancement (ERLE) between captured and cancelled
+ * data, so that AEC configurations can be benchmarked without any hardware.
  */
+
+struct ec_test_stats {
+    pa_usec_t processing_time;
+    pa_usec_t max_block_time;
+    pa_usec_t play_time;
+    unsigned n_blocks;
+    size_t n_bytes;
+
+    double captured_energy;
+    double canceled_energy;
+};
+
+/* Returns the summed energy of a block, normalised to full scale, or a
+ * negative value if the sample format is not supported. */
+static double block_energy(const pa_sample_spec *ss, const uint8_t *data, size_t length) {
+    double e = 0;
+    size_t n;
+
+    switch (ss->format) {
+        case PA_SAMPLE_S16NE: {
+            const int16_t *s = (const int16_t *) data;
+
+            for (n = length / sizeof(int16_t); n > 0; n--, s++)
+                e += ((double) *s / 0x8000) * ((double) *s / 0x8000);
+
+            return e;
+        }
+
+        case PA_SAMPLE_FLOAT32NE: {
+            const float *s = (const float *) data;
+
+            for (n = length / sizeof(float); n > 0; n--, s++)
+                e += (double) *s * (double) *s;
+
+            return e;
+        }
+
+        default:
+            return -1;
+    }
+}
+
+/* Feeds played data to the canceller. Some cancellers (e.g. webrtc) do
+ * their far-end analysis here, so the time is charged to the next
+ * captured block. */
+static void ec_test_play(struct ec_test_stats *stats, pa_echo_canceller *ec, const uint8_t *play) {
+    pa_usec_t start = pa_rtclock_now();
+
+    ec->play(ec, play);
+    stats->play_time += pa_rtclock_now() - start;
+}
+
+static void ec_test_account(struct ec_test_stats *stats, const pa_sample_spec *ss, pa_usec_t start,
+                            const uint8_t *rec, const uint8_t *out, size_t length) {
+    pa_usec_t t = pa_rtclock_now() - start + stats->play_time;
+
+    stats->play_time = 0;
+
+    stats->processing_time += t;
+    stats->max_block_time = PA_MAX(stats->max_block_time, t);
+    stats->n_blocks++;
+    stats->n_bytes += length;
+
+    if (stats->captured_energy >= 0 && stats->canceled_energy >= 0) {
+        stats->captured_energy += block_energy(ss, rec, length);
+        stats->canceled_energy += block_energy(ss, out, length);
+    }
+}
+
+static void ec_test_report(struct ec_test_stats *stats, const pa_sample_spec *ss, uint32_t blocksize) {
+    pa_usec_t audio_time;
+
+    if (stats->n_blocks <= 0) {
+        pa_log("No audio was processed");
+        return;
+    }
+
+    audio_time = pa_bytes_to_usec(stats->n_bytes, ss);
+
+    pa_log_info("Processed %0.2f s of audio in %u blocks",
+                (double) audio_time / PA_USEC_PER_SEC, stats->n_blocks);
+    pa_log_info("Block size: %0.2f ms (latency added by buffering, not measured)",
+                (double) pa_bytes_to_usec(blocksize, ss) / PA_USEC_PER_MSEC);
+    pa_log_info("CPU time per second of audio (play and record): %0.2f ms",
+                audio_time > 0 ? (double) stats->processing_time * PA_USEC_PER_SEC / audio_time / PA_USEC_PER_MSEC : 0.0);
+    pa_log_info("Block processing time: avg %0.3f ms, max %0.3f ms",
+                (double) stats->processing_time / stats->n_blocks / PA_USEC_PER_MSEC,
+                (double) stats->max_block_time / PA_USEC_PER_MSEC);
+
+    if (stats->captured_energy < 0 || stats->canceled_energy < 0)
+        pa_log_info("ERLE: not available for sample format %s", pa_sample_format_to_string(ss->format));
+    else if (stats->canceled_energy <= 0)
+        pa_log_info("ERLE: inf dB");
+    else
+        pa_log_info("ERLE: %0.2f dB", 10.0 * log10(stats->captured_energy / stats->canceled_energy));
+}
+
 int main(int argc, char* argv[]) {
     struct userdata u;
+    struct ec_test_stats stats;
     pa_sample_spec source_ss, sink_ss;
     pa_channel_map source_map, sink_map;
     pa_modargs *ma = NULL;
@@ -2049,8 +2152,11 @@ int main(int argc, char* argv[]) {
     int ret = 0, i;
     char c;
     float drift;
+    double drift_ppm = 0;
+    pa_usec_t start;
 
     pa_memzero(&u, sizeof(u));
+    pa_memzero(&stats, sizeof(stats));
 
     if (argc < 4 || argc > 7) {
         goto usage;
@@ -2089,30 +2195,41 @@ int main(int argc, char* argv[]) {
     if (init_common(ma, &u, &source_ss, &source_map) < 0)
         goto fail;
 
+    sink_ss = source_ss;
+    sink_map = source_map;
+
     if (!u.ec->init(u.core, u.ec, &source_ss, &source_map, &sink_ss, &sink_map, &u.blocksize,
-                     (argc > 4) ? argv[5] : NULL )) {
+                     (argc > 5) ? argv[5] : NULL )) {
         pa_log("Failed to init AEC engine");
         goto fail;
     }
 
     if (u.ec->params.drift_compensation) {
         if (argc < 7) {
-            pa_log("Drift compensation enabled but drift file not specified");
+            pa_log("Drift compensation enabled but neither drift file nor drift in ppm specified");
             goto fail;
         }
 
-        u.drift_file = fopen(argv[6], "rt");
+        /* A plain number is a synthetic drift in ppm, anything else is the
+         * name of a drift file as written by save_aec */
+        if (pa_atod(argv[6], &drift_ppm) < 0) {
+            u.drift_file = fopen(argv[6], "rt");
 
-        if (u.drift_file == NULL) {
-            perror ("fopen failed");
-            goto fail;
+            if (u.drift_file == NULL) {
+                perror ("fopen failed");
+                goto fail;
+            }
         }
-    }
+    } else if (argc > 6)
+        pa_log_warn("Canceller does not do drift compensation, ignoring drift argument");
 
     rdata = pa_xmalloc(u.blocksize);
     pdata = pa_xmalloc(u.blocksize);
     cdata = pa_xmalloc(u.blocksize);
 
+    if (block_energy(&source_ss, rdata, 0) < 0)
+        stats.captured_energy = stats.canceled_energy = -1;
+
     if (!u.ec->params.drift_compensation) {
         while (fread(rdata, u.blocksize, 1, u.captured_file) > 0) {
             if (fread(pdata, u.blocksize, 1, u.played_file) == 0) {
@@ -2120,7 +2237,39 @@ int main(int argc, char* argv[]) {
                 goto fail;
             }
 
+            start = pa_rtclock_now();
             u.ec->run(u.ec, rdata, pdata, cdata);
+            ec_test_account(&stats, &source_ss, start, rdata, cdata, u.blocksize);
+
+            unused = fwrite(cdata, u.blocksize, 1, u.canceled_file);
+        }
+    } else if (!u.drift_file) {
+        int64_t played = 0, recorded = 0;
+        double play_acc = 0;
+
+        /* Play back blocks at a rate that is drift_ppm off from the capture
+         * rate and tell the canceller about the drift we accumulated */
+        while (fread(rdata, u.blocksize, 1, u.captured_file) > 0) {
+            play_acc += 1.0 + drift_ppm / 1000000.0;
+
+            while (play_acc >= 1.0) {
+                if (fread(pdata, u.blocksize, 1, u.played_file) == 0) {
+                    perror("Played file ended before captured file");
+                    goto fail;
+                }
+
+                ec_test_play(&stats, u.ec, pdata);
+
+                played += u.blocksize;
+                play_acc -= 1.0;
+            }
+
+            recorded += u.blocksize;
+            u.ec->set_drift(u.ec, (float) (played - recorded) / recorded);
+
+            start = pa_rtclock_now();
+            u.ec->record(u.ec, rdata, cdata);
+            ec_test_account(&stats, &source_ss, start, rdata, cdata, u.blocksize);
 
             unused = fwrite(cdata, u.blocksize, 1, u.canceled_file);
         }
@@ -2148,7 +2297,9 @@ int main(int argc, char* argv[]) {
                         goto fail;
                     }
 
+                    start = pa_rtclock_now();
                     u.ec->record(u.ec, rdata, cdata);
+                    ec_test_account(&stats, &source_ss, start, rdata, cdata, i);
 
                     unused = fwrite(cdata, i, 1, u.canceled_file);
 
@@ -2165,7 +2316,7 @@ int main(int argc, char* argv[]) {
                         goto fail;
                     }
 
-                    u.ec->play(u.ec, pdata);
+                    ec_test_play(&stats, u.ec, pdata);
 
                     break;
             }
@@ -2179,6 +2330,8 @@ int main(int argc, char* argv[]) {
 
     u.ec->done(u.ec);
 
+    ec_test_report(&stats, &source_ss, u.blocksize);
+
 out:
     if (u.captured_file)
         fclose(u.captured_file);
@@ -2202,7 +2355,7 @@ out:
     return ret;
 
 usage:
-    pa_log("Usage: %s play_file rec_file out_file [module args] [aec_args] [drift_file]", argv[0]);
+    pa_log("Usage: %s play_file rec_file out_file [module args] [aec_args] [drift_file|drift_ppm]", argv[0]);
 
 fail:
     ret = -1;
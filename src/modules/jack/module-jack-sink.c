@@ -31,6 +31,8 @@
 
 #include <jack/jack.h>
 
+#include <pulse/rtclock.h>
+#include <pulse/timeval.h>
 #include <pulse/xmalloc.h>
 
 #include <pulsecore/sink.h>
@@ -42,6 +44,9 @@
 #include <pulsecore/thread-mq.h>
 #include <pulsecore/rtpoll.h>
 #include <pulsecore/sample-util.h>
+#include <pulsecore/atomic.h>
+#include <pulsecore/fdsem.h>
+#include <pulsecore/ringbuffer.h>
 
 #include "module-jack-sink-symdef.h"
 
@@ -51,11 +56,13 @@
  * doesn't allow us to add our own event sources to the event thread
  * we cannot use the JACK real-time thread for dispatching our PA
  * work. Instead, we run an additional RT thread which does most of
- * the PA handling, and have the JACK RT thread request data from it
- * via pa_asyncmsgq. The cost is an additional context switch which
- * should hopefully not be that expensive if RT scheduling is
- * enabled. A better fix would only be possible with additional event
- * source support in JACK.
+ * the PA handling. That thread renders ahead into a lock-free ring
+ * buffer, and the JACK RT thread only deinterleaves from it into the
+ * port buffers and then kicks our thread via a pa_fdsem to refill
+ * what it took. The JACK thread hence never blocks on us, if we
+ * cannot keep up it plays silence and we render a bit further ahead
+ * from then on. A better fix would only be possible with additional
+ * event source support in JACK.
  */
 
 PA_MODULE_AUTHOR("Lennart Poettering");
@@ -73,6 +80,18 @@ PA_MODULE_USAGE(
 
 #define DEFAULT_SINK_NAME "jack_out"
 
+/* The ring is allocated once, large enough for JACK's largest period,
+ * so that it never needs to be resized under the feet of the JACK
+ * thread */
+#define RING_FRAMES (2*8192)
+
+/* We try to stay one JACK period ahead. After an underrun we add a
+ * quarter period, up to MAX_FILL_PERIODS, and if things are quiet
+ * for FILL_DECREASE_USEC we take a quarter period away again. */
+#define FILL_STEPS 4
+#define MAX_FILL_PERIODS 2
+#define FILL_DECREASE_USEC (10*PA_USEC_PER_SEC)
+
 struct userdata {
     pa_core *core;
     pa_module *module;
@@ -83,18 +102,27 @@ struct userdata {
     jack_port_t* port[PA_CHANNELS_MAX];
     jack_client_t *client;
 
-    void *buffer[PA_CHANNELS_MAX];
-
     pa_thread_mq thread_mq;
     pa_asyncmsgq *jack_msgq;
     pa_rtpoll *rtpoll;
     pa_rtpoll_item *rtpoll_item;
 
+    pa_ringbuffer *ring;
+    pa_fdsem *fdsem;
+    pa_rtpoll_item *fdsem_item;
+
     pa_thread *thread;
 
-    jack_nframes_t frames_in_buffer;
-    jack_nframes_t saved_frame_time;
-    pa_bool_t saved_frame_time_valid;
+    /* Written by the JACK thread, read by our thread */
+    pa_atomic_t frames_in_buffer;
+    pa_atomic_t saved_frame_time;
+    pa_atomic_t underruns;
+
+    /* Only accessed from our thread */
+    size_t period;
+    size_t fill_target;
+    int underruns_seen;
+    pa_usec_t last_adjust;
 };
 
 static const char* const valid_modargs[] = {
@@ -109,57 +137,87 @@ static const char* const valid_modargs[] = {
 };
 
 enum {
-    SINK_MESSAGE_RENDER = PA_SINK_MESSAGE_MAX,
-    SINK_MESSAGE_BUFFER_SIZE,
+    SINK_MESSAGE_BUFFER_SIZE = PA_SINK_MESSAGE_MAX,
     SINK_MESSAGE_ON_SHUTDOWN
 };
 
-static int sink_process_msg(pa_msgobject *o, int code, void *data, int64_t offset, pa_memchunk *memchunk) {
-    struct userdata *u = PA_SINK(o)->userdata;
+/* Called from IO context */
+static void set_period(struct userdata *u, jack_nframes_t nframes) {
+    u->period = PA_MIN(nframes * pa_frame_size(&u->sink->sample_spec), pa_ringbuffer_capacity(u->ring) / MAX_FILL_PERIODS);
+    u->fill_target = u->period;
+    u->last_adjust = pa_rtclock_now();
 
-    switch (code) {
+    pa_sink_set_max_request_within_thread(u->sink, u->period);
+}
 
-        case SINK_MESSAGE_RENDER:
+/* Called from IO context */
+static void adjust_fill_target(struct userdata *u) {
+    size_t step, max_target;
+    pa_usec_t now;
+    int underruns;
 
-            /* Handle the request from the JACK thread */
+    now = pa_rtclock_now();
+    step = pa_frame_align(u->period / FILL_STEPS, &u->sink->sample_spec);
+    max_target = u->period * MAX_FILL_PERIODS;
 
-            if (u->sink->thread_info.state == PA_SINK_RUNNING) {
-                pa_memchunk chunk;
-                size_t nbytes;
-                void *p;
+    if ((underruns = pa_atomic_load(&u->underruns)) != u->underruns_seen) {
+        u->underruns_seen = underruns;
+        u->last_adjust = now;
 
-                pa_assert(offset > 0);
-                nbytes = (size_t) offset * pa_frame_size(&u->sink->sample_spec);
+        if (u->fill_target < max_target) {
+            u->fill_target = PA_MIN(u->fill_target + step, max_target);
+            pa_log_info("JACK thread ran out of data, rendering %0.2f ms ahead from now on.",
+                        (double) pa_bytes_to_usec(u->fill_target, &u->sink->sample_spec) / PA_USEC_PER_MSEC);
+        }
 
-                pa_sink_render_full(u->sink, nbytes, &chunk);
+    } else if (u->fill_target > u->period && now - u->last_adjust > FILL_DECREASE_USEC) {
+        u->last_adjust = now;
+        u->fill_target = PA_MAX(u->fill_target - step, u->period);
+        pa_log_debug("Decreasing render-ahead to %0.2f ms.",
+                     (double) pa_bytes_to_usec(u->fill_target, &u->sink->sample_spec) / PA_USEC_PER_MSEC);
+    }
+}
 
-                p = (uint8_t*) pa_memblock_acquire(chunk.memblock) + chunk.index;
-                pa_deinterleave(p, u->buffer, u->channels, sizeof(float), (unsigned) offset);
-                pa_memblock_release(chunk.memblock);
+/* Called from IO context */
+static void fill_ring(struct userdata *u) {
+    size_t fill;
 
-                pa_memblock_unref(chunk.memblock);
-            } else {
-                unsigned c;
-                pa_sample_spec ss;
+    adjust_fill_target(u);
 
-                /* Humm, we're not RUNNING, hence let's write some silence */
-                /* This can happen if we're paused, or during shutdown (when we're unlinked but jack is still running). */
+    while ((fill = pa_ringbuffer_fill(u->ring)) < u->fill_target) {
+        size_t n;
+        void *p;
 
-                ss = u->sink->sample_spec;
-                ss.channels = 1;
+        p = pa_ringbuffer_begin_write(u->ring, &n);
+        if ((n = PA_MIN(n, u->fill_target - fill)) <= 0)
+            break;
 
-                for (c = 0; c < u->channels; c++)
-                    pa_silence_memory(u->buffer[c], (size_t) offset * pa_sample_size(&ss), &ss);
-            }
+        if (u->sink->thread_info.state == PA_SINK_RUNNING) {
+            pa_memchunk chunk;
 
-            u->frames_in_buffer = (jack_nframes_t) offset;
-            u->saved_frame_time = * (jack_nframes_t*) data;
-            u->saved_frame_time_valid = TRUE;
+            /* Render straight into the ring */
+            chunk.memblock = pa_memblock_new_fixed(u->core->mempool, p, n, FALSE);
+            chunk.index = 0;
+            chunk.length = n;
 
-            return 0;
+            pa_sink_render_into_full(u->sink, &chunk);
+            pa_memblock_unref_fixed(chunk.memblock);
+        } else
+            /* Humm, we're not RUNNING, hence let's write some silence */
+            /* This can happen if we're paused, or during shutdown (when we're unlinked but jack is still running). */
+            pa_silence_memory(p, n, &u->sink->sample_spec);
+
+        pa_ringbuffer_end_write(u->ring, n);
+    }
+}
+
+static int sink_process_msg(pa_msgobject *o, int code, void *data, int64_t offset, pa_memchunk *memchunk) {
+    struct userdata *u = PA_SINK(o)->userdata;
+
+    switch (code) {
 
         case SINK_MESSAGE_BUFFER_SIZE:
-            pa_sink_set_max_request_within_thread(u->sink, (size_t) offset * pa_frame_size(&u->sink->sample_spec));
+            set_period(u, (jack_nframes_t) offset);
             return 0;
 
         case SINK_MESSAGE_ON_SHUTDOWN:
@@ -167,21 +225,23 @@ static int sink_process_msg(pa_msgobject *o, int code, void *data, int64_t offse
             return 0;
 
         case PA_SINK_MESSAGE_GET_LATENCY: {
-            jack_nframes_t l, ft, d;
+            jack_nframes_t l, ft, d, frames_in_buffer;
             jack_latency_range_t r;
             size_t n;
 
             /* This is the "worst-case" latency */
             jack_port_get_latency_range(u->port[0], JackPlaybackLatency, &r);
-            l = r.max + u->frames_in_buffer;
+            frames_in_buffer = (jack_nframes_t) pa_atomic_load(&u->frames_in_buffer);
+            l = r.max + frames_in_buffer + (jack_nframes_t) (pa_ringbuffer_fill(u->ring) / pa_frame_size(&u->sink->sample_spec));
 
-            if (u->saved_frame_time_valid) {
+            if (frames_in_buffer > 0) {
                 /* Adjust the worst case latency by the time that
-                 * passed since we last handed data to JACK */
+                 * passed since JACK last took data from us */
 
                 ft = jack_frame_time(u->client);
-                d = ft > u->saved_frame_time ? ft - u->saved_frame_time : 0;
-                l = l > d ? l - d : 0;
+                d = ft - (jack_nframes_t) pa_atomic_load(&u->saved_frame_time);
+                d = d < frames_in_buffer ? d : frames_in_buffer;
+                l -= d;
             }
 
             /* Convert it to usec */
@@ -199,18 +259,51 @@ static int sink_process_msg(pa_msgobject *o, int code, void *data, int64_t offse
 /* JACK Callback: This is called when JACK needs some data */
 static int jack_process(jack_nframes_t nframes, void *arg) {
     struct userdata *u = arg;
+    float *buffer[PA_CHANNELS_MAX];
+    jack_nframes_t done = 0;
+    size_t fs;
     unsigned c;
-    jack_nframes_t frame_time;
+
     pa_assert(u);
 
-    /* We just forward the request to our other RT thread */
+    /* Only copy out what our thread rendered ahead, never wait for it */
 
     for (c = 0; c < u->channels; c++)
-        pa_assert_se(u->buffer[c] = jack_port_get_buffer(u->port[c], nframes));
+        pa_assert_se(buffer[c] = jack_port_get_buffer(u->port[c], nframes));
+
+    fs = u->channels * sizeof(float);
+
+    while (done < nframes) {
+        void *dst[PA_CHANNELS_MAX];
+        const void *p;
+        jack_nframes_t k;
+        size_t n;
+
+        p = pa_ringbuffer_peek(u->ring, &n);
+        if ((k = PA_MIN(nframes - done, (jack_nframes_t) (n / fs))) <= 0)
+            break;
+
+        for (c = 0; c < u->channels; c++)
+            dst[c] = buffer[c] + done;
+
+        pa_deinterleave(p, dst, u->channels, sizeof(float), k);
+        pa_ringbuffer_drop(u->ring, k * fs);
+        done += k;
+    }
 
-    frame_time = jack_frame_time(u->client);
+    if (done < nframes) {
+        /* Our thread fell behind, fill up with silence and let it
+         * know it should render further ahead */
+        for (c = 0; c < u->channels; c++)
+            memset(buffer[c] + done, 0, (nframes - done) * sizeof(float));
 
-    pa_assert_se(pa_asyncmsgq_send(u->jack_msgq, PA_MSGOBJECT(u->sink), SINK_MESSAGE_RENDER, &frame_time, nframes, NULL) == 0);
+        pa_atomic_inc(&u->underruns);
+    }
+
+    pa_atomic_store(&u->saved_frame_time, (int) jack_frame_time(u->client));
+    pa_atomic_store(&u->frames_in_buffer, (int) nframes);
+
+    pa_fdsem_post(u->fdsem);
     return 0;
 }
 
@@ -233,6 +326,9 @@ static void thread_func(void *userdata) {
             if (u->sink->thread_info.rewind_requested)
                 pa_sink_process_rewind(u->sink, 0);
 
+        /* Top up what the JACK thread took since we last ran */
+        fill_ring(u);
+
         if ((ret = pa_rtpoll_run(u->rtpoll, TRUE)) < 0)
             goto fail;
 
@@ -321,7 +417,6 @@ int pa__init(pa_module*m) {
     m->userdata = u = pa_xnew0(struct userdata, 1);
     u->core = m->core;
     u->module = m;
-    u->saved_frame_time_valid = FALSE;
     u->rtpoll = pa_rtpoll_new();
     pa_thread_mq_init(&u->thread_mq, m->core->mainloop, u->rtpoll);
 
@@ -335,6 +430,11 @@ int pa__init(pa_module*m) {
      * anything else */
     u->rtpoll_item = pa_rtpoll_item_new_asyncmsgq_read(u->rtpoll, PA_RTPOLL_EARLY-1, u->jack_msgq);
 
+    /* The JACK thread kicks us through this one whenever it took data
+     * from the ring */
+    u->fdsem = pa_fdsem_new();
+    u->fdsem_item = pa_rtpoll_item_new_fdsem(u->rtpoll, PA_RTPOLL_EARLY-1, u->fdsem);
+
     if (!(u->client = jack_client_open(client_name, server_name ? JackServerName : JackNullOption, &status, server_name))) {
         pa_log("jack_client_open() failed.");
         goto fail;
@@ -413,7 +513,12 @@ int pa__init(pa_module*m) {
 
     pa_sink_set_asyncmsgq(u->sink, u->thread_mq.inq);
     pa_sink_set_rtpoll(u->sink, u->rtpoll);
-    pa_sink_set_max_request(u->sink, jack_get_buffer_size(u->client) * pa_frame_size(&u->sink->sample_spec));
+
+    u->ring = pa_ringbuffer_new(RING_FRAMES * pa_frame_size(&u->sink->sample_spec));
+    u->period = PA_MIN(jack_get_buffer_size(u->client) * pa_frame_size(&u->sink->sample_spec), pa_ringbuffer_capacity(u->ring) / MAX_FILL_PERIODS);
+    u->fill_target = u->period;
+    u->last_adjust = pa_rtclock_now();
+    pa_sink_set_max_request(u->sink, u->period);
 
     jack_set_process_callback(u->client, jack_process, u);
     jack_on_shutdown(u->client, jack_shutdown, u);
@@ -448,7 +553,7 @@ int pa__init(pa_module*m) {
     }
 
     jack_port_get_latency_range(u->port[0], JackPlaybackLatency, &r);
-    n = r.max * pa_frame_size(&u->sink->sample_spec);
+    n = r.max * pa_frame_size(&u->sink->sample_spec) + u->period;
     pa_sink_set_fixed_latency(u->sink, pa_bytes_to_usec(n, &u->sink->sample_spec));
     pa_sink_put(u->sink);
 
@@ -506,6 +611,15 @@ void pa__done(pa_module*m) {
     if (u->rtpoll_item)
         pa_rtpoll_item_free(u->rtpoll_item);
 
+    if (u->fdsem_item)
+        pa_rtpoll_item_free(u->fdsem_item);
+
+    if (u->fdsem)
+        pa_fdsem_free(u->fdsem);
+
+    if (u->ring)
+        pa_ringbuffer_free(u->ring);
+
     if (u->jack_msgq)
         pa_asyncmsgq_unref(u->jack_msgq);
 
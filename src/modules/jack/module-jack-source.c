@@ -42,6 +42,9 @@
 #include <pulsecore/thread-mq.h>
 #include <pulsecore/rtpoll.h>
 #include <pulsecore/sample-util.h>
+#include <pulsecore/atomic.h>
+#include <pulsecore/fdsem.h>
+#include <pulsecore/ringbuffer.h>
 
 #include "module-jack-source-symdef.h"
 
@@ -63,6 +66,9 @@ PA_MODULE_USAGE(
 
 #define DEFAULT_SOURCE_NAME "jack_in"
 
+/* Room for a couple of JACK's largest periods */
+#define RING_FRAMES (4*8192)
+
 struct userdata {
     pa_core *core;
     pa_module *module;
@@ -78,10 +84,18 @@ struct userdata {
     pa_rtpoll *rtpoll;
     pa_rtpoll_item *rtpoll_item;
 
+    pa_ringbuffer *ring;
+    pa_fdsem *fdsem;
+    pa_rtpoll_item *fdsem_item;
+
     pa_thread *thread;
 
-    jack_nframes_t saved_frame_time;
-    pa_bool_t saved_frame_time_valid;
+    /* Written by the JACK thread, read by our thread */
+    pa_atomic_t saved_frame_time;
+    pa_atomic_t saved_frame_time_valid;
+    pa_atomic_t overruns;
+
+    int overruns_seen;
 };
 
 static const char* const valid_modargs[] = {
@@ -96,28 +110,51 @@ static const char* const valid_modargs[] = {
 };
 
 enum {
-    SOURCE_MESSAGE_POST = PA_SOURCE_MESSAGE_MAX,
-    SOURCE_MESSAGE_ON_SHUTDOWN
+    SOURCE_MESSAGE_ON_SHUTDOWN = PA_SOURCE_MESSAGE_MAX
 };
 
-static int source_process_msg(pa_msgobject *o, int code, void *data, int64_t offset, pa_memchunk *chunk) {
-    struct userdata *u = PA_SOURCE(o)->userdata;
+/* Called from IO context */
+static void drain_ring(struct userdata *u) {
+    const void *p;
+    size_t n;
+    int overruns;
 
-    switch (code) {
+    if ((overruns = pa_atomic_load(&u->overruns)) != u->overruns_seen) {
+        pa_log_info("JACK thread found the ring full, dropped %i periods of capture data.", overruns - u->overruns_seen);
+        u->overruns_seen = overruns;
+    }
 
-        case SOURCE_MESSAGE_POST:
+    for (;;) {
+        p = pa_ringbuffer_peek(u->ring, &n);
+        if (n <= 0)
+            break;
 
-            /* Handle the new block from the JACK thread */
-            pa_assert(chunk);
-            pa_assert(chunk->length > 0);
+        if (u->source->thread_info.state == PA_SOURCE_RUNNING) {
+            pa_memchunk chunk;
+            void *d;
 
-            if (u->source->thread_info.state == PA_SOURCE_RUNNING)
-                pa_source_post(u->source, chunk);
+            chunk.memblock = pa_memblock_new(u->core->mempool, n);
+            chunk.index = 0;
+            chunk.length = pa_memblock_get_length(chunk.memblock);
 
-            u->saved_frame_time = (jack_nframes_t) offset;
-            u->saved_frame_time_valid = TRUE;
+            d = pa_memblock_acquire(chunk.memblock);
+            memcpy(d, p, chunk.length);
+            pa_memblock_release(chunk.memblock);
 
-            return 0;
+            pa_source_post(u->source, &chunk);
+            pa_memblock_unref(chunk.memblock);
+
+            n = chunk.length;
+        }
+
+        pa_ringbuffer_drop(u->ring, n);
+    }
+}
+
+static int source_process_msg(pa_msgobject *o, int code, void *data, int64_t offset, pa_memchunk *chunk) {
+    struct userdata *u = PA_SOURCE(o)->userdata;
+
+    switch (code) {
 
         case SOURCE_MESSAGE_ON_SHUTDOWN:
             pa_asyncmsgq_post(u->thread_mq.outq, PA_MSGOBJECT(u->core), PA_CORE_MESSAGE_UNLOAD_MODULE, u->module, 0, NULL, NULL);
@@ -130,14 +167,14 @@ static int source_process_msg(pa_msgobject *o, int code, void *data, int64_t off
 
             /* This is the "worst-case" latency */
             jack_port_get_latency_range(u->port[0], JackCaptureLatency, &r);
-            l = r.max;
+            l = r.max + (jack_nframes_t) (pa_ringbuffer_fill(u->ring) / pa_frame_size(&u->source->sample_spec));
 
-            if (u->saved_frame_time_valid) {
+            if (pa_atomic_load(&u->saved_frame_time_valid)) {
                 /* Adjust the worst case latency by the time that
-                 * passed since we last handed data to JACK */
+                 * passed since JACK last handed data to us */
 
                 ft = jack_frame_time(u->client);
-                d = ft > u->saved_frame_time ? ft - u->saved_frame_time : 0;
+                d = ft - (jack_nframes_t) pa_atomic_load(&u->saved_frame_time);
                 l += d;
             }
 
@@ -155,31 +192,46 @@ static int source_process_msg(pa_msgobject *o, int code, void *data, int64_t off
 static int jack_process(jack_nframes_t nframes, void *arg) {
     unsigned c;
     struct userdata *u = arg;
-    const void *buffer[PA_CHANNELS_MAX];
-    void *p;
-    jack_nframes_t frame_time;
-    pa_memchunk chunk;
+    const float *buffer[PA_CHANNELS_MAX];
+    jack_nframes_t done = 0;
+    size_t fs;
 
     pa_assert(u);
 
     for (c = 0; c < u->channels; c++)
         pa_assert_se(buffer[c] = jack_port_get_buffer(u->port[c], nframes));
 
-    /* We interleave the data and pass it on to the other RT thread */
+    /* We interleave the data into the ring and kick the other RT
+     * thread, never waiting for it */
+
+    fs = u->channels * sizeof(float);
 
-    pa_memchunk_reset(&chunk);
-    chunk.length = nframes * pa_frame_size(&u->source->sample_spec);
-    chunk.memblock = pa_memblock_new(u->core->mempool, chunk.length);
-    p = pa_memblock_acquire(chunk.memblock);
-    pa_interleave(buffer, u->channels, p, sizeof(float), nframes);
-    pa_memblock_release(chunk.memblock);
+    while (done < nframes) {
+        const void *src[PA_CHANNELS_MAX];
+        jack_nframes_t k;
+        size_t n;
+        void *p;
 
-    frame_time = jack_frame_time(u->client);
+        p = pa_ringbuffer_begin_write(u->ring, &n);
+        if ((k = PA_MIN(nframes - done, (jack_nframes_t) (n / fs))) <= 0)
+            break;
 
-    pa_asyncmsgq_post(u->jack_msgq, PA_MSGOBJECT(u->source), SOURCE_MESSAGE_POST, NULL, frame_time, &chunk, NULL);
+        for (c = 0; c < u->channels; c++)
+            src[c] = buffer[c] + done;
+
+        pa_interleave(src, u->channels, p, sizeof(float), k);
+        pa_ringbuffer_end_write(u->ring, k * fs);
+        done += k;
+    }
 
-    pa_memblock_unref(chunk.memblock);
+    /* The other thread fell behind, the rest is lost */
+    if (done < nframes)
+        pa_atomic_inc(&u->overruns);
 
+    pa_atomic_store(&u->saved_frame_time, (int) jack_frame_time(u->client));
+    pa_atomic_store(&u->saved_frame_time_valid, TRUE);
+
+    pa_fdsem_post(u->fdsem);
     return 0;
 }
 
@@ -198,6 +250,9 @@ static void thread_func(void *userdata) {
     for (;;) {
         int ret;
 
+        /* Pass on whatever the JACK thread captured since we last ran */
+        drain_ring(u);
+
         if ((ret = pa_rtpoll_run(u->rtpoll, TRUE)) < 0)
             goto fail;
 
@@ -274,13 +329,15 @@ int pa__init(pa_module*m) {
     m->userdata = u = pa_xnew0(struct userdata, 1);
     u->core = m->core;
     u->module = m;
-    u->saved_frame_time_valid = FALSE;
     u->rtpoll = pa_rtpoll_new();
     pa_thread_mq_init(&u->thread_mq, m->core->mainloop, u->rtpoll);
 
     u->jack_msgq = pa_asyncmsgq_new(0);
     u->rtpoll_item = pa_rtpoll_item_new_asyncmsgq_read(u->rtpoll, PA_RTPOLL_EARLY-1, u->jack_msgq);
 
+    u->fdsem = pa_fdsem_new();
+    u->fdsem_item = pa_rtpoll_item_new_fdsem(u->rtpoll, PA_RTPOLL_EARLY-1, u->fdsem);
+
     if (!(u->client = jack_client_open(client_name, server_name ? JackServerName : JackNullOption, &status, server_name))) {
         pa_log("jack_client_open() failed.");
         goto fail;
@@ -360,6 +417,8 @@ int pa__init(pa_module*m) {
     pa_source_set_asyncmsgq(u->source, u->thread_mq.inq);
     pa_source_set_rtpoll(u->source, u->rtpoll);
 
+    u->ring = pa_ringbuffer_new(RING_FRAMES * pa_frame_size(&u->source->sample_spec));
+
     jack_set_process_callback(u->client, jack_process, u);
     jack_on_shutdown(u->client, jack_shutdown, u);
     jack_set_thread_init_callback(u->client, jack_init, u);
@@ -450,6 +509,15 @@ void pa__done(pa_module*m) {
     if (u->rtpoll_item)
         pa_rtpoll_item_free(u->rtpoll_item);
 
+    if (u->fdsem_item)
+        pa_rtpoll_item_free(u->fdsem_item);
+
+    if (u->fdsem)
+        pa_fdsem_free(u->fdsem);
+
+    if (u->ring)
+        pa_ringbuffer_free(u->ring);
+
     if (u->jack_msgq)
         pa_asyncmsgq_unref(u->jack_msgq);
 
@@ -39,6 +39,7 @@
 #include <pulsecore/log.h>
 #include <pulsecore/core-rtclock.h>
 #include <pulsecore/core-util.h>
+#include <pulsecore/drift-controller.h>
 #include <pulsecore/modargs.h>
 #include <pulsecore/namereg.h>
 #include <pulsecore/thread.h>
@@ -46,6 +47,7 @@
 #include <pulsecore/rtpoll.h>
 #include <pulsecore/time-smoother.h>
 #include <pulsecore/strlist.h>
+#include <pulsecore/flist.h>
 
 #include "module-combine-sink-symdef.h"
 
@@ -58,6 +60,7 @@ PA_MODULE_USAGE(
         "sink_properties=<properties for the sink> "
         "slaves=<slave sinks> "
         "adjust_time=<how often to readjust rates in s> "
+        "render_ahead=<how far to render ahead of the outputs in ms> "
         "resample_method=<method> "
         "format=<sample format> "
         "rate=<sample rate> "
@@ -68,15 +71,24 @@ PA_MODULE_USAGE(
 
 #define MEMBLOCKQ_MAXLENGTH (1024*1024*16)
 
-#define DEFAULT_ADJUST_TIME_USEC (10*PA_USEC_PER_SEC)
+#define DEFAULT_ADJUST_TIME_USEC (1*PA_USEC_PER_SEC)
 
-#define BLOCK_USEC (PA_USEC_PER_MSEC * 200)
+/* How many adjust_time intervals the latencies need to settle */
+#define DRIFT_TIME_CONSTANT 5
+
+#define BLOCK_USEC (PA_USEC_PER_MSEC * 10)
+
+#define DEFAULT_RENDER_AHEAD_USEC (PA_USEC_PER_MSEC * 5)
+
+/* Number of rendered chunks the outputs can lag behind each other */
+#define RING_SLOTS 64
 
 static const char* const valid_modargs[] = {
     "sink_name",
     "sink_properties",
     "slaves",
     "adjust_time",
+    "render_ahead",
     "resample_method",
     "format",
     "rate",
@@ -85,6 +97,16 @@ static const char* const valid_modargs[] = {
     NULL
 };
 
+/* One rendered chunk as handed from the sink thread to one output.
+ * Whoever takes an entry out of a ring slot owns it, so neither side
+ * ever has to wait for the other. */
+struct ring_entry {
+    pa_memchunk chunk;
+    unsigned seq;
+};
+
+PA_STATIC_FLIST_DECLARE(ring_entries, 0, pa_xfree);
+
 struct output {
     struct userdata *userdata;
 
@@ -92,16 +114,25 @@ struct output {
     pa_sink_input *sink_input;
     pa_bool_t ignore_state_change;
 
-    pa_asyncmsgq *inq,    /* Message queue from the sink thread to this sink input */
-                 *outq;   /* Message queue from this sink input to the sink thread */
-    pa_rtpoll_item *inq_rtpoll_item_read, *inq_rtpoll_item_write;
+    pa_asyncmsgq *outq;   /* Message queue from this sink input to the sink thread */
     pa_rtpoll_item *outq_rtpoll_item_read, *outq_rtpoll_item_write;
 
     pa_memblockq *memblockq;
 
+    /* The ring the sink thread renders into, one struct ring_entry
+     * per slot. Filled by the sink thread, emptied by the output's IO
+     * thread. */
+    pa_atomic_ptr_t ring[RING_SLOTS];
+
+    /* Sequence number of the next ring slot this output reads. Only
+     * changed from the output's IO thread once the output is active. */
+    pa_atomic_t read_seq;
+
     /* For communication of the stream latencies to the main thread */
     pa_usec_t total_latency;
 
+    pa_drift_controller *drift;
+
     /* For communication of the stream parameters to the sink thread */
     pa_atomic_t max_request;
     pa_atomic_t requested_latency;
@@ -131,9 +162,13 @@ struct userdata {
     pa_resample_method_t resample_method;
 
     pa_usec_t block_usec;
+    pa_usec_t render_ahead;
 
     pa_idxset* outputs; /* managed in main context */
 
+    pa_atomic_t write_seq;       /* sequence number of the next slot the sink thread fills */
+    pa_atomic_t render_pending;  /* whether a SINK_MESSAGE_RENDER_AHEAD is queued */
+
     struct {
         PA_LLIST_HEAD(struct output, active_outputs); /* managed in IO thread context */
         pa_atomic_t running;  /* we cache that value here, so that every thread can query it cheaply */
@@ -148,15 +183,12 @@ enum {
     SINK_MESSAGE_ADD_OUTPUT = PA_SINK_MESSAGE_MAX,
     SINK_MESSAGE_REMOVE_OUTPUT,
     SINK_MESSAGE_NEED,
+    SINK_MESSAGE_RENDER_AHEAD,
     SINK_MESSAGE_UPDATE_LATENCY,
     SINK_MESSAGE_UPDATE_MAX_REQUEST,
     SINK_MESSAGE_UPDATE_REQUESTED_LATENCY
 };
 
-enum {
-    SINK_INPUT_MESSAGE_POST = PA_SINK_INPUT_MESSAGE_MAX,
-};
-
 static void output_disable(struct output *o);
 static void output_enable(struct output *o);
 static void output_free(struct output *o);
@@ -168,6 +200,7 @@ static void adjust_rates(struct userdata *u) {
     uint32_t base_rate;
     uint32_t idx;
     unsigned n = 0;
+    pa_usec_t now;
 
     pa_assert(u);
     pa_sink_assert_ref(u->sink);
@@ -213,31 +246,24 @@ static void adjust_rates(struct userdata *u) {
     pa_log_info("[%s] target latency is %0.2f msec.", u->sink->name, (double) target_latency / PA_USEC_PER_MSEC);
 
     base_rate = u->sink->sample_spec.rate;
+    now = pa_rtclock_now();
 
     PA_IDXSET_FOREACH(o, u->outputs, idx) {
-        uint32_t new_rate = base_rate;
-        uint32_t current_rate = o->sink_input->sample_spec.rate;
+        double new_rate;
 
         if (!o->sink_input || !PA_SINK_IS_OPENED(pa_sink_get_state(o->sink)))
             continue;
 
-        if (o->total_latency != target_latency)
-            new_rate += (uint32_t) (((double) o->total_latency - (double) target_latency) / (double) u->adjust_time * (double) new_rate);
+        /* The controller limits the step size, so that the
+         * adjustment stays inaudible */
+        pa_drift_controller_update(o->drift, now, (int64_t) o->total_latency - (int64_t) target_latency);
+        new_rate = (double) base_rate * pa_drift_controller_get_ratio(o->drift);
 
-        if (new_rate < (uint32_t) (base_rate*0.8) || new_rate > (uint32_t) (base_rate*1.25)) {
-            pa_log_warn("[%s] sample rates too different, not adjusting (%u vs. %u).", o->sink_input->sink->name, base_rate, new_rate);
-            new_rate = base_rate;
-        } else {
-            if (base_rate < new_rate + 20 && new_rate < base_rate + 20)
-              new_rate = base_rate;
-            /* Do the adjustment in small steps; 2‰ can be considered inaudible */
-            if (new_rate < (uint32_t) (current_rate*0.998) || new_rate > (uint32_t) (current_rate*1.002)) {
-                pa_log_info("[%s] new rate of %u Hz not within 2‰ of %u Hz, forcing smaller adjustment", o->sink_input->sink->name, new_rate, current_rate);
-                new_rate = PA_CLAMP(new_rate, (uint32_t) (current_rate*0.998), (uint32_t) (current_rate*1.002));
-            }
-            pa_log_info("[%s] new rate is %u Hz; ratio is %0.3f; latency is %0.2f msec.", o->sink_input->sink->name, new_rate, (double) new_rate / base_rate, (double) o->total_latency / PA_USEC_PER_MSEC);
-        }
-        pa_sink_input_set_rate(o->sink_input, new_rate);
+        pa_log_info("[%s] new rate is %0.3f Hz; ratio is %0.5f; latency is %0.2f msec; drift is %0.1f ppm.",
+                    o->sink_input->sink->name, new_rate, pa_drift_controller_get_ratio(o->drift),
+                    (double) o->total_latency / PA_USEC_PER_MSEC, pa_drift_controller_get_drift_ppm(o->drift));
+
+        pa_sink_input_set_rate_frac(o->sink_input, new_rate);
     }
 
     pa_asyncmsgq_send(u->sink->asyncmsgq, PA_MSGOBJECT(u->sink), SINK_MESSAGE_UPDATE_LATENCY, NULL, (int64_t) avg_total_latency, NULL);
@@ -347,67 +373,209 @@ finish:
     pa_log_debug("Thread shutting down");
 }
 
+/* Called from any context */
+static void ring_entry_free(struct ring_entry *e) {
+    pa_assert(e);
+
+    pa_memblock_unref(e->chunk.memblock);
+
+    if (pa_flist_push(PA_STATIC_FLIST_GET(ring_entries), e) < 0)
+        pa_xfree(e);
+}
+
+/* Called from any context */
+static struct ring_entry *ring_exchange(pa_atomic_ptr_t *slot, struct ring_entry *e) {
+    struct ring_entry *old;
+
+    pa_assert(slot);
+
+    do {
+        old = pa_atomic_ptr_load(slot);
+    } while (!pa_atomic_ptr_cmpxchg(slot, old, e));
+
+    return old;
+}
+
+/* Called from I/O thread context */
+static void ring_push(struct userdata *u, const pa_memchunk *chunk) {
+    unsigned seq;
+    struct output *o;
+
+    pa_assert(u);
+    pa_assert(chunk);
+
+    seq = (unsigned) pa_atomic_load(&u->write_seq);
+
+    PA_LLIST_FOREACH(o, u->thread_info.active_outputs) {
+        struct ring_entry *e, *old;
+
+        if (!(e = pa_flist_pop(PA_STATIC_FLIST_GET(ring_entries))))
+            e = pa_xnew(struct ring_entry, 1);
+
+        e->chunk = *chunk;
+        pa_memblock_ref(e->chunk.memblock);
+        e->seq = seq;
+
+        /* If the slot is still occupied the output never picked up
+         * that chunk, it fell behind and loses it */
+        if ((old = ring_exchange(&o->ring[seq % RING_SLOTS], e)))
+            ring_entry_free(old);
+    }
+
+    pa_atomic_store(&u->write_seq, (int) (seq + 1));
+}
+
+/* Called from I/O thread context */
+static unsigned ring_free_slots(struct userdata *u) {
+    struct output *o;
+    unsigned write_seq, lag = 0;
+
+    pa_assert(u);
+
+    write_seq = (unsigned) pa_atomic_load(&u->write_seq);
+
+    PA_LLIST_FOREACH(o, u->thread_info.active_outputs) {
+        unsigned l = write_seq - (unsigned) pa_atomic_load(&o->read_seq);
+
+        if (l > lag)
+            lag = l;
+    }
+
+    return lag < RING_SLOTS ? RING_SLOTS - lag : 0;
+}
+
+/* Called from I/O thread context */
+static size_t render_chunk(struct userdata *u, size_t length) {
+    pa_memchunk chunk;
+
+    pa_assert(u);
+
+    pa_sink_render(u->sink, length, &chunk);
+
+    u->thread_info.counter += chunk.length;
+
+    ring_push(u, &chunk);
+    pa_memblock_unref(chunk.memblock);
+
+    return chunk.length;
+}
+
 /* Called from I/O thread context */
 static void render_memblock(struct userdata *u, struct output *o, size_t length) {
     pa_assert(u);
     pa_assert(o);
 
-    /* We are run by the sink thread, on behalf of an output (o). The
-     * output is waiting for us, hence it is safe to access its
-     * mainblockq and asyncmsgq directly. */
+    /* We are run by the sink thread, on behalf of an output (o) that
+     * ran dry. The output is waiting for us, hence its read cursor
+     * won't move. If the ring is full, the slowest output loses the
+     * oldest chunk. */
 
     /* If we are not running, we cannot produce any data */
     if (!pa_atomic_load(&u->thread_info.running))
         return;
 
-    /* Maybe there's some data in the requesting output's queue
-     * now? */
-    while (pa_asyncmsgq_process_one(o->inq) > 0)
-        ;
+    while ((unsigned) pa_atomic_load(&u->write_seq) == (unsigned) pa_atomic_load(&o->read_seq))
+        render_chunk(u, length);
+}
 
-    /* Ok, now let's prepare some data if we really have to */
-    while (!pa_memblockq_is_readable(o->memblockq)) {
-        struct output *j;
-        pa_memchunk chunk;
+/* Called from I/O thread context */
+static void render_ahead(struct userdata *u, size_t length, size_t missing) {
+    size_t rendered = 0;
 
-        /* Render data! */
-        pa_sink_render(u->sink, length, &chunk);
+    pa_assert(u);
 
-        u->thread_info.counter += chunk.length;
+    pa_atomic_store(&u->render_pending, 0);
+
+    if (!pa_atomic_load(&u->thread_info.running))
+        return;
+
+    /* Unlike render_memblock() we never overwrite data an output
+     * hasn't read yet */
+    while (rendered < missing && ring_free_slots(u) > 0)
+        rendered += render_chunk(u, length);
+}
+
+/* Called from I/O thread context */
+static void output_pull(struct output *o) {
+    struct userdata *u;
+    unsigned seq, write_seq;
+
+    pa_assert(o);
+    pa_assert_se(u = o->userdata);
+
+    seq = (unsigned) pa_atomic_load(&o->read_seq);
+    write_seq = (unsigned) pa_atomic_load(&u->write_seq);
+
+    if (write_seq - seq > RING_SLOTS) {
+        pa_log_debug("[%s] Output fell behind, dropping %u chunks.", o->sink->name, write_seq - seq - RING_SLOTS);
+        seq = write_seq - RING_SLOTS;
+    }
+
+    while (seq != write_seq) {
+        struct ring_entry *e;
+
+        if (!(e = ring_exchange(&o->ring[seq % RING_SLOTS], NULL))) {
+            seq++;
+            continue;
+        }
+
+        if (e->seq != seq) {
+            pa_bool_t newer = (int) (e->seq - seq) > 0;
+
+            ring_entry_free(e);
 
-        /* OK, let's send this data to the other threads */
-        PA_LLIST_FOREACH(j, u->thread_info.active_outputs) {
-            if (j == o)
+            if (!newer) {
+                /* Left over from an earlier activation */
+                seq++;
                 continue;
+            }
 
-            pa_asyncmsgq_post(j->inq, PA_MSGOBJECT(j->sink_input), SINK_INPUT_MESSAGE_POST, NULL, 0, &chunk, NULL);
+            /* The sink thread overwrote this slot while we were
+             * looking, we'll continue with what is left next time */
+            pa_log_debug("[%s] Output fell behind, dropping data.", o->sink->name);
+            seq = (unsigned) pa_atomic_load(&u->write_seq) - RING_SLOTS/2;
+            break;
         }
 
-        /* And place it directly into the requesting output's queue */
-        pa_memblockq_push_align(o->memblockq, &chunk);
-        pa_memblock_unref(chunk.memblock);
+        pa_memblockq_push_align(o->memblockq, &e->chunk);
+        ring_entry_free(e);
+
+        seq++;
     }
+
+    pa_atomic_store(&o->read_seq, (int) seq);
 }
 
 /* Called from I/O thread context */
 static void request_memblock(struct output *o, size_t length) {
+    struct userdata *u;
+    size_t queued, ahead;
+
     pa_assert(o);
     pa_sink_input_assert_ref(o->sink_input);
-    pa_sink_assert_ref(o->userdata->sink);
+    pa_assert_se(u = o->userdata);
+    pa_sink_assert_ref(u->sink);
 
-    /* If another thread already prepared some data we received
-     * the data over the asyncmsgq, hence let's first process
-     * it. */
-    while (pa_asyncmsgq_process_one(o->inq) > 0)
-        ;
+    /* Pick up whatever the sink thread already rendered for us */
+    output_pull(o);
 
-    /* Check whether we're now readable */
-    if (pa_memblockq_is_readable(o->memblockq))
+    /* We can only get new data if the sink is actually running */
+    if (!pa_atomic_load(&u->thread_info.running))
         return;
 
-    /* OK, we need to prepare new data, but only if the sink is actually running */
-    if (pa_atomic_load(&o->userdata->thread_info.running))
-        pa_asyncmsgq_send(o->outq, PA_MSGOBJECT(o->userdata->sink), SINK_MESSAGE_NEED, o, (int64_t) length, NULL);
+    /* If the sink thread didn't keep up we have to wait for it */
+    if (!pa_memblockq_is_readable(o->memblockq)) {
+        pa_asyncmsgq_send(o->outq, PA_MSGOBJECT(u->sink), SINK_MESSAGE_NEED, o, (int64_t) length, NULL);
+        output_pull(o);
+    }
+
+    /* Ask the sink thread to stay ahead of us, without waiting for
+     * it. One pending request is enough for all outputs. */
+    queued = pa_memblockq_get_length(o->memblockq);
+    ahead = pa_usec_to_bytes(u->render_ahead, &u->sink->sample_spec) + length;
+
+    if (queued < ahead && pa_atomic_cmpxchg(&u->render_pending, 0, 1))
+        pa_asyncmsgq_post(o->outq, PA_MSGOBJECT(u->sink), SINK_MESSAGE_RENDER_AHEAD, PA_UINT_TO_PTR(ahead - queued), (int64_t) length, NULL, NULL);
 }
 
 /* Called from I/O thread context */
@@ -499,13 +667,8 @@ static void sink_input_attach_cb(pa_sink_input *i) {
     pa_sink_input_assert_ref(i);
     pa_assert_se(o = i->userdata);
 
-    /* Set up the queue from the sink thread to us */
-    pa_assert(!o->inq_rtpoll_item_read && !o->outq_rtpoll_item_write);
-
-    o->inq_rtpoll_item_read = pa_rtpoll_item_new_asyncmsgq_read(
-            i->sink->thread_info.rtpoll,
-            PA_RTPOLL_LATE,  /* This one is not that important, since we check for data in _peek() anyway. */
-            o->inq);
+    /* Set up the queue from us to the sink thread */
+    pa_assert(!o->outq_rtpoll_item_write);
 
     o->outq_rtpoll_item_write = pa_rtpoll_item_new_asyncmsgq_write(
             i->sink->thread_info.rtpoll,
@@ -530,11 +693,6 @@ static void sink_input_detach_cb(pa_sink_input *i) {
     pa_sink_input_assert_ref(i);
     pa_assert_se(o = i->userdata);
 
-    if (o->inq_rtpoll_item_read) {
-        pa_rtpoll_item_free(o->inq_rtpoll_item_read);
-        o->inq_rtpoll_item_read = NULL;
-    }
-
     if (o->outq_rtpoll_item_write) {
         pa_rtpoll_item_free(o->outq_rtpoll_item_write);
         o->outq_rtpoll_item_write = NULL;
@@ -561,21 +719,16 @@ static int sink_input_process_msg(pa_msgobject *obj, int code, void *data, int64
         case PA_SINK_INPUT_MESSAGE_GET_LATENCY: {
             pa_usec_t *r = data;
 
+            /* Data still waiting for us in the ring counts as well */
+            if (PA_SINK_IS_OPENED(o->sink_input->sink->thread_info.state))
+                output_pull(o);
+
             *r = pa_bytes_to_usec(pa_memblockq_get_length(o->memblockq), &o->sink_input->sample_spec);
 
             /* Fall through, the default handler will add in the extra
              * latency added by the resampler */
             break;
         }
-
-        case SINK_INPUT_MESSAGE_POST:
-
-            if (PA_SINK_IS_OPENED(o->sink_input->sink->thread_info.state))
-                pa_memblockq_push_align(o->memblockq, chunk);
-            else
-                pa_memblockq_flush_write(o->memblockq, TRUE);
-
-            return 0;
     }
 
     return pa_sink_input_process_msg(obj, code, data, offset, chunk);
@@ -698,16 +851,15 @@ static void output_add_within_thread(struct output *o) {
 
     PA_LLIST_PREPEND(struct output, o->userdata->thread_info.active_outputs, o);
 
-    pa_assert(!o->outq_rtpoll_item_read && !o->inq_rtpoll_item_write);
+    pa_assert(!o->outq_rtpoll_item_read);
+
+    /* Start reading at whatever the sink thread renders next */
+    pa_atomic_store(&o->read_seq, pa_atomic_load(&o->userdata->write_seq));
 
     o->outq_rtpoll_item_read = pa_rtpoll_item_new_asyncmsgq_read(
             o->userdata->rtpoll,
             PA_RTPOLL_EARLY-1,  /* This item is very important */
             o->outq);
-    o->inq_rtpoll_item_write = pa_rtpoll_item_new_asyncmsgq_write(
-            o->userdata->rtpoll,
-            PA_RTPOLL_EARLY,
-            o->inq);
 }
 
 /* Called from thread context of the io thread */
@@ -721,11 +873,6 @@ static void output_remove_within_thread(struct output *o) {
         pa_rtpoll_item_free(o->outq_rtpoll_item_read);
         o->outq_rtpoll_item_read = NULL;
     }
-
-    if (o->inq_rtpoll_item_write) {
-        pa_rtpoll_item_free(o->inq_rtpoll_item_write);
-        o->inq_rtpoll_item_write = NULL;
-    }
 }
 
 /* Called from thread context of the io thread */
@@ -779,6 +926,10 @@ static int sink_process_msg(pa_msgobject *o, int code, void *data, int64_t offse
             render_memblock(u, (struct output*) data, (size_t) offset);
             return 0;
 
+        case SINK_MESSAGE_RENDER_AHEAD:
+            render_ahead(u, (size_t) offset, (size_t) PA_PTR_TO_UINT(data));
+            return 0;
+
         case SINK_MESSAGE_UPDATE_LATENCY: {
             pa_usec_t x, y, latency = (pa_usec_t) offset;
 
@@ -867,6 +1018,9 @@ static int output_create_sink_input(struct output *o) {
     if (!o->sink_input)
         return -1;
 
+    /* A new stream starts with a latency of its own */
+    pa_drift_controller_reset(o->drift);
+
     o->sink_input->parent.process_msg = sink_input_process_msg;
     o->sink_input->pop = sink_input_pop_cb;
     o->sink_input->process_rewind = sink_input_process_rewind_cb;
@@ -893,9 +1047,9 @@ static struct output *output_new(struct userdata *u, pa_sink *sink) {
 
     o = pa_xnew0(struct output, 1);
     o->userdata = u;
-    o->inq = pa_asyncmsgq_new(0);
     o->outq = pa_asyncmsgq_new(0);
     o->sink = sink;
+    o->drift = pa_drift_controller_new(DRIFT_TIME_CONSTANT * (u->adjust_time > 0 ? u->adjust_time : DEFAULT_ADJUST_TIME_USEC));
     o->memblockq = pa_memblockq_new(
             "module-combine-sink output memblockq",
             0,
@@ -915,6 +1069,8 @@ static struct output *output_new(struct userdata *u, pa_sink *sink) {
 
 /* Called from main context */
 static void output_free(struct output *o) {
+    unsigned i;
+
     pa_assert(o);
 
     output_disable(o);
@@ -922,25 +1078,27 @@ static void output_free(struct output *o) {
     pa_assert_se(pa_idxset_remove_by_data(o->userdata->outputs, o, NULL));
     update_description(o->userdata);
 
-    if (o->inq_rtpoll_item_read)
-        pa_rtpoll_item_free(o->inq_rtpoll_item_read);
-    if (o->inq_rtpoll_item_write)
-        pa_rtpoll_item_free(o->inq_rtpoll_item_write);
-
     if (o->outq_rtpoll_item_read)
         pa_rtpoll_item_free(o->outq_rtpoll_item_read);
     if (o->outq_rtpoll_item_write)
         pa_rtpoll_item_free(o->outq_rtpoll_item_write);
 
-    if (o->inq)
-        pa_asyncmsgq_unref(o->inq);
-
     if (o->outq)
         pa_asyncmsgq_unref(o->outq);
 
     if (o->memblockq)
         pa_memblockq_free(o->memblockq);
 
+    if (o->drift)
+        pa_drift_controller_free(o->drift);
+
+    for (i = 0; i < RING_SLOTS; i++) {
+        struct ring_entry *e;
+
+        if ((e = pa_atomic_ptr_load(&o->ring[i])))
+            ring_entry_free(e);
+    }
+
     pa_xfree(o);
 }
 
@@ -998,8 +1156,10 @@ static void output_disable(struct output *o) {
 
     /* Finally, drop all queued data */
     pa_memblockq_flush_write(o->memblockq, TRUE);
-    pa_asyncmsgq_flush(o->inq, FALSE);
     pa_asyncmsgq_flush(o->outq, FALSE);
+
+    /* We might just have dropped a pending render request */
+    pa_atomic_store(&o->userdata->render_pending, 0);
 }
 
 /* Called from main context */
@@ -1136,7 +1296,7 @@ int pa__init(pa_module*m) {
     struct output *o;
     uint32_t idx;
     pa_sink_new_data data;
-    uint32_t adjust_time_sec;
+    uint32_t adjust_time_sec, render_ahead_msec;
 
     pa_assert(m);
 
@@ -1179,6 +1339,14 @@ int pa__init(pa_module*m) {
     else
         u->adjust_time = DEFAULT_ADJUST_TIME_USEC;
 
+    render_ahead_msec = DEFAULT_RENDER_AHEAD_USEC / PA_USEC_PER_MSEC;
+    if (pa_modargs_get_value_u32(ma, "render_ahead", &render_ahead_msec) < 0) {
+        pa_log("Failed to parse render_ahead value");
+        goto fail;
+    }
+
+    u->render_ahead = render_ahead_msec * PA_USEC_PER_MSEC;
+
     slaves = pa_modargs_get_value(ma, "slaves", NULL);
     u->automatic = !slaves;
 
@@ -28,6 +28,7 @@
 
 #include <math.h>
 
+#include <pulse/timeval.h>
 #include <pulse/xmalloc.h>
 
 #include <pulsecore/i18n.h>
@@ -64,6 +65,13 @@ PA_MODULE_USAGE(
 
 #define MEMBLOCKQ_MAXLENGTH (16*1024*1024)
 
+/* Plugin output below this is considered to have decayed to silence */
+#define SILENCE_THRESHOLD (1e-6f)
+
+/* ... and must stay there this long before we stop running it, so that
+ * reverb tails with quiet stretches aren't cut off */
+#define SILENCE_SETTLE_USEC (50*PA_USEC_PER_MSEC)
+
 /* PLEASE NOTICE: The PortAudio ports and the LADSPA ports are two different concepts.
 They are not related and where possible the names of the LADSPA port variables contains "ladspa" to avoid confusion */
 
@@ -86,6 +94,12 @@ struct userdata {
 
     pa_memblockq *memblockq;
 
+    /* The input is silent and the plugin's output has decayed, so we
+     * don't need to run it until the input is no longer silent.
+     * silent_out counts how long the output has been silent so far. */
+    pa_bool_t idle;
+    size_t silent_out;
+
     pa_bool_t auto_desc;
 };
 
@@ -244,6 +258,18 @@ static int sink_input_pop_cb(pa_sink_input *i, size_t nbytes, pa_memchunk *chunk
 
     pa_assert(n > 0);
 
+    if (!pa_memblock_is_silence(tchunk.memblock)) {
+        u->idle = FALSE;
+        u->silent_out = 0;
+    }
+
+    else if (u->idle) {
+        pa_silence_memchunk_get(&i->sink->core->silence_cache, i->sink->core->mempool, chunk, &i->sample_spec, n*fs);
+        pa_memblockq_drop(u->memblockq, chunk->length);
+        pa_memblock_unref(tchunk.memblock);
+        return 0;
+    }
+
     chunk->index = 0;
     chunk->length = n*fs;
     chunk->memblock = pa_memblock_new(i->sink->core->mempool, chunk->length);
@@ -261,6 +287,23 @@ static int sink_input_pop_cb(pa_sink_input *i, size_t nbytes, pa_memchunk *chunk
             pa_sample_clamp(PA_SAMPLE_FLOAT32NE, dst + h*u->max_ladspaport_count + c, u->channels*sizeof(float), u->output[c], sizeof(float), n);
     }
 
+    /* Once the tail has decayed after the input went silent there's no
+     * point in running the plugin on more silence. Plugins without audio
+     * inputs are generators and always have to run. */
+    if (u->input_count > 0 && pa_memblock_is_silence(tchunk.memblock)) {
+        unsigned k;
+
+        u->silent_out += chunk->length;
+
+        for (k = 0; k < n * u->channels; k++)
+            if (fabsf(dst[k]) >= SILENCE_THRESHOLD) {
+                u->silent_out = 0;
+                break;
+            }
+
+        u->idle = u->silent_out >= pa_usec_to_bytes(SILENCE_SETTLE_USEC, &i->sample_spec);
+    }
+
     pa_memblock_release(tchunk.memblock);
     pa_memblock_release(chunk->memblock);
 
@@ -291,6 +334,9 @@ static void sink_input_process_rewind_cb(pa_sink_input *i, size_t nbytes) {
 
             pa_log_debug("Resetting plugin");
 
+            u->idle = FALSE;
+            u->silent_out = 0;
+
             /* Reset the plugin */
             if (u->descriptor->deactivate)
                 for (c = 0; c < (u->channels / u->max_ladspaport_count); c++)
@@ -34,6 +34,7 @@
 #include <pulsecore/namereg.h>
 #include <pulsecore/log.h>
 #include <pulsecore/core-util.h>
+#include <pulsecore/drift-controller.h>
 
 #include <pulse/rtclock.h>
 #include <pulse/timeval.h>
@@ -59,11 +60,14 @@ PA_MODULE_USAGE(
         "sink_dont_move=<boolean> "
         "remix=<remix channels?> ");
 
-#define DEFAULT_LATENCY_MSEC 200
+#define DEFAULT_LATENCY_MSEC 10
 
 #define MEMBLOCKQ_MAXLENGTH (1024*1024*16)
 
-#define DEFAULT_ADJUST_TIME_USEC (10*PA_USEC_PER_SEC)
+#define DEFAULT_ADJUST_TIME_USEC (1*PA_USEC_PER_SEC)
+
+/* How many adjust_time intervals the latency needs to settle */
+#define DRIFT_TIME_CONSTANT 5
 
 struct userdata {
     pa_core *core;
@@ -79,6 +83,7 @@ struct userdata {
 
     pa_time_event *time_event;
     pa_usec_t adjust_time;
+    pa_drift_controller *drift;
 
     int64_t recv_counter;
     int64_t send_counter;
@@ -166,9 +171,11 @@ static void teardown(struct userdata *u) {
 
 /* Called from main context */
 static void adjust_rates(struct userdata *u) {
-    size_t buffer, fs;
-    uint32_t old_rate, base_rate, new_rate;
+    size_t buffer, target;
+    uint32_t base_rate;
+    double new_rate;
     pa_usec_t buffer_latency;
+    int64_t error;
 
     pa_assert(u);
     pa_assert_ctl_context();
@@ -193,34 +200,28 @@ static void adjust_rates(struct userdata *u) {
                 (double) u->latency_snapshot.source_latency / PA_USEC_PER_MSEC,
                 ((double) u->latency_snapshot.sink_latency + buffer_latency + u->latency_snapshot.source_latency) / PA_USEC_PER_MSEC);
 
+    /* With the drift controller holding the rate steady, one request
+     * worth of data left in the queue at its lowest point is enough
+     * headroom against underruns */
+    target = u->latency_snapshot.max_request;
+
     pa_log_debug("Should buffer %zu bytes, buffered at minimum %zu bytes",
-                u->latency_snapshot.max_request*2,
+                target,
                 u->latency_snapshot.min_memblockq_length);
 
-    fs = pa_frame_size(&u->sink_input->sample_spec);
-    old_rate = u->sink_input->sample_spec.rate;
     base_rate = u->source_output->sample_spec.rate;
 
-    if (u->latency_snapshot.min_memblockq_length < u->latency_snapshot.max_request*2)
-        new_rate = base_rate - (((u->latency_snapshot.max_request*2 - u->latency_snapshot.min_memblockq_length) / fs) *PA_USEC_PER_SEC)/u->adjust_time;
-    else
-        new_rate = base_rate + (((u->latency_snapshot.min_memblockq_length - u->latency_snapshot.max_request*2) / fs) *PA_USEC_PER_SEC)/u->adjust_time;
-
-    if (new_rate < (uint32_t) (base_rate*0.8) || new_rate > (uint32_t) (base_rate*1.25)) {
-        pa_log_warn("Sample rates too different, not adjusting (%u vs. %u).", base_rate, new_rate);
-        new_rate = base_rate;
-    } else {
-        if (base_rate < new_rate + 20 && new_rate < base_rate + 20)
-          new_rate = base_rate;
-        /* Do the adjustment in small steps; 2‰ can be considered inaudible */
-        if (new_rate < (uint32_t) (old_rate*0.998) || new_rate > (uint32_t) (old_rate*1.002)) {
-            pa_log_info("New rate of %u Hz not within 2‰ of %u Hz, forcing smaller adjustment", new_rate, old_rate);
-            new_rate = PA_CLAMP(new_rate, (uint32_t) (old_rate*0.998), (uint32_t) (old_rate*1.002));
-        }
-    }
+    /* The controller takes care of the step size and of not following
+     * every bit of jitter in the measurements */
+    error = (int64_t) pa_bytes_to_usec(u->latency_snapshot.min_memblockq_length, &u->sink_input->sample_spec) -
+        (int64_t) pa_bytes_to_usec(target, &u->sink_input->sample_spec);
 
-    pa_sink_input_set_rate(u->sink_input, new_rate);
-    pa_log_debug("[%s] Updated sampling rate to %lu Hz.", u->sink_input->sink->name, (unsigned long) new_rate);
+    pa_drift_controller_update(u->drift, pa_rtclock_now(), error);
+    new_rate = (double) base_rate * pa_drift_controller_get_ratio(u->drift);
+
+    pa_sink_input_set_rate_frac(u->sink_input, new_rate);
+    pa_log_debug("[%s] Updated sampling rate to %0.3f Hz, estimated drift is %0.1f ppm.",
+                 u->sink_input->sink->name, new_rate, pa_drift_controller_get_drift_ppm(u->drift));
 
     pa_core_rttime_restart(u->core, u->time_event, pa_rtclock_now() + u->adjust_time);
 }
@@ -387,6 +388,9 @@ static void source_output_moving_cb(pa_source_output *o, pa_source *dest) {
 
     pa_sink_input_update_proplist(u->sink_input, PA_UPDATE_REPLACE, p);
     pa_proplist_free(p);
+
+    /* The new source has a clock of its own */
+    pa_drift_controller_reset(u->drift);
 }
 
 /* Called from output thread context */
@@ -628,6 +632,9 @@ static void sink_input_moving_cb(pa_sink_input *i, pa_sink *dest) {
 
     pa_source_output_update_proplist(u->source_output, PA_UPDATE_REPLACE, p);
     pa_proplist_free(p);
+
+    /* The new sink has a clock of its own */
+    pa_drift_controller_reset(u->drift);
 }
 
 /* Called from main thread */
@@ -712,6 +719,8 @@ int pa__init(pa_module *m) {
     else
         u->adjust_time = DEFAULT_ADJUST_TIME_USEC;
 
+    u->drift = pa_drift_controller_new(DRIFT_TIME_CONSTANT * (u->adjust_time > 0 ? u->adjust_time : DEFAULT_ADJUST_TIME_USEC));
+
     pa_sink_input_new_data_init(&sink_input_data);
     sink_input_data.driver = __FILE__;
     sink_input_data.module = m;
@@ -870,5 +879,8 @@ void pa__done(pa_module*m) {
     if (u->asyncmsgq)
         pa_asyncmsgq_unref(u->asyncmsgq);
 
+    if (u->drift)
+        pa_drift_controller_free(u->drift);
+
     pa_xfree(u);
 }
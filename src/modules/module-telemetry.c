@@ -0,0 +1,377 @@
+/***
+  This file is part of PulseAudio.
+
+  PulseAudio is free software; you can redistribute it and/or modify
+  it under the terms of the GNU Lesser General Public License as published
+  by the Free Software Foundation; either version 2.1 of the License,
+  or (at your option) any later version.
+
+  PulseAudio is distributed in the hope that it will be useful, but
+  WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+  General Public License for more details.
+
+  You should have received a copy of the GNU Lesser General Public License
+  along with PulseAudio; if not, write to the Free Software
+  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307
+  USA.
+***/
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include <pulse/xmalloc.h>
+#include <pulse/rtclock.h>
+#include <pulse/timeval.h>
+#include <pulse/proplist.h>
+#include <pulse/ext-telemetry.h>
+
+#include <pulsecore/module.h>
+#include <pulsecore/modargs.h>
+#include <pulsecore/log.h>
+#include <pulsecore/sink.h>
+#include <pulsecore/source.h>
+#include <pulsecore/sink-input.h>
+#include <pulsecore/source-output.h>
+#include <pulsecore/protocol-native.h>
+#include <pulsecore/pstream.h>
+#include <pulsecore/pstream-util.h>
+#include <pulsecore/tagstruct.h>
+#include <pulsecore/telemetry.h>
+
+#include "module-telemetry-symdef.h"
+
+PA_MODULE_AUTHOR("PulseAudio developers");
+PA_MODULE_DESCRIPTION("Latency and xrun histograms for sinks, sources and streams");
+PA_MODULE_VERSION(PACKAGE_VERSION);
+PA_MODULE_LOAD_ONCE(TRUE);
+PA_MODULE_USAGE("enable=<start recording right away?>");
+
+/* The IO threads record into rings of PA_TELEMETRY_RING_SIZE
+ * entries. Empty them often enough that they don't overflow. */
+#define COLLECT_INTERVAL (250 * PA_USEC_PER_MSEC)
+
+#define EXT_VERSION 1
+
+static const char* const valid_modargs[] = {
+    "enable",
+    NULL
+};
+
+struct userdata {
+    pa_core *core;
+    pa_module *module;
+
+    pa_hook_slot
+        *sink_put_hook_slot,
+        *source_put_hook_slot,
+        *sink_input_put_hook_slot,
+        *source_output_put_hook_slot;
+
+    pa_time_event *collect_time_event;
+    pa_native_protocol *protocol;
+
+    pa_bool_t enabled;
+};
+
+/* Protocol extension commands */
+enum {
+    SUBCOMMAND_TEST,
+    SUBCOMMAND_ENABLE,
+    SUBCOMMAND_RESET,
+    SUBCOMMAND_READ
+};
+
+static void for_each_telemetry(struct userdata *u, void (*cb)(pa_telemetry *t, void *userdata), void *userdata) {
+    pa_sink *sink;
+    pa_source *source;
+    pa_sink_input *si;
+    pa_source_output *so;
+    uint32_t idx;
+
+    PA_IDXSET_FOREACH(sink, u->core->sinks, idx)
+        cb(sink->telemetry, userdata);
+
+    PA_IDXSET_FOREACH(source, u->core->sources, idx)
+        cb(source->telemetry, userdata);
+
+    PA_IDXSET_FOREACH(si, u->core->sink_inputs, idx)
+        cb(si->telemetry, userdata);
+
+    PA_IDXSET_FOREACH(so, u->core->source_outputs, idx)
+        cb(so->telemetry, userdata);
+}
+
+static void collect_cb(pa_telemetry *t, void *userdata) {
+    pa_telemetry_collect(t);
+}
+
+static void reset_cb(pa_telemetry *t, void *userdata) {
+    pa_telemetry_reset(t);
+}
+
+static void enable_cb(pa_telemetry *t, void *userdata) {
+    pa_telemetry_set_enabled(t, *(pa_bool_t*) userdata);
+}
+
+static void collect_time_callback(pa_mainloop_api *a, pa_time_event *e, const struct timeval *t, void *userdata) {
+    struct userdata *u = userdata;
+
+    pa_assert(u);
+    pa_assert(e == u->collect_time_event);
+
+    for_each_telemetry(u, collect_cb, NULL);
+
+    pa_core_rttime_restart(u->core, e, pa_rtclock_now() + COLLECT_INTERVAL);
+}
+
+static void set_enabled(struct userdata *u, pa_bool_t enabled) {
+    pa_assert(u);
+
+    if (u->enabled == enabled)
+        return;
+
+    u->enabled = enabled;
+
+    if (!enabled) {
+        /* Keep what has been recorded until now, so that it can still
+         * be read */
+        for_each_telemetry(u, collect_cb, NULL);
+
+        if (u->collect_time_event) {
+            u->core->mainloop->time_free(u->collect_time_event);
+            u->collect_time_event = NULL;
+        }
+    } else if (!u->collect_time_event)
+        u->collect_time_event = pa_core_rttime_new(u->core, pa_rtclock_now() + COLLECT_INTERVAL, collect_time_callback, u);
+
+    for_each_telemetry(u, enable_cb, &enabled);
+
+    pa_log_info("Telemetry %s.", enabled ? "enabled" : "disabled");
+}
+
+static void put_info(pa_tagstruct *reply, pa_ext_telemetry_object_type_t type, uint32_t idx, const char *name, pa_telemetry *t) {
+    unsigned m, b;
+
+    pa_telemetry_collect(t);
+
+    pa_tagstruct_putu32(reply, type);
+    pa_tagstruct_putu32(reply, idx);
+    pa_tagstruct_puts(reply, name);
+    pa_tagstruct_putu32(reply, pa_telemetry_get_dropped(t));
+
+    pa_tagstruct_putu32(reply, PA_TELEMETRY_MAX);
+    for (m = 0; m < PA_TELEMETRY_MAX; m++) {
+        const pa_telemetry_histogram *h = pa_telemetry_get_histogram(t, m);
+
+        pa_tagstruct_putu64(reply, h->count);
+        pa_tagstruct_putu64(reply, h->sum);
+        pa_tagstruct_putu32(reply, h->max);
+
+        pa_tagstruct_putu32(reply, PA_TELEMETRY_BUCKETS);
+        for (b = 0; b < PA_TELEMETRY_BUCKETS; b++)
+            pa_tagstruct_putu32(reply, h->buckets[b]);
+    }
+}
+
+static void read_all(struct userdata *u, pa_tagstruct *reply) {
+    pa_sink *sink;
+    pa_source *source;
+    pa_sink_input *si;
+    pa_source_output *so;
+    uint32_t idx;
+
+    pa_tagstruct_put_boolean(reply, u->enabled);
+
+    PA_IDXSET_FOREACH(sink, u->core->sinks, idx)
+        put_info(reply, PA_EXT_TELEMETRY_SINK, sink->index, sink->name, sink->telemetry);
+
+    PA_IDXSET_FOREACH(source, u->core->sources, idx)
+        put_info(reply, PA_EXT_TELEMETRY_SOURCE, source->index, source->name, source->telemetry);
+
+    PA_IDXSET_FOREACH(si, u->core->sink_inputs, idx)
+        put_info(reply, PA_EXT_TELEMETRY_SINK_INPUT, si->index, pa_proplist_gets(si->proplist, PA_PROP_MEDIA_NAME), si->telemetry);
+
+    PA_IDXSET_FOREACH(so, u->core->source_outputs, idx)
+        put_info(reply, PA_EXT_TELEMETRY_SOURCE_OUTPUT, so->index, pa_proplist_gets(so->proplist, PA_PROP_MEDIA_NAME), so->telemetry);
+}
+
+static int extension_cb(pa_native_protocol *p, pa_module *m, pa_native_connection *c, uint32_t tag, pa_tagstruct *t) {
+    struct userdata *u;
+    uint32_t command;
+    pa_tagstruct *reply = NULL;
+
+    pa_assert(p);
+    pa_assert(m);
+    pa_assert(c);
+    pa_assert(t);
+
+    u = m->userdata;
+
+    if (pa_tagstruct_getu32(t, &command) < 0)
+        goto fail;
+
+    reply = pa_tagstruct_new(NULL, 0);
+    pa_tagstruct_putu32(reply, PA_COMMAND_REPLY);
+    pa_tagstruct_putu32(reply, tag);
+
+    switch (command) {
+        case SUBCOMMAND_TEST: {
+            if (!pa_tagstruct_eof(t))
+                goto fail;
+
+            pa_tagstruct_putu32(reply, EXT_VERSION);
+            break;
+        }
+
+        case SUBCOMMAND_ENABLE: {
+            pa_bool_t enabled;
+
+            if (pa_tagstruct_get_boolean(t, &enabled) < 0 ||
+                !pa_tagstruct_eof(t))
+                goto fail;
+
+            set_enabled(u, enabled);
+            break;
+        }
+
+        case SUBCOMMAND_RESET: {
+            if (!pa_tagstruct_eof(t))
+                goto fail;
+
+            for_each_telemetry(u, reset_cb, NULL);
+            break;
+        }
+
+        case SUBCOMMAND_READ: {
+            if (!pa_tagstruct_eof(t))
+                goto fail;
+
+            read_all(u, reply);
+            break;
+        }
+
+        default:
+            goto fail;
+    }
+
+    pa_pstream_send_tagstruct(pa_native_connection_get_pstream(c), reply);
+    return 0;
+
+fail:
+
+    if (reply)
+        pa_tagstruct_free(reply);
+
+    return -1;
+}
+
+static pa_hook_result_t sink_put_hook_callback(pa_core *c, pa_sink *sink, struct userdata *u) {
+    pa_assert(sink);
+    pa_assert(u);
+
+    pa_telemetry_set_enabled(sink->telemetry, u->enabled);
+    return PA_HOOK_OK;
+}
+
+static pa_hook_result_t source_put_hook_callback(pa_core *c, pa_source *source, struct userdata *u) {
+    pa_assert(source);
+    pa_assert(u);
+
+    pa_telemetry_set_enabled(source->telemetry, u->enabled);
+    return PA_HOOK_OK;
+}
+
+static pa_hook_result_t sink_input_put_hook_callback(pa_core *c, pa_sink_input *si, struct userdata *u) {
+    pa_assert(si);
+    pa_assert(u);
+
+    pa_telemetry_set_enabled(si->telemetry, u->enabled);
+    return PA_HOOK_OK;
+}
+
+static pa_hook_result_t source_output_put_hook_callback(pa_core *c, pa_source_output *so, struct userdata *u) {
+    pa_assert(so);
+    pa_assert(u);
+
+    pa_telemetry_set_enabled(so->telemetry, u->enabled);
+    return PA_HOOK_OK;
+}
+
+int pa__init(pa_module*m) {
+    pa_modargs *ma = NULL;
+    struct userdata *u;
+    pa_bool_t enable = FALSE;
+
+    pa_assert(m);
+
+    /* The wire format is described by the public constants */
+    pa_assert_cc(PA_TELEMETRY_MAX == (int) PA_EXT_TELEMETRY_METRIC_MAX);
+    pa_assert_cc(PA_TELEMETRY_BUCKETS == PA_EXT_TELEMETRY_BUCKETS);
+    pa_assert_cc(PA_TELEMETRY_XRUN == (int) PA_EXT_TELEMETRY_XRUN);
+
+    if (!(ma = pa_modargs_new(m->argument, valid_modargs))) {
+        pa_log("Failed to parse module arguments");
+        goto fail;
+    }
+
+    if (pa_modargs_get_value_boolean(ma, "enable", &enable) < 0) {
+        pa_log("enable= expects a boolean argument");
+        goto fail;
+    }
+
+    m->userdata = u = pa_xnew0(struct userdata, 1);
+    u->core = m->core;
+    u->module = m;
+
+    u->protocol = pa_native_protocol_get(m->core);
+    pa_native_protocol_install_ext(u->protocol, m, extension_cb);
+
+    /* Objects start out disabled, switch new ones on if we are
+     * recording */
+    u->sink_put_hook_slot = pa_hook_connect(&m->core->hooks[PA_CORE_HOOK_SINK_PUT], PA_HOOK_EARLY, (pa_hook_cb_t) sink_put_hook_callback, u);
+    u->source_put_hook_slot = pa_hook_connect(&m->core->hooks[PA_CORE_HOOK_SOURCE_PUT], PA_HOOK_EARLY, (pa_hook_cb_t) source_put_hook_callback, u);
+    u->sink_input_put_hook_slot = pa_hook_connect(&m->core->hooks[PA_CORE_HOOK_SINK_INPUT_PUT], PA_HOOK_EARLY, (pa_hook_cb_t) sink_input_put_hook_callback, u);
+    u->source_output_put_hook_slot = pa_hook_connect(&m->core->hooks[PA_CORE_HOOK_SOURCE_OUTPUT_PUT], PA_HOOK_EARLY, (pa_hook_cb_t) source_output_put_hook_callback, u);
+
+    set_enabled(u, enable);
+
+    pa_modargs_free(ma);
+    return 0;
+
+fail:
+    pa__done(m);
+
+    if (ma)
+        pa_modargs_free(ma);
+
+    return -1;
+}
+
+void pa__done(pa_module*m) {
+    struct userdata* u;
+
+    pa_assert(m);
+
+    if (!(u = m->userdata))
+        return;
+
+    set_enabled(u, FALSE);
+
+    if (u->sink_put_hook_slot)
+        pa_hook_slot_free(u->sink_put_hook_slot);
+    if (u->source_put_hook_slot)
+        pa_hook_slot_free(u->source_put_hook_slot);
+    if (u->sink_input_put_hook_slot)
+        pa_hook_slot_free(u->sink_input_put_hook_slot);
+    if (u->source_output_put_hook_slot)
+        pa_hook_slot_free(u->source_output_put_hook_slot);
+
+    if (u->protocol) {
+        pa_native_protocol_remove_ext(u->protocol, m);
+        pa_native_protocol_unref(u->protocol);
+    }
+
+    pa_xfree(u);
+}
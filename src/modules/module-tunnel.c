@@ -54,6 +54,7 @@
 #include <pulsecore/proplist-util.h>
 #include <pulsecore/auth-cookie.h>
 #include <pulsecore/mcalign.h>
+#include <pulsecore/lpc-codec.h>
 
 #ifdef TUNNEL_SINK
 #include "module-tunnel-sink-symdef.h"
@@ -72,7 +73,8 @@ PA_MODULE_USAGE(
         "format=<sample format> "
         "channels=<number of channels> "
         "rate=<sample rate> "
-        "channel_map=<channel map>");
+        "channel_map=<channel map> "
+        "compression=<none or lossless>");
 #else
 PA_MODULE_DESCRIPTION("Tunnel module for sources");
 PA_MODULE_USAGE(
@@ -101,6 +103,7 @@ static const char* const valid_modargs[] = {
     "sink_name",
     "sink_properties",
     "sink",
+    "compression",
 #else
     "source_name",
     "source_properties",
@@ -122,6 +125,7 @@ enum {
     SINK_MESSAGE_REQUEST = PA_SINK_MESSAGE_MAX,
     SINK_MESSAGE_REMOTE_SUSPEND,
     SINK_MESSAGE_UPDATE_LATENCY,
+    SINK_MESSAGE_INVALIDATE_TIMING,
     SINK_MESSAGE_POST
 };
 
@@ -190,6 +194,19 @@ struct userdata {
     char *sink_name;
     pa_sink *sink;
     size_t requested_bytes;
+
+    /* The remote's playback position as derived from its data
+     * requests, maintained in the IO thread */
+    pa_bool_t request_timing_armed:1;
+    pa_bool_t request_timing_valid:1;
+    pa_usec_t request_timing_base;
+    uint64_t request_timing_bytes;
+
+    /* Whether compression was asked for, and whether the server
+     * agreed to it. In the latter case we send compressed packets,
+     * encoded in the IO thread. */
+    pa_bool_t compress;
+    pa_bool_t lpc;
 #else
     char *source_name;
     pa_source *source;
@@ -413,6 +430,47 @@ static void check_smoother_status(struct userdata *u, pa_bool_t past) {
         pa_smoother_resume(u->smoother, x, TRUE);
 }
 
+#ifdef TUNNEL_SINK
+/* Called from IO thread context */
+static void request_timing_invalidate(struct userdata *u) {
+    pa_assert(u);
+
+    u->request_timing_armed = FALSE;
+    u->request_timing_valid = FALSE;
+}
+
+/* Called from IO thread context */
+static void request_timing_update(struct userdata *u, size_t nbytes) {
+    pa_usec_t x;
+
+    pa_assert(u);
+
+    if (u->remote_corked || u->remote_suspended)
+        return;
+
+    /* While playing, the remote asks for exactly as much data as it
+     * consumed since its last request. So after each request its
+     * read index has moved on by the sum of all requests since the
+     * first one we saw after the last latency update, which gives
+     * us a smoother data point without asking for it. */
+
+    x = pa_rtclock_now();
+    x = x > u->thread_transport_usec ? x - u->thread_transport_usec : 0;
+
+    if (u->request_timing_valid) {
+        u->request_timing_bytes += nbytes;
+        pa_smoother_put(u->smoother, x, u->request_timing_base + pa_bytes_to_usec(u->request_timing_bytes, &u->sink->sample_spec));
+
+    } else if (u->request_timing_armed) {
+        /* The first request may include data consumed before the
+         * latency update, so it only serves as the base */
+        u->request_timing_base = pa_smoother_get(u->smoother, x);
+        u->request_timing_bytes = 0;
+        u->request_timing_valid = TRUE;
+    }
+}
+#endif
+
 /* Called from IO thread context */
 static void stream_cork_within_thread(struct userdata *u, pa_bool_t cork) {
     pa_assert(u);
@@ -422,6 +480,10 @@ static void stream_cork_within_thread(struct userdata *u, pa_bool_t cork) {
 
     u->remote_corked = cork;
     check_smoother_status(u, FALSE);
+
+#ifdef TUNNEL_SINK
+    request_timing_invalidate(u);
+#endif
 }
 
 /* Called from main context */
@@ -455,19 +517,48 @@ static void stream_suspend_within_thread(struct userdata *u, pa_bool_t suspend)
 
     u->remote_suspended = suspend;
     check_smoother_status(u, TRUE);
+
+#ifdef TUNNEL_SINK
+    request_timing_invalidate(u);
+#endif
 }
 
 #ifdef TUNNEL_SINK
 
 /* Called from IO thread context */
 static void send_data(struct userdata *u) {
+    size_t max_block;
+
     pa_assert(u);
 
+    if (u->requested_bytes <= 0)
+        return;
+
+    if (PA_UNLIKELY(u->sink->thread_info.rewind_requested))
+        pa_sink_process_rewind(u->sink, 0);
+
+    if (u->lpc)
+        max_block = pa_lpc_max_input(u->core->mempool, &u->sink->sample_spec);
+    else
+        max_block = pa_frame_align(pa_mempool_block_size_max(u->core->mempool), &u->sink->sample_spec);
+
+    /* Render each request into as few blocks as possible, so that the
+     * main thread is woken up and has to queue a packet only once
+     * per block instead of once per mixed chunk */
     while (u->requested_bytes > 0) {
         pa_memchunk memchunk;
 
-        pa_sink_render(u->sink, u->requested_bytes, &memchunk);
-        pa_asyncmsgq_post(u->thread_mq.outq, PA_MSGOBJECT(u->sink), SINK_MESSAGE_POST, NULL, 0, &memchunk, NULL);
+        pa_sink_render_full(u->sink, PA_MIN(u->requested_bytes, max_block), &memchunk);
+
+        if (u->lpc) {
+            pa_memchunk encoded;
+
+            pa_lpc_encode_memchunk(u->core->mempool, &u->sink->sample_spec, &memchunk, &encoded);
+            pa_asyncmsgq_post(u->thread_mq.outq, PA_MSGOBJECT(u->sink), SINK_MESSAGE_POST, NULL, (int64_t) memchunk.length, &encoded, NULL);
+            pa_memblock_unref(encoded.memblock);
+        } else
+            pa_asyncmsgq_post(u->thread_mq.outq, PA_MSGOBJECT(u->sink), SINK_MESSAGE_POST, NULL, (int64_t) memchunk.length, &memchunk, NULL);
+
         pa_memblock_unref(memchunk.memblock);
 
         u->requested_bytes -= memchunk.length;
@@ -512,6 +603,8 @@ static int sink_process_msg(pa_msgobject *o, int code, void *data, int64_t offse
             pa_assert(offset > 0);
             u->requested_bytes += (size_t) offset;
 
+            request_timing_update(u, (size_t) offset);
+
             if (PA_SINK_IS_OPENED(u->sink->thread_info.state))
                 send_data(u);
 
@@ -539,9 +632,18 @@ static int sink_process_msg(pa_msgobject *o, int code, void *data, int64_t offse
             /* We can access this freely here, since the main thread is waiting for us */
             u->thread_transport_usec = u->transport_usec;
 
+            /* Continue from here with the timing of the next requests */
+            request_timing_invalidate(u);
+            u->request_timing_armed = TRUE;
+
             return 0;
         }
 
+        case SINK_MESSAGE_INVALIDATE_TIMING:
+
+            request_timing_invalidate(u);
+            return 0;
+
         case SINK_MESSAGE_POST:
 
             /* OK, This might be a bit confusing. This message is
@@ -551,7 +653,9 @@ static int sink_process_msg(pa_msgobject *o, int code, void *data, int64_t offse
 
             pa_pstream_send_memblock(u->pstream, u->channel, 0, PA_SEEK_RELATIVE, chunk);
 
-            u->counter_delta += (int64_t) chunk->length;
+            /* offset is the length of the PCM data, which differs
+             * from the chunk length when we compress */
+            u->counter_delta += offset;
 
             return 0;
     }
@@ -884,6 +988,14 @@ static void request_latency(struct userdata *u) {
 
     u->ignore_latency_before = tag;
     u->counter_delta = 0;
+
+#ifdef TUNNEL_SINK
+    /* Whatever made us ask might have disturbed the regular request
+     * pattern, so don't derive timing from requests until the reply
+     * is in */
+    if (u->sink)
+        pa_asyncmsgq_post(u->sink->asyncmsgq, PA_MSGOBJECT(u->sink), SINK_MESSAGE_INVALIDATE_TIMING, NULL, 0, NULL, NULL);
+#endif
 }
 
 /* Called from main context */
@@ -1541,6 +1653,13 @@ static void create_stream_callback(pa_pdispatch *pd, uint32_t command,  uint32_t
             goto parse_error;
         }
 
+#ifdef TUNNEL_SINK
+        u->lpc = pa_lpc_format_info_is_lpc(format);
+
+        if (u->lpc)
+            pa_log_info("Using lossless compression.");
+#endif
+
         pa_format_info_free(format);
     }
 
@@ -1746,8 +1865,22 @@ static void setup_complete_callback(pa_pdispatch *pd, uint32_t command, uint32_t
 
 #ifdef TUNNEL_SINK
     if (u->version >= 21) {
-        /* We're not using the extended API, so n_formats = 0 and that's that */
-        pa_tagstruct_putu8(reply, 0);
+        if (u->compress && u->version >= 27) {
+            pa_format_info *f;
+
+            f = pa_format_info_from_sample_spec(&u->sink->sample_spec, &u->sink->channel_map);
+            pa_lpc_format_info_set(f);
+
+            pa_tagstruct_putu8(reply, 1);
+            pa_tagstruct_put_format_info(reply, f);
+            pa_format_info_free(f);
+        } else {
+            if (u->compress)
+                pa_log_info("Server doesn't support compression, sending uncompressed data.");
+
+            /* We're not using the extended API, so n_formats = 0 and that's that */
+            pa_tagstruct_putu8(reply, 0);
+        }
     }
 #else
     if (u->version >= 22) {
@@ -1926,6 +2059,7 @@ int pa__init(pa_module*m) {
     char *dn = NULL;
 #ifdef TUNNEL_SINK
     pa_sink_new_data data;
+    const char *compression;
 #else
     pa_source_new_data data;
 #endif
@@ -1986,6 +2120,22 @@ int pa__init(pa_module*m) {
         goto fail;
     }
 
+#ifdef TUNNEL_SINK
+    if ((compression = pa_modargs_get_value(ma, "compression", NULL))) {
+        if (pa_streq(compression, "lossless"))
+            u->compress = TRUE;
+        else if (!pa_streq(compression, "none")) {
+            pa_log("Invalid compression mode '%s'", compression);
+            goto fail;
+        }
+    }
+
+    if (u->compress && ss.format != PA_SAMPLE_S16NE) {
+        pa_log_warn("Compression is only available for %s, sending uncompressed data.", pa_sample_format_to_string(PA_SAMPLE_S16NE));
+        u->compress = FALSE;
+    }
+#endif
+
     if (!(u->client = pa_socket_client_new_string(m->core->mainloop, TRUE, u->server_name, PA_NATIVE_DEFAULT_PORT))) {
         pa_log("Failed to connect to server '%s'", u->server_name);
         goto fail;
@@ -227,6 +227,16 @@ static int sink_input_pop_cb(pa_sink_input *i, size_t nbytes, pa_memchunk *chunk
     tchunk.length = PA_MIN(nbytes, tchunk.length);
     pa_assert(tchunk.length > 0);
 
+    /* (2b) A FILTER WHOSE OUTPUT IS SILENT FOR SILENT INPUT (POSSIBLY
+     * ONCE ITS TAIL HAS DECAYED) SHOULD PASS SILENCE ON AS IT IS. THE
+     * BLOCK KEEPS ITS SILENCE FLAG, AND THE MASTER SINK WON'T EVEN
+     * MIX IT. */
+    if (pa_memblock_is_silence(tchunk.memblock)) {
+        *chunk = tchunk;
+        pa_memblockq_drop(u->memblockq, chunk->length);
+        return 0;
+    }
+
     fs = pa_frame_size(&i->sample_spec);
     n = (unsigned) (tchunk.length / fs);
 
@@ -52,6 +52,8 @@
 
 #include <pulse/xmalloc.h>
 #include <pulse/util.h>
+#include <pulse/rtclock.h>
+#include <pulse/timeval.h>
 
 #include <pulsecore/core-error.h>
 #include <pulsecore/thread.h>
@@ -66,6 +68,7 @@
 #include <pulsecore/thread-mq.h>
 #include <pulsecore/rtpoll.h>
 #include <pulsecore/poll.h>
+#include <pulsecore/time-smoother.h>
 
 #if defined(__NetBSD__) && !defined(SNDCTL_DSP_GETODELAY)
 #include <sys/audioio.h>
@@ -93,13 +96,30 @@ PA_MODULE_USAGE(
         "channel_map=<channel map> "
         "fragments=<number of fragments> "
         "fragment_size=<fragment size> "
-        "mmap=<enable memory mapping?>");
+        "mmap=<enable memory mapping?> "
+        "tsched=<enable system timer based scheduling mode?>");
 #ifdef __linux__
 PA_MODULE_DEPRECATED("Please use module-alsa-card instead of module-oss!");
 #endif
 
 #define DEFAULT_DEVICE "/dev/dsp"
 
+#define DEFAULT_TSCHED_WATERMARK_USEC (20*PA_USEC_PER_MSEC)        /* 20ms  -- Fill up when only this much is left in the buffer */
+
+#define TSCHED_WATERMARK_INC_STEP_USEC (10*PA_USEC_PER_MSEC)       /* 10ms  -- On underrun, increase watermark by this */
+#define TSCHED_WATERMARK_DEC_STEP_USEC (5*PA_USEC_PER_MSEC)        /* 5ms   -- When everything's great, decrease watermark by this */
+#define TSCHED_WATERMARK_VERIFY_AFTER_USEC (20*PA_USEC_PER_SEC)    /* 20s   -- How long after a drop out recheck if things are good now */
+#define TSCHED_WATERMARK_DEC_THRESHOLD_USEC (100*PA_USEC_PER_MSEC) /* 100ms -- If the buffer level didn't drop below this threshold in the verification time, decrease the watermark */
+
+#define TSCHED_MIN_SLEEP_USEC (10*PA_USEC_PER_MSEC)                /* 10ms  -- Sleep at least 10ms on each iteration */
+#define TSCHED_MIN_WAKEUP_USEC (4*PA_USEC_PER_MSEC)                /* 4ms   -- Wakeup at least this long before the buffer runs empty*/
+
+#define SMOOTHER_WINDOW_USEC  (10*PA_USEC_PER_SEC)                 /* 10s   -- smoother windows size */
+#define SMOOTHER_ADJUST_USEC  (1*PA_USEC_PER_SEC)                  /* 1s    -- smoother adjust time */
+
+#define SMOOTHER_MIN_INTERVAL (2*PA_USEC_PER_MSEC)                 /* 2ms   -- min smoother update interval */
+#define SMOOTHER_MAX_INTERVAL (200*PA_USEC_PER_MSEC)               /* 200ms -- max smoother update interval */
+
 struct userdata {
     pa_core *core;
     pa_module *module;
@@ -136,6 +156,20 @@ struct userdata {
 
     int in_mmap_saved_nfrags, out_mmap_saved_nfrags;
 
+    /* Timer based scheduling of mmap playback. The play position is
+     * taken from SNDCTL_DSP_GETOPTR, which many drivers only advance
+     * once per fragment, hence the smoother and a rewind safeguard of
+     * one fragment. */
+    pa_bool_t use_tsched, first;
+    uint64_t write_count, play_count;
+    int last_bytes, last_ptr;
+    size_t hwbuf_unused, min_sleep, min_wakeup, tsched_watermark, watermark_inc_step, watermark_dec_step, watermark_dec_threshold, rewind_safeguard;
+    pa_usec_t watermark_dec_not_before;
+
+    pa_smoother *smoother;
+    pa_usec_t smoother_interval;
+    pa_usec_t last_smoother_update;
+
     pa_rtpoll_item *rtpoll_item;
 };
 
@@ -154,6 +188,7 @@ static const char* const valid_modargs[] = {
     "channels",
     "channel_map",
     "mmap",
+    "tsched",
     NULL
 };
 
@@ -376,6 +411,302 @@ static pa_usec_t mmap_sink_get_latency(struct userdata *u) {
     return pa_bytes_to_usec(n, &u->sink->sample_spec);
 }
 
+static void fix_min_sleep_wakeup(struct userdata *u) {
+    size_t max_use, max_use_2;
+
+    pa_assert(u);
+    pa_assert(u->use_tsched);
+
+    max_use = u->out_hwbuf_size - u->hwbuf_unused;
+    max_use_2 = pa_frame_align(max_use/2, &u->sink->sample_spec);
+
+    u->min_sleep = pa_usec_to_bytes(TSCHED_MIN_SLEEP_USEC, &u->sink->sample_spec);
+    u->min_sleep = PA_CLAMP(u->min_sleep, u->frame_size, max_use_2);
+
+    u->min_wakeup = pa_usec_to_bytes(TSCHED_MIN_WAKEUP_USEC, &u->sink->sample_spec);
+    u->min_wakeup = PA_CLAMP(u->min_wakeup, u->frame_size, max_use_2);
+}
+
+static void fix_tsched_watermark(struct userdata *u) {
+    size_t max_use;
+
+    pa_assert(u);
+    pa_assert(u->use_tsched);
+
+    max_use = u->out_hwbuf_size - u->hwbuf_unused;
+
+    if (u->tsched_watermark > max_use - u->min_sleep)
+        u->tsched_watermark = max_use - u->min_sleep;
+
+    if (u->tsched_watermark < u->min_wakeup)
+        u->tsched_watermark = u->min_wakeup;
+}
+
+static void increase_watermark(struct userdata *u) {
+    size_t old_watermark;
+    pa_usec_t old_min_latency, new_min_latency;
+
+    pa_assert(u);
+    pa_assert(u->use_tsched);
+
+    /* First, just try to increase the watermark */
+    old_watermark = u->tsched_watermark;
+    u->tsched_watermark = PA_MIN(u->tsched_watermark * 2, u->tsched_watermark + u->watermark_inc_step);
+    fix_tsched_watermark(u);
+
+    if (old_watermark != u->tsched_watermark) {
+        pa_log_info("Increasing wakeup watermark to %0.2f ms",
+                    (double) pa_bytes_to_usec(u->tsched_watermark, &u->sink->sample_spec) / PA_USEC_PER_MSEC);
+        return;
+    }
+
+    /* Hmm, we cannot increase the watermark any further, hence let's
+       raise the latency */
+    old_min_latency = u->sink->thread_info.min_latency;
+    new_min_latency = PA_MIN(old_min_latency * 2, old_min_latency + TSCHED_WATERMARK_INC_STEP_USEC);
+    new_min_latency = PA_MIN(new_min_latency, u->sink->thread_info.max_latency);
+
+    if (old_min_latency != new_min_latency) {
+        pa_log_info("Increasing minimal latency to %0.2f ms",
+                    (double) new_min_latency / PA_USEC_PER_MSEC);
+
+        pa_sink_set_latency_range_within_thread(u->sink, new_min_latency, u->sink->thread_info.max_latency);
+    }
+}
+
+static void decrease_watermark(struct userdata *u) {
+    size_t old_watermark;
+    pa_usec_t now;
+
+    pa_assert(u);
+    pa_assert(u->use_tsched);
+
+    now = pa_rtclock_now();
+
+    if (u->watermark_dec_not_before <= 0)
+        goto restart;
+
+    if (u->watermark_dec_not_before > now)
+        return;
+
+    old_watermark = u->tsched_watermark;
+
+    if (u->tsched_watermark < u->watermark_dec_step)
+        u->tsched_watermark = u->tsched_watermark / 2;
+    else
+        u->tsched_watermark = PA_MAX(u->tsched_watermark / 2, u->tsched_watermark - u->watermark_dec_step);
+
+    fix_tsched_watermark(u);
+
+    if (old_watermark != u->tsched_watermark)
+        pa_log_info("Decreasing wakeup watermark to %0.2f ms",
+                    (double) pa_bytes_to_usec(u->tsched_watermark, &u->sink->sample_spec) / PA_USEC_PER_MSEC);
+
+restart:
+    u->watermark_dec_not_before = now + TSCHED_WATERMARK_VERIFY_AFTER_USEC;
+}
+
+static void silence_out_mmap(struct userdata *u, size_t index, size_t length) {
+    pa_assert(u);
+    pa_assert(index < u->out_hwbuf_size);
+    pa_assert(length <= u->out_hwbuf_size);
+
+    if (length <= 0)
+        return;
+
+    if (index + length > u->out_hwbuf_size) {
+        pa_silence_memory((uint8_t*) u->out_mmap + index, u->out_hwbuf_size - index, &u->sink->sample_spec);
+        length -= u->out_hwbuf_size - index;
+        index = 0;
+    }
+
+    pa_silence_memory((uint8_t*) u->out_mmap + index, length, &u->sink->sample_spec);
+}
+
+/* Called from IO context */
+static int update_play_position(struct userdata *u, pa_bool_t *underrun) {
+    struct count_info info;
+    size_t n;
+
+    pa_assert(u);
+    pa_assert(u->use_tsched);
+
+    if (ioctl(u->fd, SNDCTL_DSP_GETOPTR, &info) < 0) {
+        pa_log("SNDCTL_DSP_GETOPTR: %s", pa_cstrerror(errno));
+        return -1;
+    }
+
+    if (u->first) {
+        u->last_bytes = info.bytes;
+        u->last_ptr = info.ptr;
+        u->play_count = u->write_count = 0;
+        return 0;
+    }
+
+    /* The byte counter is a plain int, hence let it wrap around */
+    n = (size_t) ((uint32_t) info.bytes - (uint32_t) u->last_bytes);
+
+    /* Whatever the DMA went past is silenced right away, so that
+     * after an underrun the card plays silence instead of looping
+     * through stale data. */
+    if (n >= u->out_hwbuf_size)
+        silence_out_mmap(u, 0, u->out_hwbuf_size);
+    else
+        silence_out_mmap(u, (size_t) u->last_ptr, ((size_t) info.ptr + u->out_hwbuf_size - (size_t) u->last_ptr) % u->out_hwbuf_size);
+
+    u->last_bytes = info.bytes;
+    u->last_ptr = info.ptr;
+    u->play_count += n;
+
+    if (u->play_count > u->write_count) {
+        if (pa_log_ratelimit(PA_LOG_INFO))
+            pa_log_info("Underrun!");
+
+        u->write_count = u->play_count;
+        increase_watermark(u);
+        *underrun = TRUE;
+    }
+
+    return 0;
+}
+
+static void update_smoother(struct userdata *u) {
+    pa_usec_t now;
+
+    pa_assert(u);
+
+    now = pa_rtclock_now();
+
+    /* check if the time since the last update is bigger than the interval */
+    if (u->last_smoother_update > 0)
+        if (u->last_smoother_update + u->smoother_interval > now)
+            return;
+
+    pa_smoother_put(u->smoother, now, pa_bytes_to_usec(u->play_count, &u->sink->sample_spec));
+
+    u->last_smoother_update = now;
+    /* exponentially increase the update interval up to the MAX limit */
+    u->smoother_interval = PA_MIN(u->smoother_interval * 2, SMOOTHER_MAX_INTERVAL);
+}
+
+/* Called from IO context */
+static int tsched_write(struct userdata *u, pa_usec_t *sleep_usec, pa_bool_t on_timeout) {
+    pa_bool_t underrun = FALSE;
+    size_t left_to_play, max_use, index;
+
+    pa_assert(u);
+    pa_assert(u->sink);
+    pa_assert(sleep_usec);
+
+    if (update_play_position(u, &underrun) < 0)
+        return -1;
+
+    if (u->first) {
+        pa_smoother_reset(u->smoother, pa_rtclock_now(), FALSE);
+        u->smoother_interval = SMOOTHER_MIN_INTERVAL;
+        u->last_smoother_update = 0;
+    }
+
+    left_to_play = (size_t) (u->write_count - u->play_count);
+
+    /* We decrease the watermark only if have actually been woken up
+     * by a timeout and the buffer never ran low in the meantime. */
+    if (underrun || u->first || left_to_play <= u->watermark_dec_threshold)
+        u->watermark_dec_not_before = 0;
+    else if (on_timeout)
+        decrease_watermark(u);
+
+    /* Fill up to what the requested latency allows, starting right
+     * behind what has already been written. The write pointer is
+     * derived from the DMA pointer, which stays valid even if the
+     * driver restarted the DMA at some other position. */
+    max_use = u->out_hwbuf_size - u->hwbuf_unused;
+    index = ((size_t) u->last_ptr + left_to_play) % u->out_hwbuf_size;
+
+    while (left_to_play < max_use) {
+        pa_memchunk chunk;
+        size_t n;
+
+        n = pa_frame_align(PA_MIN(max_use - left_to_play, u->out_hwbuf_size - index), &u->sink->sample_spec);
+
+        if (n <= 0)
+            break;
+
+        chunk.memblock = pa_memblock_new_fixed(u->core->mempool, (uint8_t*) u->out_mmap + index, n, TRUE);
+        chunk.index = 0;
+        chunk.length = n;
+
+        pa_sink_render_into_full(u->sink, &chunk);
+        pa_memblock_unref_fixed(chunk.memblock);
+
+        u->write_count += n;
+        left_to_play += n;
+        index = (index + n) % u->out_hwbuf_size;
+    }
+
+    u->first = FALSE;
+
+    update_smoother(u);
+
+    /* Wake up when only the watermark is left, but sleep at least a
+     * bit to avoid busy looping */
+    *sleep_usec = pa_bytes_to_usec(PA_MAX(left_to_play, u->tsched_watermark + u->min_sleep) - u->tsched_watermark, &u->sink->sample_spec);
+
+    return 0;
+}
+
+/* Called from IO context */
+static int process_rewind(struct userdata *u) {
+    size_t rewind_nbytes, limit_nbytes = 0;
+
+    pa_assert(u);
+    pa_assert(u->use_tsched);
+
+    rewind_nbytes = u->sink->thread_info.rewind_nbytes;
+
+    pa_log_debug("Requested to rewind %lu bytes.", (unsigned long) rewind_nbytes);
+
+    if (!u->first) {
+        pa_bool_t underrun = FALSE;
+        size_t left_to_play;
+
+        if (update_play_position(u, &underrun) < 0)
+            return -1;
+
+        /* Keep our hands off what the DMA might already be reading,
+         * the reported pointer may lag behind by up to a fragment */
+        left_to_play = (size_t) (u->write_count - u->play_count);
+
+        if (left_to_play > u->rewind_safeguard)
+            limit_nbytes = pa_frame_align(left_to_play - u->rewind_safeguard, &u->sink->sample_spec);
+    }
+
+    if (rewind_nbytes > limit_nbytes)
+        rewind_nbytes = limit_nbytes;
+
+    if (rewind_nbytes > 0) {
+        u->write_count -= rewind_nbytes;
+        pa_log_debug("Rewound %lu bytes.", (unsigned long) rewind_nbytes);
+    } else
+        pa_log_debug("Mhmm, actually there is nothing to rewind.");
+
+    pa_sink_process_rewind(u->sink, rewind_nbytes);
+    return 0;
+}
+
+static pa_usec_t tsched_sink_get_latency(struct userdata *u) {
+    int64_t delay;
+
+    pa_assert(u);
+
+    if (u->first)
+        return 0;
+
+    delay = (int64_t) pa_bytes_to_usec(u->write_count, &u->sink->sample_spec) - (int64_t) pa_smoother_get(u->smoother, pa_rtclock_now());
+
+    return delay >= 0 ? (pa_usec_t) delay : 0;
+}
+
 static pa_usec_t mmap_source_get_latency(struct userdata *u) {
     struct count_info info;
     size_t bpos, n;
@@ -648,7 +979,9 @@ static int sink_process_msg(pa_msgobject *o, int code, void *data, int64_t offse
             pa_usec_t r = 0;
 
             if (u->fd >= 0) {
-                if (u->use_mmap)
+                if (u->use_tsched)
+                    r = tsched_sink_get_latency(u);
+                else if (u->use_mmap)
                     r = mmap_sink_get_latency(u);
                 else
                     r = io_sink_get_latency(u);
@@ -666,6 +999,9 @@ static int sink_process_msg(pa_msgobject *o, int code, void *data, int64_t offse
                 case PA_SINK_SUSPENDED:
                     pa_assert(PA_SINK_IS_OPENED(u->sink->thread_info.state));
 
+                    if (u->use_tsched)
+                        pa_smoother_pause(u->smoother, pa_rtclock_now());
+
                     if (!u->source || u->source_suspended) {
                         if (suspend(u) < 0)
                             return -1;
@@ -682,6 +1018,7 @@ static int sink_process_msg(pa_msgobject *o, int code, void *data, int64_t offse
                     if (u->sink->thread_info.state == PA_SINK_INIT) {
                         do_trigger = TRUE;
                         quick = u->source && PA_SOURCE_IS_OPENED(u->source->thread_info.state);
+                        u->first = TRUE;
                     }
 
                     if (u->sink->thread_info.state == PA_SINK_SUSPENDED) {
@@ -696,6 +1033,7 @@ static int sink_process_msg(pa_msgobject *o, int code, void *data, int64_t offse
 
                         u->out_mmap_current = 0;
                         u->out_mmap_saved_nfrags = 0;
+                        u->first = TRUE;
 
                         u->sink_suspended = FALSE;
                     }
@@ -720,6 +1058,50 @@ static int sink_process_msg(pa_msgobject *o, int code, void *data, int64_t offse
     return ret;
 }
 
+/* Called from IO context */
+static void sink_update_requested_latency_cb(pa_sink *s) {
+    struct userdata *u = s->userdata;
+    pa_usec_t latency;
+    size_t before;
+
+    pa_assert(u);
+    pa_assert(u->use_tsched); /* only when timer scheduling is used
+                               * we can dynamically adjust the
+                               * latency */
+
+    before = u->hwbuf_unused;
+
+    /* Use the full buffer if no one asked us for anything specific */
+    u->hwbuf_unused = 0;
+
+    if ((latency = pa_sink_get_requested_latency_within_thread(s)) != (pa_usec_t) -1) {
+        size_t b;
+
+        pa_log_debug("Latency set to %0.2fms", (double) latency / PA_USEC_PER_MSEC);
+
+        b = pa_usec_to_bytes(latency, &s->sample_spec);
+
+        /* We need at least one sample in our buffer */
+        if (PA_UNLIKELY(b < u->frame_size))
+            b = u->frame_size;
+
+        u->hwbuf_unused = PA_LIKELY(b < u->out_hwbuf_size) ? (u->out_hwbuf_size - b) : 0;
+    }
+
+    fix_min_sleep_wakeup(u);
+    fix_tsched_watermark(u);
+
+    pa_sink_set_max_request_within_thread(s, u->out_hwbuf_size - u->hwbuf_unused);
+
+    /* If we now use a smaller part of the buffer than before,
+     * subsequent rewinds need to be relative to the new maximum fill
+     * level, so let's do a full rewind once. */
+    if (u->hwbuf_unused > before) {
+        pa_log_debug("Requesting rewind due to latency change.");
+        pa_sink_request_rewind(s, (size_t) -1);
+    }
+}
+
 static int source_process_msg(pa_msgobject *o, int code, void *data, int64_t offset, pa_memchunk *chunk) {
     struct userdata *u = PA_SOURCE(o)->userdata;
     int ret;
@@ -888,18 +1270,38 @@ static void thread_func(void *userdata) {
 
     for (;;) {
         int ret;
+        pa_usec_t rtpoll_sleep = 0;
 
 /*        pa_log("loop");    */
 
         if (u->sink && PA_SINK_IS_OPENED(u->sink->thread_info.state))
-            if (u->sink->thread_info.rewind_requested)
-                pa_sink_process_rewind(u->sink, 0);
+            if (u->sink->thread_info.rewind_requested) {
+                if (u->use_tsched) {
+                    if (process_rewind(u) < 0)
+                        goto fail;
+                } else
+                    pa_sink_process_rewind(u->sink, 0);
+            }
 
         /* Render some data and write it to the dsp */
 
         if (u->sink && PA_SINK_IS_OPENED(u->sink->thread_info.state) && ((revents & POLLOUT) || u->use_mmap || u->use_getospace)) {
 
-            if (u->use_mmap) {
+            if (u->use_tsched) {
+                pa_usec_t sleep_usec, cusec;
+
+                if (tsched_write(u, &sleep_usec, pa_rtpoll_timer_elapsed(u->rtpoll)) < 0)
+                    goto fail;
+
+                revents &= ~POLLOUT;
+
+                /* Convert from the sound card time domain to the
+                 * system time domain. We don't trust the conversion,
+                 * so we wake up whatever comes first */
+                cusec = pa_smoother_translate(u->smoother, pa_rtclock_now(), sleep_usec);
+                rtpoll_sleep = PA_MIN(sleep_usec, cusec);
+
+            } else if (u->use_mmap) {
 
                 if ((ret = mmap_write(u)) < 0)
                     goto fail;
@@ -1117,9 +1519,14 @@ static void thread_func(void *userdata) {
             pollfd = pa_rtpoll_item_get_pollfd(u->rtpoll_item, NULL);
             pollfd->events = (short)
                 (((u->source && PA_SOURCE_IS_OPENED(u->source->thread_info.state)) ? POLLIN : 0) |
-                 ((u->sink && PA_SINK_IS_OPENED(u->sink->thread_info.state)) ? POLLOUT : 0));
+                 ((u->sink && PA_SINK_IS_OPENED(u->sink->thread_info.state) && !u->use_tsched) ? POLLOUT : 0));
         }
 
+        if (rtpoll_sleep > 0)
+            pa_rtpoll_set_timer_relative(u->rtpoll, rtpoll_sleep);
+        else
+            pa_rtpoll_set_timer_disabled(u->rtpoll);
+
         /* Hmm, nothing to do. Let's sleep */
         if ((ret = pa_rtpoll_run(u->rtpoll, TRUE)) < 0)
             goto fail;
@@ -1160,7 +1567,7 @@ int pa__init(pa_module*m) {
     int fd = -1;
     int nfrags, orig_frag_size, frag_size;
     int mode, caps;
-    pa_bool_t record = TRUE, playback = TRUE, use_mmap = TRUE;
+    pa_bool_t record = TRUE, playback = TRUE, use_mmap = TRUE, use_tsched = TRUE;
     pa_sample_spec ss;
     pa_channel_map map;
     pa_modargs *ma = NULL;
@@ -1211,6 +1618,11 @@ int pa__init(pa_module*m) {
         goto fail;
     }
 
+    if (pa_modargs_get_value_boolean(ma, "tsched", &use_tsched) < 0) {
+        pa_log("Failed to parse tsched argument.");
+        goto fail;
+    }
+
     if ((fd = pa_oss_open(dev = pa_modargs_get_value(ma, "device", DEFAULT_DEVICE), &mode, &caps)) < 0)
         goto fail;
 
@@ -1363,6 +1775,15 @@ int pa__init(pa_module*m) {
             }
         }
 
+        /* Timer based scheduling needs to know where the DMA is, which
+         * only works with memory mapping */
+        if (use_tsched && !use_mmap) {
+            pa_log_info("Cannot enable timer-based scheduling without memory mapping, falling back to sound IRQ scheduling.");
+            use_tsched = FALSE;
+        }
+
+        u->use_tsched = use_tsched;
+
         if ((name = pa_modargs_get_value(ma, "sink_name", NULL)))
             namereg_fail = TRUE;
         else {
@@ -1380,7 +1801,7 @@ int pa__init(pa_module*m) {
         pa_proplist_sets(sink_new_data.proplist, PA_PROP_DEVICE_STRING, dev);
         pa_proplist_sets(sink_new_data.proplist, PA_PROP_DEVICE_API, "oss");
         pa_proplist_sets(sink_new_data.proplist, PA_PROP_DEVICE_DESCRIPTION, hwdesc[0] ? hwdesc : dev);
-        pa_proplist_sets(sink_new_data.proplist, PA_PROP_DEVICE_ACCESS_MODE, use_mmap ? "mmap" : "serial");
+        pa_proplist_sets(sink_new_data.proplist, PA_PROP_DEVICE_ACCESS_MODE, use_tsched ? "mmap+timer" : (use_mmap ? "mmap" : "serial"));
         pa_proplist_setf(sink_new_data.proplist, PA_PROP_DEVICE_BUFFERING_BUFFER_SIZE, "%lu", (unsigned long) (u->out_hwbuf_size));
         pa_proplist_setf(sink_new_data.proplist, PA_PROP_DEVICE_BUFFERING_FRAGMENT_SIZE, "%lu", (unsigned long) (u->out_fragment_size));
 
@@ -1390,7 +1811,7 @@ int pa__init(pa_module*m) {
             goto fail;
         }
 
-        u->sink = pa_sink_new(m->core, &sink_new_data, PA_SINK_HARDWARE|PA_SINK_LATENCY);
+        u->sink = pa_sink_new(m->core, &sink_new_data, PA_SINK_HARDWARE|PA_SINK_LATENCY|(use_tsched ? PA_SINK_DYNAMIC_LATENCY : 0));
         pa_sink_new_data_done(&sink_new_data);
         pa_xfree(name_buf);
 
@@ -1404,13 +1825,44 @@ int pa__init(pa_module*m) {
 
         pa_sink_set_asyncmsgq(u->sink, u->thread_mq.inq);
         pa_sink_set_rtpoll(u->sink, u->rtpoll);
-        pa_sink_set_fixed_latency(u->sink, pa_bytes_to_usec(u->out_hwbuf_size, &u->sink->sample_spec));
         u->sink->refresh_volume = TRUE;
 
         pa_sink_set_max_request(u->sink, u->out_hwbuf_size);
 
-        if (use_mmap)
-            u->out_mmap_memblocks = pa_xnew0(pa_memblock*, u->out_nfrags);
+        if (use_tsched) {
+            u->sink->update_requested_latency = sink_update_requested_latency_cb;
+
+            u->smoother = pa_smoother_new(
+                    SMOOTHER_ADJUST_USEC,
+                    SMOOTHER_WINDOW_USEC,
+                    TRUE,
+                    TRUE,
+                    5,
+                    pa_rtclock_now(),
+                    TRUE);
+            u->smoother_interval = SMOOTHER_MIN_INTERVAL;
+
+            u->tsched_watermark = pa_usec_to_bytes(DEFAULT_TSCHED_WATERMARK_USEC, &ss);
+            u->watermark_inc_step = pa_usec_to_bytes(TSCHED_WATERMARK_INC_STEP_USEC, &ss);
+            u->watermark_dec_step = pa_usec_to_bytes(TSCHED_WATERMARK_DEC_STEP_USEC, &ss);
+            u->watermark_dec_threshold = pa_usec_to_bytes_round_up(TSCHED_WATERMARK_DEC_THRESHOLD_USEC, &ss);
+            u->rewind_safeguard = u->out_fragment_size;
+            u->first = TRUE;
+
+            fix_min_sleep_wakeup(u);
+            fix_tsched_watermark(u);
+
+            pa_sink_set_latency_range(u->sink, 0, pa_bytes_to_usec(u->out_hwbuf_size, &ss));
+            pa_sink_set_max_rewind(u->sink, u->out_hwbuf_size);
+
+            pa_log_info("Time scheduling watermark is %0.2fms",
+                        (double) pa_bytes_to_usec(u->tsched_watermark, &ss) / PA_USEC_PER_MSEC);
+        } else {
+            pa_sink_set_fixed_latency(u->sink, pa_bytes_to_usec(u->out_hwbuf_size, &u->sink->sample_spec));
+
+            if (use_mmap)
+                u->out_mmap_memblocks = pa_xnew0(pa_memblock*, u->out_nfrags);
+        }
     }
 
     if ((u->mixer_fd = pa_oss_open_mixer_for_device(u->device_name)) >= 0) {
@@ -1533,6 +1985,9 @@ void pa__done(pa_module*m) {
     if (u->rtpoll)
         pa_rtpoll_free(u->rtpoll);
 
+    if (u->smoother)
+        pa_smoother_free(u->smoother);
+
     if (u->out_mmap_memblocks) {
         unsigned i;
         for (i = 0; i < u->out_nfrags; i++)
@@ -0,0 +1,148 @@
+/***
+  This file is part of PulseAudio.
+
+  PulseAudio is free software; you can redistribute it and/or modify
+  it under the terms of the GNU Lesser General Public License as published
+  by the Free Software Foundation; either version 2.1 of the License,
+  or (at your option) any later version.
+
+  PulseAudio is distributed in the hope that it will be useful, but
+  WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+  General Public License for more details.
+
+  You should have received a copy of the GNU Lesser General Public License
+  along with PulseAudio; if not, write to the Free Software
+  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307
+  USA.
+***/
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include <string.h>
+
+#include <pulsecore/endianmacros.h>
+#include <pulsecore/macro.h>
+
+#include "raop_packet.h"
+
+/**
+ * Function to write bits into a buffer.
+ * @param buffer Handle to the buffer. It will be incremented if new data requires it.
+ * @param bit_pos A pointer to a position buffer to keep track the current write location (0 for MSB, 7 for LSB)
+ * @param size A pointer to the byte size currently written. This allows the calling function to do simple buffer overflow checks
+ * @param data The data to write
+ * @param data_bit_len The number of bits from data to write
+ */
+static inline void bit_writer(uint8_t **buffer, uint8_t *bit_pos, size_t *size, uint8_t data, uint8_t data_bit_len) {
+    int bits_left, bit_overflow;
+    uint8_t bit_data;
+
+    if (!data_bit_len)
+        return;
+
+    /* If bit pos is zero, we will definately use at least one bit from the current byte so size increments. */
+    if (!*bit_pos)
+        *size += 1;
+
+    /* Calc the number of bits left in the current byte of buffer */
+    bits_left = 7 - *bit_pos  + 1;
+    /* Calc the overflow of bits in relation to how much space we have left... */
+    bit_overflow = bits_left - data_bit_len;
+    if (bit_overflow >= 0) {
+        /* We can fit the new data in our current byte */
+        /* As we write from MSB->LSB we need to left shift by the overflow amount */
+        bit_data = data << bit_overflow;
+        if (*bit_pos)
+            **buffer |= bit_data;
+        else
+            **buffer = bit_data;
+        /* If our data fits exactly into the current byte, we need to increment our pointer */
+        if (0 == bit_overflow) {
+            /* Do not increment size as it will be incremented on next call as bit_pos is zero */
+            *buffer += 1;
+            *bit_pos = 0;
+        } else {
+            *bit_pos += data_bit_len;
+        }
+    } else {
+        /* bit_overflow is negative, there for we will need a new byte from our buffer */
+        /* Firstly fill up what's left in the current byte */
+        bit_data = data >> -bit_overflow;
+        **buffer |= bit_data;
+        /* Increment our buffer pointer and size counter*/
+        *buffer += 1;
+        *size += 1;
+        **buffer = data << (8 + bit_overflow);
+        *bit_pos = -bit_overflow;
+    }
+}
+
+size_t pa_raop_alac_pack(const uint8_t *pcm, size_t n_frames, uint8_t *out) {
+    uint8_t *bp = out, bpos = 0;
+    size_t size = 0, i;
+    uint32_t carry;
+
+    pa_assert(pcm || n_frames == 0);
+    pa_assert(out);
+
+    bit_writer(&bp,&bpos,&size,1,3); /* channel=1, stereo */
+    bit_writer(&bp,&bpos,&size,0,4); /* unknown */
+    bit_writer(&bp,&bpos,&size,0,8); /* unknown */
+    bit_writer(&bp,&bpos,&size,0,4); /* unknown */
+    bit_writer(&bp,&bpos,&size,1,1); /* hassize */
+    bit_writer(&bp,&bpos,&size,0,2); /* unused */
+    bit_writer(&bp,&bpos,&size,1,1); /* is-not-compressed */
+
+    /* size of data, integer, big endian */
+    bit_writer(&bp,&bpos,&size,(n_frames>>24)&0xff,8);
+    bit_writer(&bp,&bpos,&size,(n_frames>>16)&0xff,8);
+    bit_writer(&bp,&bpos,&size,(n_frames>>8)&0xff,8);
+    bit_writer(&bp,&bpos,&size,(n_frames)&0xff,8);
+
+    /* The header leaves us in the middle of a byte, so every sample is
+     * written shifted by bpos bits. Instead of going through bit_writer()
+     * for every byte we build a whole big endian frame in a word and
+     * carry the bits that don't fit over to the next one. */
+    pa_assert(bpos > 0);
+    carry = *bp;
+
+    for (i = 0; i < n_frames; i++, pcm += 4, bp += 4) {
+        uint32_t w;
+
+        /* Byte swap stereo data */
+        w = ((uint32_t) pcm[1] << 24) | ((uint32_t) pcm[0] << 16) | ((uint32_t) pcm[3] << 8) | (uint32_t) pcm[2];
+
+        carry = (carry << 24) | (w >> bpos);
+        carry = PA_UINT32_TO_BE(carry);
+        memcpy(bp, &carry, sizeof(carry));
+
+        carry = (w << (8 - bpos)) & 0xff;
+    }
+
+    *bp = (uint8_t) carry;
+
+    return size + n_frames * 4;
+}
+
+size_t pa_raop_aes_encrypt(EVP_CIPHER_CTX *ctx, const uint8_t *iv, uint8_t *data, size_t size) {
+    int n;
+
+    pa_assert(ctx);
+    pa_assert(iv);
+    pa_assert(data || size == 0);
+
+    size &= ~(size_t) (PA_RAOP_AES_CHUNKSIZE - 1);
+
+    if (size == 0)
+        return 0;
+
+    /* Every packet is encrypted starting from the same IV */
+    pa_assert_se(EVP_EncryptInit_ex(ctx, NULL, NULL, NULL, iv));
+    pa_assert_se(EVP_EncryptUpdate(ctx, data, &n, data, (int) size));
+    pa_assert((size_t) n == size);
+
+    return size;
+}
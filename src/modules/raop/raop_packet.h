@@ -0,0 +1,46 @@
+#ifndef fooraoppacketfoo
+#define fooraoppacketfoo
+
+/***
+  This file is part of PulseAudio.
+
+  PulseAudio is free software; you can redistribute it and/or modify
+  it under the terms of the GNU Lesser General Public License as published
+  by the Free Software Foundation; either version 2.1 of the License,
+  or (at your option) any later version.
+
+  PulseAudio is distributed in the hope that it will be useful, but
+  WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+  General Public License for more details.
+
+  You should have received a copy of the GNU Lesser General Public License
+  along with PulseAudio; if not, write to the Free Software
+  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307
+  USA.
+***/
+
+#include <inttypes.h>
+#include <sys/types.h>
+
+#include <openssl/evp.h>
+
+#define PA_RAOP_AES_CHUNKSIZE 16
+
+/* Size of an uncompressed ALAC frame holding n_frames stereo samples:
+ * a 55 bit header followed by the samples, rounded up to whole bytes */
+#define PA_RAOP_ALAC_FRAME_SIZE(n_frames) (7 + (n_frames) * 4)
+
+/* Writes n_frames of 16 bit little endian stereo samples from pcm to out
+ * as one uncompressed ALAC frame. Returns the number of bytes written,
+ * which is PA_RAOP_ALAC_FRAME_SIZE(n_frames). */
+size_t pa_raop_alac_pack(const uint8_t *pcm, size_t n_frames, uint8_t *out);
+
+/* Encrypts data in place with AES-128-CBC, starting over from iv. ctx must
+ * be set up for AES-128-CBC encryption with padding disabled. Only whole
+ * 16 byte blocks are encrypted, a trailing partial block is left as it
+ * is, like AirPort receivers expect. Returns the number of bytes
+ * encrypted. */
+size_t pa_raop_aes_encrypt(EVP_CIPHER_CTX *ctx, const uint8_t *iv, uint8_t *data, size_t size);
+
+#endif
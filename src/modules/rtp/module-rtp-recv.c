@@ -54,6 +54,11 @@
 #include <pulsecore/once.h>
 #include <pulsecore/poll.h>
 #include <pulsecore/arpa-inet.h>
+#include <pulsecore/thread.h>
+#include <pulsecore/thread-mq.h>
+#include <pulsecore/rtpoll.h>
+#include <pulsecore/hashmap.h>
+#include <pulsecore/idxset.h>
 
 #include "module-rtp-recv-symdef.h"
 
@@ -73,10 +78,13 @@ PA_MODULE_USAGE(
 #define SAP_PORT 9875
 #define DEFAULT_SAP_ADDRESS "224.0.0.56"
 #define MEMBLOCKQ_MAXLENGTH (1024*1024*40)
-#define MAX_SESSIONS 16
+#define MAX_SESSIONS 64
 #define DEATH_TIMEOUT 20
 #define RATE_UPDATE_INTERVAL (5*PA_USEC_PER_SEC)
 #define LATENCY_USEC (500*PA_USEC_PER_MSEC)
+#define JITTER_MARGIN_USEC (20*PA_USEC_PER_MSEC)
+#define CONCEAL_MAX_USEC (60*PA_USEC_PER_MSEC)
+#define PACKET_INFO_MAX (2*PA_RTP_BATCH_MAX)
 
 static const char* const valid_modargs[] = {
     "sink",
@@ -84,6 +92,34 @@ static const char* const valid_modargs[] = {
     NULL
 };
 
+/* What the receiver thread passes on to the sink input along with the
+ * payload of each packet. These live in a per-session array, in_use is
+ * set by the receiver thread and cleared once the sink input is done
+ * with the message. */
+struct packet_info {
+    uint32_t timestamp;
+    uint16_t sequence;
+    pa_bool_t marker;
+    struct timeval tstamp;
+    pa_atomic_t in_use;
+};
+
+/* All sessions announced for the same destination address share one
+ * socket, packets are handed to the sessions by their SSRC */
+struct receiver {
+    struct userdata *userdata;
+
+    char *address;
+    unsigned n_sessions;
+
+    pa_rtp_context rtp_context;
+
+    /* Only accessed from the receiver thread */
+    pa_rtpoll_item *rtpoll_item;
+    pa_hashmap *by_ssrc;
+    pa_idxset *sessions;
+};
+
 struct session {
     struct userdata *userdata;
     PA_LLIST_FIELDS(struct session);
@@ -91,13 +127,33 @@ struct session {
     pa_sink_input *sink_input;
     pa_memblockq *memblockq;
 
-    pa_bool_t first_packet;
+    struct receiver *receiver;
+    pa_asyncmsgq *asyncmsgq;
+
+    /* Only accessed from the receiver thread */
+    pa_bool_t ssrc_claimed;
     uint32_t ssrc;
+    unsigned packet_info_next;
+
+    /* Enough for the sink input to lag a full batch behind */
+    struct packet_info packet_infos[PACKET_INFO_MAX];
+
+    pa_bool_t first_packet;
     uint32_t offset;
+    uint16_t sequence;
 
-    struct pa_sdp_info sdp_info;
+    /* Jitter buffer state, RFC 3550 style interarrival jitter */
+    double jitter;
+    pa_usec_t last_arrival;
+    uint32_t last_timestamp;
+    unsigned n_lost, n_late;
 
-    pa_rtp_context rtp_context;
+    /* Packet loss concealment */
+    pa_memchunk last_played;
+    pa_memchunk silence;
+    size_t concealed;
+
+    struct pa_sdp_info sdp_info;
 
     pa_rtpoll_item *rtpoll_item;
 
@@ -108,14 +164,28 @@ struct session {
 
     pa_usec_t last_rate_update;
     pa_usec_t last_latency;
+    double rate;  /* exact input rate, sink_input->sample_spec.rate is rounded */
     double estimated_rate;
     double avg_estimated_rate;
 };
 
+typedef struct receiver_msg {
+    pa_msgobject parent;
+    struct userdata *userdata;
+} receiver_msg;
+
+PA_DEFINE_PRIVATE_CLASS(receiver_msg, pa_msgobject);
+#define RECEIVER_MSG(o) (receiver_msg_cast(o))
+
 struct userdata {
     pa_module *module;
     pa_core *core;
 
+    pa_rtpoll *rtpoll;
+    pa_thread *thread;
+    pa_thread_mq thread_mq;
+    receiver_msg *msg;
+
     pa_sap_context sap_context;
     pa_io_event* sap_event;
 
@@ -125,10 +195,23 @@ struct userdata {
 
     PA_LLIST_HEAD(struct session, sessions);
     pa_hashmap *by_origin;
+    pa_hashmap *receivers;
     int n_sessions;
 };
 
+enum {
+    SINK_INPUT_MESSAGE_POST = PA_SINK_INPUT_MESSAGE_MAX
+};
+
+enum {
+    RECEIVER_MESSAGE_ADD_RECEIVER,
+    RECEIVER_MESSAGE_REMOVE_RECEIVER,
+    RECEIVER_MESSAGE_ADD_SESSION,
+    RECEIVER_MESSAGE_REMOVE_SESSION
+};
+
 static void session_free(struct session *s);
+static void session_process_packet(struct session *s, pa_memchunk *chunk, struct packet_info *info);
 
 /* Called from I/O thread context */
 static int sink_input_process_msg(pa_msgobject *o, int code, void *data, int64_t offset, pa_memchunk *chunk) {
@@ -141,6 +224,10 @@ static int sink_input_process_msg(pa_msgobject *o, int code, void *data, int64_t
             /* Fall through, the default handler will add in the extra
              * latency added by the resampler */
             break;
+
+        case SINK_INPUT_MESSAGE_POST:
+            session_process_packet(s, chunk, data);
+            return 0;
     }
 
     return pa_sink_input_process_msg(o, code, data, offset, chunk);
@@ -155,6 +242,36 @@ static int sink_input_pop_cb(pa_sink_input *i, size_t length, pa_memchunk *chunk
     if (pa_memblockq_peek(s->memblockq, chunk) < 0)
         return -1;
 
+    if (chunk->memblock) {
+        s->concealed = 0;
+
+        /* Only real queue data may become the concealment source, the
+         * audio after a hole must not be replayed into it */
+        if (s->last_played.memblock)
+            pa_memblock_unref(s->last_played.memblock);
+
+        s->last_played = *chunk;
+        pa_memblock_ref(s->last_played.memblock);
+
+    } else {
+        size_t hole = chunk->length;
+
+        /* A packet is missing or has not arrived in time. Conceal short
+         * gaps by repeating what we played last, play silence otherwise */
+        if (s->last_played.memblock &&
+            s->concealed < pa_usec_to_bytes(CONCEAL_MAX_USEC, &s->sink_input->sample_spec))
+            *chunk = s->last_played;
+        else
+            *chunk = s->silence;
+
+        pa_memblock_ref(chunk->memblock);
+
+        if (chunk->length > hole)
+            chunk->length = hole;
+
+        s->concealed += chunk->length;
+    }
+
     pa_memblockq_drop(s->memblockq, chunk->length);
 
     return 0;
@@ -202,93 +319,121 @@ static void sink_input_suspend_within_thread(pa_sink_input* i, pa_bool_t b) {
 }
 
 /* Called from I/O thread context */
-static int rtpoll_work_cb(pa_rtpoll_item *i) {
-    pa_memchunk chunk;
-    int64_t k, j, delta;
-    struct timeval now = { 0, 0 };
-    struct session *s;
-    struct pollfd *p;
-
-    pa_assert_se(s = pa_rtpoll_item_get_userdata(i));
+static pa_bool_t session_push_packet(struct session *s, pa_memchunk *chunk, struct packet_info *info) {
+    int64_t k, j, delta, write_index;
+    int16_t seq_delta;
+    pa_usec_t arrival;
+    pa_bool_t late = FALSE;
 
-    p = pa_rtpoll_item_get_pollfd(i, NULL);
-
-    if (p->revents & (POLLERR|POLLNVAL|POLLHUP|POLLOUT)) {
-        pa_log("poll() signalled bad revents.");
-        return -1;
-    }
+    if (!PA_SINK_IS_OPENED(s->sink_input->sink->thread_info.state))
+        return FALSE;
 
-    if ((p->revents & POLLIN) == 0)
-        return 0;
+    arrival = pa_timeval_load(&info->tstamp);
 
-    p->revents = 0;
+    if (!s->first_packet) {
+        s->first_packet = TRUE;
 
-    if (pa_rtp_recv(&s->rtp_context, &chunk, s->userdata->module->core->mempool, &now) < 0)
-        return 0;
+        s->offset = info->timestamp;
+        s->sequence = info->sequence;
 
-    if (s->sdp_info.payload != s->rtp_context.payload ||
-        !PA_SINK_IS_OPENED(s->sink_input->sink->thread_info.state)) {
-        pa_memblock_unref(chunk.memblock);
-        return 0;
+        s->last_arrival = arrival;
+        s->last_timestamp = info->timestamp;
     }
 
-    if (!s->first_packet) {
-        s->first_packet = TRUE;
+    /* Order by sequence number: packets older than the next one we expect
+     * are filled into the hole they left, without moving the write index */
+    seq_delta = (int16_t) (info->sequence - s->sequence);
 
-        s->ssrc = s->rtp_context.ssrc;
-        s->offset = s->rtp_context.timestamp;
+    if (seq_delta < 0)
+        late = TRUE;
+    else {
+        if (seq_delta > 0)
+            s->n_lost += (unsigned) seq_delta;
 
-        if (s->ssrc == s->userdata->module->core->cookie)
-            pa_log_warn("Detected RTP packet loop!");
-    } else {
-        if (s->ssrc != s->rtp_context.ssrc) {
-            pa_memblock_unref(chunk.memblock);
-            return 0;
-        }
+        s->sequence = (uint16_t) (info->sequence + 1);
     }
 
     /* Check whether there was a timestamp overflow */
-    k = (int64_t) s->rtp_context.timestamp - (int64_t) s->offset;
-    j = (int64_t) 0x100000000LL - (int64_t) s->offset + (int64_t) s->rtp_context.timestamp;
+    k = (int64_t) info->timestamp - (int64_t) s->offset;
+    j = (int64_t) 0x100000000LL - (int64_t) s->offset + (int64_t) info->timestamp;
 
     if ((k < 0 ? -k : k) < (j < 0 ? -j : j))
         delta = k;
     else
         delta = j;
 
-    pa_memblockq_seek(s->memblockq, delta * (int64_t) s->rtp_context.frame_size, PA_SEEK_RELATIVE, TRUE);
+    write_index = pa_memblockq_get_write_index(s->memblockq);
 
-    if (now.tv_sec == 0) {
-        PA_ONCE_BEGIN {
-            pa_log_warn("Using artificial time instead of timestamp");
-        } PA_ONCE_END;
-        pa_rtclock_get(&now);
+    if (late) {
+        if (write_index + delta * (int64_t) pa_frame_size(&s->sdp_info.sample_spec) + (int64_t) chunk->length <= pa_memblockq_get_read_index(s->memblockq)) {
+            /* Too late, we already concealed it */
+            s->n_late++;
+            return FALSE;
+        }
+
+        if (s->n_lost > 0)
+            s->n_lost--;
+    } else {
+        /* Update the interarrival jitter estimate */
+        double d = (double) ((int64_t) arrival - (int64_t) s->last_arrival) -
+            (double) (int32_t) (info->timestamp - s->last_timestamp) * PA_USEC_PER_SEC / s->sdp_info.sample_spec.rate;
+
+        s->jitter += (fabs(d) - s->jitter) / 16;
+        s->last_arrival = arrival;
+        s->last_timestamp = info->timestamp;
+    }
+
+    if (!late && (info->marker || delta < 0 || pa_bytes_to_usec((uint64_t) delta * pa_frame_size(&s->sdp_info.sample_spec), &s->sdp_info.sample_spec) > LATENCY_USEC)) {
+        int64_t read_index = pa_memblockq_get_read_index(s->memblockq);
+
+        /* The sender skipped silence, or restarted. Queueing up the gap
+         * would add it to our latency, so continue right after what is
+         * still queued, or at the read index if we ran dry. */
+        pa_log_debug("Resynchronizing after a gap of %lli frames.", (long long) delta);
+        pa_memblockq_seek(s->memblockq, PA_MAX(write_index, read_index), PA_SEEK_ABSOLUTE, TRUE);
     } else
-        pa_rtclock_from_wallclock(&now);
+        pa_memblockq_seek(s->memblockq, delta * (int64_t) pa_frame_size(&s->sdp_info.sample_spec), PA_SEEK_RELATIVE, TRUE);
 
-    if (pa_memblockq_push(s->memblockq, &chunk) < 0) {
+    if (pa_memblockq_push(s->memblockq, chunk) < 0) {
         pa_log_warn("Queue overrun");
-        pa_memblockq_seek(s->memblockq, (int64_t) chunk.length, PA_SEEK_RELATIVE, TRUE);
+        pa_memblockq_seek(s->memblockq, (int64_t) chunk->length, PA_SEEK_RELATIVE, TRUE);
     }
 
 /*     pa_log("blocks in q: %u", pa_memblockq_get_nblocks(s->memblockq)); */
 
-    pa_memblock_unref(chunk.memblock);
+    if (late) {
+        pa_memblockq_seek(s->memblockq, write_index, PA_SEEK_ABSOLUTE, TRUE);
+        return TRUE;
+    }
 
     /* The next timestamp we expect */
-    s->offset = s->rtp_context.timestamp + (uint32_t) (chunk.length / s->rtp_context.frame_size);
+    s->offset = info->timestamp + (uint32_t) (chunk->length / pa_frame_size(&s->sdp_info.sample_spec));
 
-    pa_atomic_store(&s->timestamp, (int) now.tv_sec);
+    return TRUE;
+}
+
+/* Called from I/O thread context */
+static void session_process_packet(struct session *s, pa_memchunk *chunk, struct packet_info *info) {
+    struct timeval *now = &info->tstamp;
 
-    if (s->last_rate_update + RATE_UPDATE_INTERVAL < pa_timeval_load(&now)) {
+    if (!session_push_packet(s, chunk, info))
+        return;
+
+    if (s->last_rate_update + RATE_UPDATE_INTERVAL < pa_timeval_load(now)) {
         pa_usec_t wi, ri, render_delay, sink_delay = 0, latency;
-        uint32_t base_rate = s->sink_input->sink->sample_spec.rate;
-        uint32_t current_rate = s->sink_input->sample_spec.rate;
-        uint32_t new_rate;
+        double base_rate = (double) s->sink_input->sink->sample_spec.rate;
+        double current_rate = s->rate;
+        double new_rate;
         double estimated_rate, alpha = 0.02;
 
         pa_log_debug("Updating sample rate");
 
+        /* Adapt the jitter buffer to the observed network jitter */
+        s->intended_latency = PA_CLAMP(JITTER_MARGIN_USEC + (pa_usec_t) (4 * s->jitter), s->sink_latency*2, LATENCY_USEC);
+
+        pa_log_debug("Jitter %0.2f ms, target latency %0.2f ms, %u packets lost, %u late",
+                     s->jitter / PA_USEC_PER_MSEC, (double) s->intended_latency / PA_USEC_PER_MSEC, s->n_lost, s->n_late);
+
         wi = pa_bytes_to_usec((uint64_t) pa_memblockq_get_write_index(s->memblockq), &s->sink_input->sample_spec);
         ri = pa_bytes_to_usec((uint64_t) pa_memblockq_get_read_index(s->memblockq), &s->sink_input->sample_spec);
 
@@ -338,7 +483,7 @@ static int rtpoll_work_cb(pa_rtpoll_item *i) {
          * used.  When the successive estimates R̂ⁿ do not change much then α→1, but when there is a
          * sudden spike in the estimated rate α→0, such that the deviation is given little weight.
          */
-        estimated_rate = (double) current_rate * (double) RATE_UPDATE_INTERVAL / (double) (RATE_UPDATE_INTERVAL + s->last_latency - latency);
+        estimated_rate = current_rate * (double) RATE_UPDATE_INTERVAL / (double) (RATE_UPDATE_INTERVAL + s->last_latency - latency);
         if (fabs(s->estimated_rate - s->avg_estimated_rate) > 1) {
           double ratio = (estimated_rate + s->estimated_rate - 2*s->avg_estimated_rate) / (s->estimated_rate - s->avg_estimated_rate);
           alpha = PA_CLAMP(2 * (ratio + fabs(ratio)) / (4 + ratio*ratio), 0.02, 0.8);
@@ -346,30 +491,32 @@ static int rtpoll_work_cb(pa_rtpoll_item *i) {
         s->avg_estimated_rate = alpha * estimated_rate + (1-alpha) * s->avg_estimated_rate;
         s->estimated_rate = estimated_rate;
         pa_log_debug("Estimated target rate: %.0f Hz, using average of %.0f Hz  (α=%.3f)", estimated_rate, s->avg_estimated_rate, alpha);
-        new_rate = (uint32_t) ((double) (RATE_UPDATE_INTERVAL + latency/4 - s->intended_latency/4) / (double) RATE_UPDATE_INTERVAL * s->avg_estimated_rate);
+        new_rate = ((double) RATE_UPDATE_INTERVAL + (double) latency/4 - (double) s->intended_latency/4) / (double) RATE_UPDATE_INTERVAL * s->avg_estimated_rate;
         s->last_latency = latency;
 
-        if (new_rate < (uint32_t) (base_rate*0.8) || new_rate > (uint32_t) (base_rate*1.25)) {
-            pa_log_warn("Sample rates too different, not adjusting (%u vs. %u).", base_rate, new_rate);
+        if (new_rate < base_rate*0.8 || new_rate > base_rate*1.25) {
+            pa_log_warn("Sample rates too different, not adjusting (%0.0f vs. %0.0f).", base_rate, new_rate);
             new_rate = base_rate;
         } else {
-            if (base_rate < new_rate + 20 && new_rate < base_rate + 20)
-              new_rate = base_rate;
-            /* Do the adjustment in small steps; 2‰ can be considered inaudible */
-            if (new_rate < (uint32_t) (current_rate*0.998) || new_rate > (uint32_t) (current_rate*1.002)) {
-                pa_log_info("New rate of %u Hz not within 2‰ of %u Hz, forcing smaller adjustment", new_rate, current_rate);
-                new_rate = PA_CLAMP(new_rate, (uint32_t) (current_rate*0.998), (uint32_t) (current_rate*1.002));
+            /* Do the adjustment in small steps; 2‰ can be considered
+             * inaudible. The resampler takes fractional rates without
+             * resetting its state, so there is no need to suppress
+             * small corrections. */
+            if (new_rate < current_rate*0.998 || new_rate > current_rate*1.002) {
+                pa_log_info("New rate of %0.3f Hz not within 2‰ of %0.3f Hz, forcing smaller adjustment", new_rate, current_rate);
+                new_rate = PA_CLAMP(new_rate, current_rate*0.998, current_rate*1.002);
             }
         }
-        s->sink_input->sample_spec.rate = new_rate;
+        s->rate = new_rate;
+        s->sink_input->sample_spec.rate = (uint32_t) lrint(new_rate);
 
         pa_assert(pa_sample_spec_valid(&s->sink_input->sample_spec));
 
-        pa_resampler_set_input_rate(s->sink_input->thread_info.resampler, s->sink_input->sample_spec.rate);
+        pa_resampler_set_input_rate_frac(s->sink_input->thread_info.resampler, new_rate);
 
-        pa_log_debug("Updated sampling rate to %lu Hz.", (unsigned long) s->sink_input->sample_spec.rate);
+        pa_log_debug("Updated sampling rate to %0.3f Hz.", new_rate);
 
-        s->last_rate_update = pa_timeval_load(&now);
+        s->last_rate_update = pa_timeval_load(now);
     }
 
     if (pa_memblockq_is_readable(s->memblockq) &&
@@ -379,28 +526,20 @@ static int rtpoll_work_cb(pa_rtpoll_item *i) {
                                      (size_t) (s->sink_input->thread_info.underrun_for == (uint64_t) -1 ? 0 : s->sink_input->thread_info.underrun_for),
                                      FALSE, TRUE, FALSE);
     }
-
-    return 1;
 }
 
 /* Called from I/O thread context */
 static void sink_input_attach(pa_sink_input *i) {
     struct session *s;
-    struct pollfd *p;
 
     pa_sink_input_assert_ref(i);
     pa_assert_se(s = i->userdata);
 
     pa_assert(!s->rtpoll_item);
-    s->rtpoll_item = pa_rtpoll_item_new(i->sink->thread_info.rtpoll, PA_RTPOLL_LATE, 1);
-
-    p = pa_rtpoll_item_get_pollfd(s->rtpoll_item, NULL);
-    p->fd = s->rtp_context.fd;
-    p->events = POLLIN;
-    p->revents = 0;
-
-    pa_rtpoll_item_set_work_callback(s->rtpoll_item, rtpoll_work_cb);
-    pa_rtpoll_item_set_userdata(s->rtpoll_item, s);
+    s->rtpoll_item = pa_rtpoll_item_new_asyncmsgq_read(
+            i->sink->thread_info.rtpoll,
+            PA_RTPOLL_LATE,
+            s->asyncmsgq);
 }
 
 /* Called from I/O thread context */
@@ -414,6 +553,254 @@ static void sink_input_detach(pa_sink_input *i) {
     s->rtpoll_item = NULL;
 }
 
+/* Checks whether the packet's sender is the host named in the SDP
+ * origin line ("o=<user> <id> <version> IN IP4 <address>") */
+static pa_bool_t session_matches_sender(struct session *s, const struct sockaddr_storage *sender, socklen_t sender_len) {
+    char buf[INET6_ADDRSTRLEN];
+    const void *addr;
+    const char *host;
+
+    if (!s->sdp_info.origin || !(host = strrchr(s->sdp_info.origin, ' ')))
+        return FALSE;
+
+    host++;
+
+    if (sender->ss_family == AF_INET && sender_len >= sizeof(struct sockaddr_in))
+        addr = &((const struct sockaddr_in*) sender)->sin_addr;
+#ifdef HAVE_IPV6
+    else if (sender->ss_family == AF_INET6 && sender_len >= sizeof(struct sockaddr_in6))
+        addr = &((const struct sockaddr_in6*) sender)->sin6_addr;
+#endif
+    else
+        return FALSE;
+
+    if (!inet_ntop(sender->ss_family, addr, buf, sizeof(buf)))
+        return FALSE;
+
+    return pa_streq(buf, host);
+}
+
+/* Called from receiver thread context */
+static struct session *receiver_claim_session(struct receiver *r, uint32_t ssrc, uint8_t payload) {
+    struct session *s, *by_sender = NULL, *by_payload = NULL;
+    unsigned n_candidates = 0;
+    uint32_t idx;
+
+    /* SDP doesn't tell us the SSRC, so the first unknown SSRC that shows
+     * up is taken by a session that hasn't seen any packets yet. Prefer
+     * the session whose origin is the host the packet came from, and
+     * only fall back to the payload type if no origin matches. */
+    PA_IDXSET_FOREACH(s, r->sessions, idx) {
+        if (s->ssrc_claimed || s->sdp_info.payload != payload)
+            continue;
+
+        if (session_matches_sender(s, &r->rtp_context.sender, r->rtp_context.sender_len)) {
+            by_sender = s;
+            break;
+        }
+
+        if (!by_payload)
+            by_payload = s;
+
+        n_candidates++;
+    }
+
+    if (!(s = by_sender)) {
+        if (!(s = by_payload))
+            return NULL;
+
+        if (n_candidates > 1)
+            pa_log_warn("Can't tell which of %u sessions SSRC 0x%08x belongs to, picking '%s'.",
+                        n_candidates, ssrc, s->sdp_info.session_name ? s->sdp_info.session_name : s->sdp_info.origin);
+    }
+
+    s->ssrc_claimed = TRUE;
+    s->ssrc = ssrc;
+    pa_hashmap_put(r->by_ssrc, PA_UINT32_TO_PTR(ssrc), s);
+
+    if (ssrc == r->userdata->module->core->cookie)
+        pa_log_warn("Detected RTP packet loop!");
+
+    return s;
+}
+
+/* Called from receiver thread context */
+static struct packet_info *session_get_packet_info(struct session *s) {
+    unsigned n;
+
+    for (n = 0; n < PACKET_INFO_MAX; n++) {
+        struct packet_info *info = &s->packet_infos[s->packet_info_next];
+
+        s->packet_info_next = (s->packet_info_next + 1) % PACKET_INFO_MAX;
+
+        if (pa_atomic_cmpxchg(&info->in_use, 0, 1))
+            return info;
+    }
+
+    return NULL;
+}
+
+/* Called from I/O thread context, or from main context when flushing */
+static void packet_info_release(void *p) {
+    struct packet_info *info = p;
+
+    pa_assert_se(pa_atomic_dec(&info->in_use) == 1);
+}
+
+/* Called from receiver thread context */
+static int receiver_work_cb(pa_rtpoll_item *i) {
+    struct receiver *r;
+    struct pollfd *p;
+
+    pa_assert_se(r = pa_rtpoll_item_get_userdata(i));
+
+    p = pa_rtpoll_item_get_pollfd(i, NULL);
+
+    if (p->revents & (POLLERR|POLLNVAL|POLLHUP|POLLOUT)) {
+        pa_log("poll() signalled bad revents.");
+        return -1;
+    }
+
+    if ((p->revents & POLLIN) == 0)
+        return 0;
+
+    p->revents = 0;
+
+    /* Read everything that is pending in as few system calls as possible
+     * and queue it up for the sessions. Each sink's IO thread then picks
+     * up all packets queued for its sessions in one go. */
+    for (;;) {
+        pa_memchunk chunk;
+        struct timeval tstamp = { 0, 0 };
+        struct packet_info *info;
+        struct session *s;
+
+        if (pa_rtp_recv(&r->rtp_context, &chunk, r->userdata->module->core->mempool, &tstamp) < 0 || !chunk.memblock)
+            break;
+
+        if (!(s = pa_hashmap_get(r->by_ssrc, PA_UINT32_TO_PTR(r->rtp_context.ssrc))))
+            s = receiver_claim_session(r, r->rtp_context.ssrc, r->rtp_context.payload);
+
+        if (!s ||
+            s->sdp_info.payload != r->rtp_context.payload ||
+            chunk.length % pa_frame_size(&s->sdp_info.sample_spec) != 0) {
+            pa_memblock_unref(chunk.memblock);
+            continue;
+        }
+
+        if (tstamp.tv_sec == 0) {
+            PA_ONCE_BEGIN {
+                pa_log_warn("Using artificial time instead of timestamp");
+            } PA_ONCE_END;
+            pa_rtclock_get(&tstamp);
+        } else
+            pa_rtclock_from_wallclock(&tstamp);
+
+        pa_atomic_store(&s->timestamp, (int) tstamp.tv_sec);
+
+        /* The sink input hasn't caught up with what we queued before,
+         * this packet would be late anyway */
+        if (!(info = session_get_packet_info(s))) {
+            if (pa_log_ratelimit(PA_LOG_DEBUG))
+                pa_log_debug("Dropping packet, sink input is lagging behind.");
+            pa_memblock_unref(chunk.memblock);
+            continue;
+        }
+
+        info->timestamp = r->rtp_context.timestamp;
+        info->sequence = r->rtp_context.sequence;
+        info->marker = r->rtp_context.marker;
+        info->tstamp = tstamp;
+
+        pa_asyncmsgq_post(s->asyncmsgq, PA_MSGOBJECT(s->sink_input), SINK_INPUT_MESSAGE_POST, info, 0, &chunk, packet_info_release);
+        pa_memblock_unref(chunk.memblock);
+    }
+
+    return 1;
+}
+
+/* Called from receiver thread context */
+static int receiver_process_msg(pa_msgobject *o, int code, void *data, int64_t offset, pa_memchunk *chunk) {
+    struct userdata *u;
+
+    pa_assert_se(u = RECEIVER_MSG(o)->userdata);
+
+    switch (code) {
+
+        case RECEIVER_MESSAGE_ADD_RECEIVER: {
+            struct receiver *r = data;
+            struct pollfd *p;
+
+            r->rtpoll_item = pa_rtpoll_item_new(u->rtpoll, PA_RTPOLL_LATE, 1);
+
+            p = pa_rtpoll_item_get_pollfd(r->rtpoll_item, NULL);
+            p->fd = r->rtp_context.fd;
+            p->events = POLLIN;
+            p->revents = 0;
+
+            pa_rtpoll_item_set_work_callback(r->rtpoll_item, receiver_work_cb);
+            pa_rtpoll_item_set_userdata(r->rtpoll_item, r);
+            return 0;
+        }
+
+        case RECEIVER_MESSAGE_REMOVE_RECEIVER: {
+            struct receiver *r = data;
+
+            pa_rtpoll_item_free(r->rtpoll_item);
+            r->rtpoll_item = NULL;
+            return 0;
+        }
+
+        case RECEIVER_MESSAGE_ADD_SESSION: {
+            struct session *s = data;
+
+            pa_idxset_put(s->receiver->sessions, s, NULL);
+            return 0;
+        }
+
+        case RECEIVER_MESSAGE_REMOVE_SESSION: {
+            struct session *s = data;
+
+            pa_idxset_remove_by_data(s->receiver->sessions, s, NULL);
+
+            if (s->ssrc_claimed)
+                pa_hashmap_remove(s->receiver->by_ssrc, PA_UINT32_TO_PTR(s->ssrc));
+            return 0;
+        }
+    }
+
+    return 0;
+}
+
+static void thread_func(void *userdata) {
+    struct userdata *u = userdata;
+
+    pa_assert(u);
+
+    pa_log_debug("Thread starting up");
+
+    pa_thread_mq_install(&u->thread_mq);
+
+    for (;;) {
+        int ret;
+
+        if ((ret = pa_rtpoll_run(u->rtpoll, TRUE)) < 0)
+            goto fail;
+
+        if (ret == 0)
+            goto finish;
+    }
+
+fail:
+    /* If this was no regular exit from the loop we have to continue
+     * processing messages until we received PA_MESSAGE_SHUTDOWN */
+    pa_asyncmsgq_post(u->thread_mq.outq, PA_MSGOBJECT(u->core), PA_CORE_MESSAGE_UNLOAD_MODULE, u->module, 0, NULL, NULL);
+    pa_asyncmsgq_wait_for(u->thread_mq.inq, PA_MESSAGE_SHUTDOWN);
+
+finish:
+    pa_log_debug("Thread shutting down");
+}
+
 static int mcast_socket(const struct sockaddr* sa, socklen_t salen) {
     int af, fd = -1, r, one;
 
@@ -478,11 +865,96 @@ fail:
     return -1;
 }
 
+static char *receiver_address(const pa_sdp_info *sdp_info) {
+    char buf[INET6_ADDRSTRLEN];
+    const struct sockaddr *sa = (const struct sockaddr*) &sdp_info->sa;
+
+    if (sa->sa_family == AF_INET) {
+        const struct sockaddr_in *sa4 = (const struct sockaddr_in*) sa;
+
+        if (inet_ntop(AF_INET, &sa4->sin_addr, buf, sizeof(buf)))
+            return pa_sprintf_malloc("%s:%u", buf, (unsigned) ntohs(sa4->sin_port));
+#ifdef HAVE_IPV6
+    } else if (sa->sa_family == AF_INET6) {
+        const struct sockaddr_in6 *sa6 = (const struct sockaddr_in6*) sa;
+
+        if (inet_ntop(AF_INET6, &sa6->sin6_addr, buf, sizeof(buf)))
+            return pa_sprintf_malloc("[%s]:%u", buf, (unsigned) ntohs(sa6->sin6_port));
+#endif
+    }
+
+    return NULL;
+}
+
+/* Called from main context */
+static struct receiver *receiver_get(struct userdata *u, const pa_sdp_info *sdp_info) {
+    struct receiver *r;
+    char *address;
+    int fd;
+
+    if (!(address = receiver_address(sdp_info))) {
+        pa_log("Invalid session address.");
+        return NULL;
+    }
+
+    if ((r = pa_hashmap_get(u->receivers, address))) {
+        pa_xfree(address);
+        r->n_sessions++;
+        return r;
+    }
+
+    if ((fd = mcast_socket((const struct sockaddr*) &sdp_info->sa, sdp_info->salen)) < 0) {
+        pa_xfree(address);
+        return NULL;
+    }
+
+    r = pa_xnew0(struct receiver, 1);
+    r->userdata = u;
+    r->address = address;
+    r->n_sessions = 1;
+    r->by_ssrc = pa_hashmap_new(pa_idxset_trivial_hash_func, pa_idxset_trivial_compare_func);
+    r->sessions = pa_idxset_new(pa_idxset_trivial_hash_func, pa_idxset_trivial_compare_func);
+
+    /* The frame size differs between the sessions sharing this socket, the
+     * receiver thread checks it per session */
+    pa_rtp_context_init_recv(&r->rtp_context, fd, 1);
+
+    pa_hashmap_put(u->receivers, r->address, r);
+
+    pa_asyncmsgq_send(u->thread_mq.inq, PA_MSGOBJECT(u->msg), RECEIVER_MESSAGE_ADD_RECEIVER, r, 0, NULL);
+
+    pa_log_debug("Listening for RTP sessions on %s", r->address);
+
+    return r;
+}
+
+/* Called from main context */
+static void receiver_unref(struct receiver *r) {
+    struct userdata *u;
+
+    pa_assert(r);
+    pa_assert(r->n_sessions >= 1);
+
+    if (--r->n_sessions > 0)
+        return;
+
+    u = r->userdata;
+
+    pa_asyncmsgq_send(u->thread_mq.inq, PA_MSGOBJECT(u->msg), RECEIVER_MESSAGE_REMOVE_RECEIVER, r, 0, NULL);
+
+    pa_hashmap_remove(u->receivers, r->address);
+
+    pa_rtp_context_destroy(&r->rtp_context);
+    pa_hashmap_free(r->by_ssrc, NULL, NULL);
+    pa_idxset_free(r->sessions, NULL, NULL);
+    pa_xfree(r->address);
+    pa_xfree(r);
+}
+
 static struct session *session_new(struct userdata *u, const pa_sdp_info *sdp_info) {
     struct session *s = NULL;
     pa_sink *sink;
-    int fd = -1;
-    pa_memchunk silence;
+    struct receiver *r = NULL;
     pa_sink_input_new_data data;
     struct timeval now;
 
@@ -509,11 +981,12 @@ static struct session *session_new(struct userdata *u, const pa_sdp_info *sdp_in
     s->intended_latency = LATENCY_USEC;
     s->last_rate_update = pa_timeval_load(&now);
     s->last_latency = LATENCY_USEC;
+    s->rate = (double) sink->sample_spec.rate;
     s->estimated_rate = (double) sink->sample_spec.rate;
     s->avg_estimated_rate = (double) sink->sample_spec.rate;
     pa_atomic_store(&s->timestamp, (int) now.tv_sec);
 
-    if ((fd = mcast_socket((const struct sockaddr*) &sdp_info->sa, sdp_info->salen)) < 0)
+    if (!(r = receiver_get(u, sdp_info)))
         goto fail;
 
     pa_sink_input_new_data_init(&data);
@@ -553,7 +1026,7 @@ static struct session *session_new(struct userdata *u, const pa_sdp_info *sdp_in
     s->sink_input->detach = sink_input_detach;
     s->sink_input->suspend_within_thread = sink_input_suspend_within_thread;
 
-    pa_sink_input_get_silence(s->sink_input, &silence);
+    pa_sink_input_get_silence(s->sink_input, &s->silence);
 
     s->sink_latency = pa_sink_input_set_requested_latency(s->sink_input, s->intended_latency/2);
 
@@ -569,11 +1042,10 @@ static struct session *session_new(struct userdata *u, const pa_sdp_info *sdp_in
             pa_usec_to_bytes(s->intended_latency - s->sink_latency, &s->sink_input->sample_spec),
             0,
             0,
-            &silence);
-
-    pa_memblock_unref(silence.memblock);
+            NULL);
 
-    pa_rtp_context_init_recv(&s->rtp_context, fd, pa_frame_size(&s->sdp_info.sample_spec));
+    s->asyncmsgq = pa_asyncmsgq_new(0);
+    s->receiver = r;
 
     pa_hashmap_put(s->userdata->by_origin, s->sdp_info.origin, s);
     u->n_sessions++;
@@ -581,15 +1053,17 @@ static struct session *session_new(struct userdata *u, const pa_sdp_info *sdp_in
 
     pa_sink_input_put(s->sink_input);
 
-    pa_log_info("New session '%s'", s->sdp_info.session_name);
+    pa_asyncmsgq_send(u->thread_mq.inq, PA_MSGOBJECT(u->msg), RECEIVER_MESSAGE_ADD_SESSION, s, 0, NULL);
+
+    pa_log_info("New session '%s' on %s", s->sdp_info.session_name, r->address);
 
     return s;
 
 fail:
     pa_xfree(s);
 
-    if (fd >= 0)
-        pa_close(fd);
+    if (r)
+        receiver_unref(r);
 
     return NULL;
 }
@@ -599,7 +1073,16 @@ static void session_free(struct session *s) {
 
     pa_log_info("Freeing session '%s'", s->sdp_info.session_name);
 
+    /* Make sure the receiver thread doesn't queue up any more packets
+     * for us */
+    pa_asyncmsgq_send(s->userdata->thread_mq.inq, PA_MSGOBJECT(s->userdata->msg), RECEIVER_MESSAGE_REMOVE_SESSION, s, 0, NULL);
+    receiver_unref(s->receiver);
+
     pa_sink_input_unlink(s->sink_input);
+
+    pa_asyncmsgq_flush(s->asyncmsgq, FALSE);
+    pa_asyncmsgq_unref(s->asyncmsgq);
+
     pa_sink_input_unref(s->sink_input);
 
     PA_LLIST_REMOVE(struct session, s->userdata->sessions, s);
@@ -608,8 +1091,13 @@ static void session_free(struct session *s) {
     pa_hashmap_remove(s->userdata->by_origin, s->sdp_info.origin);
 
     pa_memblockq_free(s->memblockq);
+
+    if (s->last_played.memblock)
+        pa_memblock_unref(s->last_played.memblock);
+    if (s->silence.memblock)
+        pa_memblock_unref(s->silence.memblock);
+
     pa_sdp_info_destroy(&s->sdp_info);
-    pa_rtp_context_destroy(&s->rtp_context);
 
     pa_xfree(s);
 }
@@ -722,7 +1210,7 @@ int pa__init(pa_module*m) {
     if ((fd = mcast_socket(sa, salen)) < 0)
         goto fail;
 
-    m->userdata = u = pa_xnew(struct userdata, 1);
+    m->userdata = u = pa_xnew0(struct userdata, 1);
     u->module = m;
     u->core = m->core;
     u->sink_name = pa_xstrdup(pa_modargs_get_value(ma, "sink", NULL));
@@ -733,6 +1221,21 @@ int pa__init(pa_module*m) {
     PA_LLIST_HEAD_INIT(struct session, u->sessions);
     u->n_sessions = 0;
     u->by_origin = pa_hashmap_new(pa_idxset_string_hash_func, pa_idxset_string_compare_func);
+    u->receivers = pa_hashmap_new(pa_idxset_string_hash_func, pa_idxset_string_compare_func);
+
+    u->rtpoll = pa_rtpoll_new();
+    pa_thread_mq_init(&u->thread_mq, m->core->mainloop, u->rtpoll);
+
+    u->msg = pa_msgobject_new(receiver_msg);
+    u->msg->parent.process_msg = receiver_process_msg;
+    u->msg->userdata = u;
+
+    if (!(u->thread = pa_thread_new("rtp-recv", thread_func, u))) {
+        pa_log("Failed to create thread.");
+        pa_modargs_free(ma);
+        pa__done(m);
+        return -1;
+    }
 
     u->check_death_event = pa_core_rttime_new(m->core, pa_rtclock_now() + DEATH_TIMEOUT * PA_USEC_PER_SEC, check_death_event_cb, u);
 
@@ -774,6 +1277,24 @@ void pa__done(pa_module*m) {
         pa_hashmap_free(u->by_origin, NULL, NULL);
     }
 
+    if (u->thread) {
+        pa_asyncmsgq_send(u->thread_mq.inq, NULL, PA_MESSAGE_SHUTDOWN, NULL, 0, NULL);
+        pa_thread_free(u->thread);
+    }
+
+    if (u->rtpoll) {
+        pa_thread_mq_done(&u->thread_mq);
+        pa_rtpoll_free(u->rtpoll);
+    }
+
+    if (u->msg)
+        pa_msgobject_unref(PA_MSGOBJECT(u->msg));
+
+    if (u->receivers) {
+        pa_assert(pa_hashmap_isempty(u->receivers));
+        pa_hashmap_free(u->receivers, NULL, NULL);
+    }
+
     pa_xfree(u->sink_name);
     pa_xfree(u);
 }
@@ -67,7 +67,8 @@ PA_MODULE_USAGE(
         "port=<port number> "
         "mtu=<maximum transfer unit> "
         "loop=<loopback to local host?> "
-        "ttl=<ttl value>"
+        "ttl=<ttl value> "
+        "skip_silence=<don't send packets of pure silence?>"
 );
 
 #define DEFAULT_PORT 46000
@@ -88,6 +89,7 @@ static const char* const valid_modargs[] = {
     "mtu" ,
     "loop",
     "ttl",
+    "skip_silence",
     NULL
 };
 
@@ -182,7 +184,7 @@ int pa__init(pa_module*m) {
     int r, j;
     socklen_t k;
     char hn[128], *n;
-    pa_bool_t loop = FALSE;
+    pa_bool_t loop = FALSE, skip_silence = FALSE;
     pa_source_output_new_data data;
 
     pa_assert(m);
@@ -202,6 +204,11 @@ int pa__init(pa_module*m) {
         goto fail;
     }
 
+    if (pa_modargs_get_value_boolean(ma, "skip_silence", &skip_silence) < 0) {
+        pa_log("Failed to parse \"skip_silence\" parameter.");
+        goto fail;
+    }
+
     ss = s->sample_spec;
     pa_rtp_sample_spec_fixup(&ss);
     cm = s->channel_map;
@@ -382,6 +389,7 @@ int pa__init(pa_module*m) {
     pa_xfree(n);
 
     pa_rtp_context_init_send(&u->rtp_context, fd, m->core->cookie, payload, pa_frame_size(&ss));
+    u->rtp_context.skip_silence = skip_silence;
     pa_sap_context_init_send(&u->sap_context, sap_fd, p);
 
     pa_log_info("RTP stream initialized with mtu %u on %s:%u ttl=%u, SSRC=0x%08x, payload=%u, initial sequence #%u", mtu, dest, port, ttl, u->rtp_context.ssrc, payload, u->rtp_context.sequence);
@@ -55,19 +55,96 @@ pa_rtp_context* pa_rtp_context_init_send(pa_rtp_context *c, int fd, uint32_t ssr
     c->ssrc = ssrc ? ssrc : (uint32_t) (rand()*rand());
     c->payload = (uint8_t) (payload & 127U);
     c->frame_size = frame_size;
+    c->skip_silence = FALSE;
+    c->marker = FALSE;
 
     pa_memchunk_reset(&c->memchunk);
+    c->recv_queue_length = c->recv_queue_index = 0;
 
     return c;
 }
 
 #define MAX_IOVECS 16
 
-int pa_rtp_send(pa_rtp_context *c, size_t size, pa_memblockq *q) {
+struct send_packet {
+    uint32_t header[3];
     struct iovec iov[MAX_IOVECS];
-    pa_memblock* mb[MAX_IOVECS];
-    int iov_idx = 1;
+    pa_memblock *mb[MAX_IOVECS];
+    int n_iov;
+};
+
+static void release_packet(struct send_packet *p) {
+    int j;
+
+    for (j = 1; j < p->n_iov; j++) {
+        pa_memblock_release(p->mb[j]);
+        pa_memblock_unref(p->mb[j]);
+    }
+}
+
+/* Sends all assembled packets with as few system calls as possible and
+ * releases their memory blocks */
+static int send_packets(pa_rtp_context *c, struct send_packet *p, unsigned n) {
+    unsigned i;
+    int ret = 0;
+#ifdef HAVE_SENDMMSG
+    struct mmsghdr m[PA_RTP_BATCH_MAX];
+#else
+    struct msghdr m;
+#endif
+
+    pa_assert(n <= PA_RTP_BATCH_MAX);
+
+#ifdef HAVE_SENDMMSG
+    pa_zero(m);
+
+    for (i = 0; i < n; i++) {
+        m[i].msg_hdr.msg_iov = p[i].iov;
+        m[i].msg_hdr.msg_iovlen = (size_t) p[i].n_iov;
+    }
+
+    for (i = 0; i < n;) {
+        int k;
+
+        if ((k = sendmmsg(c->fd, m + i, n - i, MSG_DONTWAIT)) <= 0) {
+            ret = -1;
+            break;
+        }
+
+        i += (unsigned) k;
+    }
+#else
+    for (i = 0; i < n; i++) {
+        m.msg_name = NULL;
+        m.msg_namelen = 0;
+        m.msg_iov = p[i].iov;
+        m.msg_iovlen = (size_t) p[i].n_iov;
+        m.msg_control = NULL;
+        m.msg_controllen = 0;
+        m.msg_flags = 0;
+
+        if (sendmsg(c->fd, &m, MSG_DONTWAIT) < 0) {
+            ret = -1;
+            break;
+        }
+    }
+#endif
+
+    if (ret < 0 && errno != EAGAIN && errno != EINTR) /* If the queue is full, just ignore it */
+        pa_log("sendmsg() failed: %s", pa_cstrerror(errno));
+
+    for (i = 0; i < n; i++)
+        release_packet(p + i);
+
+    return ret;
+}
+
+int pa_rtp_send(pa_rtp_context *c, size_t size, pa_memblockq *q) {
+    struct send_packet packets[PA_RTP_BATCH_MAX], *p;
+    unsigned n_packets = 0;
     size_t n = 0;
+    pa_bool_t silent = TRUE;
+    int ret = 0;
 
     pa_assert(c);
     pa_assert(size > 0);
@@ -76,6 +153,9 @@ int pa_rtp_send(pa_rtp_context *c, size_t size, pa_memblockq *q) {
     if (pa_memblockq_get_length(q) < size)
         return 0;
 
+    p = packets;
+    p->n_iov = 1;
+
     for (;;) {
         int r;
         pa_memchunk chunk;
@@ -88,10 +168,12 @@ int pa_rtp_send(pa_rtp_context *c, size_t size, pa_memblockq *q) {
 
             pa_assert(chunk.memblock);
 
-            iov[iov_idx].iov_base = ((uint8_t*) pa_memblock_acquire(chunk.memblock) + chunk.index);
-            iov[iov_idx].iov_len = k;
-            mb[iov_idx] = chunk.memblock;
-            iov_idx ++;
+            p->iov[p->n_iov].iov_base = ((uint8_t*) pa_memblock_acquire(chunk.memblock) + chunk.index);
+            p->iov[p->n_iov].iov_len = k;
+            p->mb[p->n_iov] = chunk.memblock;
+            p->n_iov ++;
+
+            silent = silent && pa_memblock_is_silence(chunk.memblock);
 
             n += k;
             pa_memblockq_drop(q, k);
@@ -99,56 +181,51 @@ int pa_rtp_send(pa_rtp_context *c, size_t size, pa_memblockq *q) {
 
         pa_assert(n % c->frame_size == 0);
 
-        if (r < 0 || n >= size || iov_idx >= MAX_IOVECS) {
-            uint32_t header[3];
-            struct msghdr m;
-            ssize_t k;
-            int i;
+        if (r < 0 || n >= size || p->n_iov >= MAX_IOVECS) {
 
-            if (n > 0) {
-                header[0] = htonl(((uint32_t) 2 << 30) | ((uint32_t) c->payload << 16) | ((uint32_t) c->sequence));
-                header[1] = htonl(c->timestamp);
-                header[2] = htonl(c->ssrc);
+            if (n > 0 && silent && c->skip_silence) {
 
-                iov[0].iov_base = (void*)header;
-                iov[0].iov_len = sizeof(header);
+                /* Nothing to hear, so don't put it on the wire. The
+                 * receiver fills the timestamp gap with silence. */
+                release_packet(p);
+                c->marker = TRUE;
 
-                m.msg_name = NULL;
-                m.msg_namelen = 0;
-                m.msg_iov = iov;
-                m.msg_iovlen = (size_t) iov_idx;
-                m.msg_control = NULL;
-                m.msg_controllen = 0;
-                m.msg_flags = 0;
+            } else if (n > 0) {
+                p->header[0] = htonl(((uint32_t) 2 << 30) | ((uint32_t) c->marker << 23) | ((uint32_t) c->payload << 16) | ((uint32_t) c->sequence));
+                p->header[1] = htonl(c->timestamp);
+                p->header[2] = htonl(c->ssrc);
 
-                k = sendmsg(c->fd, &m, MSG_DONTWAIT);
-
-                for (i = 1; i < iov_idx; i++) {
-                    pa_memblock_release(mb[i]);
-                    pa_memblock_unref(mb[i]);
-                }
+                p->iov[0].iov_base = (void*) p->header;
+                p->iov[0].iov_len = sizeof(p->header);
 
+                n_packets++;
                 c->sequence++;
-            } else
-                k = 0;
+                c->marker = FALSE;
+            }
 
             c->timestamp += (unsigned) (n/c->frame_size);
 
-            if (k < 0) {
-                if (errno != EAGAIN && errno != EINTR) /* If the queue is full, just ignore it */
-                    pa_log("sendmsg() failed: %s", pa_cstrerror(errno));
-                return -1;
-            }
-
             if (r < 0 || pa_memblockq_get_length(q) < size)
                 break;
 
+            if (n_packets >= PA_RTP_BATCH_MAX) {
+                if ((ret = send_packets(c, packets, n_packets)) < 0)
+                    return ret;
+
+                n_packets = 0;
+            }
+
             n = 0;
-            iov_idx = 1;
+            silent = TRUE;
+            p = packets + n_packets;
+            p->n_iov = 1;
         }
     }
 
-    return 0;
+    if (n_packets > 0)
+        ret = send_packets(c, packets, n_packets);
+
+    return ret;
 }
 
 pa_rtp_context* pa_rtp_context_init_recv(pa_rtp_context *c, int fd, size_t frame_size) {
@@ -158,80 +235,202 @@ pa_rtp_context* pa_rtp_context_init_recv(pa_rtp_context *c, int fd, size_t frame
     c->frame_size = frame_size;
 
     pa_memchunk_reset(&c->memchunk);
+
+    c->recv_queue_length = c->recv_queue_index = 0;
+    c->max_packet_size = 0;
+    c->recv_drained = FALSE;
+
     return c;
 }
 
-int pa_rtp_recv(pa_rtp_context *c, pa_memchunk *chunk, pa_mempool *pool, struct timeval *tstamp) {
-    int size;
-    struct msghdr m;
+static void get_tstamp(struct msghdr *m, struct timeval *tstamp) {
     struct cmsghdr *cm;
-    struct iovec iov;
-    uint32_t header;
-    unsigned cc;
-    ssize_t r;
-    uint8_t aux[1024];
-    pa_bool_t found_tstamp = FALSE;
 
-    pa_assert(c);
-    pa_assert(chunk);
+    for (cm = CMSG_FIRSTHDR(m); cm; cm = CMSG_NXTHDR(m, cm))
+        if (cm->cmsg_level == SOL_SOCKET && cm->cmsg_type == SCM_TIMESTAMP) {
+            memcpy(tstamp, CMSG_DATA(cm), sizeof(struct timeval));
+            return;
+        }
 
-    pa_memchunk_reset(chunk);
+    pa_log_warn("Couldn't find SCM_TIMESTAMP data in auxiliary recvmsg() data!");
+    memset(tstamp, 0, sizeof(*tstamp));
+}
 
-    if (ioctl(c->fd, FIONREAD, &size) < 0) {
-        pa_log_warn("FIONREAD failed: %s", pa_cstrerror(errno));
-        goto fail;
-    }
+/* Reads as many packets as are available, up to PA_RTP_BATCH_MAX, into
+ * the receive queue. Returns the number of packets read or -1 on error. */
+static int recv_packets(pa_rtp_context *c, pa_mempool *pool) {
+    uint8_t aux[PA_RTP_BATCH_MAX][128];
+    struct sockaddr_storage sender[PA_RTP_BATCH_MAX];
+    struct iovec iov[PA_RTP_BATCH_MAX];
+#ifdef HAVE_RECVMMSG
+    struct mmsghdr m[PA_RTP_BATCH_MAX];
+#else
+    struct msghdr m[1];
+    ssize_t l;
+#endif
+    unsigned n, i, k;
+    size_t stride, grow = 0;
+    uint8_t *d;
+    int r;
 
-    if (size <= 0)
-        return 0;
+    pa_assert(c->recv_queue_index >= c->recv_queue_length);
+
+    c->recv_queue_length = c->recv_queue_index = 0;
+
+    /* Learn the packet size from the first packet; afterwards we rely on
+     * the sender to stick to it */
+    if (c->max_packet_size <= 0) {
+        int size;
+
+        if (ioctl(c->fd, FIONREAD, &size) < 0) {
+            pa_log_warn("FIONREAD failed: %s", pa_cstrerror(errno));
+            return -1;
+        }
+
+        if (size <= 0)
+            return 0;
+
+        c->max_packet_size = (size_t) size;
+    }
 
-    if (c->memchunk.length < (unsigned) size) {
+    if (c->memchunk.length < c->max_packet_size) {
         size_t l;
 
         if (c->memchunk.memblock)
             pa_memblock_unref(c->memchunk.memblock);
 
-        l = PA_MAX((size_t) size, pa_mempool_block_size_max(pool));
+        l = PA_MAX(c->max_packet_size, pa_mempool_block_size_max(pool));
 
         c->memchunk.memblock = pa_memblock_new(pool, l);
         c->memchunk.index = 0;
         c->memchunk.length = pa_memblock_get_length(c->memchunk.memblock);
     }
 
-    pa_assert(c->memchunk.length >= (size_t) size);
+    /* The slot size must stay fixed for the whole batch, even if a
+     * truncated packet tells us to grow it */
+    stride = c->max_packet_size;
 
-    chunk->memblock = pa_memblock_ref(c->memchunk.memblock);
-    chunk->index = c->memchunk.index;
+#ifdef HAVE_RECVMMSG
+    n = (unsigned) PA_MIN(c->memchunk.length / stride, (size_t) PA_RTP_BATCH_MAX);
+#else
+    n = 1;
+#endif
+
+    d = (uint8_t*) pa_memblock_acquire(c->memchunk.memblock) + c->memchunk.index;
 
-    iov.iov_base = (uint8_t*) pa_memblock_acquire(chunk->memblock) + chunk->index;
-    iov.iov_len = (size_t) size;
+    for (i = 0; i < n; i++) {
+        iov[i].iov_base = d + i * stride;
+        iov[i].iov_len = stride;
+    }
 
-    m.msg_name = NULL;
-    m.msg_namelen = 0;
-    m.msg_iov = &iov;
-    m.msg_iovlen = 1;
-    m.msg_control = aux;
-    m.msg_controllen = sizeof(aux);
-    m.msg_flags = 0;
+#ifdef HAVE_RECVMMSG
+    pa_zero(m);
 
-    r = recvmsg(c->fd, &m, 0);
-    pa_memblock_release(chunk->memblock);
+    for (i = 0; i < n; i++) {
+        m[i].msg_hdr.msg_name = &sender[i];
+        m[i].msg_hdr.msg_namelen = sizeof(sender[i]);
+        m[i].msg_hdr.msg_iov = &iov[i];
+        m[i].msg_hdr.msg_iovlen = 1;
+        m[i].msg_hdr.msg_control = aux[i];
+        m[i].msg_hdr.msg_controllen = sizeof(aux[i]);
+    }
 
-    if (r != size) {
-        if (r < 0 && errno != EAGAIN && errno != EINTR)
-            pa_log_warn("recvmsg() failed: %s", r < 0 ? pa_cstrerror(errno) : "size mismatch");
+    r = recvmmsg(c->fd, m, n, MSG_DONTWAIT, NULL);
+#else
+    m[0].msg_name = &sender[0];
+    m[0].msg_namelen = sizeof(sender[0]);
+    m[0].msg_iov = &iov[0];
+    m[0].msg_iovlen = 1;
+    m[0].msg_control = aux[0];
+    m[0].msg_controllen = sizeof(aux[0]);
+    m[0].msg_flags = 0;
+
+    if ((l = recvmsg(c->fd, &m[0], MSG_DONTWAIT)) >= 0)
+        r = 1;
+    else
+        r = -1;
+#endif
 
-        goto fail;
+    pa_memblock_release(c->memchunk.memblock);
+
+    if (r < 0) {
+        if (errno == EAGAIN || errno == EINTR)
+            return 0;
+
+        pa_log_warn("recvmsg() failed: %s", pa_cstrerror(errno));
+        return -1;
+    }
+
+    for (i = 0, k = 0; i < (unsigned) r; i++) {
+        pa_rtp_packet *p;
+#ifdef HAVE_RECVMMSG
+        struct msghdr *h = &m[i].msg_hdr;
+        size_t length = m[i].msg_len;
+#else
+        struct msghdr *h = &m[0];
+        size_t length = (size_t) l;
+#endif
+
+        if (h->msg_flags & MSG_TRUNC) {
+            /* The sender increased its packet size, drop this one and
+             * make room for bigger packets once this batch is consumed */
+            grow = PA_MIN(stride * 2, (size_t) 0xFFFF);
+            continue;
+        }
+
+        p = &c->recv_queue[k++];
+        p->memchunk.memblock = pa_memblock_ref(c->memchunk.memblock);
+        p->memchunk.index = c->memchunk.index + i * stride;
+        p->memchunk.length = length;
+        p->sender = sender[i];
+        p->sender_len = h->msg_namelen;
+
+        get_tstamp(h, &p->tstamp);
+    }
+
+    c->recv_queue_length = k;
+    c->recv_drained = (unsigned) r < n;
+
+    c->memchunk.index += (size_t) r * stride;
+    c->memchunk.length -= (size_t) r * stride;
+
+    if (grow > c->max_packet_size) {
+        pa_log_warn("RTP packet truncated, increasing packet size to %lu.", (unsigned long) grow);
+        c->max_packet_size = grow;
+
+        /* The rest of the current block is too small for the new slot
+         * size, start over with a fresh one on the next read */
+        pa_memblock_unref(c->memchunk.memblock);
+        pa_memchunk_reset(&c->memchunk);
+
+    } else if (c->memchunk.length <= 0) {
+        pa_memblock_unref(c->memchunk.memblock);
+        pa_memchunk_reset(&c->memchunk);
     }
 
+    return (int) r;
+}
+
+/* Parses the RTP header of a received packet and hands out the payload */
+static int parse_packet(pa_rtp_context *c, pa_rtp_packet *p, pa_memchunk *chunk, struct timeval *tstamp) {
+    uint32_t header;
+    unsigned cc;
+    uint8_t *d;
+    size_t size = p->memchunk.length;
+
+    *chunk = p->memchunk;
+    pa_memchunk_reset(&p->memchunk);
+
     if (size < 12) {
         pa_log_warn("RTP packet too short.");
         goto fail;
     }
 
-    memcpy(&header, iov.iov_base, sizeof(uint32_t));
-    memcpy(&c->timestamp, (uint8_t*) iov.iov_base + 4, sizeof(uint32_t));
-    memcpy(&c->ssrc, (uint8_t*) iov.iov_base + 8, sizeof(uint32_t));
+    d = (uint8_t*) pa_memblock_acquire(chunk->memblock) + chunk->index;
+    memcpy(&header, d, sizeof(uint32_t));
+    memcpy(&c->timestamp, d + 4, sizeof(uint32_t));
+    memcpy(&c->ssrc, d + 8, sizeof(uint32_t));
+    pa_memblock_release(chunk->memblock);
 
     header = ntohl(header);
     c->timestamp = ntohl(c->timestamp);
@@ -255,49 +454,62 @@ int pa_rtp_recv(pa_rtp_context *c, pa_memchunk *chunk, pa_mempool *pool, struct
     cc = (header >> 24) & 0xF;
     c->payload = (uint8_t) ((header >> 16) & 127U);
     c->sequence = (uint16_t) (header & 0xFFFFU);
+    c->marker = !!((header >> 23) & 1);
 
-    if (12 + cc*4 > (unsigned) size) {
+    if (12 + cc*4 > size) {
         pa_log_warn("RTP packet too short. (CSRC)");
         goto fail;
     }
 
     chunk->index += 12 + cc*4;
-    chunk->length = (size_t) size - 12 + cc*4;
+    chunk->length = size - (12 + cc*4);
 
     if (chunk->length % c->frame_size != 0) {
         pa_log_warn("Bad RTP packet size.");
         goto fail;
     }
 
-    c->memchunk.index = chunk->index + chunk->length;
-    c->memchunk.length = pa_memblock_get_length(c->memchunk.memblock) - c->memchunk.index;
-
-    if (c->memchunk.length <= 0) {
-        pa_memblock_unref(c->memchunk.memblock);
-        pa_memchunk_reset(&c->memchunk);
-    }
-
-    for (cm = CMSG_FIRSTHDR(&m); cm; cm = CMSG_NXTHDR(&m, cm))
-        if (cm->cmsg_level == SOL_SOCKET && cm->cmsg_type == SCM_TIMESTAMP) {
-            memcpy(tstamp, CMSG_DATA(cm), sizeof(struct timeval));
-            found_tstamp = TRUE;
-            break;
-        }
-
-    if (!found_tstamp) {
-        pa_log_warn("Couldn't find SCM_TIMESTAMP data in auxiliary recvmsg() data!");
-        memset(tstamp, 0, sizeof(tstamp));
-    }
+    *tstamp = p->tstamp;
+    c->sender = p->sender;
+    c->sender_len = p->sender_len;
 
     return 0;
 
 fail:
-    if (chunk->memblock)
-        pa_memblock_unref(chunk->memblock);
+    pa_memblock_unref(chunk->memblock);
+    pa_memchunk_reset(chunk);
 
     return -1;
 }
 
+int pa_rtp_recv(pa_rtp_context *c, pa_memchunk *chunk, pa_mempool *pool, struct timeval *tstamp) {
+    pa_assert(c);
+    pa_assert(chunk);
+    pa_assert(tstamp);
+
+    pa_memchunk_reset(chunk);
+
+    for (;;) {
+
+        if (c->recv_queue_index >= c->recv_queue_length) {
+            int r;
+
+            /* If the last batch didn't fill up, the socket is empty and
+             * we can save ourselves another system call */
+            if (c->recv_drained) {
+                c->recv_drained = FALSE;
+                return 0;
+            }
+
+            if ((r = recv_packets(c, pool)) <= 0)
+                return r;
+        }
+
+        if (parse_packet(c, &c->recv_queue[c->recv_queue_index++], chunk, tstamp) >= 0)
+            return 0;
+    }
+}
+
 uint8_t pa_rtp_payload_from_sample_spec(const pa_sample_spec *ss) {
     pa_assert(ss);
 
@@ -378,6 +590,10 @@ void pa_rtp_context_destroy(pa_rtp_context *c) {
 
     if (c->memchunk.memblock)
         pa_memblock_unref(c->memchunk.memblock);
+
+    for (; c->recv_queue_index < c->recv_queue_length; c->recv_queue_index++)
+        if (c->recv_queue[c->recv_queue_index].memchunk.memblock)
+            pa_memblock_unref(c->recv_queue[c->recv_queue_index].memchunk.memblock);
 }
 
 const char* pa_rtp_format_to_string(pa_sample_format_t f) {
@@ -25,9 +25,20 @@
 #include <inttypes.h>
 #include <sys/socket.h>
 #include <sys/types.h>
+#include <sys/time.h>
 #include <pulsecore/memblockq.h>
 #include <pulsecore/memchunk.h>
 
+/* Maximum number of packets read or written with a single system call */
+#define PA_RTP_BATCH_MAX 16
+
+typedef struct pa_rtp_packet {
+    pa_memchunk memchunk;
+    struct timeval tstamp;
+    struct sockaddr_storage sender;
+    socklen_t sender_len;
+} pa_rtp_packet;
+
 typedef struct pa_rtp_context {
     int fd;
     uint16_t sequence;
@@ -36,7 +47,24 @@ typedef struct pa_rtp_context {
     uint8_t payload;
     size_t frame_size;
 
+    /* If TRUE, packets made up entirely of silence blocks are not sent;
+     * the timestamp still advances and the marker bit is set on the first
+     * packet after the gap, as for discontinuous transmission. When
+     * receiving, 'marker' is the marker bit of the last packet. */
+    pa_bool_t skip_silence;
+    pa_bool_t marker;
+
+    /* When receiving, the address the last packet was sent from */
+    struct sockaddr_storage sender;
+    socklen_t sender_len;
+
     pa_memchunk memchunk;
+
+    /* Packets that were received in one batch but not handed out yet */
+    pa_rtp_packet recv_queue[PA_RTP_BATCH_MAX];
+    unsigned recv_queue_length, recv_queue_index;
+    size_t max_packet_size;
+    pa_bool_t recv_drained;
 } pa_rtp_context;
 
 pa_rtp_context* pa_rtp_context_init_send(pa_rtp_context *c, int fd, uint32_t ssrc, uint8_t payload, size_t frame_size);
@@ -46,6 +74,10 @@ pa_rtp_context* pa_rtp_context_init_send(pa_rtp_context *c, int fd, uint32_t ssr
 int pa_rtp_send(pa_rtp_context *c, size_t size, pa_memblockq *q);
 
 pa_rtp_context* pa_rtp_context_init_recv(pa_rtp_context *c, int fd, size_t frame_size);
+
+/* Returns the next valid packet in chunk, reading up to PA_RTP_BATCH_MAX
+ * packets from the socket at once. If no more packets are available
+ * chunk->memblock is NULL and 0 is returned. Returns -1 on socket errors. */
 int pa_rtp_recv(pa_rtp_context *c, pa_memchunk *chunk, pa_mempool *pool, struct timeval *tstamp);
 
 void pa_rtp_context_destroy(pa_rtp_context *c);
@@ -54,6 +54,7 @@
 #include "module-xenpv-sink-symdef.h"
 #include "gntalloc.h"
 #include "gntdev.h"
+#include "xenpv-ring.h"
 
 PA_MODULE_AUTHOR("Giorgos Boutsioukis");
 PA_MODULE_DESCRIPTION("Xen PV audio sink");
@@ -108,22 +109,19 @@ struct userdata {
 
     pa_memchunk memchunk;
 
-    pa_rtpoll_item *rtpoll_item;
-
-    int write_type;
+    pa_xenpv_ring ring;
+    uint64_t n_notifies;
 };
 
 pa_sample_spec ss;
 pa_channel_map map;
 
-/* just to test non- frame-aligned size */
-#define BUFSIZE 2047
+/* Data pages of the multi-page ring, not counting the header page; a
+ * power of two */
+#define RING_DATA_PAGES 8
 
-struct ring {
-    uint32_t cons_indx, prod_indx;
-    uint32_t usable_buffer_space; /* kept here for convenience */
-    uint8_t buffer[BUFSIZE];
-} *ioring;
+void *ring_pages;
+unsigned n_ring_pages;
 
 static const char* const valid_modargs[] = {
     "sink_name",
@@ -141,12 +139,12 @@ xc_interface* xch;
 xc_evtchn* xce;
 evtchn_port_or_error_t xen_evtchn_port;
 static struct xs_handle *xsh;
-struct ioctl_gntalloc_alloc_gref gref;
+struct ioctl_gntalloc_alloc_gref *gref;
 
 static int register_backend_state_watch(void);
 static int wait_for_backend_state_change(void);
 static int alloc_gref(struct ioctl_gntalloc_alloc_gref *gref, void **addr);
-static int ring_write(struct ring *r, void *src, int length);
+static unsigned negotiate_ring_pages(void);
 static int publish_spec(pa_sample_spec *ss);
 static int read_backend_default_spec(pa_sample_spec *ss);
 static int publish_param(const char *paramname, const char *value);
@@ -238,8 +236,12 @@ int (*state_callbacks[9])(void) = {
 
 static void xen_cleanup() {
     char keybuf[64];
-    /*XXX hardcoded*/
-    munmap((void*)gref.index, 4096);
+
+    if (ring_pages)
+        munmap(ring_pages, n_ring_pages * PA_XENPV_RING_PAGE_SIZE);
+    ring_pages = NULL;
+    pa_xfree(gref);
+    gref = NULL;
 
     set_state(XenbusStateClosing);
     /* send one last event to unblock the backend */
@@ -263,7 +265,10 @@ static int sink_process_msg(pa_msgobject *o, int code, void *data, int64_t offse
         case PA_SINK_MESSAGE_GET_LATENCY: {
             size_t n = 0;
 
+            /* Whatever the backend hasn't consumed yet is still ahead of
+             * the speakers */
             n += u->memchunk.length;
+            n += pa_xenpv_ring_fill(&u->ring);
 
             *((pa_usec_t*) data) = pa_bytes_to_usec(n, &u->sink->sample_spec);
             return 0;
@@ -273,51 +278,46 @@ static int sink_process_msg(pa_msgobject *o, int code, void *data, int64_t offse
     return pa_sink_process_msg(o, code, data, offset, chunk);
 }
 
-static int process_render(struct userdata *u) {
+/* Fills the ring as far as it goes and publishes all of it with a single
+ * index update. The backend only gets an event if it went to sleep on
+ * an empty ring. */
+static void process_render(struct userdata *u) {
     pa_assert(u);
 
+    for (;;) {
+        size_t l;
+        void *p;
 
-    if (u->memchunk.length <= 0)
-        pa_sink_render(u->sink, ioring->usable_buffer_space, &u->memchunk);
+        if (u->memchunk.length <= 0) {
+            size_t n = pa_frame_align(pa_xenpv_ring_free(&u->ring), &u->sink->sample_spec);
 
+            if (n <= 0)
+                break;
 
-    pa_assert(u->memchunk.length > 0);
+            pa_sink_render(u->sink, n, &u->memchunk);
+        }
 
-    xc_evtchn_notify(xce, xen_evtchn_port);
-    for (;;) {
-        ssize_t l;
-        void *p;
+        pa_assert(u->memchunk.length > 0);
 
         p = pa_memblock_acquire(u->memchunk.memblock);
-	    /* xen: write data to ring buffer & notify backend */
-        l = ring_write(ioring, (uint8_t*)p + u->memchunk.index, u->memchunk.length);
-
+        l = pa_xenpv_ring_write(&u->ring, (uint8_t*) p + u->memchunk.index, u->memchunk.length);
         pa_memblock_release(u->memchunk.memblock);
 
-        pa_assert(l != 0);
+        if (l <= 0)
+            break;
 
-        if (l < 0) {
-            if (errno == EINTR)
-                continue;
-            else if (errno == EAGAIN)
-                return 0;
-            else {
-                pa_log("Failed to write data to FIFO: %s", pa_cstrerror(errno));
-                return -1;
-            }
-
-        } else {
-
-            u->memchunk.index += (size_t) l;
-            u->memchunk.length -= (size_t) l;
-
-            if (u->memchunk.length <= 0) {
-                pa_memblock_unref(u->memchunk.memblock);
-                pa_memchunk_reset(&u->memchunk);
-            }
+        u->memchunk.index += l;
+        u->memchunk.length -= l;
+
+        if (u->memchunk.length <= 0) {
+            pa_memblock_unref(u->memchunk.memblock);
+            pa_memchunk_reset(&u->memchunk);
         }
+    }
 
-        return 0;
+    if (pa_xenpv_ring_push(&u->ring)) {
+        xc_evtchn_notify(xce, xen_evtchn_port);
+        u->n_notifies++;
     }
 }
 
@@ -330,42 +330,32 @@ static void thread_func(void *userdata) {
 
     pa_thread_mq_install(&u->thread_mq);
 
-    for(;;){
-        struct pollfd *pollfd;
+    for (;;) {
         int ret;
 
-        pollfd = pa_rtpoll_item_get_pollfd(u->rtpoll_item, NULL);
-
-        /* Render some data and write it to the fifo */
+        /* Render some data and write it to the ring */
         if (PA_SINK_IS_OPENED(u->sink->thread_info.state)) {
+            size_t fill;
 
             if (u->sink->thread_info.rewind_requested)
                 pa_sink_process_rewind(u->sink, 0);
 
-            if (pollfd->revents) {
-                if (process_render(u) < 0)
-                    goto fail;
+            process_render(u);
 
-                pollfd->revents = 0;
-            }
-        }
+            /* Come back when the backend has consumed half of the ring */
+            fill = pa_xenpv_ring_fill(&u->ring);
+            pa_rtpoll_set_timer_relative(u->rtpoll,
+                                         pa_bytes_to_usec(fill > u->ring.size / 2 ? fill - u->ring.size / 2 : 0,
+                                                          &u->sink->sample_spec));
+        } else
+            pa_rtpoll_set_timer_disabled(u->rtpoll);
 
         /* Hmm, nothing to do. Let's sleep */
-
-        pollfd->events = (short) (u->sink->thread_info.state == PA_SINK_RUNNING ? POLLOUT : 0);
-
         if ((ret = pa_rtpoll_run(u->rtpoll, TRUE)) < 0)
             goto fail;
 
         if (ret == 0)
             goto finish;
-
-        pollfd = pa_rtpoll_item_get_pollfd(u->rtpoll_item, NULL);
-
-        if (pollfd->revents & ~POLLOUT) {
-            pa_log("FIFO shutdown.");
-            goto fail;
-        }
     }
 
 fail:
@@ -376,7 +366,7 @@ fail:
     pa_log_debug("Shutting down Xen...");
     xen_cleanup();
 finish:
-    pa_log_debug("Thread shutting down");
+    pa_log_debug("Thread shutting down, %llu backend notifications sent", (unsigned long long) u->n_notifies);
 }
 
 int pa__init(pa_module*m) {
@@ -386,6 +376,7 @@ int pa__init(pa_module*m) {
     pa_sink_new_data data;
     int backend_state;
     int ret;
+    unsigned i;
     char strbuf[100];
 
     pa_assert(m);
@@ -430,10 +421,13 @@ int pa__init(pa_module*m) {
         pa_log("xc_evtchn_bind_unbound_port failed");
     }
 
-    /* get grant reference & map locally */
-    if (alloc_gref(&gref, (void**)&ioring)) {
-       pa_log("alloc_gref failed");
-    };
+    /* get grant references & map locally */
+    n_ring_pages = negotiate_ring_pages();
+    gref = pa_xmalloc0(sizeof(struct ioctl_gntalloc_alloc_gref) + (n_ring_pages - 1) * sizeof(uint32_t));
+    if (alloc_gref(gref, &ring_pages) || !ring_pages) {
+        pa_log("alloc_gref failed");
+        goto fail;
+    }
     device_id = 0; /* hardcoded for now */
 
     if (register_backend_state_watch()) {
@@ -441,7 +435,16 @@ int pa__init(pa_module*m) {
     };
 
     publish_param_int("event-channel", xen_evtchn_port);
-    publish_param_int("ring-ref", gref.gref_ids[0]);
+    publish_param_int("ring-ref", gref->gref_ids[0]);
+    if (n_ring_pages > 1) {
+        publish_param_int("ring-pages", (int) n_ring_pages - 1);
+        for (i = 0; i < n_ring_pages - 1; i++) {
+            char name[16];
+
+            pa_snprintf(name, sizeof(name), "ring-ref-%u", i);
+            publish_param_int(name, gref->gref_ids[i + 1]);
+        }
+    }
 
     /* let's ask for something absurd and deal with rejection */
     ss.rate = 192000;
@@ -478,11 +481,9 @@ int pa__init(pa_module*m) {
     pa_memchunk_reset(&u->memchunk);
     u->rtpoll = pa_rtpoll_new();
     pa_thread_mq_init(&u->thread_mq, m->core->mainloop, u->rtpoll);
-    u->write_type = 0;
 
     /* init ring buffer */
-    ioring->prod_indx = ioring->cons_indx = 0;
-    ioring->usable_buffer_space = BUFSIZE - BUFSIZE % pa_frame_size(&ss);
+    pa_xenpv_ring_init(&u->ring, ring_pages, n_ring_pages, pa_frame_size(&ss));
 
     pa_sink_new_data_init(&data);
     data.driver = __FILE__;
@@ -512,10 +513,8 @@ int pa__init(pa_module*m) {
 
     pa_sink_set_asyncmsgq(u->sink, u->thread_mq.inq);
     pa_sink_set_rtpoll(u->sink, u->rtpoll);
-    pa_sink_set_max_request(u->sink, ioring->usable_buffer_space);
-    pa_sink_set_fixed_latency(u->sink, pa_bytes_to_usec(ioring->usable_buffer_space, &u->sink->sample_spec));
-
-    u->rtpoll_item = pa_rtpoll_item_new(u->rtpoll, PA_RTPOLL_NEVER, 1);
+    pa_sink_set_max_request(u->sink, u->ring.size);
+    pa_sink_set_fixed_latency(u->sink, pa_bytes_to_usec(u->ring.size, &u->sink->sample_spec));
 
     if (!(u->thread = pa_thread_new("xenpv-sink", thread_func, u))) {
         pa_log("Failed to create thread.");
@@ -570,9 +569,6 @@ void pa__done(pa_module*m) {
     if (u->memchunk.memblock)
        pa_memblock_unref(u->memchunk.memblock);
 
-    if (u->rtpoll_item)
-        pa_rtpoll_item_free(u->rtpoll_item);
-
     if (u->rtpoll)
         pa_rtpoll_free(u->rtpoll);
 
@@ -601,7 +597,7 @@ static int alloc_gref(struct ioctl_gntalloc_alloc_gref *gref_, void **addr) {
     /* use dom0 */
     gref_->domid = 0;
     gref_->flags = GNTALLOC_FLAG_WRITABLE;
-    gref_->count = 1;
+    gref_->count = n_ring_pages;
 
     rv = ioctl(alloc_fd, IOCTL_GNTALLOC_ALLOC_GREF, gref_);
     if (rv) {
@@ -610,7 +606,7 @@ static int alloc_gref(struct ioctl_gntalloc_alloc_gref *gref_, void **addr) {
     }
 
     /*addr=NULL(default),length, prot,             flags,    fd,         offset*/
-    *addr = mmap(0, 4096, PROT_READ|PROT_WRITE, MAP_SHARED, alloc_fd, gref_->index);
+    *addr = mmap(0, n_ring_pages * PA_XENPV_RING_PAGE_SIZE, PROT_READ|PROT_WRITE, MAP_SHARED, alloc_fd, gref_->index);
     if (*addr == MAP_FAILED) {
         *addr = 0;
         pa_log_debug("Xen audio sink: mmap'ing shared page failed\n");
@@ -637,41 +633,38 @@ static int alloc_gref(struct ioctl_gntalloc_alloc_gref *gref_, void **addr) {
     return rv;
 }
 
-#define RING_FREE_BYTES ((r->usable_buffer_space - (r->prod_indx-r->cons_indx) -1) % r->usable_buffer_space)
-static int ring_write(struct ring *r, void *src, int length) {
-    int full = 0;
-    for (;;) {
-        /* free space may be split over the end of the buffer */
-        int first_chunk_size = (r->usable_buffer_space-r->prod_indx);
-        int second_chunk_size = (r->cons_indx>=r->prod_indx)? (r->cons_indx) : 0;
-        int l, fl, sl;
-
-        /* full? */
-        if (RING_FREE_BYTES==0) {
-            /*XXX hardcoded*/
-            if (full>=100) {
-                errno = EINTR;
-                return -1;
-            }
-            /*XXX hardcoded */
-            usleep(1000);
-            /* should return in 100ms max; definitely not midstream */
-            full++;
-            continue;
-        }
+/* The multi-page ring is only used if the backend advertises it, with
+ * max-ring-pages limiting the number of data pages. Returns the number
+ * of pages to grant, the header page included. */
+static unsigned negotiate_ring_pages(void) {
+    char *out;
+    unsigned n = RING_DATA_PAGES;
+
+    out = read_param("feature-multi-page-ring");
+    if (!out || atoi(out) != 1) {
+        free(out);
+        pa_log_info("Xen backend doesn't support multi-page rings, using a single page.");
+        return 1;
+    }
+    free(out);
+
+    if ((out = read_param("max-ring-pages"))) {
+        int max = atoi(out);
 
-        /* calculate lengths in case of a split buffer */
-        l = PA_MIN((int)RING_FREE_BYTES, length);
-        fl = PA_MIN(l, first_chunk_size);
-        sl = PA_MIN(l-fl, second_chunk_size);
+        free(out);
 
-        memcpy(r->buffer+r->prod_indx, src, fl);
-        if (sl)
-            memcpy(r->buffer, ((char*)src)+fl, sl);
-        r->prod_indx = (r->prod_indx+fl+sl) % r->usable_buffer_space;
+        if (max < 1) {
+            pa_log_info("Xen backend allows no ring data pages, using a single page.");
+            return 1;
+        }
 
-        return sl+fl;
+        while (n > (unsigned) max)
+            n /= 2;
     }
+
+    pa_log_debug("Xen audio sink: using a ring of %u data pages", n);
+
+    return n + 1;
 }
 
 static int publish_param(const char *paramname, const char *value) {
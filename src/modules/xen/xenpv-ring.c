@@ -0,0 +1,134 @@
+/***
+  This file is part of PulseAudio.
+
+  PulseAudio is free software; you can redistribute it and/or modify
+  it under the terms of the GNU Lesser General Public License as
+  published by the Free Software Foundation; either version 2.1 of the
+  License, or (at your option) any later version.
+
+  PulseAudio is distributed in the hope that it will be useful, but
+  WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+  Lesser General Public License for more details.
+
+  You should have received a copy of the GNU Lesser General Public
+  License along with PulseAudio; if not, write to the Free Software
+  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307
+  USA.
+***/
+
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include <string.h>
+
+#include "xenpv-ring.h"
+
+void pa_xenpv_ring_init(pa_xenpv_ring *r, void *pages, unsigned n_pages, size_t frame_size) {
+    pa_assert(r);
+    pa_assert(pages);
+    pa_assert(n_pages >= 1);
+    pa_assert(frame_size > 0);
+
+    r->prod = 0;
+
+    if (n_pages == 1) {
+        r->header = NULL;
+        r->legacy = pages;
+        r->data = (uint8_t*) pages + sizeof(pa_xenpv_ring_legacy_header);
+        r->size = PA_XENPV_RING_LEGACY_BUFSIZE - PA_XENPV_RING_LEGACY_BUFSIZE % (uint32_t) frame_size;
+
+        r->legacy->cons_indx = 0;
+        r->legacy->usable_buffer_space = r->size;
+        pa_xenpv_store(&r->legacy->prod_indx, 0);
+        return;
+    }
+
+    pa_assert(((n_pages - 1) & (n_pages - 2)) == 0);
+
+    r->header = pages;
+    r->legacy = NULL;
+    r->data = (uint8_t*) pages + PA_XENPV_RING_PAGE_SIZE;
+    r->size = (n_pages - 1) * PA_XENPV_RING_PAGE_SIZE;
+
+    r->header->size = r->size;
+    r->header->cons_indx = 0;
+    r->header->prod_event = 1;
+    pa_xenpv_store(&r->header->prod_indx, 0);
+}
+
+size_t pa_xenpv_ring_fill(pa_xenpv_ring *r) {
+    uint32_t fill;
+
+    pa_assert(r);
+
+    if (r->legacy) {
+        /* Don't trust the other domain too much */
+        uint32_t cons = pa_xenpv_load(&r->legacy->cons_indx) % r->size;
+
+        return (r->prod + r->size - cons) % r->size;
+    }
+
+    fill = r->prod - pa_xenpv_load(&r->header->cons_indx);
+
+    return PA_MIN(fill, r->size);
+}
+
+size_t pa_xenpv_ring_free(pa_xenpv_ring *r) {
+    pa_assert(r);
+
+    /* The legacy ring can't tell a full ring from an empty one, so one
+     * byte always stays unused */
+    return r->size - (r->legacy ? 1 : 0) - pa_xenpv_ring_fill(r);
+}
+
+size_t pa_xenpv_ring_write(pa_xenpv_ring *r, const void *src, size_t length) {
+    size_t index, first;
+
+    pa_assert(r);
+    pa_assert(src);
+
+    length = PA_MIN(length, pa_xenpv_ring_free(r));
+
+    /* The free space may be split over the end of the data area */
+    index = r->legacy ? r->prod : r->prod & (r->size - 1);
+    first = PA_MIN(length, r->size - index);
+
+    memcpy(r->data + index, src, first);
+    memcpy(r->data, (const uint8_t*) src + first, length - first);
+
+    if (r->legacy)
+        r->prod = (uint32_t) ((r->prod + length) % r->size);
+    else
+        r->prod += (uint32_t) length;
+
+    return length;
+}
+
+pa_bool_t pa_xenpv_ring_push(pa_xenpv_ring *r) {
+    uint32_t old_prod;
+
+    pa_assert(r);
+
+    if (r->legacy) {
+        if (r->legacy->prod_indx == r->prod)
+            return FALSE;
+
+        pa_xenpv_store(&r->legacy->prod_indx, r->prod);
+        return TRUE;
+    }
+
+    old_prod = r->header->prod_indx;
+
+    if (old_prod == r->prod)
+        return FALSE;
+
+    /* The data before the index, and the index before reading
+     * prod_event, or we might miss a consumer going to sleep */
+    pa_xenpv_store(&r->header->prod_indx, r->prod);
+    pa_xenpv_mb();
+
+    return r->prod - pa_xenpv_load(&r->header->prod_event) < r->prod - old_prod;
+}
@@ -0,0 +1,110 @@
+#ifndef fooxenpvringhfoo
+#define fooxenpvringhfoo
+
+/***
+  This file is part of PulseAudio.
+
+  PulseAudio is free software; you can redistribute it and/or modify
+  it under the terms of the GNU Lesser General Public License as
+  published by the Free Software Foundation; either version 2.1 of the
+  License, or (at your option) any later version.
+
+  PulseAudio is distributed in the hope that it will be useful, but
+  WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+  Lesser General Public License for more details.
+
+  You should have received a copy of the GNU Lesser General Public
+  License along with PulseAudio; if not, write to the Free Software
+  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307
+  USA.
+***/
+
+#include <inttypes.h>
+#include <sys/types.h>
+
+#include <pulsecore/macro.h>
+
+/* The audio ring shared with the backend domain comes in two layouts.
+ *
+ * The multi-page ring is only used if the backend advertises
+ * feature-multi-page-ring. The first granted page holds the header, the
+ * data area spans the following pages, whose number must be a power of
+ * two. Both indexes are free running byte counters; the data area is
+ * indexed modulo its size. The producer copies as much as it likes into
+ * the ring and publishes it with a single update of prod_indx. A
+ * consumer that finds the ring empty sets prod_event to cons_indx + 1,
+ * checks once more, and then waits for an event. The producer only
+ * sends one when an update moves prod_indx past prod_event, i.e. when
+ * the ring turns non-empty under a waiting consumer, just like the
+ * standard Xen I/O rings do.
+ *
+ * Otherwise we fall back to the original single-page ring: the indexes
+ * wrap at usable_buffer_space, one byte is always left free, and the
+ * backend is notified on every update.
+ *
+ * The headers are shared with another domain, so they are made of fixed
+ * size words, accessed with explicit barriers. */
+
+#define PA_XENPV_RING_PAGE_SIZE 4096U
+
+typedef struct pa_xenpv_ring_header {
+    uint32_t cons_indx;
+    uint32_t prod_indx;
+    uint32_t prod_event;
+    uint32_t size;
+} pa_xenpv_ring_header;
+
+#define PA_XENPV_RING_LEGACY_BUFSIZE 2047U
+
+typedef struct pa_xenpv_ring_legacy_header {
+    uint32_t cons_indx;
+    uint32_t prod_indx;
+    uint32_t usable_buffer_space;
+} pa_xenpv_ring_legacy_header;
+
+#define pa_xenpv_mb() __sync_synchronize()
+
+/* Reads an index, ordered before the accesses to the data that follow */
+static inline uint32_t pa_xenpv_load(const uint32_t *p) {
+    uint32_t v = *(const volatile uint32_t*) p;
+    pa_xenpv_mb();
+    return v;
+}
+
+/* Writes an index, ordered after the accesses to the data that precede */
+static inline void pa_xenpv_store(uint32_t *p, uint32_t v) {
+    pa_xenpv_mb();
+    *(volatile uint32_t*) p = v;
+}
+
+/* The producer's view of the ring */
+typedef struct pa_xenpv_ring {
+    /* Exactly one of these is set */
+    pa_xenpv_ring_header *header;
+    pa_xenpv_ring_legacy_header *legacy;
+
+    uint8_t *data;
+    uint32_t size;
+
+    /* Written up to here, published up to the prod_indx in the header */
+    uint32_t prod;
+} pa_xenpv_ring;
+
+/* pages points to n_pages mapped pages, the header page included. A
+ * single page selects the legacy layout, whose size is aligned to
+ * frame_size. */
+void pa_xenpv_ring_init(pa_xenpv_ring *r, void *pages, unsigned n_pages, size_t frame_size);
+
+/* Bytes the consumer has not consumed yet, unpublished ones included */
+size_t pa_xenpv_ring_fill(pa_xenpv_ring *r);
+size_t pa_xenpv_ring_free(pa_xenpv_ring *r);
+
+/* Copies up to length bytes into the ring without publishing them */
+size_t pa_xenpv_ring_write(pa_xenpv_ring *r, const void *src, size_t length);
+
+/* Publishes everything written so far; returns TRUE if the consumer
+ * needs to be notified */
+pa_bool_t pa_xenpv_ring_push(pa_xenpv_ring *r);
+
+#endif
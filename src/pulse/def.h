@@ -991,6 +991,12 @@ typedef void (*pa_free_cb_t)(void *p);
  * playback, \since 1.0 */
 #define PA_STREAM_EVENT_FORMAT_LOST "format-lost"
 
+/** A stream event notifying that the sink the stream is connected to
+ * could not keep up, and that the server switched the stream to a
+ * cheaper resampler to cope. Clients may want to lower their own
+ * load in response, \since 3.0 */
+#define PA_STREAM_EVENT_OVERLOAD "overload"
+
 /** Port availability / jack detection status
  * \since 2.0 */
 typedef enum pa_port_available {
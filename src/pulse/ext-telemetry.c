@@ -0,0 +1,250 @@
+/***
+  This file is part of PulseAudio.
+
+  PulseAudio is free software; you can redistribute it and/or modify
+  it under the terms of the GNU Lesser General Public License as published
+  by the Free Software Foundation; either version 2.1 of the License,
+  or (at your option) any later version.
+
+  PulseAudio is distributed in the hope that it will be useful, but
+  WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+  General Public License for more details.
+
+  You should have received a copy of the GNU Lesser General Public License
+  along with PulseAudio; if not, write to the Free Software
+  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307
+  USA.
+***/
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include <pulse/context.h>
+#include <pulse/fork-detect.h>
+#include <pulse/operation.h>
+
+#include <pulsecore/macro.h>
+#include <pulsecore/pstream-util.h>
+
+#include "internal.h"
+#include "ext-telemetry.h"
+
+enum {
+    SUBCOMMAND_TEST,
+    SUBCOMMAND_ENABLE,
+    SUBCOMMAND_RESET,
+    SUBCOMMAND_READ
+};
+
+static void ext_telemetry_test_cb(pa_pdispatch *pd, uint32_t command, uint32_t tag, pa_tagstruct *t, void *userdata) {
+    pa_operation *o = userdata;
+    uint32_t version = PA_INVALID_INDEX;
+
+    pa_assert(pd);
+    pa_assert(o);
+    pa_assert(PA_REFCNT_VALUE(o) >= 1);
+
+    if (!o->context)
+        goto finish;
+
+    if (command != PA_COMMAND_REPLY) {
+        if (pa_context_handle_error(o->context, command, t, FALSE) < 0)
+            goto finish;
+
+    } else if (pa_tagstruct_getu32(t, &version) < 0 ||
+               !pa_tagstruct_eof(t)) {
+
+        pa_context_fail(o->context, PA_ERR_PROTOCOL);
+        goto finish;
+    }
+
+    if (o->callback) {
+        pa_ext_telemetry_test_cb_t cb = (pa_ext_telemetry_test_cb_t) o->callback;
+        cb(o->context, version, o->userdata);
+    }
+
+finish:
+    pa_operation_done(o);
+    pa_operation_unref(o);
+}
+
+static pa_operation *send_simple_command(
+        pa_context *c,
+        uint32_t command,
+        pa_pdispatch_cb_t internal_cb,
+        pa_operation_cb_t cb,
+        void *userdata) {
+
+    uint32_t tag;
+    pa_operation *o;
+    pa_tagstruct *t;
+
+    pa_assert(c);
+    pa_assert(PA_REFCNT_VALUE(c) >= 1);
+
+    PA_CHECK_VALIDITY_RETURN_NULL(c, !pa_detect_fork(), PA_ERR_FORKED);
+    PA_CHECK_VALIDITY_RETURN_NULL(c, c->state == PA_CONTEXT_READY, PA_ERR_BADSTATE);
+    PA_CHECK_VALIDITY_RETURN_NULL(c, c->version >= 14, PA_ERR_NOTSUPPORTED);
+
+    o = pa_operation_new(c, NULL, cb, userdata);
+
+    t = pa_tagstruct_command(c, PA_COMMAND_EXTENSION, &tag);
+    pa_tagstruct_putu32(t, PA_INVALID_INDEX);
+    pa_tagstruct_puts(t, "module-telemetry");
+    pa_tagstruct_putu32(t, command);
+    pa_pstream_send_tagstruct(c->pstream, t);
+    pa_pdispatch_register_reply(c->pdispatch, tag, DEFAULT_TIMEOUT, internal_cb, pa_operation_ref(o), (pa_free_cb_t) pa_operation_unref);
+
+    return o;
+}
+
+pa_operation *pa_ext_telemetry_test(
+        pa_context *c,
+        pa_ext_telemetry_test_cb_t cb,
+        void *userdata) {
+
+    return send_simple_command(c, SUBCOMMAND_TEST, ext_telemetry_test_cb, (pa_operation_cb_t) cb, userdata);
+}
+
+/* Reads one histogram. The server may know more or fewer buckets than
+ * we do: surplus buckets are folded into our last one. */
+static int read_histogram(pa_tagstruct *t, pa_ext_telemetry_histogram *h) {
+    uint32_t n_buckets, b;
+
+    if (pa_tagstruct_getu64(t, &h->count) < 0 ||
+        pa_tagstruct_getu64(t, &h->sum) < 0 ||
+        pa_tagstruct_getu32(t, &h->max) < 0 ||
+        pa_tagstruct_getu32(t, &n_buckets) < 0)
+        return -1;
+
+    for (b = 0; b < n_buckets; b++) {
+        uint32_t v;
+
+        if (pa_tagstruct_getu32(t, &v) < 0)
+            return -1;
+
+        h->buckets[PA_MIN(b, PA_EXT_TELEMETRY_BUCKETS - 1)] += v;
+    }
+
+    return 0;
+}
+
+static void ext_telemetry_read_cb(pa_pdispatch *pd, uint32_t command, uint32_t tag, pa_tagstruct *t, void *userdata) {
+    pa_operation *o = userdata;
+    int eol = 1;
+
+    pa_assert(pd);
+    pa_assert(o);
+    pa_assert(PA_REFCNT_VALUE(o) >= 1);
+
+    if (!o->context)
+        goto finish;
+
+    if (command != PA_COMMAND_REPLY) {
+        if (pa_context_handle_error(o->context, command, t, FALSE) < 0)
+            goto finish;
+
+        eol = -1;
+    } else {
+        pa_bool_t enabled;
+
+        if (pa_tagstruct_get_boolean(t, &enabled) < 0) {
+            pa_context_fail(o->context, PA_ERR_PROTOCOL);
+            goto finish;
+        }
+
+        while (!pa_tagstruct_eof(t)) {
+            pa_ext_telemetry_info i;
+            uint32_t type, n_metrics, m;
+
+            memset(&i, 0, sizeof(i));
+
+            if (pa_tagstruct_getu32(t, &type) < 0 ||
+                pa_tagstruct_getu32(t, &i.index) < 0 ||
+                pa_tagstruct_gets(t, &i.name) < 0 ||
+                pa_tagstruct_getu32(t, &i.dropped) < 0 ||
+                pa_tagstruct_getu32(t, &n_metrics) < 0) {
+
+                pa_context_fail(o->context, PA_ERR_PROTOCOL);
+                goto finish;
+            }
+
+            i.type = (pa_ext_telemetry_object_type_t) type;
+
+            /* Metrics we don't know about are skipped */
+            for (m = 0; m < n_metrics; m++) {
+                pa_ext_telemetry_histogram h, *d;
+
+                memset(&h, 0, sizeof(h));
+                d = m < PA_EXT_TELEMETRY_METRIC_MAX ? &i.histograms[m] : &h;
+
+                if (read_histogram(t, d) < 0) {
+                    pa_context_fail(o->context, PA_ERR_PROTOCOL);
+                    goto finish;
+                }
+            }
+
+            if (o->callback) {
+                pa_ext_telemetry_read_cb_t cb = (pa_ext_telemetry_read_cb_t) o->callback;
+                cb(o->context, &i, 0, o->userdata);
+            }
+        }
+    }
+
+    if (o->callback) {
+        pa_ext_telemetry_read_cb_t cb = (pa_ext_telemetry_read_cb_t) o->callback;
+        cb(o->context, NULL, eol, o->userdata);
+    }
+
+finish:
+    pa_operation_done(o);
+    pa_operation_unref(o);
+}
+
+pa_operation *pa_ext_telemetry_read(
+        pa_context *c,
+        pa_ext_telemetry_read_cb_t cb,
+        void *userdata) {
+
+    return send_simple_command(c, SUBCOMMAND_READ, ext_telemetry_read_cb, (pa_operation_cb_t) cb, userdata);
+}
+
+pa_operation *pa_ext_telemetry_enable(
+        pa_context *c,
+        int enable,
+        pa_context_success_cb_t cb,
+        void *userdata) {
+
+    uint32_t tag;
+    pa_operation *o;
+    pa_tagstruct *t;
+
+    pa_assert(c);
+    pa_assert(PA_REFCNT_VALUE(c) >= 1);
+
+    PA_CHECK_VALIDITY_RETURN_NULL(c, !pa_detect_fork(), PA_ERR_FORKED);
+    PA_CHECK_VALIDITY_RETURN_NULL(c, c->state == PA_CONTEXT_READY, PA_ERR_BADSTATE);
+    PA_CHECK_VALIDITY_RETURN_NULL(c, c->version >= 14, PA_ERR_NOTSUPPORTED);
+
+    o = pa_operation_new(c, NULL, (pa_operation_cb_t) cb, userdata);
+
+    t = pa_tagstruct_command(c, PA_COMMAND_EXTENSION, &tag);
+    pa_tagstruct_putu32(t, PA_INVALID_INDEX);
+    pa_tagstruct_puts(t, "module-telemetry");
+    pa_tagstruct_putu32(t, SUBCOMMAND_ENABLE);
+    pa_tagstruct_put_boolean(t, !!enable);
+    pa_pstream_send_tagstruct(c->pstream, t);
+    pa_pdispatch_register_reply(c->pdispatch, tag, DEFAULT_TIMEOUT, pa_context_simple_ack_callback, pa_operation_ref(o), (pa_free_cb_t) pa_operation_unref);
+
+    return o;
+}
+
+pa_operation *pa_ext_telemetry_reset(
+        pa_context *c,
+        pa_context_success_cb_t cb,
+        void *userdata) {
+
+    return send_simple_command(c, SUBCOMMAND_RESET, pa_context_simple_ack_callback, (pa_operation_cb_t) cb, userdata);
+}
@@ -0,0 +1,126 @@
+#ifndef foopulseexttelemetryhfoo
+#define foopulseexttelemetryhfoo
+
+/***
+  This file is part of PulseAudio.
+
+  PulseAudio is free software; you can redistribute it and/or modify
+  it under the terms of the GNU Lesser General Public License as published
+  by the Free Software Foundation; either version 2.1 of the License,
+  or (at your option) any later version.
+
+  PulseAudio is distributed in the hope that it will be useful, but
+  WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+  General Public License for more details.
+
+  You should have received a copy of the GNU Lesser General Public License
+  along with PulseAudio; if not, write to the Free Software
+  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307
+  USA.
+***/
+
+#include <inttypes.h>
+
+#include <pulse/cdecl.h>
+#include <pulse/context.h>
+#include <pulse/version.h>
+
+/** \file
+ *
+ * Routines for controlling module-telemetry
+ */
+
+PA_C_DECL_BEGIN
+
+/** The kind of object a set of histograms belongs to. \since 3.0 */
+typedef enum pa_ext_telemetry_object_type {
+    PA_EXT_TELEMETRY_SINK,
+    PA_EXT_TELEMETRY_SOURCE,
+    PA_EXT_TELEMETRY_SINK_INPUT,
+    PA_EXT_TELEMETRY_SOURCE_OUTPUT
+} pa_ext_telemetry_object_type_t;
+
+/** The quantities that are recorded. All values are in usec. \since 3.0 */
+typedef enum pa_ext_telemetry_metric {
+    PA_EXT_TELEMETRY_RENDER_TIME,
+    /**< Time spent mixing (sinks) or distributing (sources) one chunk */
+
+    PA_EXT_TELEMETRY_BUFFER_FILL,
+    /**< Amount of audio in the device or stream buffer when the IO thread looks at it */
+
+    PA_EXT_TELEMETRY_WAKEUP_LATENESS,
+    /**< How late the IO thread woke up after its timer elapsed */
+
+    PA_EXT_TELEMETRY_REWIND,
+    /**< Amount of audio rewound */
+
+    PA_EXT_TELEMETRY_XRUN,
+    /**< Amount of audio lost in an underrun or overrun, 0 if unknown */
+
+    PA_EXT_TELEMETRY_METRIC_MAX
+} pa_ext_telemetry_metric_t;
+
+/** The number of histogram buckets. Bucket 0 counts zeros, bucket n
+ * counts values from 2^(n-1) to 2^n - 1, the last bucket everything
+ * above. \since 3.0 */
+#define PA_EXT_TELEMETRY_BUCKETS 32
+
+/** A histogram of one metric. \since 3.0 */
+typedef struct pa_ext_telemetry_histogram {
+    uint64_t count;                              /**< Number of samples */
+    uint64_t sum;                                /**< Sum of all samples */
+    uint32_t max;                                /**< Largest sample */
+    uint32_t buckets[PA_EXT_TELEMETRY_BUCKETS];  /**< Samples per bucket */
+} pa_ext_telemetry_histogram;
+
+/** The histograms of one sink, source or stream. \since 3.0 */
+typedef struct pa_ext_telemetry_info {
+    pa_ext_telemetry_object_type_t type;  /**< What kind of object this is */
+    uint32_t index;                       /**< Index of the object */
+    const char *name;                     /**< Name of the device, or media name of the stream */
+    uint32_t dropped;                     /**< Samples lost because nobody collected them in time */
+    pa_ext_telemetry_histogram histograms[PA_EXT_TELEMETRY_METRIC_MAX]; /**< One histogram per metric */
+} pa_ext_telemetry_info;
+
+/** Callback prototype for pa_ext_telemetry_test(). \since 3.0 */
+typedef void (*pa_ext_telemetry_test_cb_t)(
+        pa_context *c,
+        uint32_t version,
+        void *userdata);
+
+/** Test if this extension module is available in the server. \since 3.0 */
+pa_operation *pa_ext_telemetry_test(
+        pa_context *c,
+        pa_ext_telemetry_test_cb_t cb,
+        void *userdata);
+
+/** Callback prototype for pa_ext_telemetry_read(). \since 3.0 */
+typedef void (*pa_ext_telemetry_read_cb_t)(
+        pa_context *c,
+        const pa_ext_telemetry_info *info,
+        int eol,
+        void *userdata);
+
+/** Read the histograms of all sinks, sources and streams. \since 3.0 */
+pa_operation *pa_ext_telemetry_read(
+        pa_context *c,
+        pa_ext_telemetry_read_cb_t cb,
+        void *userdata);
+
+/** Start or stop recording. Recording is off by default. \since 3.0 */
+pa_operation *pa_ext_telemetry_enable(
+        pa_context *c,
+        int enable,
+        pa_context_success_cb_t cb,
+        void *userdata);
+
+/** Clear all histograms. \since 3.0 */
+pa_operation *pa_ext_telemetry_reset(
+        pa_context *c,
+        pa_context_success_cb_t cb,
+        void *userdata);
+
+PA_C_DECL_END
+
+#endif
@@ -169,6 +169,12 @@ struct pa_stream {
     /* playback */
     pa_memblock *write_memblock;
     void *write_data;
+    size_t write_index, write_length;
+
+    /* Pool block successive writes are packed into, so that small
+     * writes don't use up one pool slot each */
+    pa_memblock *write_arena;
+    size_t write_arena_index;
     int64_t latest_underrun_at_index;
 
     /* recording */
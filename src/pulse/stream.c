@@ -171,6 +171,9 @@ static pa_stream *pa_stream_new_with_proplist_internal(
 
     s->write_memblock = NULL;
     s->write_data = NULL;
+    s->write_index = s->write_length = 0;
+    s->write_arena = NULL;
+    s->write_arena_index = 0;
 
     pa_memchunk_reset(&s->peek_memchunk);
     s->peek_data = NULL;
@@ -289,6 +292,9 @@ static void stream_free(pa_stream *s) {
         pa_memblock_unref(s->write_memblock);
     }
 
+    if (s->write_arena)
+        pa_memblock_unref(s->write_arena);
+
     if (s->peek_memchunk.memblock) {
         if (s->peek_data)
             pa_memblock_release(s->peek_memchunk.memblock);
@@ -1399,6 +1405,33 @@ int pa_stream_connect_record(
     return create_stream(PA_STREAM_RECORD, s, dev, attr, flags, NULL, NULL);
 }
 
+/* Makes sure the write arena has length bytes free, starting a new one
+ * if it doesn't. length must not exceed the pool block size. Returns the
+ * index of the free space. */
+static size_t write_arena_reserve(pa_stream *s, size_t length) {
+    pa_assert(length <= pa_mempool_block_size_max(s->context->mempool));
+
+    if (!s->write_arena || s->write_arena_index + length > pa_memblock_get_length(s->write_arena)) {
+
+        if (s->write_arena)
+            pa_memblock_unref(s->write_arena);
+
+        /* The old block stays alive for as long as the data already
+         * written into it is still queued */
+        s->write_arena = pa_memblock_new(s->context->mempool, (size_t) -1);
+        s->write_arena_index = 0;
+    }
+
+    return s->write_arena_index;
+}
+
+/* Marks everything up to end as used. Pieces are kept pointer aligned. */
+static void write_arena_consume(pa_stream *s, size_t end) {
+    pa_assert(s->write_arena);
+
+    s->write_arena_index = PA_MIN(PA_ALIGN(end), pa_memblock_get_length(s->write_arena));
+}
+
 int pa_stream_begin_write(
         pa_stream *s,
         void **data,
@@ -1413,7 +1446,7 @@ int pa_stream_begin_write(
     PA_CHECK_VALIDITY(s->context, data, PA_ERR_INVALID);
     PA_CHECK_VALIDITY(s->context, nbytes && *nbytes != 0, PA_ERR_INVALID);
 
-    if (*nbytes != (size_t) -1) {
+    if (!s->write_memblock) {
         size_t m, fs;
 
         m = pa_mempool_block_size_max(s->context->mempool);
@@ -1422,15 +1455,16 @@ int pa_stream_begin_write(
         m = (m / fs) * fs;
         if (*nbytes > m)
             *nbytes = m;
-    }
 
-    if (!s->write_memblock) {
-        s->write_memblock = pa_memblock_new(s->context->mempool, *nbytes);
-        s->write_data = pa_memblock_acquire(s->write_memblock);
+        /* Hand out the next piece of the write arena */
+        s->write_index = write_arena_reserve(s, *nbytes);
+        s->write_length = *nbytes;
+        s->write_memblock = pa_memblock_ref(s->write_arena);
+        s->write_data = (uint8_t*) pa_memblock_acquire(s->write_memblock) + s->write_index;
     }
 
     *data = s->write_data;
-    *nbytes = pa_memblock_get_length(s->write_memblock);
+    *nbytes = s->write_length;
 
     return 0;
 }
@@ -1452,6 +1486,7 @@ int pa_stream_cancel_write(
     pa_memblock_unref(s->write_memblock);
     s->write_memblock = NULL;
     s->write_data = NULL;
+    s->write_index = s->write_length = 0;
 
     return 0;
 }
@@ -1476,7 +1511,7 @@ int pa_stream_write(
     PA_CHECK_VALIDITY(s->context,
                       !s->write_memblock ||
                       ((data >= s->write_data) &&
-                       ((const char*) data + length <= (const char*) s->write_data + pa_memblock_get_length(s->write_memblock))),
+                       ((const char*) data + length <= (const char*) s->write_data + s->write_length)),
                       PA_ERR_INVALID);
     PA_CHECK_VALIDITY(s->context, !free_cb || !s->write_memblock, PA_ERR_INVALID);
 
@@ -1488,11 +1523,16 @@ int pa_stream_write(
         pa_memblock_release(s->write_memblock);
 
         chunk.memblock = s->write_memblock;
-        chunk.index = (const char *) data - (const char *) s->write_data;
+        chunk.index = s->write_index + (size_t) ((const char *) data - (const char *) s->write_data);
         chunk.length = length;
 
+        /* The rest of the arena can be used by the next write */
+        if (chunk.memblock == s->write_arena)
+            write_arena_consume(s, chunk.index + chunk.length);
+
         s->write_memblock = NULL;
         s->write_data = NULL;
+        s->write_index = s->write_length = 0;
 
         pa_pstream_send_memblock(s->context->pstream, s->channel, offset, seek, &chunk);
         pa_memblock_unref(chunk.memblock);
@@ -1508,20 +1548,23 @@ int pa_stream_write(
         while (t_length > 0) {
             pa_memchunk chunk;
 
-            chunk.index = 0;
-
             if (free_cb && !pa_pstream_get_shm(s->context->pstream)) {
                 chunk.memblock = pa_memblock_new_user(s->context->mempool, (void*) t_data, t_length, free_cb, 1);
+                chunk.index = 0;
                 chunk.length = t_length;
             } else {
                 void *d;
 
+                /* Copy into the write arena instead of a block of its own */
                 chunk.length = PA_MIN(t_length, pa_mempool_block_size_max(s->context->mempool));
-                chunk.memblock = pa_memblock_new(s->context->mempool, chunk.length);
+                chunk.index = write_arena_reserve(s, chunk.length);
+                chunk.memblock = pa_memblock_ref(s->write_arena);
 
                 d = pa_memblock_acquire(chunk.memblock);
-                memcpy(d, t_data, chunk.length);
+                memcpy((uint8_t*) d + chunk.index, t_data, chunk.length);
                 pa_memblock_release(chunk.memblock);
+
+                write_arena_consume(s, chunk.index + chunk.length);
             }
 
             pa_pstream_send_memblock(s->context->pstream, s->channel, t_offset, t_seek, &chunk);
@@ -485,7 +485,11 @@ int pa_stream_disconnect(pa_stream *s);
  * pa_stream_write() use pa_stream_cancel_write(). Calling
  * pa_stream_begin_write() twice without calling pa_stream_write() or
  * pa_stream_cancel_write() in between will return exactly the same
- * \a data pointer and \a nbytes values. \since 0.9.16 */
+ * \a data pointer and \a nbytes values.
+ *
+ * Asking for no more than you actually need is cheap: consecutive
+ * small writes are placed next to each other in the same shared
+ * memory block. \since 0.9.16 */
 int pa_stream_begin_write(
         pa_stream *p,
         void **data,
@@ -32,13 +32,15 @@
 #include <pulsecore/log.h>
 #include <pulsecore/semaphore.h>
 #include <pulsecore/macro.h>
-#include <pulsecore/mutex.h>
 #include <pulsecore/flist.h>
+#include <pulsecore/futex.h>
 
 #include "asyncmsgq.h"
 
 PA_STATIC_FLIST_DECLARE(asyncmsgq, 0, pa_xfree);
+#ifndef PA_HAVE_FUTEX
 PA_STATIC_FLIST_DECLARE(semaphores, 0, (void(*)(void*)) pa_semaphore_free);
+#endif
 
 struct asyncmsgq_item {
     int code;
@@ -47,14 +49,21 @@ struct asyncmsgq_item {
     pa_free_cb_t free_cb;
     int64_t offset;
     pa_memchunk memchunk;
+
+    /* Only for items sent with pa_asyncmsgq_send(), which lie on the
+     * sender's stack. The sender sleeps until 'done' is set. */
+    pa_bool_t sync;
+#ifdef PA_HAVE_FUTEX
+    pa_atomic_t done;
+#else
     pa_semaphore *semaphore;
+#endif
     int ret;
 };
 
 struct pa_asyncmsgq {
     PA_REFCNT_DECLARE;
-    pa_asyncq *asyncq;
-    pa_mutex *mutex; /* only for the writer side */
+    pa_asyncq *asyncq; /* multiple-writer safe on its own */
 
     struct asyncmsgq_item *current;
 };
@@ -66,7 +75,6 @@ pa_asyncmsgq *pa_asyncmsgq_new(unsigned size) {
 
     PA_REFCNT_INIT(a);
     pa_assert_se(a->asyncq = pa_asyncq_new(size));
-    pa_assert_se(a->mutex = pa_mutex_new(FALSE, TRUE));
     a->current = NULL;
 
     return a;
@@ -78,7 +86,7 @@ static void asyncmsgq_free(pa_asyncmsgq *a) {
 
     while ((i = pa_asyncq_pop(a->asyncq, FALSE))) {
 
-        pa_assert(!i->semaphore);
+        pa_assert(!i->sync);
 
         if (i->object)
             pa_msgobject_unref(i->object);
@@ -94,7 +102,6 @@ static void asyncmsgq_free(pa_asyncmsgq *a) {
     }
 
     pa_asyncq_free(a->asyncq, NULL);
-    pa_mutex_free(a->mutex);
     pa_xfree(a);
 }
 
@@ -130,12 +137,9 @@ void pa_asyncmsgq_post(pa_asyncmsgq *a, pa_msgobject *object, int code, const vo
         pa_memblock_ref(i->memchunk.memblock);
     } else
         pa_memchunk_reset(&i->memchunk);
-    i->semaphore = NULL;
+    i->sync = FALSE;
 
-    /* This mutex makes the queue multiple-writer safe. This lock is only used on the writing side */
-    pa_mutex_lock(a->mutex);
     pa_asyncq_post(a->asyncq, i);
-    pa_mutex_unlock(a->mutex);
 }
 
 int pa_asyncmsgq_send(pa_asyncmsgq *a, pa_msgobject *object, int code, const void *userdata, int64_t offset, const pa_memchunk *chunk) {
@@ -154,20 +158,28 @@ int pa_asyncmsgq_send(pa_asyncmsgq *a, pa_msgobject *object, int code, const voi
     } else
         pa_memchunk_reset(&i.memchunk);
 
+    i.sync = TRUE;
+
+#ifdef PA_HAVE_FUTEX
+    pa_atomic_store(&i.done, 0);
+
+    pa_assert_se(pa_asyncq_push(a->asyncq, &i, TRUE) == 0);
+
+    while (!pa_atomic_load(&i.done))
+        pa_futex_wait(&i.done, 0);
+#else
     if (!(i.semaphore = pa_flist_pop(PA_STATIC_FLIST_GET(semaphores))))
         i.semaphore = pa_semaphore_new(0);
 
     pa_assert_se(i.semaphore);
 
-    /* This mutex makes the queue multiple-writer safe. This lock is only used on the writing side */
-    pa_mutex_lock(a->mutex);
     pa_assert_se(pa_asyncq_push(a->asyncq, &i, TRUE) == 0);
-    pa_mutex_unlock(a->mutex);
 
     pa_semaphore_wait(i.semaphore);
 
     if (pa_flist_push(PA_STATIC_FLIST_GET(semaphores), i.semaphore) < 0)
         pa_semaphore_free(i.semaphore);
+#endif
 
     return i.ret;
 }
@@ -212,9 +224,17 @@ void pa_asyncmsgq_done(pa_asyncmsgq *a, int ret) {
     pa_assert(a);
     pa_assert(a->current);
 
-    if (a->current->semaphore) {
+    if (a->current->sync) {
         a->current->ret = ret;
+#ifdef PA_HAVE_FUTEX
+        /* The item lives on the sender's stack and may be gone as
+         * soon as 'done' is set. A wakeup hitting that address
+         * afterwards is harmless, futex waiters recheck. */
+        pa_atomic_store(&a->current->done, 1);
+        pa_futex_wake(&a->current->done, 1);
+#else
         pa_semaphore_post(a->current->semaphore);
+#endif
     } else {
 
         if (a->current->free_cb)
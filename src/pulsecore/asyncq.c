@@ -36,6 +36,7 @@
 #include <pulsecore/llist.h>
 #include <pulsecore/flist.h>
 #include <pulsecore/fdsem.h>
+#include <pulsecore/mutex.h>
 
 #include "asyncq.h"
 
@@ -57,12 +58,25 @@ struct localq {
     PA_LLIST_FIELDS(struct localq);
 };
 
+/* Each cell carries a sequence number: it equals the write index a
+ * writer may claim the cell for, and that index plus one once the
+ * item has been stored and may be read. The reader advances it by
+ * the queue size when it releases the cell again. */
+struct cell {
+    pa_atomic_t seq;
+    pa_atomic_ptr_t data;
+};
+
 struct pa_asyncq {
     unsigned size;
     unsigned read_idx;
-    unsigned write_idx;
+    pa_atomic_t write_idx;
     pa_fdsem *read_fdsem, *write_fdsem;
 
+    /* Protects the local queue, only taken while it is not empty */
+    pa_mutex *mutex;
+    pa_atomic_t n_localq;
+
     PA_LLIST_HEAD(struct localq, localq);
     struct localq *last_localq;
     pa_bool_t waiting_for_post;
@@ -70,7 +84,7 @@ struct pa_asyncq {
 
 PA_STATIC_FLIST_DECLARE(localq, 0, pa_xfree);
 
-#define PA_ASYNCQ_CELLS(x) ((pa_atomic_ptr_t*) ((uint8_t*) (x) + PA_ALIGN(sizeof(struct pa_asyncq))))
+#define PA_ASYNCQ_CELLS(x) ((struct cell*) ((uint8_t*) (x) + PA_ALIGN(sizeof(struct pa_asyncq))))
 
 static unsigned reduce(pa_asyncq *l, unsigned value) {
     return value & (unsigned) (l->size - 1);
@@ -78,16 +92,22 @@ static unsigned reduce(pa_asyncq *l, unsigned value) {
 
 pa_asyncq *pa_asyncq_new(unsigned size) {
     pa_asyncq *l;
+    struct cell *cells;
+    unsigned i;
 
     if (!size)
         size = ASYNCQ_SIZE;
 
     pa_assert(pa_is_power_of_two(size));
 
-    l = pa_xmalloc0(PA_ALIGN(sizeof(pa_asyncq)) + (sizeof(pa_atomic_ptr_t) * size));
+    l = pa_xmalloc0(PA_ALIGN(sizeof(pa_asyncq)) + (sizeof(struct cell) * size));
 
     l->size = size;
 
+    cells = PA_ASYNCQ_CELLS(l);
+    for (i = 0; i < size; i++)
+        pa_atomic_store(&cells[i].seq, (int) i);
+
     PA_LLIST_HEAD_INIT(struct localq, l->localq);
     l->last_localq = NULL;
     l->waiting_for_post = FALSE;
@@ -103,6 +123,8 @@ pa_asyncq *pa_asyncq_new(unsigned size) {
         return NULL;
     }
 
+    pa_assert_se(l->mutex = pa_mutex_new(FALSE, FALSE));
+
     return l;
 }
 
@@ -129,41 +151,65 @@ void pa_asyncq_free(pa_asyncq *l, pa_free_cb_t free_cb) {
 
     pa_fdsem_free(l->read_fdsem);
     pa_fdsem_free(l->write_fdsem);
+    pa_mutex_free(l->mutex);
     pa_xfree(l);
 }
 
 static int push(pa_asyncq*l, void *p, pa_bool_t wait_op) {
-    unsigned idx;
-    pa_atomic_ptr_t *cells;
+    struct cell *cells;
+    pa_bool_t slept = FALSE;
 
     pa_assert(l);
     pa_assert(p);
 
     cells = PA_ASYNCQ_CELLS(l);
 
-    _Y;
-    idx = reduce(l, l->write_idx);
+    for (;;) {
+        unsigned idx;
+        struct cell *c;
+        int d;
 
-    if (!pa_atomic_ptr_cmpxchg(&cells[idx], NULL, p)) {
+        _Y;
+        idx = (unsigned) pa_atomic_load(&l->write_idx);
+        c = &cells[reduce(l, idx)];
+        d = (int) ((unsigned) pa_atomic_load(&c->seq) - idx);
 
-        if (!wait_op)
-            return -1;
+        if (d == 0) {
 
-/*         pa_log("sleeping on push"); */
+            /* The cell is free, try to claim it */
+            if (pa_atomic_cmpxchg(&l->write_idx, (int) idx, (int) (idx + 1))) {
+                _Y;
+                pa_atomic_ptr_store(&c->data, p);
+                pa_atomic_store(&c->seq, (int) (idx + 1));
+                break;
+            }
+
+        } else if (d < 0) {
+
+            /* The reader didn't release the cell yet, we're full */
+            if (!wait_op)
+                return -1;
+
+/*             pa_log("sleeping on push"); */
 
-        do {
             pa_fdsem_wait(l->read_fdsem);
-        } while (!pa_atomic_ptr_cmpxchg(&cells[idx], NULL, p));
+            slept = TRUE;
+        }
+
+        /* Otherwise another writer was quicker, try again */
     }
 
-    _Y;
-    l->write_idx++;
+    /* Other writers might be waiting for room, too. The wakeup was
+     * consumed by us, so pass it on. */
+    if (slept)
+        pa_fdsem_post(l->read_fdsem);
 
     pa_fdsem_post(l->write_fdsem);
 
     return 0;
 }
 
+/* Called with the mutex held */
 static pa_bool_t flush_postq(pa_asyncq *l, pa_bool_t wait_op) {
     struct localq *q;
 
@@ -177,6 +223,7 @@ static pa_bool_t flush_postq(pa_asyncq *l, pa_bool_t wait_op) {
         l->last_localq = q->prev;
 
         PA_LLIST_REMOVE(struct localq, l->localq, q);
+        pa_atomic_dec(&l->n_localq);
 
         if (pa_flist_push(PA_STATIC_FLIST_GET(localq), q) < 0)
             pa_xfree(q);
@@ -186,12 +233,22 @@ static pa_bool_t flush_postq(pa_asyncq *l, pa_bool_t wait_op) {
 }
 
 int pa_asyncq_push(pa_asyncq*l, void *p, pa_bool_t wait_op) {
+    int r = -1;
+
     pa_assert(l);
 
-    if (!flush_postq(l, wait_op))
-        return -1;
+    /* Items queued locally have to go first */
+    if (pa_atomic_load(&l->n_localq) <= 0)
+        return push(l, p, wait_op);
+
+    pa_mutex_lock(l->mutex);
+
+    if (flush_postq(l, wait_op))
+        r = push(l, p, wait_op);
+
+    pa_mutex_unlock(l->mutex);
 
-    return push(l, p, wait_op);
+    return r;
 }
 
 void pa_asyncq_post(pa_asyncq*l, void *p) {
@@ -200,9 +257,17 @@ void pa_asyncq_post(pa_asyncq*l, void *p) {
     pa_assert(l);
     pa_assert(p);
 
+    if (pa_atomic_load(&l->n_localq) <= 0)
+        if (push(l, p, FALSE) >= 0)
+            return;
+
+    pa_mutex_lock(l->mutex);
+
     if (flush_postq(l, FALSE))
-        if (pa_asyncq_push(l, p, FALSE) >= 0)
+        if (push(l, p, FALSE) >= 0) {
+            pa_mutex_unlock(l->mutex);
             return;
+        }
 
     /* OK, we couldn't push anything in the queue. So let's queue it
      * locally and push it later */
@@ -219,22 +284,21 @@ void pa_asyncq_post(pa_asyncq*l, void *p) {
     if (!l->last_localq)
         l->last_localq = q;
 
-    return;
+    pa_atomic_inc(&l->n_localq);
+
+    pa_mutex_unlock(l->mutex);
 }
 
 void* pa_asyncq_pop(pa_asyncq*l, pa_bool_t wait_op) {
-    unsigned idx;
+    struct cell *c;
     void *ret;
-    pa_atomic_ptr_t *cells;
 
     pa_assert(l);
 
-    cells = PA_ASYNCQ_CELLS(l);
-
     _Y;
-    idx = reduce(l, l->read_idx);
+    c = &PA_ASYNCQ_CELLS(l)[reduce(l, l->read_idx)];
 
-    if (!(ret = pa_atomic_ptr_load(&cells[idx]))) {
+    if (pa_atomic_load(&c->seq) != (int) (l->read_idx + 1)) {
 
         if (!wait_op)
             return NULL;
@@ -243,15 +307,15 @@ void* pa_asyncq_pop(pa_asyncq*l, pa_bool_t wait_op) {
 
         do {
             pa_fdsem_wait(l->write_fdsem);
-        } while (!(ret = pa_atomic_ptr_load(&cells[idx])));
+        } while (pa_atomic_load(&c->seq) != (int) (l->read_idx + 1));
     }
 
-    pa_assert(ret);
-
-    /* Guaranteed to succeed if we only have a single reader */
-    pa_assert_se(pa_atomic_ptr_cmpxchg(&cells[idx], ret, NULL));
+    pa_assert_se(ret = pa_atomic_ptr_load(&c->data));
+    pa_atomic_ptr_store(&c->data, NULL);
 
+    /* Hand the cell back to the writers for the next round */
     _Y;
+    pa_atomic_store(&c->seq, (int) (l->read_idx + l->size));
     l->read_idx++;
 
     pa_fdsem_post(l->read_fdsem);
@@ -266,18 +330,15 @@ int pa_asyncq_read_fd(pa_asyncq *q) {
 }
 
 int pa_asyncq_read_before_poll(pa_asyncq *l) {
-    unsigned idx;
-    pa_atomic_ptr_t *cells;
+    struct cell *c;
 
     pa_assert(l);
 
-    cells = PA_ASYNCQ_CELLS(l);
-
     _Y;
-    idx = reduce(l, l->read_idx);
+    c = &PA_ASYNCQ_CELLS(l)[reduce(l, l->read_idx)];
 
     for (;;) {
-        if (pa_atomic_ptr_load(&cells[idx]))
+        if (pa_atomic_load(&c->seq) == (int) (l->read_idx + 1))
             return -1;
 
         if (pa_fdsem_before_poll(l->write_fdsem) >= 0)
@@ -301,8 +362,15 @@ void pa_asyncq_write_before_poll(pa_asyncq *l) {
     pa_assert(l);
 
     for (;;) {
+        pa_bool_t flushed = TRUE;
+
+        if (pa_atomic_load(&l->n_localq) > 0) {
+            pa_mutex_lock(l->mutex);
+            flushed = flush_postq(l, FALSE);
+            pa_mutex_unlock(l->mutex);
+        }
 
-        if (flush_postq(l, FALSE))
+        if (flushed)
             break;
 
         if (pa_fdsem_before_poll(l->read_fdsem) >= 0) {
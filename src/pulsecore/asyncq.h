@@ -27,11 +27,12 @@
 #include <pulsecore/macro.h>
 
 /* A simple, asynchronous, lock-free (if requested also wait-free)
- * queue. Not multiple-reader/multiple-writer safe. If that is
- * required both sides can be protected by a mutex each. --- Which is
- * not a bad thing in most cases, since this queue is intended for
- * communication between a normal thread and a single real-time
- * thread. Only the real-time side needs to be lock-free/wait-free.
+ * queue. It is safe to push from multiple threads at the same time
+ * without any locking, but there may only be a single reader. Only
+ * when items had to be queued locally by pa_asyncq_post() because the
+ * queue was full, the writers serialize on a mutex until these have
+ * been flushed. The reading side, which is usually a real-time
+ * thread, never takes a lock.
  *
  * If the queue is full and another entry shall be pushed, or when the
  * queue is empty and another entry shall be popped and the "wait"
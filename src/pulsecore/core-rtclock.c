@@ -48,6 +48,7 @@
 #include <windows.h>
 #endif
 
+#include <pulse/rtclock.h>
 #include <pulse/timeval.h>
 #include <pulsecore/macro.h>
 #include <pulsecore/core-error.h>
@@ -65,6 +66,17 @@ pa_usec_t pa_rtclock_age(const struct timeval *tv) {
     return pa_timeval_diff(pa_rtclock_get(&now), tv);
 }
 
+pa_usec_t pa_rtclock_thread_cpu(void) {
+#if defined(HAVE_CLOCK_GETTIME) && defined(CLOCK_THREAD_CPUTIME_ID)
+    struct timespec ts;
+
+    if (clock_gettime(CLOCK_THREAD_CPUTIME_ID, &ts) == 0)
+        return pa_timespec_load(&ts);
+#endif
+
+    return pa_rtclock_now();
+}
+
 struct timeval *pa_rtclock_get(struct timeval *tv) {
 
 #if defined(OS_IS_DARWIN)
@@ -32,6 +32,11 @@ struct timeval;
 struct timeval *pa_rtclock_get(struct timeval *ts);
 
 pa_usec_t pa_rtclock_age(const struct timeval *tv);
+
+/* CPU time used by the calling thread, unlike the wall clock this
+ * doesn't advance while the thread is preempted. Falls back to
+ * pa_rtclock_now() where that isn't available. */
+pa_usec_t pa_rtclock_thread_cpu(void);
 pa_bool_t pa_rtclock_hrtimer(void);
 void pa_rtclock_hrtimer_enable(void);
 
@@ -26,6 +26,7 @@
 
 #include <stdlib.h>
 #include <stdio.h>
+#include <string.h>
 #include <sys/types.h>
 #include <dirent.h>
 #include <sys/stat.h>
@@ -59,11 +60,21 @@
 #include <pulsecore/log.h>
 #include <pulsecore/core-error.h>
 #include <pulsecore/macro.h>
+#include <pulsecore/resampler.h>
 
 #include "core-scache.h"
 
 #define UNLOAD_POLL_TIME (60 * PA_USEC_PER_SEC)
 
+struct pa_scache_converted {
+    pa_sample_spec sample_spec;
+    pa_channel_map channel_map;
+    pa_memchunk memchunk;
+    pa_usec_t last_used;
+
+    PA_LLIST_FIELDS(pa_scache_converted);
+};
+
 static void timeout_callback(pa_mainloop_api *m, pa_time_event *e, const struct timeval *t, void *userdata) {
     pa_core *c = userdata;
 
@@ -76,6 +87,28 @@ static void timeout_callback(pa_mainloop_api *m, pa_time_event *e, const struct
     pa_core_rttime_restart(c, e, pa_rtclock_now() + UNLOAD_POLL_TIME);
 }
 
+static void free_converted(pa_scache_entry *e, pa_scache_converted *cv) {
+    pa_assert(e);
+    pa_assert(cv);
+
+    PA_LLIST_REMOVE(pa_scache_converted, e->converted, cv);
+    pa_assert(e->n_converted > 0);
+    e->n_converted--;
+
+    pa_assert(e->core->scache_converted_size >= cv->memchunk.length);
+    e->core->scache_converted_size -= cv->memchunk.length;
+
+    pa_memblock_unref(cv->memchunk.memblock);
+    pa_xfree(cv);
+}
+
+static void free_all_converted(pa_scache_entry *e) {
+    pa_assert(e);
+
+    while (e->converted)
+        free_converted(e, e->converted);
+}
+
 static void free_entry(pa_scache_entry *e) {
     pa_assert(e);
 
@@ -83,6 +116,7 @@ static void free_entry(pa_scache_entry *e) {
     pa_subscription_post(e->core, PA_SUBSCRIPTION_EVENT_SAMPLE_CACHE|PA_SUBSCRIPTION_EVENT_REMOVE, e->index);
     pa_xfree(e->name);
     pa_xfree(e->filename);
+    free_all_converted(e);
     if (e->memchunk.memblock)
         pa_memblock_unref(e->memchunk.memblock);
     if (e->proplist)
@@ -97,6 +131,7 @@ static pa_scache_entry* scache_add_item(pa_core *c, const char *name) {
     pa_assert(name);
 
     if ((e = pa_namereg_get(c, name, PA_NAMEREG_SAMPLE))) {
+        free_all_converted(e);
         if (e->memchunk.memblock)
             pa_memblock_unref(e->memchunk.memblock);
 
@@ -118,6 +153,9 @@ static pa_scache_entry* scache_add_item(pa_core *c, const char *name) {
         e->core = c;
         e->proplist = pa_proplist_new();
 
+        PA_LLIST_HEAD_INIT(pa_scache_converted, e->converted);
+        e->n_converted = 0;
+
         pa_idxset_put(c->scache, e, &e->index);
 
         pa_subscription_post(c, PA_SUBSCRIPTION_EVENT_SAMPLE_CACHE|PA_SUBSCRIPTION_EVENT_NEW, e->index);
@@ -295,8 +333,200 @@ void pa_scache_free_all(pa_core *c) {
     }
 }
 
+/* How much silence we push through the resampler after the sample, so
+ * that the samples held back in its filter come out, too. This is more
+ * than the delay of any of our resamplers. */
+#define CONVERT_DRAIN_USEC (20*PA_USEC_PER_MSEC)
+
+/* Runs one block through the resampler and appends the result to buf */
+static void append_resampled(pa_resampler *r, const pa_memchunk *in, uint8_t **buf, size_t *length, size_t *allocated) {
+    pa_memchunk out;
+    void *src;
+
+    pa_resampler_run(r, in, &out);
+
+    if (!out.memblock)
+        return;
+
+    if (*length + out.length > *allocated) {
+        *allocated = PA_MAX(*allocated * 2, *length + out.length);
+        *buf = pa_xrealloc(*buf, *allocated);
+    }
+
+    src = pa_memblock_acquire(out.memblock);
+    memcpy(*buf + *length, (uint8_t*) src + out.index, out.length);
+    pa_memblock_release(out.memblock);
+    pa_memblock_unref(out.memblock);
+
+    *length += out.length;
+}
+
+/* Convert the whole entry to the sample spec and channel map of the
+ * sink in one go, so that playing it needs no resampler anymore. */
+static pa_scache_converted* convert_entry(pa_scache_entry *e, pa_sink *sink) {
+    pa_resampler *r;
+    pa_scache_converted *cv;
+    size_t block_size, offset = 0, length = 0, allocated, drain;
+    uint8_t *buf;
+
+    pa_assert(e);
+    pa_assert(e->memchunk.memblock);
+    pa_assert(sink);
+
+    if (!(r = pa_resampler_new(
+                  e->core->mempool,
+                  &e->sample_spec, &e->channel_map,
+                  &sink->sample_spec, &sink->channel_map,
+                  e->core->resample_method,
+                  (e->core->disable_remixing ? PA_RESAMPLER_NO_REMIX : 0) |
+                  (e->core->disable_lfe_remixing ? PA_RESAMPLER_NO_LFE : 0))))
+        return NULL;
+
+    block_size = pa_frame_align(pa_resampler_max_block_size(r), &e->sample_spec);
+    drain = pa_usec_to_bytes(CONVERT_DRAIN_USEC, &e->sample_spec);
+    allocated = pa_resampler_result(r, e->memchunk.length + drain) + pa_frame_size(&sink->sample_spec) * 64;
+
+    if (allocated > PA_SCACHE_ENTRY_SIZE_MAX) {
+        pa_resampler_free(r);
+        return NULL;
+    }
+
+    buf = pa_xmalloc(allocated);
+
+    while (offset < e->memchunk.length) {
+        pa_memchunk in;
+
+        in.memblock = e->memchunk.memblock;
+        in.index = e->memchunk.index + offset;
+        in.length = PA_MIN(e->memchunk.length - offset, block_size);
+        offset += in.length;
+
+        append_resampled(r, &in, &buf, &length, &allocated);
+    }
+
+    /* Flush the filter delay out with trailing silence. The copy ends
+     * up slightly longer than the original, which is inaudible. */
+    while (drain > 0) {
+        pa_memchunk silence;
+
+        pa_silence_memchunk_get(&e->core->silence_cache, e->core->mempool, &silence, &e->sample_spec, PA_MIN(drain, block_size));
+        drain -= silence.length;
+
+        append_resampled(r, &silence, &buf, &length, &allocated);
+        pa_memblock_unref(silence.memblock);
+    }
+
+    pa_resampler_free(r);
+
+    if (length == 0 || length > PA_SCACHE_ENTRY_SIZE_MAX) {
+        pa_xfree(buf);
+        return NULL;
+    }
+
+    cv = pa_xnew(pa_scache_converted, 1);
+    cv->sample_spec = sink->sample_spec;
+    cv->channel_map = sink->channel_map;
+    cv->memchunk.memblock = pa_memblock_new_malloced(e->core->mempool, pa_xrealloc(buf, length), length);
+    cv->memchunk.index = 0;
+    cv->memchunk.length = length;
+
+    return cv;
+}
+
+static pa_scache_converted* last_converted(pa_scache_entry *e) {
+    pa_scache_converted *cv;
+
+    if (!(cv = e->converted))
+        return NULL;
+
+    while (cv->next)
+        cv = cv->next;
+
+    return cv;
+}
+
+/* Frees the least recently used converted copy of any entry. Returns
+ * FALSE if there was none. */
+static pa_bool_t evict_converted(pa_core *c) {
+    pa_scache_entry *e, *oldest_e = NULL;
+    pa_scache_converted *cv, *oldest = NULL;
+    uint32_t idx;
+
+    PA_IDXSET_FOREACH(e, c->scache, idx)
+        if ((cv = last_converted(e)) && (!oldest || cv->last_used < oldest->last_used)) {
+            oldest = cv;
+            oldest_e = e;
+        }
+
+    if (!oldest)
+        return FALSE;
+
+    free_converted(oldest_e, oldest);
+    return TRUE;
+}
+
+/* Returns a copy of the entry in the sample spec and channel map of
+ * the sink, converting it first if we don't have one yet. Returns
+ * NULL if the entry should be played unconverted. */
+static pa_scache_converted* get_converted(pa_scache_entry *e, pa_sink *sink) {
+    pa_scache_converted *cv;
+    char st[PA_SAMPLE_SPEC_SNPRINT_MAX];
+    size_t size;
+
+    pa_assert(e);
+    pa_assert(sink);
+
+    if (pa_sample_spec_equal(&e->sample_spec, &sink->sample_spec) &&
+        pa_channel_map_equal(&e->channel_map, &sink->channel_map))
+        return NULL;
+
+    PA_LLIST_FOREACH(cv, e->converted)
+        if (pa_sample_spec_equal(&cv->sample_spec, &sink->sample_spec) &&
+            pa_channel_map_equal(&cv->channel_map, &sink->channel_map)) {
+
+            /* Move to the front, so that the least recently used copy
+             * is the first one to go */
+            PA_LLIST_REMOVE(pa_scache_converted, e->converted, cv);
+            PA_LLIST_PREPEND(pa_scache_converted, e->converted, cv);
+            cv->last_used = pa_rtclock_now();
+            return cv;
+        }
+
+    size = pa_usec_to_bytes(pa_bytes_to_usec(e->memchunk.length, &e->sample_spec), &sink->sample_spec);
+
+    if (size > PA_SCACHE_CONVERT_SIZE_MAX) {
+        pa_log_debug("Sample \"%s\" is too large to be converted for sink \"%s\", playing it unconverted.", e->name, sink->name);
+        return NULL;
+    }
+
+    if (!(cv = convert_entry(e, sink))) {
+        pa_log_debug("Failed to convert sample \"%s\" for sink \"%s\", playing it unconverted.", e->name, sink->name);
+        return NULL;
+    }
+
+    /* Only make room once we know the conversion worked */
+    if (e->n_converted >= PA_SCACHE_CONVERTED_MAX)
+        free_converted(e, last_converted(e));
+
+    while (e->core->scache_converted_size + cv->memchunk.length > PA_SCACHE_CONVERTED_TOTAL_MAX)
+        if (!evict_converted(e->core))
+            break;
+
+    PA_LLIST_PREPEND(pa_scache_converted, e->converted, cv);
+    e->n_converted++;
+    e->core->scache_converted_size += cv->memchunk.length;
+    cv->last_used = pa_rtclock_now();
+
+    pa_log_debug("Converted sample \"%s\" to %s for sink \"%s\", %lu bytes",
+                 e->name, pa_sample_spec_snprint(st, sizeof(st), &cv->sample_spec), sink->name,
+                 (unsigned long) cv->memchunk.length);
+
+    return cv;
+}
+
 int pa_scache_play_item(pa_core *c, const char *name, pa_sink *sink, pa_volume_t volume, pa_proplist *p, uint32_t *sink_input_idx) {
     pa_scache_entry *e;
+    pa_scache_converted *cv;
     pa_cvolume r;
     pa_proplist *merged;
     pa_bool_t pass_volume;
@@ -350,12 +580,24 @@ int pa_scache_play_item(pa_core *c, const char *name, pa_sink *sink, pa_volume_t
     if (p)
         pa_proplist_update(merged, PA_UPDATE_REPLACE, p);
 
-    if (pa_play_memchunk(sink,
-                         &e->sample_spec, &e->channel_map,
-                         &e->memchunk,
-                         pass_volume ? &r : NULL,
-                         merged,
-                         PA_SINK_INPUT_NO_CREATE_ON_SUSPEND|PA_SINK_INPUT_KILL_ON_SUSPEND, sink_input_idx) < 0)
+    if ((cv = get_converted(e, sink))) {
+        if (pass_volume)
+            pa_cvolume_remap(&r, &e->channel_map, &cv->channel_map);
+
+        if (pa_play_memchunk(sink,
+                             &cv->sample_spec, &cv->channel_map,
+                             &cv->memchunk,
+                             pass_volume ? &r : NULL,
+                             merged,
+                             PA_SINK_INPUT_NO_CREATE_ON_SUSPEND|PA_SINK_INPUT_KILL_ON_SUSPEND, sink_input_idx) < 0)
+            goto fail;
+
+    } else if (pa_play_memchunk(sink,
+                                &e->sample_spec, &e->channel_map,
+                                &e->memchunk,
+                                pass_volume ? &r : NULL,
+                                merged,
+                                PA_SINK_INPUT_NO_CREATE_ON_SUSPEND|PA_SINK_INPUT_KILL_ON_SUSPEND, sink_input_idx) < 0)
         goto fail;
 
     pa_proplist_free(merged);
@@ -416,10 +658,16 @@ size_t pa_scache_total_size(pa_core *c) {
     if (!c->scache || !pa_idxset_size(c->scache))
         return 0;
 
-    for (e = pa_idxset_first(c->scache, &idx); e; e = pa_idxset_next(c->scache, &idx))
+    for (e = pa_idxset_first(c->scache, &idx); e; e = pa_idxset_next(c->scache, &idx)) {
+        pa_scache_converted *cv;
+
         if (e->memchunk.memblock)
             sum += e->memchunk.length;
 
+        PA_LLIST_FOREACH(cv, e->converted)
+            sum += cv->memchunk.length;
+    }
+
     return sum;
 }
 
@@ -443,6 +691,7 @@ void pa_scache_unload_unused(pa_core *c) {
         if (e->last_used_time + c->scache_idle_time > now)
             continue;
 
+        free_all_converted(e);
         pa_memblock_unref(e->memchunk.memblock);
         pa_memchunk_reset(&e->memchunk);
 
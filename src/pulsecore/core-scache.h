@@ -26,9 +26,24 @@
 #include <pulsecore/core.h>
 #include <pulsecore/memchunk.h>
 #include <pulsecore/sink.h>
+#include <pulsecore/llist.h>
 
 #define PA_SCACHE_ENTRY_SIZE_MAX (1024*1024*16)
 
+/* How many sink-specific converted copies we keep per entry */
+#define PA_SCACHE_CONVERTED_MAX 4
+
+/* Entries that would convert to more than this are resampled while
+ * playing instead, converting them in one go would stall the main
+ * loop */
+#define PA_SCACHE_CONVERT_SIZE_MAX (1024*1024)
+
+/* How much memory the converted copies of all entries may take
+ * together */
+#define PA_SCACHE_CONVERTED_TOTAL_MAX (1024*1024*4)
+
+typedef struct pa_scache_converted pa_scache_converted;
+
 typedef struct pa_scache_entry {
     uint32_t index;
     pa_core *core;
@@ -41,6 +56,12 @@ typedef struct pa_scache_entry {
     pa_channel_map channel_map;
     pa_memchunk memchunk;
 
+    /* Copies of memchunk converted to the sample spec and channel map
+     * of the sinks this entry was played on, most recently used
+     * first. */
+    PA_LLIST_HEAD(pa_scache_converted, converted);
+    unsigned n_converted;
+
     char *filename;
 
     pa_bool_t lazy;
@@ -164,6 +164,9 @@ struct pa_core {
 
     int exit_idle_time, scache_idle_time;
 
+    /* Memory taken by converted copies of sample cache entries */
+    size_t scache_converted_size;
+
     pa_bool_t flat_volumes:1;
     pa_bool_t disallow_module_loading:1;
     pa_bool_t disallow_exit:1;
@@ -26,6 +26,7 @@
 
 #include <errno.h>
 #include <sys/types.h>
+#include <sys/stat.h>
 #include <unistd.h>
 #include <stdio.h>
 
@@ -37,12 +38,36 @@
 
 #include "database.h"
 
+/* Changes are appended to a journal next to the database file on every
+ * sync. The database file itself is only rewritten (compacted) when the
+ * journal holds more records than there are entries in the database,
+ * or after the database was cleared.
+ *
+ * The journal starts with a header record (an empty key) that holds the
+ * inode number of the database file it applies to. Compaction writes a
+ * new file, so a journal left over from before a compaction is
+ * recognized as stale and ignored, even if we crashed before removing
+ * it. */
+#define COMPACT_MIN_RECORDS 64
+#define JOURNAL_HEADER_SIZE 8
 
 typedef struct simple_data {
     char *filename;
     char *tmp_filename;
+    char *journal_filename;
     pa_hashmap *map;
     pa_bool_t read_only;
+
+    /* Entries set and keys removed since the last sync */
+    pa_idxset *dirty;
+    pa_hashmap *removed;
+
+    unsigned journal_records;
+    pa_bool_t compact;
+
+    /* Identifies the database file the journal belongs to, 0 if there
+     * is no database file yet */
+    uint64_t file_id;
 } simple_data;
 
 typedef struct entry {
@@ -112,6 +137,31 @@ static void free_entry(entry *e) {
     }
 }
 
+static void mark_set(simple_data *db, entry *e) {
+    pa_datum *k;
+
+    if ((k = pa_hashmap_remove(db->removed, &e->key))) {
+        pa_datum_free(k);
+        pa_xfree(k);
+    }
+
+    pa_idxset_put(db->dirty, e, NULL);
+}
+
+static void mark_removed(simple_data *db, entry *e) {
+    pa_datum *k;
+
+    pa_idxset_remove_by_data(db->dirty, e, NULL);
+
+    if (pa_hashmap_get(db->removed, &e->key))
+        return;
+
+    k = pa_xnew(pa_datum, 1);
+    k->data = e->key.size > 0 ? pa_xmemdup(e->key.data, e->key.size) : NULL;
+    k->size = e->key.size;
+    pa_hashmap_put(db->removed, k, k);
+}
+
 static int read_uint(FILE *f, uint32_t *res) {
     size_t items = 0;
     uint8_t values[4];
@@ -134,6 +184,8 @@ static int read_uint(FILE *f, uint32_t *res) {
     return items;
 }
 
+/* Returns 0 for a field with data, 1 for an empty field and -1 on EOF
+ * or error */
 static int read_data(FILE *f, void **data, ssize_t *length) {
     size_t items = 0;
     uint32_t data_len = 0;
@@ -158,9 +210,8 @@ static int read_data(FILE *f, void **data, ssize_t *length) {
 
         *length = data_len;
 
-    } else { /* no data? */
-        return -1;
-    }
+    } else /* no data, a removed entry in the journal */
+        return 1;
 
     return 0;
 
@@ -171,64 +222,129 @@ reset:
     return -1;
 }
 
-static int fill_data(simple_data *db, FILE *f) {
+/* Reads key/data records, later records replace earlier ones and a key
+ * with empty data removes the entry. Returns the number of records
+ * read. *clean is set to FALSE if the file doesn't end right after the
+ * last complete record, e.g. because we crashed while appending. */
+static int fill_data(simple_data *db, FILE *f, pa_bool_t *clean) {
     pa_datum key;
-    pa_datum data;
     void *d = NULL;
     ssize_t l = 0;
-    pa_bool_t append = FALSE;
+    int r, n = 0;
+    long good;
     enum { FIELD_KEY = 0, FIELD_DATA } field = FIELD_KEY;
 
     pa_assert(db);
     pa_assert(db->map);
+    pa_assert(clean);
 
     errno = 0;
+    *clean = TRUE;
+    good = ftell(f);
 
     key.size = 0;
     key.data = NULL;
 
-    while (!read_data(f, &d, &l)) {
+    while ((r = read_data(f, &d, &l)) >= 0) {
+        entry *e;
 
-        switch (field) {
-            case FIELD_KEY:
-                key.data = d;
-                key.size = l;
-                field = FIELD_DATA;
-                break;
-            case FIELD_DATA:
-                data.data = d;
-                data.size = l;
-                append = TRUE;
+        if (field == FIELD_KEY) {
+            /* Empty keys are never written */
+            if (r > 0)
                 break;
+
+            key.data = d;
+            key.size = l;
+            field = FIELD_DATA;
+            continue;
         }
 
-        if (append) {
-            entry *e = pa_xnew0(entry, 1);
+        if ((e = pa_hashmap_remove(db->map, &key)))
+            free_entry(e);
+
+        if (r > 0)
+            pa_xfree(key.data);
+        else {
+            e = pa_xnew0(entry, 1);
             e->key.data = key.data;
             e->key.size = key.size;
-            e->data.data = data.data;
-            e->data.size = data.size;
+            e->data.data = d;
+            e->data.size = l;
             pa_hashmap_put(db->map, &e->key, e);
-            append = FALSE;
-            field = FIELD_KEY;
         }
+
+        key.data = NULL;
+        field = FIELD_KEY;
+        n++;
+
+        good = ftell(f);
     }
 
     if (ferror(f)) {
         pa_log_warn("read error. %s", pa_cstrerror(errno));
         pa_database_clear((pa_database*)db);
+    } else if (fseek(f, 0, SEEK_END) < 0 || ftell(f) != good) {
+        pa_log_warn("Ignoring incomplete record at the end of the database.");
+        *clean = FALSE;
     }
 
-    if (field == FIELD_DATA && d)
+    if (field == FIELD_DATA)
+        pa_xfree(key.data);
+
+    return n;
+}
+
+static uint64_t file_id(FILE *f) {
+    struct stat st;
+
+    if (fstat(fileno(f), &st) < 0)
+        return 0;
+
+    return (uint64_t) st.st_ino;
+}
+
+/* Returns 0 if the journal belongs to the database file identified by
+ * id, -1 otherwise */
+static int read_journal_header(FILE *f, uint64_t id) {
+    void *d;
+    ssize_t l;
+    uint64_t header_id = 0;
+    int r, i;
+
+    r = read_data(f, &d, &l);
+    pa_xfree(d);
+
+    if (r != 1)
+        goto fail;
+
+    if (read_data(f, &d, &l) != 0)
+        goto fail;
+
+    if (l != JOURNAL_HEADER_SIZE) {
         pa_xfree(d);
+        goto fail;
+    }
+
+    for (i = 0; i < JOURNAL_HEADER_SIZE; i++)
+        header_id |= (uint64_t) ((uint8_t*) d)[i] << (i*8);
+
+    pa_xfree(d);
+
+    if (header_id != id)
+        goto fail;
+
+    return 0;
 
-    return pa_hashmap_size(db->map);
+fail:
+    pa_log_info("Ignoring stale or invalid database journal.");
+    return -1;
 }
 
 pa_database* pa_database_open(const char *fn, pa_bool_t for_write) {
     FILE *f;
     char *path;
     simple_data *db;
+    pa_bool_t clean;
 
     pa_assert(fn);
 
@@ -241,11 +357,34 @@ pa_database* pa_database_open(const char *fn, pa_bool_t for_write) {
         db = pa_xnew0(simple_data, 1);
         db->map = pa_hashmap_new(hash_func, compare_func);
         db->filename = pa_xstrdup(path);
-        db->tmp_filename = pa_sprintf_malloc(".%s.tmp", db->filename);
+        db->tmp_filename = pa_sprintf_malloc("%s.tmp", db->filename);
+        db->journal_filename = pa_sprintf_malloc("%s.journal", db->filename);
         db->read_only = !for_write;
+        db->dirty = pa_idxset_new(NULL, NULL);
+        db->removed = pa_hashmap_new(hash_func, compare_func);
 
         if (f) {
-            fill_data(db, f);
+            db->file_id = file_id(f);
+            fill_data(db, f, &clean);
+            fclose(f);
+        }
+
+        /* Replay the changes that were made since the last compaction.
+         * If the journal is stale, torn or unreadable, rewrite
+         * everything on the next sync, which also removes it. */
+        if ((f = pa_fopen_cloexec(db->journal_filename, "r"))) {
+            if (db->file_id != 0 && read_journal_header(f, db->file_id) >= 0) {
+                db->journal_records = (unsigned) fill_data(db, f, &clean);
+
+                if (!clean)
+                    db->compact = TRUE;
+            } else {
+                db->compact = TRUE;
+
+                if (for_write)
+                    unlink(db->journal_filename);
+            }
+
             fclose(f);
         }
     } else {
@@ -267,7 +406,10 @@ void pa_database_close(pa_database *database) {
     pa_database_clear(database);
     pa_xfree(db->filename);
     pa_xfree(db->tmp_filename);
+    pa_xfree(db->journal_filename);
     pa_hashmap_free(db->map, NULL, NULL);
+    pa_idxset_free(db->dirty, NULL, NULL);
+    pa_hashmap_free(db->removed, NULL, NULL);
     pa_xfree(db);
 }
 
@@ -309,7 +451,9 @@ int pa_database_set(pa_database *database, const pa_datum *key, const pa_datum*
         entry *r;
         if (overwrite) {
             r = pa_hashmap_remove(db->map, key);
+            pa_idxset_remove_by_data(db->dirty, r, NULL);
             pa_hashmap_put(db->map, &e->key, e);
+            mark_set(db, e);
         } else {
             /* won't overwrite, so clean new entry */
             r = e;
@@ -317,7 +461,8 @@ int pa_database_set(pa_database *database, const pa_datum *key, const pa_datum*
         }
 
         free_entry(r);
-    }
+    } else
+        mark_set(db, e);
 
     return ret;
 }
@@ -333,6 +478,7 @@ int pa_database_unset(pa_database *database, const pa_datum *key) {
     if (!e)
         return -1;
 
+    mark_removed(db, e);
     free_entry(e);
 
     return 0;
@@ -342,11 +488,24 @@ int pa_database_clear(pa_database *database) {
     simple_data *db = (simple_data*)database;
     entry *e;
 
+    pa_datum *k;
+
     pa_assert(db);
 
     while ((e = pa_hashmap_steal_first(db->map)))
         free_entry(e);
 
+    while (pa_idxset_steal_first(db->dirty, NULL))
+        ;
+
+    while ((k = pa_hashmap_steal_first(db->removed))) {
+        pa_datum_free(k);
+        pa_xfree(k);
+    }
+
+    /* The journal can't express this, so rewrite the whole file */
+    db->compact = TRUE;
+
     return 0;
 }
 
@@ -465,16 +624,86 @@ static int write_entry(FILE *f, const entry *e) {
     return 0;
 }
 
-int pa_database_sync(pa_database *database) {
-    simple_data *db = (simple_data*)database;
+/* Appends all changes since the last sync to the journal */
+static int write_journal(simple_data *db) {
     FILE *f;
-    void *state;
     entry *e;
+    pa_datum *k;
 
-    pa_assert(db);
+    if (pa_idxset_isempty(db->dirty) && pa_hashmap_isempty(db->removed))
+        return 0;
 
-    if (db->read_only)
+    /* The journal needs a database file to refer to */
+    if (db->file_id == 0) {
+        db->compact = TRUE;
         return 0;
+    }
+
+    errno = 0;
+
+    if (!(f = pa_fopen_cloexec(db->journal_filename, "a")))
+        goto fail;
+
+    if (fseek(f, 0, SEEK_END) < 0)
+        goto fail;
+
+    if (ftell(f) == 0) {
+        uint8_t header[JOURNAL_HEADER_SIZE];
+        int i;
+
+        for (i = 0; i < JOURNAL_HEADER_SIZE; i++)
+            header[i] = (uint8_t) (db->file_id >> (i*8));
+
+        if (write_uint(f, 0) <= 0 || write_data(f, header, sizeof(header)) < 0)
+            goto fail;
+    }
+
+    while ((k = pa_hashmap_steal_first(db->removed))) {
+        int r;
+
+        r = write_data(f, k->data, k->size) < 0 || write_uint(f, 0) <= 0 ? -1 : 0;
+
+        pa_datum_free(k);
+        pa_xfree(k);
+
+        if (r < 0)
+            goto fail;
+
+        db->journal_records++;
+    }
+
+    while ((e = pa_idxset_steal_first(db->dirty, NULL))) {
+        if (write_entry(f, e) < 0)
+            goto fail;
+
+        db->journal_records++;
+    }
+
+    if (fclose(f) != 0) {
+        f = NULL;
+        goto fail;
+    }
+
+    return 0;
+
+fail:
+    pa_log_warn("error while writing to journal. %s", pa_cstrerror(errno));
+
+    if (f)
+        fclose(f);
+
+    /* We can't tell what made it to the journal, write everything */
+    db->compact = TRUE;
+    return -1;
+}
+
+/* Rewrites the database file from scratch and drops the journal */
+static int compact(simple_data *db) {
+    FILE *f;
+    void *state;
+    entry *e;
+    pa_datum *k;
+    uint64_t id;
 
     errno = 0;
 
@@ -491,6 +720,13 @@ int pa_database_sync(pa_database *database) {
         }
     }
 
+    if (fflush(f) != 0 || fsync(fileno(f)) < 0) {
+        pa_log_warn("error while writing to file. %s", pa_cstrerror(errno));
+        goto fail;
+    }
+
+    id = file_id(f);
+
     fclose(f);
     f = NULL;
 
@@ -499,6 +735,26 @@ int pa_database_sync(pa_database *database) {
         goto fail;
     }
 
+    db->file_id = id;
+
+    db->journal_records = 0;
+    db->compact = FALSE;
+
+    /* If we crash before this, the journal refers to the old file and
+     * is ignored. Don't append to it if it couldn't be removed. */
+    if (unlink(db->journal_filename) < 0 && errno != ENOENT) {
+        pa_log_warn("error while removing journal. %s", pa_cstrerror(errno));
+        db->compact = TRUE;
+    }
+
+    while (pa_idxset_steal_first(db->dirty, NULL))
+        ;
+
+    while ((k = pa_hashmap_steal_first(db->removed))) {
+        pa_datum_free(k);
+        pa_xfree(k);
+    }
+
     return 0;
 
 fail:
@@ -506,3 +762,21 @@ fail:
         fclose(f);
     return -1;
 }
+
+int pa_database_sync(pa_database *database) {
+    simple_data *db = (simple_data*)database;
+
+    pa_assert(db);
+
+    if (db->read_only)
+        return 0;
+
+    if (!db->compact)
+        write_journal(db);
+
+    if (db->compact ||
+        (db->journal_records >= COMPACT_MIN_RECORDS && db->journal_records > pa_hashmap_size(db->map)))
+        return compact(db);
+
+    return 0;
+}
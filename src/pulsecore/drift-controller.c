@@ -0,0 +1,168 @@
+/***
+  This file is part of PulseAudio.
+
+  PulseAudio is free software; you can redistribute it and/or modify
+  it under the terms of the GNU Lesser General Public License as
+  published by the Free Software Foundation; either version 2.1 of the
+  License, or (at your option) any later version.
+
+  PulseAudio is distributed in the hope that it will be useful, but
+  WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+  Lesser General Public License for more details.
+
+  You should have received a copy of the GNU Lesser General Public
+  License along with PulseAudio; if not, write to the Free Software
+  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307
+  USA.
+***/
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include <math.h>
+
+#include <pulse/timeval.h>
+#include <pulse/xmalloc.h>
+
+#include <pulsecore/macro.h>
+
+#include "drift-controller.h"
+
+/*
+ * A PI controller on the latency error. Writing x for the latency
+ * error, d for the clock drift and r for the rate ratio we apply, the
+ * latency evolves as
+ *
+ *     dx/dt = d - (r - 1)
+ *
+ * We set r - 1 = k_p * x + e, where e, the integral term, is our
+ * estimate of d and is updated with de/dt = k_i * x. With k_p = 2/T
+ * and k_i = 1/T^2 the loop is critically damped and the error decays
+ * with the time constant T, without overshooting.
+ *
+ * The measurements are low pass filtered to keep the ratio from
+ * following measurement noise, and the ratio is limited both in its
+ * deviation from 1 and in how much it may change per update, so that
+ * the corrections stay inaudible. While the ratio is limited the
+ * integral term is not updated further in that direction.
+ */
+
+/* The largest deviation of the ratio from 1 */
+#define MAX_DEVIATION 0.005
+
+/* The largest change of the ratio per update; 2‰ can be considered
+ * inaudible */
+#define MAX_STEP 0.002
+
+/* Weight of a new measurement in the filtered error */
+#define ERROR_WEIGHT 0.5
+
+struct pa_drift_controller {
+    double time_constant;
+
+    pa_bool_t have_last;
+    pa_usec_t last_time;
+
+    double error;  /* filtered latency error, in s */
+    double drift;  /* estimated drift, the integral term */
+    double ratio;
+};
+
+pa_drift_controller* pa_drift_controller_new(pa_usec_t time_constant) {
+    pa_drift_controller *c;
+
+    pa_assert(time_constant > 0);
+
+    c = pa_xnew(pa_drift_controller, 1);
+    c->time_constant = (double) time_constant / PA_USEC_PER_SEC;
+
+    pa_drift_controller_reset(c);
+
+    return c;
+}
+
+void pa_drift_controller_free(pa_drift_controller *c) {
+    pa_assert(c);
+
+    pa_xfree(c);
+}
+
+void pa_drift_controller_reset(pa_drift_controller *c) {
+    pa_assert(c);
+
+    c->have_last = FALSE;
+    c->last_time = 0;
+    c->error = 0;
+    c->drift = 0;
+    c->ratio = 1.0;
+}
+
+double pa_drift_controller_update(pa_drift_controller *c, pa_usec_t now, int64_t error) {
+    double dt, e, kp, ki, drift, ratio;
+
+    pa_assert(c);
+
+    e = (double) error / PA_USEC_PER_SEC;
+
+    if (!c->have_last || now <= c->last_time) {
+
+        if (!c->have_last)
+            c->error = e;
+
+        c->have_last = TRUE;
+        c->last_time = now;
+
+        return c->ratio;
+    }
+
+    dt = (double) (now - c->last_time) / PA_USEC_PER_SEC;
+    c->last_time = now;
+
+    /* After a long pause the history doesn't tell us much anymore */
+    if (dt > c->time_constant) {
+        c->error = e;
+        dt = c->time_constant;
+    } else
+        c->error += ERROR_WEIGHT * (e - c->error);
+
+    kp = 2.0 / c->time_constant;
+    ki = 1.0 / (c->time_constant * c->time_constant);
+
+    drift = c->drift + ki * c->error * dt;
+    ratio = 1.0 + kp * c->error + drift;
+
+    /* Don't wind up the integral term while we are limited */
+    if ((ratio > 1.0 + MAX_DEVIATION && c->error > 0) ||
+        (ratio < 1.0 - MAX_DEVIATION && c->error < 0)) {
+        drift = c->drift;
+        ratio = 1.0 + kp * c->error + drift;
+    }
+
+    c->drift = PA_CLAMP(drift, -MAX_DEVIATION, MAX_DEVIATION);
+
+    ratio = PA_CLAMP(ratio, 1.0 - MAX_DEVIATION, 1.0 + MAX_DEVIATION);
+    c->ratio = PA_CLAMP(ratio, c->ratio - MAX_STEP, c->ratio + MAX_STEP);
+
+    return c->ratio;
+}
+
+double pa_drift_controller_get_ratio(pa_drift_controller *c) {
+    pa_assert(c);
+
+    return c->ratio;
+}
+
+uint32_t pa_drift_controller_get_rate(pa_drift_controller *c, uint32_t base_rate) {
+    pa_assert(c);
+    pa_assert(base_rate > 0);
+
+    return (uint32_t) lrint((double) base_rate * c->ratio);
+}
+
+double pa_drift_controller_get_drift_ppm(pa_drift_controller *c) {
+    pa_assert(c);
+
+    return c->drift * 1000000.0;
+}
@@ -0,0 +1,56 @@
+#ifndef foopulsedriftcontrollerhfoo
+#define foopulsedriftcontrollerhfoo
+
+/***
+  This file is part of PulseAudio.
+
+  PulseAudio is free software; you can redistribute it and/or modify
+  it under the terms of the GNU Lesser General Public License as
+  published by the Free Software Foundation; either version 2.1 of the
+  License, or (at your option) any later version.
+
+  PulseAudio is distributed in the hope that it will be useful, but
+  WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+  Lesser General Public License for more details.
+
+  You should have received a copy of the GNU Lesser General Public
+  License along with PulseAudio; if not, write to the Free Software
+  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307
+  USA.
+***/
+
+#include <inttypes.h>
+
+#include <pulse/sample.h>
+
+/* Closed loop controller that steers the sample rate of a stream so
+ * that a measured latency converges on a target latency, compensating
+ * for the drift between the clocks of two devices. */
+typedef struct pa_drift_controller pa_drift_controller;
+
+/* time_constant is the time in which the latency error should
+ * settle. It should be a few times the interval the controller is
+ * updated in. */
+pa_drift_controller* pa_drift_controller_new(pa_usec_t time_constant);
+void pa_drift_controller_free(pa_drift_controller *c);
+
+/* Forget the history, e.g. after the stream was moved or had an
+ * underrun */
+void pa_drift_controller_reset(pa_drift_controller *c);
+
+/* Feed a new measurement taken at the local time 'now'. error is the
+ * measured minus the target latency. A positive error makes the
+ * stream consume faster. Returns the new rate ratio. */
+double pa_drift_controller_update(pa_drift_controller *c, pa_usec_t now, int64_t error);
+
+/* The ratio to apply to the nominal rate of the stream */
+double pa_drift_controller_get_ratio(pa_drift_controller *c);
+
+/* The ratio applied to base_rate, rounded to the nearest Hz */
+uint32_t pa_drift_controller_get_rate(pa_drift_controller *c, uint32_t base_rate);
+
+/* The estimated relative drift of the clocks, in parts per million */
+double pa_drift_controller_get_drift_ppm(pa_drift_controller *c);
+
+#endif
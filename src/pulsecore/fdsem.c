@@ -35,6 +35,7 @@
 #include <pulsecore/macro.h>
 #include <pulsecore/core-util.h>
 #include <pulsecore/core-error.h>
+#include <pulsecore/futex.h>
 #include <pulse/xmalloc.h>
 
 #ifndef HAVE_PIPE
@@ -54,6 +55,14 @@ struct pa_fdsem {
 #endif
 
     pa_fdsem_data *data;
+
+#ifdef PA_HAVE_FUTEX
+    /* Threads of this process blocking in pa_fdsem_wait() sleep on
+     * the futex instead of the fd. Not used for fdsems shared with
+     * other processes. */
+    pa_bool_t use_futex;
+    pa_atomic_t futex_waiting;
+#endif
 };
 
 pa_fdsem *pa_fdsem_new(void) {
@@ -79,6 +88,11 @@ pa_fdsem *pa_fdsem_new(void) {
     pa_atomic_store(&f->data->signalled, 0);
     pa_atomic_store(&f->data->in_pipe, 0);
 
+#ifdef PA_HAVE_FUTEX
+    f->use_futex = TRUE;
+    pa_atomic_store(&f->futex_waiting, 0);
+#endif
+
     return f;
 }
 
@@ -95,6 +109,10 @@ pa_fdsem *pa_fdsem_open_shm(pa_fdsem_data *data, int event_fd) {
     pa_make_fd_cloexec(f->efd);
     f->fds[0] = f->fds[1] = -1;
     f->data = data;
+
+#ifdef PA_HAVE_FUTEX
+    f->use_futex = FALSE;
+#endif
 #endif
 
     return f;
@@ -122,6 +140,9 @@ pa_fdsem *pa_fdsem_new_shm(pa_fdsem_data *data, int* event_fd) {
     pa_atomic_store(&f->data->signalled, 0);
     pa_atomic_store(&f->data->in_pipe, 0);
 
+#ifdef PA_HAVE_FUTEX
+    f->use_futex = FALSE;
+#endif
 #endif
 
     return f;
@@ -184,6 +205,11 @@ void pa_fdsem_post(pa_fdsem *f) {
 
     if (pa_atomic_cmpxchg(&f->data->signalled, 0, 1)) {
 
+#ifdef PA_HAVE_FUTEX
+        if (f->use_futex && pa_atomic_load(&f->futex_waiting) > 0)
+            pa_futex_wake(&f->data->signalled, 1);
+#endif
+
         if (pa_atomic_load(&f->data->waiting)) {
             ssize_t r;
             char x = 'x';
@@ -230,6 +256,20 @@ void pa_fdsem_wait(pa_fdsem *f) {
     if (pa_atomic_cmpxchg(&f->data->signalled, 1, 0))
         return;
 
+#ifdef PA_HAVE_FUTEX
+    if (f->use_futex) {
+        /* No syscall at all is needed on the posting side unless we
+         * really go to sleep here */
+        pa_atomic_inc(&f->futex_waiting);
+
+        while (!pa_atomic_cmpxchg(&f->data->signalled, 1, 0))
+            pa_futex_wait(&f->data->signalled, 0);
+
+        pa_assert_se(pa_atomic_dec(&f->futex_waiting) >= 1);
+        return;
+    }
+#endif
+
     pa_atomic_inc(&f->data->waiting);
 
     while (!pa_atomic_cmpxchg(&f->data->signalled, 1, 0)) {
@@ -0,0 +1,54 @@
+#ifndef foopulsefutexhfoo
+#define foopulsefutexhfoo
+
+/***
+  This file is part of PulseAudio.
+
+  PulseAudio is free software; you can redistribute it and/or modify
+  it under the terms of the GNU Lesser General Public License as
+  published by the Free Software Foundation; either version 2.1 of the
+  License, or (at your option) any later version.
+
+  PulseAudio is distributed in the hope that it will be useful, but
+  WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+  Lesser General Public License for more details.
+
+  You should have received a copy of the GNU Lesser General Public
+  License along with PulseAudio; if not, write to the Free Software
+  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307
+  USA.
+***/
+
+#include <pulsecore/atomic.h>
+
+/* Minimal wrappers around the Linux futex syscall, for sleeping on a
+ * pa_atomic_t between threads of the same process without going
+ * through an fd. Both calls may return spuriously, so callers must
+ * always recheck their condition in a loop. Only available where
+ * pa_atomic_t is a plain int. */
+
+#if defined(__linux__) && defined(HAVE_SYS_SYSCALL_H) && defined(HAVE_ATOMIC_BUILTINS)
+
+#include <unistd.h>
+#include <sys/syscall.h>
+#include <linux/futex.h>
+
+#ifdef SYS_futex
+
+#define PA_HAVE_FUTEX 1
+
+/* Sleep as long as a still has the value v */
+static inline void pa_futex_wait(pa_atomic_t *a, int v) {
+    syscall(SYS_futex, &a->value, FUTEX_WAIT_PRIVATE, v, NULL, NULL, 0);
+}
+
+/* Wake up at most n threads sleeping on a */
+static inline void pa_futex_wake(pa_atomic_t *a, int n) {
+    syscall(SYS_futex, &a->value, FUTEX_WAKE_PRIVATE, n, NULL, NULL, 0);
+}
+
+#endif
+#endif
+
+#endif
@@ -0,0 +1,501 @@
+/***
+  This file is part of PulseAudio.
+
+  PulseAudio is free software; you can redistribute it and/or modify
+  it under the terms of the GNU Lesser General Public License as
+  published by the Free Software Foundation; either version 2.1 of the
+  License, or (at your option) any later version.
+
+  PulseAudio is distributed in the hope that it will be useful, but
+  WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+  Lesser General Public License for more details.
+
+  You should have received a copy of the GNU Lesser General Public
+  License along with PulseAudio; if not, write to the Free Software
+  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307
+  USA.
+***/
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include <string.h>
+
+#include <pulse/xmalloc.h>
+
+#include <pulsecore/core-util.h>
+#include <pulsecore/macro.h>
+#include <pulsecore/sample-util.h>
+
+#include "lpc-codec.h"
+
+/* Packet layout:
+ *
+ *   uint8_t  type       PACKET_VERBATIM or PACKET_LPC
+ *   uint8_t  channels
+ *   uint16_t n_frames   little endian
+ *
+ * followed by either the samples as little endian 16 bit values, or
+ * by a bit stream (MSB first) which holds for each channel:
+ *
+ *   3 bits   predictor order
+ *   16 bits  for each of the first 'order' samples, verbatim
+ *   and for each partition of up to PARTITION_SIZE residuals:
+ *     5 bits   Rice parameter k
+ *     for each residual: the quotient in unary (zeros terminated by
+ *     a one) and the k low bits of the zigzag mapped value */
+
+#define HEADER_SIZE 4
+
+#define PACKET_VERBATIM 0
+#define PACKET_LPC 1
+
+#define MAX_ORDER 4
+#define PARTITION_SIZE 256
+
+/* We pick k so that no quotient gets longer than this, which bounds
+ * the damage a single spike can do */
+#define MAX_QUOTIENT 64
+
+/* A 16 bit sample minus a fourth order prediction fits in 20 bits after
+ * zigzag mapping, so the encoder never needs a larger Rice parameter.
+ * The decoder rejects anything above it. */
+#define MAX_RICE_K 20
+
+struct bit_writer {
+    uint8_t *data;
+    size_t size, pos;
+    uint64_t acc;
+    unsigned n;
+    pa_bool_t overflow;
+};
+
+struct bit_reader {
+    const uint8_t *data;
+    size_t size, pos;
+    uint64_t acc;
+    unsigned n;
+};
+
+static void put_bits(struct bit_writer *w, uint32_t v, unsigned bits) {
+    pa_assert(bits <= 32);
+
+    if (bits <= 0 || w->overflow)
+        return;
+
+    w->acc = (w->acc << bits) | (v & (((uint64_t) 1 << bits) - 1));
+    w->n += bits;
+
+    while (w->n >= 8) {
+        w->n -= 8;
+
+        if (w->pos >= w->size) {
+            w->overflow = TRUE;
+            return;
+        }
+
+        w->data[w->pos++] = (uint8_t) (w->acc >> w->n);
+    }
+}
+
+static void flush_bits(struct bit_writer *w) {
+    if (!w->overflow && w->n > 0)
+        put_bits(w, 0, 8 - w->n);
+}
+
+static void put_rice(struct bit_writer *w, uint32_t u, unsigned k) {
+    uint32_t q = u >> k;
+
+    while (q >= 32) {
+        put_bits(w, 0, 32);
+        q -= 32;
+    }
+
+    put_bits(w, 1, q + 1);
+    put_bits(w, u, k);
+}
+
+static int get_bits(struct bit_reader *r, unsigned bits, uint32_t *v) {
+    pa_assert(bits <= 32);
+
+    while (r->n < bits) {
+        if (r->pos >= r->size)
+            return -1;
+
+        r->acc = (r->acc << 8) | r->data[r->pos++];
+        r->n += 8;
+    }
+
+    r->n -= bits;
+    *v = (uint32_t) ((r->acc >> r->n) & (((uint64_t) 1 << bits) - 1));
+
+    return 0;
+}
+
+static int get_rice(struct bit_reader *r, unsigned k, uint32_t *u) {
+    uint32_t q = 0, b, low = 0;
+
+    for (;;) {
+        if (get_bits(r, 1, &b) < 0)
+            return -1;
+
+        if (b)
+            break;
+
+        if (++q > MAX_QUOTIENT)
+            return -1;
+    }
+
+    if (k > 0 && get_bits(r, k, &low) < 0)
+        return -1;
+
+    *u = (q << k) | low;
+    return 0;
+}
+
+static inline uint32_t zigzag(int32_t v) {
+    return ((uint32_t) v << 1) ^ (uint32_t) (v >> 31);
+}
+
+static inline int32_t unzigzag(uint32_t u) {
+    return (int32_t) (u >> 1) ^ -(int32_t) (u & 1);
+}
+
+/* x points to the sample to predict, earlier samples are stride
+ * elements apart */
+#define PREDICT(order, x, stride)                                       \
+    ((order) == 0 ? 0 :                                                 \
+     (order) == 1 ? (int32_t) (x)[-(stride)] :                          \
+     (order) == 2 ? 2 * (int32_t) (x)[-(stride)] - (int32_t) (x)[-2*(stride)] : \
+     (order) == 3 ? 3 * (int32_t) (x)[-(stride)] - 3 * (int32_t) (x)[-2*(stride)] + (int32_t) (x)[-3*(stride)] : \
+     4 * (int32_t) (x)[-(stride)] - 6 * (int32_t) (x)[-2*(stride)] + 4 * (int32_t) (x)[-3*(stride)] - (int32_t) (x)[-4*(stride)])
+
+static unsigned pick_order(const int32_t *x, size_t n) {
+    uint64_t sum[MAX_ORDER+1];
+    unsigned order, best = 0;
+    size_t i;
+
+    if (n <= MAX_ORDER)
+        return 0;
+
+    memset(sum, 0, sizeof(sum));
+
+    for (i = MAX_ORDER; i < n; i++)
+        for (order = 0; order <= MAX_ORDER; order++) {
+            int32_t e = x[i] - PREDICT(order, x + i, 1);
+            sum[order] += (uint64_t) (e < 0 ? -e : e);
+        }
+
+    for (order = 1; order <= MAX_ORDER; order++)
+        if (sum[order] < sum[best])
+            best = order;
+
+    return best;
+}
+
+static unsigned rice_parameter(uint64_t sum, uint32_t max, size_t n) {
+    unsigned k = 0;
+
+    /* Make 2^k about the mean value */
+    while (k < MAX_RICE_K && ((uint64_t) n << (k + 1)) <= sum)
+        k++;
+
+    while (k < MAX_RICE_K && (max >> k) > MAX_QUOTIENT)
+        k++;
+
+    return k;
+}
+
+static void encode_channel(struct bit_writer *w, const int32_t *x, size_t n) {
+    uint32_t u[PARTITION_SIZE];
+    unsigned order;
+    size_t i;
+
+    order = pick_order(x, n);
+    put_bits(w, order, 3);
+
+    for (i = 0; i < order; i++)
+        put_bits(w, (uint32_t) (uint16_t) x[i], 16);
+
+    for (i = order; i < n && !w->overflow; i += PARTITION_SIZE) {
+        size_t j, m = PA_MIN(n - i, (size_t) PARTITION_SIZE);
+        uint64_t sum = 0;
+        uint32_t max = 0;
+        unsigned k;
+
+        for (j = 0; j < m; j++) {
+            u[j] = zigzag(x[i+j] - PREDICT(order, x + i + j, 1));
+            sum += u[j];
+            max = PA_MAX(max, u[j]);
+        }
+
+        k = rice_parameter(sum, max, m);
+        put_bits(w, k, 5);
+
+        for (j = 0; j < m; j++)
+            put_rice(w, u[j], k);
+    }
+}
+
+static void write_header(uint8_t *d, uint8_t type, uint8_t channels, size_t n_frames) {
+    d[0] = type;
+    d[1] = channels;
+    d[2] = (uint8_t) (n_frames & 0xFF);
+    d[3] = (uint8_t) (n_frames >> 8);
+}
+
+size_t pa_lpc_encode_bound(size_t n_frames, uint8_t channels) {
+    return HEADER_SIZE + n_frames * channels * sizeof(int16_t);
+}
+
+size_t pa_lpc_encode(const int16_t *src, size_t n_frames, uint8_t channels, void *dst) {
+    struct bit_writer w;
+    int32_t *x;
+    uint8_t *d = dst;
+    size_t i, raw;
+    unsigned c;
+
+    pa_assert(src);
+    pa_assert(dst);
+    pa_assert(channels > 0);
+    pa_assert(n_frames <= PA_LPC_MAX_FRAMES);
+
+    raw = n_frames * channels * sizeof(int16_t);
+
+    /* Anything that gets larger than the raw data is pointless */
+    memset(&w, 0, sizeof(w));
+    w.data = d + HEADER_SIZE;
+    w.size = raw;
+
+    x = pa_xnew(int32_t, PA_MAX(n_frames, 1U));
+
+    for (c = 0; c < channels && !w.overflow; c++) {
+
+        for (i = 0; i < n_frames; i++)
+            x[i] = src[i * channels + c];
+
+        encode_channel(&w, x, n_frames);
+    }
+
+    pa_xfree(x);
+
+    flush_bits(&w);
+
+    if (!w.overflow && w.pos < raw) {
+        write_header(d, PACKET_LPC, channels, n_frames);
+        return HEADER_SIZE + w.pos;
+    }
+
+    write_header(d, PACKET_VERBATIM, channels, n_frames);
+
+    for (i = 0; i < n_frames * channels; i++) {
+        d[HEADER_SIZE + 2*i] = (uint8_t) ((uint16_t) src[i] & 0xFF);
+        d[HEADER_SIZE + 2*i + 1] = (uint8_t) ((uint16_t) src[i] >> 8);
+    }
+
+    return HEADER_SIZE + raw;
+}
+
+void pa_lpc_format_info_set(pa_format_info *f) {
+    pa_assert(f);
+    pa_assert(pa_format_info_is_pcm(f));
+
+    pa_format_info_set_prop_string(f, PA_LPC_FORMAT_PROPERTY, "lpc");
+}
+
+pa_bool_t pa_lpc_format_info_is_lpc(pa_format_info *f) {
+    char *v = NULL;
+    pa_bool_t r;
+
+    pa_assert(f);
+
+    if (!pa_format_info_is_pcm(f) || pa_format_info_get_prop_string(f, PA_LPC_FORMAT_PROPERTY, &v) < 0)
+        return FALSE;
+
+    r = pa_streq(v, "lpc");
+    pa_xfree(v);
+
+    return r;
+}
+
+size_t pa_lpc_memchunk_frames(const pa_memchunk *in) {
+    const uint8_t *s;
+    size_t n_frames = (size_t) -1;
+
+    pa_assert(in);
+    pa_assert(in->memblock);
+
+    s = (const uint8_t*) pa_memblock_acquire(in->memblock) + in->index;
+
+    if (in->length >= HEADER_SIZE)
+        n_frames = (size_t) s[2] | ((size_t) s[3] << 8);
+
+    pa_memblock_release(in->memblock);
+
+    return n_frames;
+}
+
+size_t pa_lpc_decoded_frames(const void *src, size_t length, uint8_t channels) {
+    const uint8_t *s = src;
+    size_t n_frames;
+
+    pa_assert(src);
+
+    if (length < HEADER_SIZE || s[1] != channels)
+        return (size_t) -1;
+
+    n_frames = (size_t) s[2] | ((size_t) s[3] << 8);
+
+    if (s[0] == PACKET_VERBATIM) {
+        if (length != HEADER_SIZE + n_frames * channels * sizeof(int16_t))
+            return (size_t) -1;
+    } else if (s[0] != PACKET_LPC)
+        return (size_t) -1;
+
+    return n_frames;
+}
+
+int pa_lpc_decode(const void *src, size_t length, uint8_t channels, int16_t *dst) {
+    const uint8_t *s = src;
+    struct bit_reader r;
+    size_t i, n_frames;
+    unsigned c;
+
+    pa_assert(src);
+    pa_assert(dst);
+
+    if ((n_frames = pa_lpc_decoded_frames(src, length, channels)) == (size_t) -1)
+        return -1;
+
+    if (s[0] == PACKET_VERBATIM) {
+        for (i = 0; i < n_frames * channels; i++)
+            dst[i] = (int16_t) (uint16_t) (s[HEADER_SIZE + 2*i] | (s[HEADER_SIZE + 2*i + 1] << 8));
+
+        return 0;
+    }
+
+    memset(&r, 0, sizeof(r));
+    r.data = s + HEADER_SIZE;
+    r.size = length - HEADER_SIZE;
+
+    for (c = 0; c < channels; c++) {
+        int16_t *x = dst + c;
+        uint32_t order, v;
+
+        if (get_bits(&r, 3, &order) < 0 || order > MAX_ORDER || order > n_frames)
+            return -1;
+
+        for (i = 0; i < order; i++) {
+            if (get_bits(&r, 16, &v) < 0)
+                return -1;
+
+            x[i * channels] = (int16_t) (uint16_t) v;
+        }
+
+        for (i = order; i < n_frames; i += PARTITION_SIZE) {
+            size_t j, m = PA_MIN(n_frames - i, (size_t) PARTITION_SIZE);
+            uint32_t k;
+
+            if (get_bits(&r, 5, &k) < 0 || k > MAX_RICE_K)
+                return -1;
+
+            for (j = 0; j < m; j++) {
+                int16_t *p = x + (i + j) * channels;
+                uint32_t u;
+                int64_t y;
+
+                if (get_rice(&r, k, &u) < 0)
+                    return -1;
+
+                y = (int64_t) unzigzag(u) + PREDICT(order, p, channels);
+
+                if (y < -0x8000 || y > 0x7FFF)
+                    return -1;
+
+                *p = (int16_t) y;
+            }
+        }
+    }
+
+    return 0;
+}
+
+size_t pa_lpc_max_input(pa_mempool *pool, const pa_sample_spec *ss) {
+    size_t fs, n_frames;
+
+    pa_assert(pool);
+    pa_assert(ss);
+    pa_assert(ss->format == PA_SAMPLE_S16NE);
+
+    fs = pa_frame_size(ss);
+    n_frames = (pa_mempool_block_size_max(pool) - HEADER_SIZE) / fs;
+
+    return PA_MIN(n_frames, (size_t) PA_LPC_MAX_FRAMES) * fs;
+}
+
+int pa_lpc_encode_memchunk(pa_mempool *pool, const pa_sample_spec *ss, const pa_memchunk *in, pa_memchunk *out) {
+    size_t n_frames;
+    const void *s;
+    void *d;
+
+    pa_assert(pool);
+    pa_assert(ss);
+    pa_assert(ss->format == PA_SAMPLE_S16NE);
+    pa_assert(in);
+    pa_assert(in->memblock);
+    pa_assert(out);
+    pa_assert(pa_frame_aligned(in->length, ss));
+    pa_assert(in->length <= pa_lpc_max_input(pool, ss));
+
+    n_frames = in->length / pa_frame_size(ss);
+
+    out->memblock = pa_memblock_new(pool, pa_lpc_encode_bound(n_frames, ss->channels));
+    out->index = 0;
+
+    s = (const uint8_t*) pa_memblock_acquire(in->memblock) + in->index;
+    d = pa_memblock_acquire(out->memblock);
+
+    out->length = pa_lpc_encode(s, n_frames, ss->channels, d);
+
+    pa_memblock_release(out->memblock);
+    pa_memblock_release(in->memblock);
+
+    return 0;
+}
+
+int pa_lpc_decode_memchunk(pa_mempool *pool, const pa_sample_spec *ss, const pa_memchunk *in, pa_memchunk *out) {
+    size_t n_frames;
+    const void *s;
+    int r = -1;
+
+    pa_assert(pool);
+    pa_assert(ss);
+    pa_assert(ss->format == PA_SAMPLE_S16NE);
+    pa_assert(in);
+    pa_assert(in->memblock);
+    pa_assert(out);
+
+    s = (const uint8_t*) pa_memblock_acquire(in->memblock) + in->index;
+
+    if ((n_frames = pa_lpc_decoded_frames(s, in->length, ss->channels)) == (size_t) -1 || n_frames <= 0)
+        goto finish;
+
+    out->memblock = pa_memblock_new(pool, n_frames * pa_frame_size(ss));
+    out->index = 0;
+    out->length = n_frames * pa_frame_size(ss);
+
+    r = pa_lpc_decode(s, in->length, ss->channels, pa_memblock_acquire(out->memblock));
+    pa_memblock_release(out->memblock);
+
+    if (r < 0) {
+        pa_memblock_unref(out->memblock);
+        pa_memchunk_reset(out);
+    }
+
+finish:
+    pa_memblock_release(in->memblock);
+
+    return r;
+}
@@ -0,0 +1,81 @@
+#ifndef foopulselpccodechfoo
+#define foopulselpccodechfoo
+
+/***
+  This file is part of PulseAudio.
+
+  PulseAudio is free software; you can redistribute it and/or modify
+  it under the terms of the GNU Lesser General Public License as
+  published by the Free Software Foundation; either version 2.1 of the
+  License, or (at your option) any later version.
+
+  PulseAudio is distributed in the hope that it will be useful, but
+  WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+  Lesser General Public License for more details.
+
+  You should have received a copy of the GNU Lesser General Public
+  License along with PulseAudio; if not, write to the Free Software
+  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307
+  USA.
+***/
+
+#include <inttypes.h>
+#include <sys/types.h>
+
+#include <pulse/format.h>
+#include <pulse/sample.h>
+#include <pulsecore/memblock.h>
+#include <pulsecore/memchunk.h>
+
+/* A simple lossless codec for 16 bit PCM, used on the wire between
+ * two PulseAudio instances. Each packet is self-contained: every
+ * channel is predicted with the best of the fixed polynomial
+ * predictors of order 0 to 4 and the residuals are Rice coded in
+ * short partitions. Packets that wouldn't get smaller are stored
+ * verbatim. The wire format doesn't depend on the host byte order. */
+
+/* A compressed stream is negotiated as a PCM format with this
+ * property set to "lpc". It is not a pa_encoding_t of its own, since
+ * only the native protocol knows about it, never a client or a sink. */
+#define PA_LPC_FORMAT_PROPERTY "format.compression"
+
+void pa_lpc_format_info_set(pa_format_info *f);
+pa_bool_t pa_lpc_format_info_is_lpc(pa_format_info *f);
+
+/* The most frames a single packet may carry */
+#define PA_LPC_MAX_FRAMES 0xFFFFU
+
+/* The largest size a packet of n_frames frames can take */
+size_t pa_lpc_encode_bound(size_t n_frames, uint8_t channels);
+
+/* Encode n_frames interleaved frames of native endian samples into
+ * dst, which needs to have room for pa_lpc_encode_bound()
+ * bytes. Returns the size of the packet. */
+size_t pa_lpc_encode(const int16_t *src, size_t n_frames, uint8_t channels, void *dst);
+
+/* Returns the number of frames in the packet, or (size_t) -1 if the
+ * packet is invalid */
+size_t pa_lpc_decoded_frames(const void *src, size_t length, uint8_t channels);
+
+/* The number of frames the packet header claims, without checking the
+ * rest of the packet. Returns (size_t) -1 if there is no header. */
+size_t pa_lpc_memchunk_frames(const pa_memchunk *in);
+
+/* Decode a packet into dst, which needs room for
+ * pa_lpc_decoded_frames() frames. Returns 0 on success, a negative
+ * value if the packet is corrupt. */
+int pa_lpc_decode(const void *src, size_t length, uint8_t channels, int16_t *dst);
+
+/* The longest PCM chunk in ss (which needs to be S16NE) that fits
+ * into a single packet that is not larger than a memory block of
+ * pool */
+size_t pa_lpc_max_input(pa_mempool *pool, const pa_sample_spec *ss);
+
+/* Encode resp. decode a whole memchunk into a newly allocated
+ * block. in must not be longer than pa_lpc_max_input() when
+ * encoding. Returns 0 on success. */
+int pa_lpc_encode_memchunk(pa_mempool *pool, const pa_sample_spec *ss, const pa_memchunk *in, pa_memchunk *out);
+int pa_lpc_decode_memchunk(pa_mempool *pool, const pa_sample_spec *ss, const pa_memchunk *in, pa_memchunk *out);
+
+#endif
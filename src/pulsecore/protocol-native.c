@@ -57,6 +57,7 @@
 #include <pulsecore/core-util.h>
 #include <pulsecore/ipacl.h>
 #include <pulsecore/thread-mq.h>
+#include <pulsecore/lpc-codec.h>
 
 #include "protocol-native.h"
 
@@ -133,6 +134,13 @@ typedef struct playback_stream {
     pa_atomic_t seek_or_post_in_queue;
     int64_t seek_windex;
 
+    /* The client sends compressed packets (see lpc-codec.h) which we
+     * decode in the IO thread. Packets may arrive in pieces, the seek
+     * request comes with the first one. */
+    pa_bool_t lpc;
+    pa_seek_mode_t lpc_seek;
+    int64_t lpc_offset;
+
     pa_atomic_t missing;
     pa_usec_t configured_sink_latency;
     /* Requested buffer attributes */
@@ -1072,6 +1080,7 @@ static playback_stream* playback_stream_new(
         pa_bool_t adjust_latency,
         pa_bool_t early_requests,
         pa_bool_t relative_volume,
+        pa_bool_t lpc,
         uint32_t syncid,
         uint32_t *missing,
         int *ret) {
@@ -1165,6 +1174,7 @@ static playback_stream* playback_stream_new(
     s->early_requests = early_requests;
     pa_atomic_store(&s->seek_or_post_in_queue, 0);
     s->seek_windex = -1;
+    s->lpc = lpc;
 
     s->sink_input->parent.process_msg = sink_input_process_msg;
     s->sink_input->pop = sink_input_pop_cb;
@@ -1439,6 +1449,27 @@ static int sink_input_process_msg(pa_msgobject *o, int code, void *userdata, int
         case SINK_INPUT_MESSAGE_SEEK:
         case SINK_INPUT_MESSAGE_POST_DATA: {
             int64_t windex = pa_memblockq_get_write_index(s->memblockq);
+            pa_memchunk decoded;
+            size_t skip = 0;
+
+            pa_memchunk_reset(&decoded);
+
+            if (s->lpc && chunk) {
+                if (pa_lpc_decode_memchunk(i->core->mempool, &i->sample_spec, chunk, &decoded) < 0) {
+                    size_t n_frames = pa_lpc_memchunk_frames(chunk);
+
+                    /* The client has accounted for the decoded length
+                     * already, so leave a hole of that size to stay in
+                     * sync with it */
+                    if (n_frames != (size_t) -1)
+                        skip = n_frames * pa_frame_size(&i->sample_spec);
+
+                    if (pa_log_ratelimit(PA_LOG_WARN))
+                        pa_log_warn("Failed to decode compressed data, replacing %lu bytes with silence.", (unsigned long) skip);
+                    chunk = NULL;
+                } else
+                    chunk = &decoded;
+            }
 
             if (code == SINK_INPUT_MESSAGE_SEEK) {
                 /* The client side is incapable of accounting correctly
@@ -1456,6 +1487,11 @@ static int sink_input_process_msg(pa_msgobject *o, int code, void *userdata, int
                 pa_memblockq_seek(s->memblockq, (int64_t) chunk->length, PA_SEEK_RELATIVE, TRUE);
             }
 
+            if (skip > 0)
+                pa_memblockq_seek(s->memblockq, (int64_t) skip, PA_SEEK_RELATIVE, TRUE);
+            if (decoded.memblock)
+                pa_memblock_unref(decoded.memblock);
+
             /* If more data is in queue, we rewind later instead. */
             if (s->seek_windex != -1)
                 windex = PA_MIN(windex, s->seek_windex);
@@ -1583,6 +1619,8 @@ static int sink_input_pop_cb(pa_sink_input *i, size_t nbytes, pa_memchunk *chunk
     pa_log("%s, pop(): %lu", pa_proplist_gets(i->proplist, PA_PROP_MEDIA_NAME), (unsigned long) pa_memblockq_get_length(s->memblockq));
 #endif
 
+    pa_telemetry_record(i->telemetry, PA_TELEMETRY_BUFFER_FILL, pa_bytes_to_usec(pa_memblockq_get_length(s->memblockq), &i->sample_spec));
+
     if (pa_memblockq_is_readable(s->memblockq))
         s->is_underrun = FALSE;
     else {
@@ -1960,7 +1998,7 @@ static void command_create_playback_stream(pa_pdispatch *pd, uint32_t command, u
     pa_proplist *p = NULL;
     int ret = PA_ERR_INVALID;
     uint8_t n_formats = 0;
-    pa_format_info *format;
+    pa_format_info *format, *lpc_format = NULL;
     pa_idxset *formats = NULL;
     uint32_t i;
 
@@ -2084,6 +2122,21 @@ static void command_create_playback_stream(pa_pdispatch *pd, uint32_t command, u
         }
     }
 
+    if (n_formats == 1 && pa_lpc_format_info_is_lpc(format = pa_idxset_first(formats, NULL))) {
+        /* Compressed transport: the sink input itself is plain PCM in
+         * the sample spec of the format, we decode in the IO thread */
+        CHECK_VALIDITY_GOTO(c->pstream, !passthrough && !fix_format && !fix_rate && !fix_channels, tag, PA_ERR_INVALID, finish);
+
+        lpc_format = pa_format_info_copy(format);
+
+        CHECK_VALIDITY_GOTO(c->pstream, pa_format_info_to_sample_spec(format, &ss, NULL) >= 0, tag, PA_ERR_INVALID, finish);
+        CHECK_VALIDITY_GOTO(c->pstream, ss.format == PA_SAMPLE_S16NE, tag, PA_ERR_NOTSUPPORTED, finish);
+
+        pa_idxset_free(formats, (pa_free2_cb_t) pa_format_info_free2, NULL);
+        formats = NULL;
+        n_formats = 0;
+    }
+
     if (n_formats == 0) {
         CHECK_VALIDITY_GOTO(c->pstream, pa_sample_spec_valid(&ss), tag, PA_ERR_INVALID, finish);
         CHECK_VALIDITY_GOTO(c->pstream, map.channels == ss.channels && volume.channels == ss.channels, tag, PA_ERR_INVALID, finish);
@@ -2131,7 +2184,7 @@ static void command_create_playback_stream(pa_pdispatch *pd, uint32_t command, u
      * flag. For older versions we synthesize it here */
     muted_set = muted_set || muted;
 
-    s = playback_stream_new(c, sink, &ss, &map, formats, &attr, volume_set ? &volume : NULL, muted, muted_set, flags, p, adjust_latency, early_requests, relative_volume, syncid, &missing, &ret);
+    s = playback_stream_new(c, sink, &ss, &map, formats, &attr, volume_set ? &volume : NULL, muted, muted_set, flags, p, adjust_latency, early_requests, relative_volume, !!lpc_format, syncid, &missing, &ret);
     /* We no longer own the formats idxset */
     formats = NULL;
 
@@ -2175,7 +2228,9 @@ static void command_create_playback_stream(pa_pdispatch *pd, uint32_t command, u
 
     if (c->version >= 21) {
         /* Send back the format we negotiated */
-        if (s->sink_input->format)
+        if (lpc_format)
+            pa_tagstruct_put_format_info(reply, lpc_format);
+        else if (s->sink_input->format)
             pa_tagstruct_put_format_info(reply, s->sink_input->format);
         else {
             pa_format_info *f = pa_format_info_new();
@@ -2191,6 +2246,8 @@ finish:
         pa_proplist_free(p);
     if (formats)
         pa_idxset_free(formats, (pa_free2_cb_t) pa_format_info_free2, NULL);
+    if (lpc_format)
+        pa_format_info_free(lpc_format);
 }
 
 static void command_delete_stream(pa_pdispatch *pd, uint32_t command, uint32_t tag, pa_tagstruct *t, void *userdata) {
@@ -4770,6 +4827,26 @@ static void pstream_memblock_callback(pa_pstream *p, uint32_t channel, int64_t o
 
     if (playback_stream_isinstance(stream)) {
         playback_stream *ps = PLAYBACK_STREAM(stream);
+        pa_memchunk packet;
+
+        if (ps->lpc && chunk->memblock) {
+            /* Only hand complete packets to the IO thread */
+            if (chunk->index == 0) {
+                ps->lpc_seek = seek;
+                ps->lpc_offset = offset;
+            }
+
+            if (chunk->index + chunk->length < pa_memblock_get_length(chunk->memblock))
+                return;
+
+            packet.memblock = chunk->memblock;
+            packet.index = 0;
+            packet.length = chunk->index + chunk->length;
+            chunk = &packet;
+
+            seek = ps->lpc_seek;
+            offset = ps->lpc_offset;
+        }
 
         pa_atomic_inc(&ps->seek_or_post_in_queue);
         if (chunk->memblock) {
@@ -558,6 +558,7 @@ static int do_write(pa_pstream *p) {
     size_t l;
     ssize_t r;
     pa_memblock *release_memblock = NULL;
+    uint32_t length;
 
     pa_assert(p);
     pa_assert(PA_REFCNT_VALUE(p) > 0);
@@ -568,9 +569,44 @@ static int do_write(pa_pstream *p) {
     if (!p->write.current)
         return 0;
 
+    length = ntohl(p->write.descriptor[PA_PSTREAM_DESCRIPTOR_LENGTH]);
+
     if (p->write.index < PA_PSTREAM_DESCRIPTOR_SIZE) {
         d = (uint8_t*) p->write.descriptor + p->write.index;
         l = PA_PSTREAM_DESCRIPTOR_SIZE - p->write.index;
+
+#ifdef HAVE_SYS_UIO_H
+        /* Hand the descriptor and the payload to the kernel in one
+         * go, so that they end up in the same segment on TCP
+         * connections with TCP_NODELAY and we save a syscall and a
+         * main loop iteration for each item */
+        if (length > 0
+#ifdef HAVE_CREDS
+            && !p->send_creds_now
+#endif
+            ) {
+            struct iovec iov[2];
+
+            pa_assert(p->write.data || p->write.memchunk.memblock);
+
+            iov[0].iov_base = d;
+            iov[0].iov_len = l;
+
+            if (p->write.data)
+                iov[1].iov_base = p->write.data;
+            else {
+                iov[1].iov_base = (uint8_t*) pa_memblock_acquire(p->write.memchunk.memblock) + p->write.memchunk.index;
+                release_memblock = p->write.memchunk.memblock;
+            }
+
+            iov[1].iov_len = length;
+
+            if ((r = pa_iochannel_writev(p->io, iov, 2)) < 0)
+                goto fail;
+
+            goto written;
+        }
+#endif
     } else {
         pa_assert(p->write.data || p->write.memchunk.memblock);
 
@@ -582,7 +618,7 @@ static int do_write(pa_pstream *p) {
         }
 
         d = (uint8_t*) d + p->write.index - PA_PSTREAM_DESCRIPTOR_SIZE;
-        l = ntohl(p->write.descriptor[PA_PSTREAM_DESCRIPTOR_LENGTH]) - (p->write.index - PA_PSTREAM_DESCRIPTOR_SIZE);
+        l = length - (p->write.index - PA_PSTREAM_DESCRIPTOR_SIZE);
     }
 
     pa_assert(l > 0);
@@ -600,12 +636,16 @@ static int do_write(pa_pstream *p) {
     if ((r = pa_iochannel_write(p->io, d, l)) < 0)
         goto fail;
 
+#ifdef HAVE_SYS_UIO_H
+written:
+#endif
+
     if (release_memblock)
         pa_memblock_release(release_memblock);
 
     p->write.index += (size_t) r;
 
-    if (p->write.index >= PA_PSTREAM_DESCRIPTOR_SIZE + ntohl(p->write.descriptor[PA_PSTREAM_DESCRIPTOR_LENGTH])) {
+    if (p->write.index >= PA_PSTREAM_DESCRIPTOR_SIZE + length) {
         pa_assert(p->write.current);
         item_free(p->write.current);
         p->write.current = NULL;
@@ -24,6 +24,7 @@
 #endif
 
 #include <string.h>
+#include <math.h>
 
 #ifdef HAVE_LIBSAMPLERATE
 #include <samplerate.h>
@@ -34,11 +35,13 @@
 #endif
 
 #include <pulse/xmalloc.h>
+#include <pulse/timeval.h>
 #include <pulsecore/sconv.h>
 #include <pulsecore/log.h>
 #include <pulsecore/macro.h>
 #include <pulsecore/strbuf.h>
 #include <pulsecore/remap.h>
+#include <pulsecore/sample-util.h>
 
 #include "ffmpeg/avcodec.h"
 
@@ -47,12 +50,21 @@
 /* Number of samples of extra space we allow the resamplers to return */
 #define EXTRA_FRAMES 128
 
+/* How much silence we feed through the filters before we assume
+ * that they only produce silence from then on */
+#define SILENCE_SETTLE_USEC (50*PA_USEC_PER_MSEC)
+
 struct pa_resampler {
     pa_resample_method_t method;
     pa_resample_flags_t flags;
 
     pa_sample_spec i_ss, o_ss;
     pa_channel_map i_cm, o_cm;
+
+    /* The exact input rate; i_ss.rate is this rounded to full Hz */
+    double i_rate_frac;
+    pa_bool_t frac_rate_supported;
+
     size_t i_fz, o_fz, w_sz;
     pa_mempool *mempool;
 
@@ -74,6 +86,21 @@ struct pa_resampler {
     pa_remap_t remap;
     pa_bool_t map_required;
 
+    /* The remapping matrix as calculated, before any gains set with
+     * pa_resampler_set_remap_volume() were folded into it */
+    float map_table_unity[PA_CHANNELS_MAX][PA_CHANNELS_MAX];
+    pa_cvolume remap_i_volume, remap_o_volume;
+    pa_bool_t remap_volume_set;
+
+    /* Silence passed through the full pipeline since the last
+     * non-silent input, once the filters have settled we produce
+     * silence without running them. silence_frac carries the
+     * fractional output frame over to the next block. */
+    size_t silence_settled;
+    size_t silence_in;
+    double silence_frac;
+    pa_memchunk silence_buf;
+
     void (*impl_free)(pa_resampler *r);
     void (*impl_update_rates)(pa_resampler *r);
     void (*impl_resample)(pa_resampler *r, const pa_memchunk *in, unsigned in_samples, pa_memchunk *out, unsigned *out_samples);
@@ -102,6 +129,7 @@ struct pa_resampler {
 #ifdef HAVE_SPEEX
     struct { /* data specific to speex */
         SpeexResamplerState* state;
+        uint32_t ratio_num; /* input rate speex currently runs at, times SPEEX_FRAC_SCALE */
     } speex;
 #endif
 
@@ -123,6 +151,7 @@ static int libsamplerate_init(pa_resampler*r);
 #endif
 
 static void calc_map_table(pa_resampler *r);
+static void update_map_table(pa_resampler *r);
 
 static int (* const init_table[])(pa_resampler*r) = {
 #ifdef HAVE_LIBSAMPLERATE
@@ -249,6 +278,10 @@ pa_resampler* pa_resampler_new(
     /* Fill sample specs */
     r->i_ss = *a;
     r->o_ss = *b;
+    r->i_rate_frac = (double) r->i_ss.rate;
+
+    /* Long enough to flush the longest filter we use */
+    r->silence_settled = pa_usec_to_bytes(SILENCE_SETTLE_USEC, &r->i_ss);
 
     /* set up the remap structure */
     r->remap.i_ss = &r->i_ss;
@@ -349,6 +382,8 @@ void pa_resampler_free(pa_resampler *r) {
         pa_memblock_unref(r->resample_buf.memblock);
     if (r->from_work_format_buf.memblock)
         pa_memblock_unref(r->from_work_format_buf.memblock);
+    if (r->silence_buf.memblock)
+        pa_memblock_unref(r->silence_buf.memblock);
 
     pa_xfree(r);
 }
@@ -357,14 +392,39 @@ void pa_resampler_set_input_rate(pa_resampler *r, uint32_t rate) {
     pa_assert(r);
     pa_assert(rate > 0);
 
-    if (r->i_ss.rate == rate)
+    if (r->i_ss.rate == rate && r->i_rate_frac == (double) rate)
         return;
 
     r->i_ss.rate = rate;
+    r->i_rate_frac = (double) rate;
 
     r->impl_update_rates(r);
 }
 
+void pa_resampler_set_input_rate_frac(pa_resampler *r, double rate) {
+    pa_assert(r);
+    pa_assert(rate >= 1.0);
+
+    /* Implementations that can't do better get the nearest integer
+     * rate */
+    if (!r->frac_rate_supported) {
+        pa_resampler_set_input_rate(r, (uint32_t) lrint(rate));
+        return;
+    }
+
+    /* The implementation picks this up with the next block, without
+     * resetting its state. i_ss.rate is kept close enough for
+     * pa_resampler_request() and pa_resampler_result(). */
+    r->i_rate_frac = rate;
+    r->i_ss.rate = (uint32_t) lrint(rate);
+}
+
+double pa_resampler_get_input_rate_frac(pa_resampler *r) {
+    pa_assert(r);
+
+    return r->i_rate_frac;
+}
+
 void pa_resampler_set_output_rate(pa_resampler *r, uint32_t rate) {
     pa_assert(r);
     pa_assert(rate > 0);
@@ -377,6 +437,62 @@ void pa_resampler_set_output_rate(pa_resampler *r, uint32_t rate) {
     r->impl_update_rates(r);
 }
 
+static void reset_remap_volume(pa_resampler *r) {
+    pa_assert(r);
+
+    if (!r->remap_volume_set)
+        return;
+
+    r->remap_volume_set = FALSE;
+    update_map_table(r);
+
+    /* The special cased remap functions only match unscaled tables */
+    pa_init_remap(&r->remap);
+}
+
+pa_bool_t pa_resampler_set_remap_volume(pa_resampler *r, const pa_cvolume *i_volume, const pa_cvolume *o_volume) {
+    pa_bool_t was_set;
+
+    pa_assert(r);
+    pa_assert(i_volume);
+    pa_assert(o_volume);
+    pa_assert(i_volume->channels == r->i_ss.channels);
+    pa_assert(o_volume->channels == r->o_ss.channels);
+
+    if (!r->map_required)
+        return FALSE;
+
+    /* The remap functions can only attenuate, amplifying would need
+     * clipping which they don't do. */
+    if (pa_cvolume_max(i_volume) > PA_VOLUME_NORM ||
+        pa_cvolume_max(o_volume) > PA_VOLUME_NORM) {
+        reset_remap_volume(r);
+        return FALSE;
+    }
+
+    if (pa_cvolume_is_norm(i_volume) && pa_cvolume_is_norm(o_volume)) {
+        reset_remap_volume(r);
+        return TRUE;
+    }
+
+    if (r->remap_volume_set &&
+        pa_cvolume_equal(&r->remap_i_volume, i_volume) &&
+        pa_cvolume_equal(&r->remap_o_volume, o_volume))
+        return TRUE;
+
+    was_set = r->remap_volume_set;
+
+    r->remap_i_volume = *i_volume;
+    r->remap_o_volume = *o_volume;
+    r->remap_volume_set = TRUE;
+    update_map_table(r);
+
+    if (!was_set)
+        pa_init_remap(&r->remap);
+
+    return TRUE;
+}
+
 size_t pa_resampler_request(pa_resampler *r, size_t out_length) {
     pa_assert(r);
 
@@ -444,6 +560,8 @@ void pa_resampler_reset(pa_resampler *r) {
         r->impl_reset(r);
 
     r->remap_buf_contains_leftover_data = FALSE;
+    r->silence_in = 0;
+    r->silence_frac = 0;
 }
 
 pa_resample_method_t pa_resampler_get_method(pa_resampler *r) {
@@ -539,6 +657,46 @@ int pa_resample_method_supported(pa_resample_method_t m) {
     return 1;
 }
 
+static pa_resample_method_t cheaper_method(pa_resample_method_t m) {
+
+    if (m >= PA_RESAMPLER_SPEEX_FLOAT_BASE && m <= PA_RESAMPLER_SPEEX_FLOAT_MAX)
+        return m > PA_RESAMPLER_SPEEX_FLOAT_BASE ? PA_RESAMPLER_SPEEX_FLOAT_BASE + (m - PA_RESAMPLER_SPEEX_FLOAT_BASE) / 2 : PA_RESAMPLER_TRIVIAL;
+
+    if (m >= PA_RESAMPLER_SPEEX_FIXED_BASE && m <= PA_RESAMPLER_SPEEX_FIXED_MAX)
+        return m > PA_RESAMPLER_SPEEX_FIXED_BASE ? PA_RESAMPLER_SPEEX_FIXED_BASE + (m - PA_RESAMPLER_SPEEX_FIXED_BASE) / 2 : PA_RESAMPLER_TRIVIAL;
+
+    switch (m) {
+        case PA_RESAMPLER_SRC_SINC_BEST_QUALITY:
+            return PA_RESAMPLER_SRC_SINC_MEDIUM_QUALITY;
+
+        case PA_RESAMPLER_SRC_SINC_MEDIUM_QUALITY:
+            return PA_RESAMPLER_SRC_SINC_FASTEST;
+
+        case PA_RESAMPLER_SRC_SINC_FASTEST:
+        case PA_RESAMPLER_FFMPEG:
+            return PA_RESAMPLER_SPEEX_FLOAT_BASE + 1;
+
+        case PA_RESAMPLER_SRC_ZERO_ORDER_HOLD:
+        case PA_RESAMPLER_SRC_LINEAR:
+            return PA_RESAMPLER_TRIVIAL;
+
+        default:
+            return PA_RESAMPLER_INVALID;
+    }
+}
+
+pa_resample_method_t pa_resample_method_cheaper(pa_resample_method_t m) {
+
+    /* Don't step onto a method that isn't compiled in, since
+     * pa_resampler_new() would replace it by 'auto', which is likely
+     * more expensive again */
+    do
+        m = cheaper_method(m);
+    while (m != PA_RESAMPLER_INVALID && !pa_resample_method_supported(m));
+
+    return m;
+}
+
 pa_resample_method_t pa_parse_resample_method(const char *string) {
     pa_resample_method_t m;
 
@@ -1081,10 +1239,38 @@ static void calc_map_table(pa_resampler *r) {
     pa_log_debug("Channel matrix:\n%s", t = pa_strbuf_tostring_free(s));
     pa_xfree(t);
 
+    memcpy(r->map_table_unity, m->map_table_f, sizeof(r->map_table_unity));
+
     /* initialize the remapping function */
     pa_init_remap(m);
 }
 
+static void update_map_table(pa_resampler *r) {
+    unsigned oc, ic;
+    pa_remap_t *m;
+
+    pa_assert(r);
+
+    m = &r->remap;
+
+    for (oc = 0; oc < r->o_ss.channels; oc++) {
+        float o_gain = 1.0f;
+
+        if (r->remap_volume_set)
+            o_gain = (float) pa_sw_volume_to_linear(r->remap_o_volume.values[oc]);
+
+        for (ic = 0; ic < r->i_ss.channels; ic++) {
+            float gain = o_gain;
+
+            if (r->remap_volume_set)
+                gain *= (float) pa_sw_volume_to_linear(r->remap_i_volume.values[ic]);
+
+            m->map_table_f[oc][ic] = r->map_table_unity[oc][ic] * gain;
+            m->map_table_i[oc][ic] = (int32_t) (m->map_table_f[oc][ic] * 0x10000);
+        }
+    }
+}
+
 static pa_memchunk* convert_to_work_format(pa_resampler *r, pa_memchunk *input) {
     unsigned n_samples;
     void *src, *dst;
@@ -1272,6 +1458,43 @@ static pa_memchunk *convert_from_work_format(pa_resampler *r, pa_memchunk *input
     return &r->from_work_format_buf;
 }
 
+/* Produces the silence the full pipeline would have produced for a
+ * silent input block. Only valid once the filters have settled. */
+static void run_silence(pa_resampler *r, const pa_memchunk *in, pa_memchunk *out) {
+    size_t frames;
+
+    frames = in->length / r->i_fz;
+
+    /* Whatever the filters left over is silence by now as well */
+    if (r->remap_buf_contains_leftover_data) {
+        frames += r->remap_buf.length / (r->w_sz * r->o_ss.channels);
+        r->remap_buf_contains_leftover_data = FALSE;
+    }
+
+    r->silence_frac += (double) frames * r->o_ss.rate / r->i_rate_frac;
+    frames = (size_t) r->silence_frac;
+    r->silence_frac -= (double) frames;
+
+    if (frames <= 0) {
+        pa_memchunk_reset(out);
+        return;
+    }
+
+    if (!r->silence_buf.memblock || r->silence_buf.length < frames * r->o_fz) {
+        if (r->silence_buf.memblock)
+            pa_memblock_unref(r->silence_buf.memblock);
+
+        r->silence_buf.memblock = pa_silence_memblock(pa_memblock_new(r->mempool, frames * r->o_fz), &r->o_ss);
+        r->silence_buf.index = 0;
+        r->silence_buf.length = pa_memblock_get_length(r->silence_buf.memblock);
+        pa_memblock_set_is_silence(r->silence_buf.memblock, TRUE);
+    }
+
+    out->memblock = pa_memblock_ref(r->silence_buf.memblock);
+    out->index = 0;
+    out->length = frames * r->o_fz;
+}
+
 void pa_resampler_run(pa_resampler *r, const pa_memchunk *in, pa_memchunk *out) {
     pa_memchunk *buf;
 
@@ -1282,6 +1505,19 @@ void pa_resampler_run(pa_resampler *r, const pa_memchunk *in, pa_memchunk *out)
     pa_assert(in->memblock);
     pa_assert(in->length % r->i_fz == 0);
 
+    if (pa_memblock_is_silence(in->memblock)) {
+
+        if (r->silence_in >= r->silence_settled) {
+            run_silence(r, in, out);
+            return;
+        }
+
+        r->silence_in += in->length;
+    } else {
+        r->silence_in = 0;
+        r->silence_frac = 0;
+    }
+
     buf = (pa_memchunk*) in;
     buf = convert_to_work_format(r, buf);
     buf = remap_channels(r, buf);
@@ -1344,7 +1580,9 @@ static void libsamplerate_resample(pa_resampler *r, const pa_memchunk *input, un
     data.data_out = (float*) ((uint8_t*) pa_memblock_acquire(output->memblock) + output->index);
     data.output_frames = (long int) *out_n_frames;
 
-    data.src_ratio = (double) r->o_ss.rate / r->i_ss.rate;
+    /* If the ratio changed since the last block libsamplerate moves
+     * to the new one smoothly over this block */
+    data.src_ratio = (double) r->o_ss.rate / r->i_rate_frac;
     data.end_of_input = 0;
 
     pa_assert_se(src_process(r->src.state, &data) == 0);
@@ -1389,6 +1627,8 @@ static int libsamplerate_init(pa_resampler *r) {
     if (!(r->src.state = src_new(r->method, r->o_ss.channels, &err)))
         return -1;
 
+    r->frac_rate_supported = TRUE;
+
     r->impl_free = libsamplerate_free;
     r->impl_update_rates = libsamplerate_update_rates;
     r->impl_resample = libsamplerate_resample;
@@ -1401,6 +1641,28 @@ static int libsamplerate_init(pa_resampler *r) {
 #ifdef HAVE_SPEEX
 /*** speex based implementation ***/
 
+/* To follow a fractional input rate we hand speex the exact ratio with
+ * a fine denominator. speex recomputes its filter whenever the ratio
+ * changes, so we only touch it when the scaled ratio actually moves,
+ * i.e. once per rate adjustment and not on every block. */
+#define SPEEX_FRAC_SCALE 1000
+
+static void speex_follow_frac_rate(pa_resampler *r) {
+    uint32_t num;
+
+    pa_assert(r);
+
+    num = (uint32_t) lround(r->i_rate_frac * SPEEX_FRAC_SCALE);
+
+    if (num == r->speex.ratio_num)
+        return;
+
+    pa_assert_se(speex_resampler_set_rate_frac(r->speex.state,
+                                               num, r->o_ss.rate * SPEEX_FRAC_SCALE,
+                                               (uint32_t) lround(r->i_rate_frac), r->o_ss.rate) == 0);
+    r->speex.ratio_num = num;
+}
+
 static void speex_resample_float(pa_resampler *r, const pa_memchunk *input, unsigned in_n_frames, pa_memchunk *output, unsigned *out_n_frames) {
     float *in, *out;
     uint32_t inf = in_n_frames, outf = *out_n_frames;
@@ -1410,6 +1672,8 @@ static void speex_resample_float(pa_resampler *r, const pa_memchunk *input, unsi
     pa_assert(output);
     pa_assert(out_n_frames);
 
+    speex_follow_frac_rate(r);
+
     in = (float*) ((uint8_t*) pa_memblock_acquire(input->memblock) + input->index);
     out = (float*) ((uint8_t*) pa_memblock_acquire(output->memblock) + output->index);
 
@@ -1431,6 +1695,8 @@ static void speex_resample_int(pa_resampler *r, const pa_memchunk *input, unsign
     pa_assert(output);
     pa_assert(out_n_frames);
 
+    speex_follow_frac_rate(r);
+
     in = (int16_t*) ((uint8_t*) pa_memblock_acquire(input->memblock) + input->index);
     out = (int16_t*) ((uint8_t*) pa_memblock_acquire(output->memblock) + output->index);
 
@@ -1447,6 +1713,7 @@ static void speex_update_rates(pa_resampler *r) {
     pa_assert(r);
 
     pa_assert_se(speex_resampler_set_rate(r->speex.state, r->i_ss.rate, r->o_ss.rate) == 0);
+    r->speex.ratio_num = r->i_ss.rate * SPEEX_FRAC_SCALE;
 }
 
 static void speex_reset(pa_resampler *r) {
@@ -1490,6 +1757,9 @@ static int speex_init(pa_resampler *r) {
     if (!(r->speex.state = speex_resampler_init(r->o_ss.channels, r->i_ss.rate, r->o_ss.rate, q, &err)))
         return -1;
 
+    r->speex.ratio_num = r->i_ss.rate * SPEEX_FRAC_SCALE;
+    r->frac_rate_supported = TRUE;
+
     return 0;
 }
 #endif
@@ -24,6 +24,7 @@
 
 #include <pulse/sample.h>
 #include <pulse/channelmap.h>
+#include <pulse/volume.h>
 #include <pulsecore/memblock.h>
 #include <pulsecore/memchunk.h>
 
@@ -81,6 +82,24 @@ void pa_resampler_run(pa_resampler *r, const pa_memchunk *in, pa_memchunk *out);
 /* Change the input rate of the resampler object */
 void pa_resampler_set_input_rate(pa_resampler *r, uint32_t rate);
 
+/* Change the input rate of the resampler object to a fractional
+ * value. Unlike pa_resampler_set_input_rate() this never resets the
+ * resampler state, so it may be called for every block to correct
+ * clock drift in fine steps. Implementations that only support
+ * integer rates round to the nearest one. */
+void pa_resampler_set_input_rate_frac(pa_resampler *r, double rate);
+
+/* The exact input rate, as last set by either of the above */
+double pa_resampler_get_input_rate_frac(pa_resampler *r);
+
+/* Fold the per channel gains i_volume (in the input channel map)
+ * and o_volume (in the output channel map) into the channel remapping
+ * matrix, so that they are applied without an extra pass over the
+ * data. Returns FALSE if the resampler does no remapping or the gains
+ * cannot be applied this way, in which case no gain is applied by the
+ * resampler at all and the caller has to do it. */
+pa_bool_t pa_resampler_set_remap_volume(pa_resampler *r, const pa_cvolume *i_volume, const pa_cvolume *o_volume);
+
 /* Change the output rate of the resampler object */
 void pa_resampler_set_output_rate(pa_resampler *r, uint32_t rate);
 
@@ -99,6 +118,10 @@ const char *pa_resample_method_to_string(pa_resample_method_t m);
 /* Return 1 when the specified resampling method is supported */
 int pa_resample_method_supported(pa_resample_method_t m);
 
+/* Return the next supported method that needs less CPU than the
+ * specified one, or PA_RESAMPLER_INVALID if there is none */
+pa_resample_method_t pa_resample_method_cheaper(pa_resample_method_t m);
+
 const pa_channel_map* pa_resampler_input_channel_map(pa_resampler *r);
 const pa_sample_spec* pa_resampler_input_sample_spec(pa_resampler *r);
 const pa_channel_map* pa_resampler_output_channel_map(pa_resampler *r);
@@ -0,0 +1,129 @@
+/***
+  This file is part of PulseAudio.
+
+  PulseAudio is free software; you can redistribute it and/or modify
+  it under the terms of the GNU Lesser General Public License as
+  published by the Free Software Foundation; either version 2.1 of the
+  License, or (at your option) any later version.
+
+  PulseAudio is distributed in the hope that it will be useful, but
+  WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+  Lesser General Public License for more details.
+
+  You should have received a copy of the GNU Lesser General Public
+  License along with PulseAudio; if not, write to the Free Software
+  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307
+  USA.
+***/
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include <limits.h>
+#include <stdint.h>
+
+#include <pulse/xmalloc.h>
+
+#include <pulsecore/atomic.h>
+#include <pulsecore/macro.h>
+
+#include "ringbuffer.h"
+
+struct pa_ringbuffer {
+    /* The only state shared between the two sides. The full barriers
+     * of pa_atomic_add()/pa_atomic_sub() order the data accesses
+     * against publishing them. */
+    pa_atomic_t count;
+
+    size_t capacity;
+
+    /* Owned by the reading and the writing side, respectively */
+    size_t read_index;
+    size_t write_index;
+};
+
+#define PA_RINGBUFFER_DATA(r) ((uint8_t*) (r) + PA_ALIGN(sizeof(pa_ringbuffer)))
+
+pa_ringbuffer *pa_ringbuffer_new(size_t capacity) {
+    pa_ringbuffer *r;
+
+    pa_assert(capacity > 0);
+    pa_assert(capacity <= INT_MAX);
+
+    r = pa_xmalloc(PA_ALIGN(sizeof(pa_ringbuffer)) + capacity);
+    pa_atomic_store(&r->count, 0);
+    r->capacity = capacity;
+    r->read_index = r->write_index = 0;
+
+    return r;
+}
+
+void pa_ringbuffer_free(pa_ringbuffer *r) {
+    pa_assert(r);
+
+    pa_xfree(r);
+}
+
+size_t pa_ringbuffer_capacity(pa_ringbuffer *r) {
+    pa_assert(r);
+
+    return r->capacity;
+}
+
+size_t pa_ringbuffer_fill(pa_ringbuffer *r) {
+    pa_assert(r);
+
+    return (size_t) pa_atomic_load(&r->count);
+}
+
+/* Called from the reading thread */
+const void *pa_ringbuffer_peek(pa_ringbuffer *r, size_t *length) {
+    pa_assert(r);
+    pa_assert(length);
+
+    *length = PA_MIN(pa_ringbuffer_fill(r), r->capacity - r->read_index);
+
+    return PA_RINGBUFFER_DATA(r) + r->read_index;
+}
+
+/* Called from the reading thread */
+void pa_ringbuffer_drop(pa_ringbuffer *r, size_t length) {
+    pa_assert(r);
+    pa_assert(length <= r->capacity - r->read_index);
+
+    if (length <= 0)
+        return;
+
+    r->read_index += length;
+    if (r->read_index >= r->capacity)
+        r->read_index = 0;
+
+    pa_assert_se((size_t) pa_atomic_sub(&r->count, (int) length) >= length);
+}
+
+/* Called from the writing thread */
+void *pa_ringbuffer_begin_write(pa_ringbuffer *r, size_t *length) {
+    pa_assert(r);
+    pa_assert(length);
+
+    *length = PA_MIN(r->capacity - pa_ringbuffer_fill(r), r->capacity - r->write_index);
+
+    return PA_RINGBUFFER_DATA(r) + r->write_index;
+}
+
+/* Called from the writing thread */
+void pa_ringbuffer_end_write(pa_ringbuffer *r, size_t length) {
+    pa_assert(r);
+    pa_assert(length <= r->capacity - r->write_index);
+
+    if (length <= 0)
+        return;
+
+    r->write_index += length;
+    if (r->write_index >= r->capacity)
+        r->write_index = 0;
+
+    pa_assert_se((size_t) pa_atomic_add(&r->count, (int) length) + length <= r->capacity);
+}
@@ -0,0 +1,54 @@
+#ifndef foopulseringbufferhfoo
+#define foopulseringbufferhfoo
+
+/***
+  This file is part of PulseAudio.
+
+  PulseAudio is free software; you can redistribute it and/or modify
+  it under the terms of the GNU Lesser General Public License as
+  published by the Free Software Foundation; either version 2.1 of the
+  License, or (at your option) any later version.
+
+  PulseAudio is distributed in the hope that it will be useful, but
+  WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+  Lesser General Public License for more details.
+
+  You should have received a copy of the GNU Lesser General Public
+  License along with PulseAudio; if not, write to the Free Software
+  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307
+  USA.
+***/
+
+#include <sys/types.h>
+
+/* A lock-free and wait-free byte ring buffer for exactly one writing
+ * and one reading thread. Neither side ever blocks, allocates or
+ * takes a lock, which makes it suitable for handing audio to and from
+ * foreign real-time threads such as the JACK process callback. Waking
+ * up the other side is left to the caller, e.g. with a pa_fdsem.
+ *
+ * Data is accessed in place: the writer asks for the contiguous free
+ * space at the write index, fills it and commits it; the reader asks
+ * for the contiguous data at the read index, consumes it and drops
+ * it. Both may have to do this twice when the data wraps around. */
+
+typedef struct pa_ringbuffer pa_ringbuffer;
+
+pa_ringbuffer *pa_ringbuffer_new(size_t capacity);
+void pa_ringbuffer_free(pa_ringbuffer *r);
+
+size_t pa_ringbuffer_capacity(pa_ringbuffer *r);
+
+/* Number of bytes currently queued, may be called from either side */
+size_t pa_ringbuffer_fill(pa_ringbuffer *r);
+
+/* For the reading side */
+const void *pa_ringbuffer_peek(pa_ringbuffer *r, size_t *length);
+void pa_ringbuffer_drop(pa_ringbuffer *r, size_t length);
+
+/* For the writing side */
+void *pa_ringbuffer_begin_write(pa_ringbuffer *r, size_t *length);
+void pa_ringbuffer_end_write(pa_ringbuffer *r, size_t length);
+
+#endif
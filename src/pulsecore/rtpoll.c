@@ -636,3 +636,19 @@ pa_bool_t pa_rtpoll_timer_elapsed(pa_rtpoll *p) {
 
     return p->timer_elapsed;
 }
+
+pa_usec_t pa_rtpoll_timer_lateness(pa_rtpoll *p) {
+    struct timeval now;
+
+    pa_assert(p);
+
+    if (!p->timer_elapsed)
+        return 0;
+
+    pa_rtclock_get(&now);
+
+    if (pa_timeval_cmp(&now, &p->next_elapse) <= 0)
+        return 0;
+
+    return pa_timeval_diff(&now, &p->next_elapse);
+}
@@ -769,6 +769,57 @@ pa_bool_t pa_frame_aligned(size_t l, const pa_sample_spec *ss) {
     return l % fs == 0;
 }
 
+/* Typed versions of the shuffles for the common sample sizes. Unlike
+ * a memcpy() per sample these compile to plain loads and stores, and
+ * the stereo case to a simple loop the compiler can vectorize. */
+#define DEFINE_SHUFFLE(bits)                                                    \
+    static void interleave_##bits(const void *src[], unsigned channels,         \
+                                  uint##bits##_t *d, unsigned n) {              \
+        unsigned c, j;                                                          \
+                                                                                \
+        if (channels == 2) {                                                    \
+            const uint##bits##_t *l = src[0], *r = src[1];                      \
+                                                                                \
+            for (j = 0; j < n; j++) {                                           \
+                d[2*j] = l[j];                                                  \
+                d[2*j+1] = r[j];                                                \
+            }                                                                   \
+            return;                                                             \
+        }                                                                       \
+                                                                                \
+        for (c = 0; c < channels; c++) {                                        \
+            const uint##bits##_t *s = src[c];                                   \
+                                                                                \
+            for (j = 0; j < n; j++)                                             \
+                d[j*channels+c] = s[j];                                         \
+        }                                                                       \
+    }                                                                           \
+                                                                                \
+    static void deinterleave_##bits(const uint##bits##_t *s, void *dst[],       \
+                                    unsigned channels, unsigned n) {            \
+        unsigned c, j;                                                          \
+                                                                                \
+        if (channels == 2) {                                                    \
+            uint##bits##_t *l = dst[0], *r = dst[1];                            \
+                                                                                \
+            for (j = 0; j < n; j++) {                                           \
+                l[j] = s[2*j];                                                  \
+                r[j] = s[2*j+1];                                                \
+            }                                                                   \
+            return;                                                             \
+        }                                                                       \
+                                                                                \
+        for (c = 0; c < channels; c++) {                                        \
+            uint##bits##_t *d = dst[c];                                         \
+                                                                                \
+            for (j = 0; j < n; j++)                                             \
+                d[j] = s[j*channels+c];                                         \
+        }                                                                       \
+    }
+
+DEFINE_SHUFFLE(16)
+DEFINE_SHUFFLE(32)
+
 void pa_interleave(const void *src[], unsigned channels, void *dst, size_t ss, unsigned n) {
     unsigned c;
     size_t fs;
@@ -779,6 +830,21 @@ void pa_interleave(const void *src[], unsigned channels, void *dst, size_t ss, u
     pa_assert(ss > 0);
     pa_assert(n > 0);
 
+    if (channels == 1) {
+        memcpy(dst, src[0], ss * n);
+        return;
+    }
+
+    switch (ss) {
+        case 2:
+            interleave_16(src, channels, dst, n);
+            return;
+
+        case 4:
+            interleave_32(src, channels, dst, n);
+            return;
+    }
+
     fs = ss * channels;
 
     for (c = 0; c < channels; c++) {
@@ -807,6 +873,21 @@ void pa_deinterleave(const void *src, void *dst[], unsigned channels, size_t ss,
     pa_assert(ss > 0);
     pa_assert(n > 0);
 
+    if (channels == 1) {
+        memcpy(dst[0], src, ss * n);
+        return;
+    }
+
+    switch (ss) {
+        case 2:
+            deinterleave_16(src, dst, channels, n);
+            return;
+
+        case 4:
+            deinterleave_32(src, dst, channels, n);
+            return;
+    }
+
     fs = ss * channels;
 
     for (c = 0; c < channels; c++) {
@@ -26,6 +26,7 @@
 
 #include <stdio.h>
 #include <stdlib.h>
+#include <math.h>
 
 #include <pulse/utf8.h>
 #include <pulse/xmalloc.h>
@@ -477,6 +478,8 @@ int pa_sink_input_new(
     reset_callbacks(i);
     i->userdata = NULL;
 
+    i->telemetry = pa_telemetry_new();
+
     i->thread_info.state = i->state;
     i->thread_info.attached = FALSE;
     pa_atomic_store(&i->thread_info.drained, 1);
@@ -490,6 +493,7 @@ int pa_sink_input_new(
     i->thread_info.dont_rewind_render = FALSE;
     i->thread_info.underrun_for = (uint64_t) -1;
     i->thread_info.playing_for = 0;
+    i->thread_info.render_cost = 0;
     i->thread_info.direct_outputs = pa_hashmap_new(pa_idxset_trivial_hash_func, pa_idxset_trivial_compare_func);
 
     pa_assert_se(pa_idxset_put(core->sink_inputs, i, &i->index) == 0);
@@ -693,6 +697,9 @@ static void sink_input_free(pa_object *o) {
     if (i->proplist)
         pa_proplist_free(i->proplist);
 
+    if (i->telemetry)
+        pa_telemetry_free(i->telemetry);
+
     if (i->direct_outputs)
         pa_idxset_free(i->direct_outputs, NULL, NULL);
 
@@ -779,7 +786,7 @@ pa_usec_t pa_sink_input_get_latency(pa_sink_input *i, pa_usec_t *sink_latency) {
 /* Called from thread context */
 void pa_sink_input_peek(pa_sink_input *i, size_t slength /* in sink frames */, pa_memchunk *chunk, pa_cvolume *volume) {
     pa_bool_t do_volume_adj_here, need_volume_factor_sink;
-    pa_bool_t volume_is_norm;
+    pa_bool_t volume_is_norm, volume_in_resampler = FALSE;
     size_t block_size_max_sink, block_size_max_sink_input;
     size_t ilength;
 
@@ -820,11 +827,31 @@ void pa_sink_input_peek(pa_sink_input *i, size_t slength /* in sink frames */, p
 
     /* If the channel maps of the sink and this stream differ, we need
      * to adjust the volume *before* we resample. Otherwise we can do
-     * it after and leave it for the sink code */
+     * it after and leave it for the sink code, which applies it
+     * together with volume_factor_sink while mixing */
 
     do_volume_adj_here = !pa_channel_map_equal(&i->channel_map, &i->sink->channel_map);
     volume_is_norm = pa_cvolume_is_norm(&i->thread_info.soft_volume) && !i->thread_info.muted;
-    need_volume_factor_sink = !pa_cvolume_is_norm(&i->volume_factor_sink);
+    need_volume_factor_sink = do_volume_adj_here && !pa_cvolume_is_norm(&i->volume_factor_sink);
+
+    /* If the resampler has to remap the channels anyway, let it apply
+     * both volumes in the same pass, so that we neither need to copy
+     * the data nor touch it again afterwards */
+    if (do_volume_adj_here && i->thread_info.resampler) {
+        pa_cvolume v;
+
+        if (i->thread_info.muted)
+            pa_cvolume_mute(&v, i->thread_info.sample_spec.channels);
+        else
+            v = i->thread_info.soft_volume;
+
+        volume_in_resampler = pa_resampler_set_remap_volume(i->thread_info.resampler, &v, &i->volume_factor_sink);
+    }
+
+    if (volume_in_resampler) {
+        volume_is_norm = TRUE;
+        need_volume_factor_sink = FALSE;
+    }
 
     while (!pa_memblockq_is_readable(i->thread_info.render_memblockq)) {
         pa_memchunk tchunk;
@@ -851,6 +878,9 @@ void pa_sink_input_peek(pa_sink_input *i, size_t slength /* in sink frames */, p
         pa_assert(tchunk.length > 0);
         pa_assert(tchunk.memblock);
 
+        if (i->thread_info.underrun_for > 0 && i->thread_info.underrun_for != (uint64_t) -1)
+            pa_telemetry_record(i->telemetry, PA_TELEMETRY_XRUN, pa_bytes_to_usec(i->thread_info.underrun_for, &i->sample_spec));
+
         i->thread_info.underrun_for = 0;
         i->thread_info.playing_for += tchunk.length;
 
@@ -864,8 +894,14 @@ void pa_sink_input_peek(pa_sink_input *i, size_t slength /* in sink frames */, p
             if (wchunk.length > block_size_max_sink_input)
                 wchunk.length = block_size_max_sink_input;
 
+            /* Silence stays silence at any volume. Pass it on
+             * untouched, so that it keeps its silence flag and the
+             * resampler and mixer can skip it as well. */
+            if (pa_memblock_is_silence(wchunk.memblock))
+                nvfs = FALSE;
+
             /* It might be necessary to adjust the volume here */
-            if (do_volume_adj_here && !volume_is_norm) {
+            else if (do_volume_adj_here && !volume_is_norm) {
                 pa_memchunk_make_writable(&wchunk, 0);
 
                 if (i->thread_info.muted) {
@@ -945,7 +981,8 @@ void pa_sink_input_peek(pa_sink_input *i, size_t slength /* in sink frames */, p
         /* We've both the same channel map, so let's have the sink do the adjustment for us*/
         pa_cvolume_mute(volume, i->sink->sample_spec.channels);
     else
-        *volume = i->thread_info.soft_volume;
+        /* The mixer applies volume_factor_sink in the same pass */
+        pa_sw_cvolume_multiply(volume, &i->thread_info.soft_volume, &i->volume_factor_sink);
 }
 
 /* Called from thread context */
@@ -983,6 +1020,8 @@ void pa_sink_input_process_rewind(pa_sink_input *i, size_t nbytes /* in sink sam
     if (nbytes > 0 && !i->thread_info.dont_rewind_render) {
         pa_log_debug("Have to rewind %lu bytes on render memblockq.", (unsigned long) nbytes);
         pa_memblockq_rewind(i->thread_info.render_memblockq, nbytes);
+
+        pa_telemetry_record(i->telemetry, PA_TELEMETRY_REWIND, pa_bytes_to_usec(nbytes, &i->sink->sample_spec));
     }
 
     if (i->thread_info.rewrite_nbytes == (size_t) -1) {
@@ -1333,6 +1372,31 @@ int pa_sink_input_set_rate(pa_sink_input *i, uint32_t rate) {
     return 0;
 }
 
+/* Called from main context */
+int pa_sink_input_set_rate_frac(pa_sink_input *i, double rate) {
+    uint32_t rounded;
+
+    pa_sink_input_assert_ref(i);
+    pa_assert_ctl_context();
+    pa_assert(PA_SINK_INPUT_IS_LINKED(i->state));
+    pa_return_val_if_fail(i->thread_info.resampler, -PA_ERR_BADSTATE);
+    pa_return_val_if_fail(rate >= 1.0 && rate <= PA_RATE_MAX, -PA_ERR_INVALID);
+
+    /* The sample spec only carries the rounded rate, the exact one is
+     * passed on to the resampler in mHz */
+    rounded = (uint32_t) lrint(rate);
+
+    pa_asyncmsgq_post(i->sink->asyncmsgq, PA_MSGOBJECT(i), PA_SINK_INPUT_MESSAGE_SET_RATE, PA_UINT_TO_PTR(rounded), (int64_t) llrint(rate * 1000.0), NULL, NULL);
+
+    if (i->sample_spec.rate == rounded)
+        return 0;
+
+    i->sample_spec.rate = rounded;
+
+    pa_subscription_post(i->core, PA_SUBSCRIPTION_EVENT_SINK_INPUT|PA_SUBSCRIPTION_EVENT_CHANGE, i->index);
+    return 0;
+}
+
 /* Called from main context */
 void pa_sink_input_set_name(pa_sink_input *i, const char *name) {
     const char *old;
@@ -1829,8 +1893,28 @@ int pa_sink_input_process_msg(pa_msgobject *o, int code, void *userdata, int64_t
         case PA_SINK_INPUT_MESSAGE_SET_RATE:
 
             i->thread_info.sample_spec.rate = PA_PTR_TO_UINT(userdata);
-            pa_resampler_set_input_rate(i->thread_info.resampler, PA_PTR_TO_UINT(userdata));
 
+            /* A non-zero offset is the exact rate in mHz */
+            if (offset > 0)
+                pa_resampler_set_input_rate_frac(i->thread_info.resampler, (double) offset / 1000.0);
+            else
+                pa_resampler_set_input_rate(i->thread_info.resampler, PA_PTR_TO_UINT(userdata));
+
+            return 0;
+
+        case PA_SINK_INPUT_MESSAGE_SET_RESAMPLER:
+
+            /* The render queue holds data in the sink's format and
+             * stays valid, we only lose what the old resampler had
+             * buffered internally. The sample spec only has the
+             * rounded rate, so the exact one has to be carried over
+             * from the old resampler. */
+            if (i->thread_info.resampler) {
+                pa_resampler_set_input_rate_frac(userdata, pa_resampler_get_input_rate_frac(i->thread_info.resampler));
+                pa_resampler_free(i->thread_info.resampler);
+            }
+
+            i->thread_info.resampler = userdata;
             return 0;
 
         case PA_SINK_INPUT_MESSAGE_SET_STATE: {
@@ -2090,3 +2174,42 @@ int pa_sink_input_update_rate(pa_sink_input *i) {
 
     return 0;
 }
+
+/* Called from main context */
+int pa_sink_input_set_resample_method(pa_sink_input *i, pa_resample_method_t method) {
+    pa_resampler *new_resampler;
+
+    pa_sink_input_assert_ref(i);
+    pa_assert_ctl_context();
+    pa_assert(PA_SINK_INPUT_IS_LINKED(i->state));
+
+    if (!i->thread_info.resampler)
+        return -PA_ERR_NOTSUPPORTED;
+
+    if (method == i->actual_resample_method)
+        return 0;
+
+    new_resampler = pa_resampler_new(i->core->mempool,
+                                     &i->sample_spec, &i->channel_map,
+                                     &i->sink->sample_spec, &i->sink->channel_map,
+                                     method,
+                                     ((i->flags & PA_SINK_INPUT_VARIABLE_RATE) ? PA_RESAMPLER_VARIABLE_RATE : 0) |
+                                     ((i->flags & PA_SINK_INPUT_NO_REMAP) ? PA_RESAMPLER_NO_REMAP : 0) |
+                                     (i->core->disable_remixing || (i->flags & PA_SINK_INPUT_NO_REMIX) ? PA_RESAMPLER_NO_REMIX : 0));
+
+    if (!new_resampler) {
+        pa_log_warn("Unsupported resampling operation.");
+        return -PA_ERR_NOTSUPPORTED;
+    }
+
+    pa_assert_se(pa_asyncmsgq_send(i->sink->asyncmsgq, PA_MSGOBJECT(i), PA_SINK_INPUT_MESSAGE_SET_RESAMPLER, new_resampler, 0, NULL) == 0);
+
+    i->requested_resample_method = method;
+    i->actual_resample_method = pa_resampler_get_method(new_resampler);
+
+    pa_log_debug("Sink input %u now uses resampler '%s'", i->index, pa_resample_method_to_string(i->actual_resample_method));
+
+    pa_subscription_post(i->core, PA_SUBSCRIPTION_EVENT_SINK_INPUT|PA_SUBSCRIPTION_EVENT_CHANGE, i->index);
+
+    return 0;
+}
@@ -35,6 +35,7 @@ typedef struct pa_sink_input pa_sink_input;
 #include <pulsecore/client.h>
 #include <pulsecore/sink.h>
 #include <pulsecore/core.h>
+#include <pulsecore/telemetry.h>
 
 typedef enum pa_sink_input_state {
     PA_SINK_INPUT_INIT,         /*< The stream is not active yet, because pa_sink_input_put() has not been called yet */
@@ -210,6 +211,9 @@ struct pa_sink_input {
      * mute status changes. Called from main context */
     void (*mute_changed)(pa_sink_input *i); /* may be NULL */
 
+    /* Recorded from the IO thread, collected from the main thread */
+    pa_telemetry *telemetry;
+
     struct {
         pa_sink_input_state_t state;
         pa_atomic_t drained;
@@ -237,6 +241,10 @@ struct pa_sink_input {
         pa_usec_t requested_sink_latency;
 
         pa_hashmap *direct_outputs;
+
+        /* Time spent in pa_sink_input_peek() in the sink's current
+         * overload detection window */
+        pa_usec_t render_cost;
     } thread_info;
 
     void *userdata;
@@ -253,6 +261,7 @@ enum {
     PA_SINK_INPUT_MESSAGE_SET_STATE,
     PA_SINK_INPUT_MESSAGE_SET_REQUESTED_LATENCY,
     PA_SINK_INPUT_MESSAGE_GET_REQUESTED_LATENCY,
+    PA_SINK_INPUT_MESSAGE_SET_RESAMPLER,
     PA_SINK_INPUT_MESSAGE_MAX
 };
 
@@ -338,8 +347,12 @@ void pa_sink_input_request_rewind(pa_sink_input *i, size_t nbytes, pa_bool_t rew
 void pa_sink_input_cork(pa_sink_input *i, pa_bool_t b);
 
 int pa_sink_input_set_rate(pa_sink_input *i, uint32_t rate);
+int pa_sink_input_set_rate_frac(pa_sink_input *i, double rate);
 int pa_sink_input_update_rate(pa_sink_input *i);
 
+/* Switch to a different resampling method while running */
+int pa_sink_input_set_resample_method(pa_sink_input *i, pa_resample_method_t method);
+
 /* This returns the sink's fields converted into out sample type */
 size_t pa_sink_input_get_max_rewind(pa_sink_input *i);
 size_t pa_sink_input_get_max_request(pa_sink_input *i);
@@ -41,6 +41,7 @@
 #include <pulsecore/sink-input.h>
 #include <pulsecore/namereg.h>
 #include <pulsecore/core-util.h>
+#include <pulsecore/core-rtclock.h>
 #include <pulsecore/sample-util.h>
 #include <pulsecore/core-subscribe.h>
 #include <pulsecore/log.h>
@@ -56,6 +57,11 @@
 #define ABSOLUTE_MAX_LATENCY (10*PA_USEC_PER_SEC)
 #define DEFAULT_FIXED_LATENCY (250*PA_USEC_PER_MSEC)
 
+/* A sink is overloaded if rendering takes more than this share of the
+ * duration of the audio rendered, averaged over the window below */
+#define OVERLOAD_PERCENT 75
+#define OVERLOAD_WINDOW (PA_USEC_PER_SEC)
+
 PA_DEFINE_PUBLIC_CLASS(pa_sink, pa_msgobject);
 
 struct pa_sink_volume_change {
@@ -318,6 +324,8 @@ pa_sink* pa_sink_new(
             &s->sample_spec,
             0);
 
+    s->telemetry = pa_telemetry_new();
+
     s->thread_info.rtpoll = NULL;
     s->thread_info.inputs = pa_hashmap_new(pa_idxset_trivial_hash_func, pa_idxset_trivial_compare_func);
     s->thread_info.soft_volume =  s->soft_volume;
@@ -338,6 +346,10 @@ pa_sink* pa_sink_new(
     pa_sw_cvolume_multiply(&s->thread_info.current_hw_volume, &s->soft_volume, &s->real_volume);
     s->thread_info.volume_change_safety_margin = core->deferred_volume_safety_margin_usec;
     s->thread_info.volume_change_extra_delay = core->deferred_volume_extra_delay_usec;
+    s->thread_info.render_cost = 0;
+    s->thread_info.render_duration = 0;
+    s->thread_info.rendering = FALSE;
+    s->thread_info.render_start = 0;
 
     /* FIXME: This should probably be moved to pa_sink_put() */
     pa_assert_se(pa_idxset_put(core->sinks, s, &s->index) >= 0);
@@ -730,6 +742,9 @@ static void sink_free(pa_object *o) {
     if (s->silence.memblock)
         pa_memblock_unref(s->silence.memblock);
 
+    if (s->telemetry)
+        pa_telemetry_free(s->telemetry);
+
     pa_xfree(s->name);
     pa_xfree(s->driver);
 
@@ -935,6 +950,8 @@ void pa_sink_process_rewind(pa_sink *s, size_t nbytes) {
         pa_log_debug("Processing rewind...");
         if (s->flags & PA_SINK_DEFERRED_VOLUME)
             pa_sink_volume_change_rewind(s, nbytes);
+
+        pa_telemetry_record(s->telemetry, PA_TELEMETRY_REWIND, pa_bytes_to_usec(nbytes, &s->sample_spec));
     }
 
     PA_HASHMAP_FOREACH(i, s->thread_info.inputs, state) {
@@ -954,16 +971,26 @@ static unsigned fill_mix_info(pa_sink *s, size_t *length, pa_mix_info *info, uns
     unsigned n = 0;
     void *state = NULL;
     size_t mixlength = *length;
+    pa_usec_t t, now;
 
     pa_sink_assert_ref(s);
     pa_sink_assert_io_context(s);
     pa_assert(info);
 
+    /* Measured in thread CPU time, so that being preempted doesn't
+     * count as load */
+    t = pa_rtclock_thread_cpu();
+
     while ((i = pa_hashmap_iterate(s->thread_info.inputs, &state, NULL)) && maxinfo > 0) {
         pa_sink_input_assert_ref(i);
 
         pa_sink_input_peek(i, *length, &info->chunk, &info->volume);
 
+        /* Popping, resampling and volume adjustment of this input */
+        now = pa_rtclock_thread_cpu();
+        i->thread_info.render_cost += now - t;
+        t = now;
+
         if (mixlength == 0 || info->chunk.length < mixlength)
             mixlength = info->chunk.length;
 
@@ -988,6 +1015,40 @@ static unsigned fill_mix_info(pa_sink *s, size_t *length, pa_mix_info *info, uns
     return n;
 }
 
+/* Called from IO thread context */
+static void monitor_post(pa_sink *s, const pa_memchunk *result) {
+    size_t block_size_max, d;
+
+    block_size_max = pa_frame_align(pa_mempool_block_size_max(s->core->mempool), &s->sample_spec);
+
+    if (result->length <= block_size_max ||
+        pa_hashmap_size(s->monitor_source->thread_info.outputs) <= 0) {
+        pa_source_post(s->monitor_source, result);
+        return;
+    }
+
+    /* pa_sink_render_into() may have mixed into a caller supplied block
+     * much larger than a pool slot, e.g. one wrapping a whole DMA
+     * area. If the monitor's outputs kept references to it,
+     * pa_memblock_unref_fixed() would have to copy it to malloc()ed
+     * memory, so hand out copies in slot sized pool blocks instead. */
+    for (d = 0; d < result->length; d += block_size_max) {
+        pa_memchunk piece, copy;
+
+        piece = *result;
+        piece.index += d;
+        piece.length = PA_MIN(result->length - d, block_size_max);
+
+        copy.memblock = pa_memblock_new(s->core->mempool, piece.length);
+        copy.index = 0;
+        copy.length = piece.length;
+
+        pa_memchunk_memcpy(&copy, &piece);
+        pa_source_post(s->monitor_source, &copy);
+        pa_memblock_unref(copy.memblock);
+    }
+}
+
 /* Called from IO thread context */
 static void inputs_drop(pa_sink *s, pa_mix_info *info, unsigned n, pa_memchunk *result) {
     pa_sink_input *i;
@@ -1082,7 +1143,62 @@ static void inputs_drop(pa_sink *s, pa_mix_info *info, unsigned n, pa_memchunk *
     }
 
     if (s->monitor_source && PA_SOURCE_IS_LINKED(s->monitor_source->thread_info.state))
-        pa_source_post(s->monitor_source, result);
+        monitor_post(s, result);
+}
+
+/* Called from IO thread context. pa_sink_render_full() and
+ * pa_sink_render_into_full() render in several steps, but we only want
+ * to account for the whole of it, hence only the outermost call
+ * measures. Returns TRUE for that one. */
+static pa_bool_t render_begin(pa_sink *s) {
+    if (s->thread_info.rendering)
+        return FALSE;
+
+    s->thread_info.rendering = TRUE;
+    s->thread_info.render_start = pa_rtclock_thread_cpu();
+    return TRUE;
+}
+
+/* Called from IO thread context */
+static void render_done(pa_sink *s, size_t length) {
+    pa_sink_input *i, *heaviest = NULL;
+    pa_usec_t cost, heaviest_cost = 0;
+    unsigned percent;
+    void *state;
+
+    cost = pa_rtclock_thread_cpu() - s->thread_info.render_start;
+    s->thread_info.rendering = FALSE;
+
+    pa_telemetry_record(s->telemetry, PA_TELEMETRY_RENDER_TIME, cost);
+
+    s->thread_info.render_cost += cost;
+    s->thread_info.render_duration += pa_bytes_to_usec(length, &s->sample_spec);
+
+    if (s->thread_info.render_duration < OVERLOAD_WINDOW)
+        return;
+
+    percent = (unsigned) (s->thread_info.render_cost * 100 / s->thread_info.render_duration);
+
+    s->thread_info.render_cost = 0;
+    s->thread_info.render_duration = 0;
+
+    PA_HASHMAP_FOREACH(i, s->thread_info.inputs, state) {
+        if (i->thread_info.render_cost > heaviest_cost) {
+            heaviest = i;
+            heaviest_cost = i->thread_info.render_cost;
+        }
+
+        i->thread_info.render_cost = 0;
+    }
+
+    if (percent < OVERLOAD_PERCENT)
+        return;
+
+    /* Let the main thread decide what to do about it */
+    if (heaviest)
+        pa_asyncmsgq_post(pa_thread_mq_get()->outq, PA_MSGOBJECT(s), PA_SINK_MESSAGE_OVERLOAD, pa_sink_input_ref(heaviest), (int64_t) percent, NULL, (pa_free_cb_t) pa_sink_input_unref);
+    else
+        pa_asyncmsgq_post(pa_thread_mq_get()->outq, PA_MSGOBJECT(s), PA_SINK_MESSAGE_OVERLOAD, NULL, (int64_t) percent, NULL, NULL);
 }
 
 /* Called from IO thread context */
@@ -1090,6 +1206,7 @@ void pa_sink_render(pa_sink*s, size_t length, pa_memchunk *result) {
     pa_mix_info info[MAX_MIX_CHANNELS];
     unsigned n;
     size_t block_size_max;
+    pa_bool_t outermost;
 
     pa_sink_assert_ref(s);
     pa_sink_assert_io_context(s);
@@ -1109,6 +1226,8 @@ void pa_sink_render(pa_sink*s, size_t length, pa_memchunk *result) {
 
     pa_sink_ref(s);
 
+    outermost = render_begin(s);
+
     if (length <= 0)
         length = pa_frame_align(MIX_BUFFER_LENGTH, &s->sample_spec);
 
@@ -1167,6 +1286,9 @@ void pa_sink_render(pa_sink*s, size_t length, pa_memchunk *result) {
 
     inputs_drop(s, info, n, result);
 
+    if (outermost)
+        render_done(s, result->length);
+
     pa_sink_unref(s);
 }
 
@@ -1174,7 +1296,8 @@ void pa_sink_render(pa_sink*s, size_t length, pa_memchunk *result) {
 void pa_sink_render_into(pa_sink*s, pa_memchunk *target) {
     pa_mix_info info[MAX_MIX_CHANNELS];
     unsigned n;
-    size_t length, block_size_max;
+    size_t length;
+    pa_bool_t outermost;
 
     pa_sink_assert_ref(s);
     pa_sink_assert_io_context(s);
@@ -1194,12 +1317,12 @@ void pa_sink_render_into(pa_sink*s, pa_memchunk *target) {
 
     pa_sink_ref(s);
 
-    length = target->length;
-    block_size_max = pa_mempool_block_size_max(s->core->mempool);
-    if (length > block_size_max)
-        length = pa_frame_align(block_size_max, &s->sample_spec);
+    outermost = render_begin(s);
 
-    pa_assert(length > 0);
+    /* The target is not limited to the size of a pool slot: we mix
+     * straight into it, and the chunks we read from the inputs are
+     * limited by pa_sink_input_peek() anyway. */
+    length = target->length;
 
     n = fill_mix_info(s, &length, info, MAX_MIX_CHANNELS);
 
@@ -1252,6 +1375,9 @@ void pa_sink_render_into(pa_sink*s, pa_memchunk *target) {
 
     inputs_drop(s, info, n, target);
 
+    if (outermost)
+        render_done(s, target->length);
+
     pa_sink_unref(s);
 }
 
@@ -1259,6 +1385,7 @@ void pa_sink_render_into(pa_sink*s, pa_memchunk *target) {
 void pa_sink_render_into_full(pa_sink *s, pa_memchunk *target) {
     pa_memchunk chunk;
     size_t l, d;
+    pa_bool_t outermost;
 
     pa_sink_assert_ref(s);
     pa_sink_assert_io_context(s);
@@ -1278,6 +1405,8 @@ void pa_sink_render_into_full(pa_sink *s, pa_memchunk *target) {
 
     pa_sink_ref(s);
 
+    outermost = render_begin(s);
+
     l = target->length;
     d = 0;
     while (l > 0) {
@@ -1291,11 +1420,16 @@ void pa_sink_render_into_full(pa_sink *s, pa_memchunk *target) {
         l -= chunk.length;
     }
 
+    if (outermost)
+        render_done(s, target->length);
+
     pa_sink_unref(s);
 }
 
 /* Called from IO thread context */
 void pa_sink_render_full(pa_sink *s, size_t length, pa_memchunk *result) {
+    pa_bool_t outermost;
+
     pa_sink_assert_ref(s);
     pa_sink_assert_io_context(s);
     pa_assert(PA_SINK_IS_LINKED(s->thread_info.state));
@@ -1308,6 +1442,8 @@ void pa_sink_render_full(pa_sink *s, size_t length, pa_memchunk *result) {
 
     pa_sink_ref(s);
 
+    outermost = render_begin(s);
+
     pa_sink_render(s, length, result);
 
     if (result->length < length) {
@@ -1324,6 +1460,9 @@ void pa_sink_render_full(pa_sink *s, size_t length, pa_memchunk *result) {
         result->length = length;
     }
 
+    if (outermost)
+        render_done(s, result->length);
+
     pa_sink_unref(s);
 }
 
@@ -2365,6 +2504,91 @@ static void set_shared_volume_within_thread(pa_sink *s) {
     }
 }
 
+/* Streams we may drop when a sink is overloaded, least important first */
+static const char * const sheddable_roles[] = {
+    "test",
+    "event",
+    "animation",
+    NULL
+};
+
+/* Called from main context */
+static int shed_priority(pa_sink_input *i) {
+    const char *role;
+    int p;
+
+    if (!(role = pa_proplist_gets(i->proplist, PA_PROP_MEDIA_ROLE)))
+        return -1;
+
+    for (p = 0; sheddable_roles[p]; p++)
+        if (pa_streq(role, sheddable_roles[p]))
+            return p;
+
+    return -1;
+}
+
+/* Called from main context */
+static pa_bool_t degrade_resampler(pa_sink_input *i) {
+    pa_resample_method_t m;
+
+    if (i->actual_resample_method == PA_RESAMPLER_INVALID)
+        return FALSE;
+
+    if ((m = pa_resample_method_cheaper(i->actual_resample_method)) == PA_RESAMPLER_INVALID)
+        return FALSE;
+
+    if (pa_sink_input_set_resample_method(i, m) < 0)
+        return FALSE;
+
+    pa_log_info("Switched sink input %u to resampler '%s' to relieve sink %s.",
+                i->index, pa_resample_method_to_string(i->actual_resample_method), i->sink->name);
+
+    pa_sink_input_send_event(i, PA_STREAM_EVENT_OVERLOAD, NULL);
+    return TRUE;
+}
+
+/* Called from main context. Takes one step to reduce the load: make
+ * the most expensive input cheaper if possible, then any other input,
+ * and only if no resampler can be made cheaper anymore drop the least
+ * important stream. If that doesn't suffice the next overload report
+ * will take the next step. */
+static void handle_overload(pa_sink *s, pa_sink_input *heaviest, unsigned percent) {
+    pa_sink_input *i, *victim = NULL;
+    int victim_priority = 0;
+    uint32_t idx;
+
+    pa_sink_assert_ref(s);
+    pa_assert_ctl_context();
+
+    if (pa_log_ratelimit(PA_LOG_WARN))
+        pa_log_warn("Sink %s is overloaded: %u%% of the time is spent rendering.", s->name, percent);
+
+    if (heaviest && heaviest->sink == s && PA_SINK_INPUT_IS_LINKED(heaviest->state))
+        if (degrade_resampler(heaviest))
+            return;
+
+    PA_IDXSET_FOREACH(i, s->inputs, idx)
+        if (i != heaviest && degrade_resampler(i))
+            return;
+
+    PA_IDXSET_FOREACH(i, s->inputs, idx) {
+        int p;
+
+        if ((p = shed_priority(i)) < 0)
+            continue;
+
+        if (!victim || p < victim_priority) {
+            victim = i;
+            victim_priority = p;
+        }
+    }
+
+    if (victim) {
+        pa_log_warn("Dropping sink input %u to relieve sink %s.", victim->index, s->name);
+        pa_sink_input_kill(victim);
+    }
+}
+
 /* Called from IO thread, except when it is not */
 int pa_sink_process_msg(pa_msgobject *o, int code, void *userdata, int64_t offset, pa_memchunk *chunk) {
     pa_sink *s = PA_SINK(o);
@@ -2812,6 +3036,16 @@ int pa_sink_process_msg(pa_msgobject *o, int code, void *userdata, int64_t offse
             pa_sink_get_mute(s, TRUE);
             return 0;
 
+        case PA_SINK_MESSAGE_OVERLOAD:
+            /* This message is sent from IO-thread and handled in main thread. */
+            pa_assert_ctl_context();
+
+            if (!PA_SINK_IS_LINKED(s->state))
+                return 0;
+
+            handle_overload(s, userdata, (unsigned) offset);
+            return 0;
+
         case PA_SINK_MESSAGE_GET_LATENCY:
         case PA_SINK_MESSAGE_MAX:
             ;
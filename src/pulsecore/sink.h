@@ -46,6 +46,7 @@ typedef struct pa_sink_volume_change pa_sink_volume_change;
 #include <pulsecore/card.h>
 #include <pulsecore/queue.h>
 #include <pulsecore/thread-mq.h>
+#include <pulsecore/telemetry.h>
 #include <pulsecore/sink-input.h>
 
 #define PA_MAX_INPUTS_PER_SINK 32
@@ -109,6 +110,9 @@ struct pa_sink {
 
     pa_memchunk silence;
 
+    /* Recorded from the IO thread, collected from the main thread */
+    pa_telemetry *telemetry;
+
     pa_hashmap *ports;
     pa_device_port *active_port;
     pa_atomic_t mixer_dirty;
@@ -282,6 +286,16 @@ struct pa_sink {
         uint32_t volume_change_safety_margin;
         /* Usec delay added to all volume change events, may be negative. */
         int32_t volume_change_extra_delay;
+
+        /* Time spent rendering vs. the duration of the audio rendered
+         * in the current overload detection window */
+        pa_usec_t render_cost;
+        pa_usec_t render_duration;
+
+        /* Thread CPU time when the outermost pa_sink_render*() call
+         * that is in progress started */
+        pa_bool_t rendering;
+        pa_usec_t render_start;
     } thread_info;
 
     void *userdata;
@@ -317,6 +331,7 @@ typedef enum pa_sink_message {
     PA_SINK_MESSAGE_SET_MAX_REQUEST,
     PA_SINK_MESSAGE_SET_PORT,
     PA_SINK_MESSAGE_UPDATE_VOLUME_AND_MUTE,
+    PA_SINK_MESSAGE_OVERLOAD,
     PA_SINK_MESSAGE_MAX
 } pa_sink_message_t;
 
@@ -442,6 +442,8 @@ int pa_source_output_new(
     reset_callbacks(o);
     o->userdata = NULL;
 
+    o->telemetry = pa_telemetry_new();
+
     o->thread_info.state = o->state;
     o->thread_info.attached = FALSE;
     o->thread_info.sample_spec = o->sample_spec;
@@ -618,6 +620,9 @@ static void source_output_free(pa_object* mo) {
     if (o->proplist)
         pa_proplist_free(o->proplist);
 
+    if (o->telemetry)
+        pa_telemetry_free(o->telemetry);
+
     pa_xfree(o->driver);
     pa_xfree(o);
 }
@@ -715,6 +720,8 @@ void pa_source_output_push(pa_source_output *o, const pa_memchunk *chunk) {
     if (pa_memblockq_push(o->thread_info.delay_memblockq, chunk) < 0) {
         pa_log_debug("Delay queue overflow!");
         pa_memblockq_seek(o->thread_info.delay_memblockq, (int64_t) chunk->length, PA_SEEK_RELATIVE, TRUE);
+
+        pa_telemetry_record(o->telemetry, PA_TELEMETRY_XRUN, pa_bytes_to_usec(chunk->length, &o->source->sample_spec));
     }
 
     limit = o->process_rewind ? 0 : o->source->thread_info.max_rewind;
@@ -824,6 +831,8 @@ void pa_source_output_process_rewind(pa_source_output *o, size_t nbytes /* in so
     if (nbytes <= 0)
         return;
 
+    pa_telemetry_record(o->telemetry, PA_TELEMETRY_REWIND, pa_bytes_to_usec(nbytes, &o->source->sample_spec));
+
     if (o->process_rewind) {
         pa_assert(pa_memblockq_get_length(o->thread_info.delay_memblockq) == 0);
 
@@ -35,6 +35,7 @@ typedef struct pa_source_output pa_source_output;
 #include <pulsecore/source.h>
 #include <pulsecore/core.h>
 #include <pulsecore/sink-input.h>
+#include <pulsecore/telemetry.h>
 
 typedef enum pa_source_output_state {
     PA_SOURCE_OUTPUT_INIT,
@@ -190,6 +191,9 @@ struct pa_source_output {
      * mute status changes. Called from main context */
     void (*mute_changed)(pa_source_output *o); /* may be NULL */
 
+    /* Recorded from the IO thread, collected from the main thread */
+    pa_telemetry *telemetry;
+
     struct {
         pa_source_output_state_t state;
 
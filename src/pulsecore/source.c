@@ -306,6 +306,8 @@ pa_source* pa_source_new(
             &s->sample_spec,
             0);
 
+    s->telemetry = pa_telemetry_new();
+
     s->thread_info.rtpoll = NULL;
     s->thread_info.outputs = pa_hashmap_new(pa_idxset_trivial_hash_func, pa_idxset_trivial_compare_func);
     s->thread_info.soft_volume = s->soft_volume;
@@ -660,6 +662,9 @@ static void source_free(pa_object *o) {
     if (s->silence.memblock)
         pa_memblock_unref(s->silence.memblock);
 
+    if (s->telemetry)
+        pa_telemetry_free(s->telemetry);
+
     pa_xfree(s->name);
     pa_xfree(s->driver);
 
@@ -863,6 +868,8 @@ void pa_source_process_rewind(pa_source *s, size_t nbytes) {
 
     pa_log_debug("Processing rewind...");
 
+    pa_telemetry_record(s->telemetry, PA_TELEMETRY_REWIND, pa_bytes_to_usec(nbytes, &s->sample_spec));
+
     PA_HASHMAP_FOREACH(o, s->thread_info.outputs, state) {
         pa_source_output_assert_ref(o);
         pa_source_output_process_rewind(o, nbytes);
@@ -873,6 +880,7 @@ void pa_source_process_rewind(pa_source *s, size_t nbytes) {
 void pa_source_post(pa_source*s, const pa_memchunk *chunk) {
     pa_source_output *o;
     void *state = NULL;
+    pa_usec_t post_start = 0;
 
     pa_source_assert_ref(s);
     pa_source_assert_io_context(s);
@@ -882,6 +890,9 @@ void pa_source_post(pa_source*s, const pa_memchunk *chunk) {
     if (s->thread_info.state == PA_SOURCE_SUSPENDED)
         return;
 
+    if (pa_telemetry_enabled(s->telemetry))
+        post_start = pa_rtclock_now();
+
     if (s->thread_info.soft_muted || !pa_cvolume_is_norm(&s->thread_info.soft_volume)) {
         pa_memchunk vchunk = *chunk;
 
@@ -910,6 +921,9 @@ void pa_source_post(pa_source*s, const pa_memchunk *chunk) {
                 pa_source_output_push(o, chunk);
         }
     }
+
+    if (post_start > 0)
+        pa_telemetry_push(s->telemetry, PA_TELEMETRY_RENDER_TIME, pa_rtclock_now() - post_start);
 }
 
 /* Called from IO thread context */
@@ -46,6 +46,7 @@ typedef struct pa_source_volume_change pa_source_volume_change;
 #include <pulsecore/device-port.h>
 #include <pulsecore/queue.h>
 #include <pulsecore/thread-mq.h>
+#include <pulsecore/telemetry.h>
 #include <pulsecore/source-output.h>
 
 #define PA_MAX_OUTPUTS_PER_SOURCE 32
@@ -109,6 +110,9 @@ struct pa_source {
 
     pa_memchunk silence;
 
+    /* Recorded from the IO thread, collected from the main thread */
+    pa_telemetry *telemetry;
+
     pa_hashmap *ports;
     pa_device_port *active_port;
     pa_atomic_t mixer_dirty;
@@ -0,0 +1,134 @@
+/***
+  This file is part of PulseAudio.
+
+  PulseAudio is free software; you can redistribute it and/or modify
+  it under the terms of the GNU Lesser General Public License as
+  published by the Free Software Foundation; either version 2.1 of the
+  License, or (at your option) any later version.
+
+  PulseAudio is distributed in the hope that it will be useful, but
+  WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+  Lesser General Public License for more details.
+
+  You should have received a copy of the GNU Lesser General Public
+  License along with PulseAudio; if not, write to the Free Software
+  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307
+  USA.
+***/
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include <string.h>
+
+#include <pulse/xmalloc.h>
+
+#include "telemetry.h"
+
+/* Each ring entry holds the metric in the top bits and the value,
+ * saturated, in the rest */
+#define METRIC_SHIFT 29
+#define VALUE_MAX ((1U << METRIC_SHIFT) - 1)
+
+pa_telemetry *pa_telemetry_new(void) {
+    pa_telemetry *t;
+
+    t = pa_xnew0(pa_telemetry, 1);
+    pa_atomic_store(&t->write_idx, 0);
+    pa_atomic_store(&t->read_idx, 0);
+    pa_atomic_store(&t->dropped, 0);
+
+    return t;
+}
+
+void pa_telemetry_free(pa_telemetry *t) {
+    pa_assert(t);
+
+    pa_xfree(t);
+}
+
+/* Called from IO thread context */
+void pa_telemetry_push(pa_telemetry *t, pa_telemetry_metric_t m, uint64_t value) {
+    unsigned w;
+
+    pa_assert(t);
+    pa_assert(m < PA_TELEMETRY_MAX);
+
+    w = (unsigned) pa_atomic_load(&t->write_idx);
+
+    if (w - (unsigned) pa_atomic_load(&t->read_idx) >= PA_TELEMETRY_RING_SIZE) {
+        pa_atomic_inc(&t->dropped);
+        return;
+    }
+
+    t->ring[w % PA_TELEMETRY_RING_SIZE] = ((uint32_t) m << METRIC_SHIFT) | (uint32_t) PA_MIN(value, (uint64_t) VALUE_MAX);
+
+    /* Publishes the entry */
+    pa_atomic_store(&t->write_idx, (int) (w + 1));
+}
+
+static unsigned bucket(uint32_t value) {
+    unsigned b = 0;
+
+    while (value > 0 && b < PA_TELEMETRY_BUCKETS - 1) {
+        value >>= 1;
+        b++;
+    }
+
+    return b;
+}
+
+void pa_telemetry_set_enabled(pa_telemetry *t, pa_bool_t enabled) {
+    pa_assert(t);
+
+    t->enabled = enabled;
+}
+
+void pa_telemetry_collect(pa_telemetry *t) {
+    unsigned r, w;
+
+    pa_assert(t);
+
+    r = (unsigned) pa_atomic_load(&t->read_idx);
+    w = (unsigned) pa_atomic_load(&t->write_idx);
+
+    for (; r != w; r++) {
+        uint32_t e = t->ring[r % PA_TELEMETRY_RING_SIZE], v;
+        pa_telemetry_histogram *h;
+
+        h = &t->histograms[e >> METRIC_SHIFT];
+        v = e & VALUE_MAX;
+
+        h->count++;
+        h->sum += v;
+        h->max = PA_MAX(h->max, v);
+        h->buckets[bucket(v)]++;
+    }
+
+    /* Hands the slots back to the IO thread */
+    pa_atomic_store(&t->read_idx, (int) r);
+}
+
+void pa_telemetry_reset(pa_telemetry *t) {
+    pa_assert(t);
+
+    pa_atomic_store(&t->read_idx, pa_atomic_load(&t->write_idx));
+    pa_atomic_store(&t->dropped, 0);
+
+    memset(t->histograms, 0, sizeof(t->histograms));
+}
+
+const pa_telemetry_histogram *pa_telemetry_get_histogram(pa_telemetry *t, pa_telemetry_metric_t m) {
+    pa_assert(t);
+    pa_assert(m < PA_TELEMETRY_MAX);
+
+    return &t->histograms[m];
+}
+
+unsigned pa_telemetry_get_dropped(pa_telemetry *t) {
+    pa_assert(t);
+
+    return (unsigned) pa_atomic_load(&t->dropped);
+}
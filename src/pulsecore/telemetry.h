@@ -0,0 +1,103 @@
+#ifndef foopulsetelemetryhfoo
+#define foopulsetelemetryhfoo
+
+/***
+  This file is part of PulseAudio.
+
+  PulseAudio is free software; you can redistribute it and/or modify
+  it under the terms of the GNU Lesser General Public License as
+  published by the Free Software Foundation; either version 2.1 of the
+  License, or (at your option) any later version.
+
+  PulseAudio is distributed in the hope that it will be useful, but
+  WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+  Lesser General Public License for more details.
+
+  You should have received a copy of the GNU Lesser General Public
+  License along with PulseAudio; if not, write to the Free Software
+  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307
+  USA.
+***/
+
+#include <inttypes.h>
+
+#include <pulsecore/atomic.h>
+#include <pulsecore/macro.h>
+
+/* Timing telemetry for sinks, sources and streams. The IO thread that
+ * owns an object records samples into a small lock-free ring, the
+ * main thread drains that ring from time to time and accumulates the
+ * samples into log2 histograms. While telemetry is disabled (the
+ * default) recording a sample costs a single load and branch, and the
+ * value isn't even computed. */
+
+typedef enum pa_telemetry_metric {
+    PA_TELEMETRY_RENDER_TIME,     /* usec spent mixing (sinks, in thread CPU time) or posting (sources) one chunk */
+    PA_TELEMETRY_BUFFER_FILL,     /* usec of audio buffered when we look at it */
+    PA_TELEMETRY_WAKEUP_LATENESS, /* usec the IO thread woke up after its timer */
+    PA_TELEMETRY_REWIND,          /* usec rewound */
+    PA_TELEMETRY_XRUN,            /* usec lost in an under- or overrun, 0 if unknown */
+    PA_TELEMETRY_MAX
+} pa_telemetry_metric_t;
+
+/* Bucket 0 counts zeros, bucket n > 0 counts values in
+ * [2^(n-1), 2^n), and the last bucket everything above */
+#define PA_TELEMETRY_BUCKETS 32
+
+typedef struct pa_telemetry_histogram {
+    uint64_t count;
+    uint64_t sum;
+    uint32_t max;
+    uint32_t buckets[PA_TELEMETRY_BUCKETS];
+} pa_telemetry_histogram;
+
+#define PA_TELEMETRY_RING_SIZE 1024
+
+typedef struct pa_telemetry {
+    /* Written by the main thread, read unsynchronized by the IO
+     * thread. Seeing a stale value just loses or adds a few samples
+     * around the switch. */
+    pa_bool_t enabled;
+
+    /* Written only by the IO thread */
+    uint32_t ring[PA_TELEMETRY_RING_SIZE];
+    pa_atomic_t write_idx;
+    pa_atomic_t dropped;
+
+    /* Owned by the main thread */
+    pa_atomic_t read_idx;
+    pa_telemetry_histogram histograms[PA_TELEMETRY_MAX];
+} pa_telemetry;
+
+pa_telemetry *pa_telemetry_new(void);
+void pa_telemetry_free(pa_telemetry *t);
+
+/* Called from IO thread context */
+void pa_telemetry_push(pa_telemetry *t, pa_telemetry_metric_t m, uint64_t value);
+
+#define pa_telemetry_enabled(t) PA_UNLIKELY((t)->enabled)
+
+/* Called from IO thread context. value is only evaluated while
+ * telemetry is enabled. */
+#define pa_telemetry_record(t, m, value)                \
+    do {                                                \
+        if (pa_telemetry_enabled(t))                    \
+            pa_telemetry_push((t), (m), (value));       \
+    } while (FALSE)
+
+/* The rest is to be called from main context only */
+void pa_telemetry_set_enabled(pa_telemetry *t, pa_bool_t enabled);
+
+/* Move everything recorded so far into the histograms */
+void pa_telemetry_collect(pa_telemetry *t);
+
+/* Drop everything recorded so far */
+void pa_telemetry_reset(pa_telemetry *t);
+
+const pa_telemetry_histogram *pa_telemetry_get_histogram(pa_telemetry *t, pa_telemetry_metric_t m);
+
+/* Number of samples lost because the ring was full */
+unsigned pa_telemetry_get_dropped(pa_telemetry *t);
+
+#endif
@@ -0,0 +1,155 @@
+/***
+  This file is part of PulseAudio.
+
+  PulseAudio is free software; you can redistribute it and/or modify
+  it under the terms of the GNU Lesser General Public License as
+  published by the Free Software Foundation; either version 2.1 of the
+  License, or (at your option) any later version.
+
+  PulseAudio is distributed in the hope that it will be useful, but
+  WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+  Lesser General Public License for more details.
+
+  You should have received a copy of the GNU Lesser General Public
+  License along with PulseAudio; if not, write to the Free Software
+  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307
+  USA.
+***/
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include <string.h>
+
+#include <pulse/timeval.h>
+#include <pulse/xmalloc.h>
+
+#include <pulsecore/macro.h>
+
+#include "wakeup-predictor.h"
+
+/* Linear buckets of 100us up to 51.2ms, everything above that ends up
+ * in the last one */
+#define BUCKET_USEC 100
+#define N_BUCKETS 512
+
+/* Every this many samples all counts are halved, so that old history
+ * fades out and the prediction follows changes in system load. Counts
+ * are kept in fixed point, so that a single rare outlier is still
+ * remembered for several decay periods rather than rounded away on
+ * the first one. */
+#define DECAY_SAMPLES 2048
+#define SAMPLE_WEIGHT 256
+
+/* Don't predict anything before we have seen this many wakeups */
+#define MIN_SAMPLES 256
+
+/* Walking the histogram isn't free, we do it only every so often */
+#define UPDATE_SAMPLES 32
+
+struct pa_wakeup_predictor {
+    unsigned ppm;
+
+    uint32_t buckets[N_BUCKETS];
+    uint64_t total;
+    unsigned n_samples;
+    unsigned since_decay;
+    unsigned since_update;
+
+    pa_bool_t valid;
+    pa_usec_t margin;
+};
+
+pa_wakeup_predictor* pa_wakeup_predictor_new(unsigned ppm) {
+    pa_wakeup_predictor *p;
+
+    pa_assert(ppm > 0);
+    pa_assert(ppm <= 1000000);
+
+    p = pa_xnew(pa_wakeup_predictor, 1);
+    p->ppm = ppm;
+    pa_wakeup_predictor_reset(p);
+
+    return p;
+}
+
+void pa_wakeup_predictor_free(pa_wakeup_predictor *p) {
+    pa_assert(p);
+
+    pa_xfree(p);
+}
+
+void pa_wakeup_predictor_reset(pa_wakeup_predictor *p) {
+    pa_assert(p);
+
+    memset(p->buckets, 0, sizeof(p->buckets));
+    p->total = 0;
+    p->n_samples = 0;
+    p->since_decay = 0;
+    p->since_update = 0;
+    p->valid = FALSE;
+    p->margin = 0;
+}
+
+static void decay(pa_wakeup_predictor *p) {
+    unsigned i;
+
+    p->total = 0;
+    p->since_decay = 0;
+
+    for (i = 0; i < N_BUCKETS; i++) {
+        p->buckets[i] /= 2;
+        p->total += p->buckets[i];
+    }
+}
+
+static void update_margin(pa_wakeup_predictor *p) {
+    uint64_t needed, sum = 0;
+    unsigned i;
+
+    /* The smallest margin that covers the requested fraction of all
+     * samples, rounded up to the end of its bucket */
+    needed = (p->total * p->ppm + 999999) / 1000000;
+
+    for (i = 0; i < N_BUCKETS - 1; i++)
+        if ((sum += p->buckets[i]) >= needed)
+            break;
+
+    p->margin = (pa_usec_t) (i + 1) * BUCKET_USEC;
+    p->valid = TRUE;
+    p->since_update = 0;
+}
+
+void pa_wakeup_predictor_add(pa_wakeup_predictor *p, pa_usec_t late, pa_usec_t work) {
+    pa_usec_t t;
+
+    pa_assert(p);
+
+    t = (late + work) / BUCKET_USEC;
+    p->buckets[PA_MIN(t, (pa_usec_t) N_BUCKETS - 1)] += SAMPLE_WEIGHT;
+    p->total += SAMPLE_WEIGHT;
+
+    if (p->n_samples < MIN_SAMPLES)
+        p->n_samples++;
+
+    if (++p->since_decay >= DECAY_SAMPLES)
+        decay(p);
+
+    p->since_update++;
+}
+
+pa_bool_t pa_wakeup_predictor_get_margin(pa_wakeup_predictor *p, pa_usec_t *margin) {
+    pa_assert(p);
+    pa_assert(margin);
+
+    if (!p->valid && p->n_samples < MIN_SAMPLES)
+        return FALSE;
+
+    if (!p->valid || p->since_update >= UPDATE_SAMPLES)
+        update_margin(p);
+
+    *margin = p->margin;
+    return TRUE;
+}
@@ -0,0 +1,50 @@
+#ifndef foopulsewakeuppredictorhfoo
+#define foopulsewakeuppredictorhfoo
+
+/***
+  This file is part of PulseAudio.
+
+  PulseAudio is free software; you can redistribute it and/or modify
+  it under the terms of the GNU Lesser General Public License as
+  published by the Free Software Foundation; either version 2.1 of the
+  License, or (at your option) any later version.
+
+  PulseAudio is distributed in the hope that it will be useful, but
+  WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+  Lesser General Public License for more details.
+
+  You should have received a copy of the GNU Lesser General Public
+  License along with PulseAudio; if not, write to the Free Software
+  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307
+  USA.
+***/
+
+#include <pulse/sample.h>
+
+#include <pulsecore/macro.h>
+
+/* Learns how much time a timer-scheduled IO thread needs between the
+ * moment it wanted to wake up and the moment the device buffer is
+ * refilled: wakeup lateness, clock translation errors and render
+ * cost, summed up per wakeup. From a decaying histogram of these
+ * samples it predicts the margin that covers a given fraction of all
+ * wakeups, which drivers use as their wakeup watermark. */
+typedef struct pa_wakeup_predictor pa_wakeup_predictor;
+
+/* ppm is the fraction of wakeups the predicted margin shall cover, in
+ * parts per million, e.g. 999900 */
+pa_wakeup_predictor* pa_wakeup_predictor_new(unsigned ppm);
+void pa_wakeup_predictor_free(pa_wakeup_predictor *p);
+
+void pa_wakeup_predictor_reset(pa_wakeup_predictor *p);
+
+/* Record one wakeup: how much of the margin was already gone when we
+ * looked at the buffer, and how long it took to refill it */
+void pa_wakeup_predictor_add(pa_wakeup_predictor *p, pa_usec_t late, pa_usec_t work);
+
+/* Returns FALSE as long as there are too few samples for a
+ * prediction */
+pa_bool_t pa_wakeup_predictor_get_margin(pa_wakeup_predictor *p, pa_usec_t *margin);
+
+#endif
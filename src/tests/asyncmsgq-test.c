@@ -25,18 +25,28 @@
 #include <stdlib.h>
 #include <unistd.h>
 
+#include <pulse/rtclock.h>
+
 #include <pulsecore/asyncmsgq.h>
+#include <pulsecore/atomic.h>
 #include <pulsecore/thread.h>
 #include <pulsecore/log.h>
 #include <pulsecore/macro.h>
 
+#define N_ROUND_TRIPS 20000
+#define N_POSTS 20000
+
 enum {
     OPERATION_A,
     OPERATION_B,
     OPERATION_C,
+    PING,
+    COUNT,
     QUIT
 };
 
+static pa_atomic_t counted = PA_ATOMIC_INIT(0);
+
 static void the_thread(void *_q) {
     pa_asyncmsgq *q = _q;
     int quit = 0;
@@ -60,6 +70,13 @@ static void the_thread(void *_q) {
                 pa_log_info("Operation C");
                 break;
 
+            case PING:
+                break;
+
+            case COUNT:
+                pa_atomic_inc(&counted);
+                break;
+
             case QUIT:
                 pa_log_info("quit");
                 quit = 1;
@@ -71,6 +88,14 @@ static void the_thread(void *_q) {
     } while (!quit);
 }
 
+static void post_thread(void *_q) {
+    pa_asyncmsgq *q = _q;
+    unsigned n;
+
+    for (n = 0; n < N_POSTS; n++)
+        pa_asyncmsgq_post(q, NULL, COUNT, NULL, 0, NULL, NULL);
+}
+
 int main(int argc, char *argv[]) {
     pa_asyncmsgq *q;
     pa_thread *t;
@@ -94,6 +119,37 @@ int main(int argc, char *argv[]) {
 
     pa_thread_yield();
 
+    /* Measure the round trip time of synchronous messages, which is
+     * what most main thread to IO thread calls boil down to */
+    {
+        pa_usec_t ts;
+        unsigned n;
+
+        ts = pa_rtclock_now();
+
+        for (n = 0; n < N_ROUND_TRIPS; n++)
+            pa_assert_se(pa_asyncmsgq_send(q, NULL, PING, NULL, 0, NULL) == 0);
+
+        pa_log_info("%u round trips: %0.2f usec each", N_ROUND_TRIPS, (double) (pa_rtclock_now() - ts) / N_ROUND_TRIPS);
+    }
+
+    /* Several writers posting at the same time, none of the messages
+     * may get lost */
+    {
+        pa_thread *w1, *w2;
+
+        pa_assert_se(w1 = pa_thread_new("post1", post_thread, q));
+        pa_assert_se(w2 = pa_thread_new("post2", post_thread, q));
+
+        pa_thread_free(w1);
+        pa_thread_free(w2);
+
+        /* Everything posted before is processed by the time this returns */
+        pa_asyncmsgq_send(q, NULL, PING, NULL, 0, NULL);
+
+        pa_assert_se(pa_atomic_load(&counted) == 2 * N_POSTS);
+    }
+
     pa_log_info("Quit post");
     pa_asyncmsgq_post(q, NULL, QUIT, NULL, 0, NULL, NULL);
 
@@ -0,0 +1,119 @@
+/***
+  This file is part of PulseAudio.
+
+  PulseAudio is free software; you can redistribute it and/or modify
+  it under the terms of the GNU Lesser General Public License as published
+  by the Free Software Foundation; either version 2.1 of the License,
+  or (at your option) any later version.
+
+  PulseAudio is distributed in the hope that it will be useful, but
+  WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+  General Public License for more details.
+
+  You should have received a copy of the GNU Lesser General Public License
+  along with PulseAudio; if not, write to the Free Software
+  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307
+  USA.
+***/
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <math.h>
+
+#include <pulse/timeval.h>
+
+#include <pulsecore/log.h>
+#include <pulsecore/macro.h>
+#include <pulsecore/drift-controller.h>
+
+#define RATE 48000
+#define TARGET_USEC (10*PA_USEC_PER_MSEC)
+#define ADJUST_USEC PA_USEC_PER_SEC
+#define TICK_USEC (10*PA_USEC_PER_MSEC)
+#define NOISE_USEC (2*PA_USEC_PER_MSEC)
+
+/* Simulates a queue that is filled by a device whose clock runs
+ * drift_ppm faster than ours, and drained at the rate the controller
+ * picks, rounded to full Hz like pa_sink_input_set_rate() does. The
+ * latency is measured with some noise, as it would be by a real
+ * latency snapshot. Returns the largest deviation from the target in
+ * the second half of the run. */
+static double simulate(double drift_ppm, pa_usec_t start_latency, double *estimated_ppm) {
+    pa_drift_controller *c;
+    double latency, max_error = 0;
+    pa_usec_t now;
+    uint32_t rate = RATE;
+
+    c = pa_drift_controller_new(5 * ADJUST_USEC);
+
+    latency = (double) start_latency / PA_USEC_PER_SEC;
+
+    for (now = 0; now < 120 * PA_USEC_PER_SEC; now += TICK_USEC) {
+        double produced, consumed, error;
+
+        produced = (1.0 + drift_ppm / 1000000.0) * TICK_USEC / PA_USEC_PER_SEC;
+        consumed = (double) rate / RATE * TICK_USEC / PA_USEC_PER_SEC;
+        latency += produced - consumed;
+
+        error = latency - (double) TARGET_USEC / PA_USEC_PER_SEC;
+
+        if (now >= 60 * PA_USEC_PER_SEC && fabs(error) > max_error)
+            max_error = fabs(error);
+
+        if (now % ADJUST_USEC == 0) {
+            int64_t noise = (int64_t) (rand() % (2 * NOISE_USEC + 1)) - (int64_t) NOISE_USEC;
+
+            pa_drift_controller_update(c, now, (int64_t) (error * PA_USEC_PER_SEC) + noise);
+            rate = pa_drift_controller_get_rate(c, RATE);
+
+            pa_log_debug("%0.1f s: latency %0.2f ms, rate %u Hz, drift %0.1f ppm",
+                         (double) now / PA_USEC_PER_SEC, latency * 1000, rate, pa_drift_controller_get_drift_ppm(c));
+        }
+    }
+
+    *estimated_ppm = pa_drift_controller_get_drift_ppm(c);
+    pa_drift_controller_free(c);
+
+    return max_error;
+}
+
+int main(int argc, char *argv[]) {
+    static const struct {
+        double drift_ppm;
+        pa_usec_t start_latency;
+    } runs[] = {
+        {    0, 10 * PA_USEC_PER_MSEC },
+        {  300, 10 * PA_USEC_PER_MSEC },
+        { -800, 10 * PA_USEC_PER_MSEC },
+        {  150, 200 * PA_USEC_PER_MSEC },
+        { -150, 0 },
+        { 2000, 50 * PA_USEC_PER_MSEC }
+    };
+    unsigned i;
+
+    srand(0);
+
+    if (!getenv("MAKE_CHECK"))
+        pa_log_set_level(PA_LOG_DEBUG);
+
+    for (i = 0; i < PA_ELEMENTSOF(runs); i++) {
+        double max_error, estimated_ppm;
+
+        max_error = simulate(runs[i].drift_ppm, runs[i].start_latency, &estimated_ppm);
+
+        pa_log_info("Drift %0.0f ppm, start latency %0.0f ms: estimated %0.1f ppm, max error %0.2f ms",
+                    runs[i].drift_ppm, (double) runs[i].start_latency / PA_USEC_PER_MSEC, estimated_ppm, max_error * 1000);
+
+        /* Converged to within 2 ms of the target and found the drift
+         * within a few Hz worth of ppm */
+        pa_assert_se(max_error < 0.002);
+        pa_assert_se(fabs(estimated_ppm - runs[i].drift_ppm) < 100);
+    }
+
+    return 0;
+}
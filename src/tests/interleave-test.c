@@ -0,0 +1,110 @@
+/***
+  This file is part of PulseAudio.
+
+  PulseAudio is free software; you can redistribute it and/or modify
+  it under the terms of the GNU Lesser General Public License as published
+  by the Free Software Foundation; either version 2.1 of the License,
+  or (at your option) any later version.
+
+  PulseAudio is distributed in the hope that it will be useful, but
+  WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+  General Public License for more details.
+
+  You should have received a copy of the GNU Lesser General Public License
+  along with PulseAudio; if not, write to the Free Software
+  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307
+  USA.
+***/
+
+/* Checks pa_interleave() and pa_deinterleave() against a byte by byte
+ * reference for all sample sizes and a range of channel counts, and
+ * times the float case as used by the JACK modules. */
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include <stdlib.h>
+#include <string.h>
+
+#include <pulse/rtclock.h>
+#include <pulse/xmalloc.h>
+
+#include <pulsecore/log.h>
+#include <pulsecore/macro.h>
+#include <pulsecore/sample-util.h>
+
+#define N_FRAMES 1027
+#define N_LOOPS 2000
+
+static void reference_interleave(uint8_t *src[], unsigned channels, uint8_t *dst, size_t ss, unsigned n) {
+    unsigned c, j;
+    size_t b;
+
+    for (j = 0; j < n; j++)
+        for (c = 0; c < channels; c++)
+            for (b = 0; b < ss; b++)
+                dst[(j * channels + c) * ss + b] = src[c][j * ss + b];
+}
+
+int main(int argc, char *argv[]) {
+    static const size_t sizes[] = { 1, 2, 3, 4, 8 };
+    uint8_t *planes[PA_CHANNELS_MAX], *back[PA_CHANNELS_MAX];
+    uint8_t *interleaved, *reference;
+    unsigned channels, c, i;
+    size_t k;
+    pa_usec_t t;
+
+    if (!getenv("MAKE_CHECK"))
+        pa_log_set_level(PA_LOG_DEBUG);
+
+    srand(0);
+
+    for (c = 0; c < PA_CHANNELS_MAX; c++) {
+        planes[c] = pa_xmalloc(N_FRAMES * 8);
+        back[c] = pa_xmalloc(N_FRAMES * 8);
+
+        for (i = 0; i < N_FRAMES * 8; i++)
+            planes[c][i] = (uint8_t) rand();
+    }
+
+    interleaved = pa_xmalloc(N_FRAMES * 8 * PA_CHANNELS_MAX);
+    reference = pa_xmalloc(N_FRAMES * 8 * PA_CHANNELS_MAX);
+
+    for (k = 0; k < PA_ELEMENTSOF(sizes); k++)
+        for (channels = 1; channels <= 8; channels++) {
+            size_t ss = sizes[k];
+
+            reference_interleave(planes, channels, reference, ss, N_FRAMES);
+
+            pa_interleave((const void**) planes, channels, interleaved, ss, N_FRAMES);
+            pa_assert_se(memcmp(interleaved, reference, N_FRAMES * ss * channels) == 0);
+
+            pa_deinterleave(interleaved, (void**) back, channels, ss, N_FRAMES);
+            for (c = 0; c < channels; c++)
+                pa_assert_se(memcmp(back[c], planes[c], N_FRAMES * ss) == 0);
+        }
+
+    for (channels = 2; channels <= 8; channels *= 2) {
+        t = pa_rtclock_now();
+        for (i = 0; i < N_LOOPS; i++) {
+            pa_deinterleave(interleaved, (void**) back, channels, sizeof(float), N_FRAMES);
+            pa_interleave((const void**) back, channels, interleaved, sizeof(float), N_FRAMES);
+        }
+        t = pa_rtclock_now() - t;
+
+        pa_log_info("%u channels: %u float round trips of %u frames in %llu usec",
+                    channels, N_LOOPS, N_FRAMES, (unsigned long long) t);
+    }
+
+    for (c = 0; c < PA_CHANNELS_MAX; c++) {
+        pa_xfree(planes[c]);
+        pa_xfree(back[c]);
+    }
+
+    pa_xfree(interleaved);
+    pa_xfree(reference);
+
+    return 0;
+}
@@ -0,0 +1,212 @@
+/***
+  This file is part of PulseAudio.
+
+  PulseAudio is free software; you can redistribute it and/or modify
+  it under the terms of the GNU Lesser General Public License as published
+  by the Free Software Foundation; either version 2.1 of the License,
+  or (at your option) any later version.
+
+  PulseAudio is distributed in the hope that it will be useful, but
+  WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+  General Public License for more details.
+
+  You should have received a copy of the GNU Lesser General Public License
+  along with PulseAudio; if not, write to the Free Software
+  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307
+  USA.
+***/
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+
+#include <pulse/xmalloc.h>
+
+#include <pulsecore/log.h>
+#include <pulsecore/macro.h>
+#include <pulsecore/lpc-codec.h>
+
+#define RATE 44100
+#define CHANNELS 2
+#define N_FRAMES 4096
+
+enum {
+    SIGNAL_SILENCE,
+    SIGNAL_SINE,
+    SIGNAL_SINE_NOISE,
+    SIGNAL_NOISE,
+    SIGNAL_EXTREMES,
+    SIGNAL_MAX
+};
+
+static const char * const signal_names[SIGNAL_MAX] = {
+    [SIGNAL_SILENCE] = "silence",
+    [SIGNAL_SINE] = "sine",
+    [SIGNAL_SINE_NOISE] = "sine+noise",
+    [SIGNAL_NOISE] = "noise",
+    [SIGNAL_EXTREMES] = "extremes"
+};
+
+static void generate(int16_t *d, size_t n_frames, unsigned channels, int signal) {
+    size_t i;
+    unsigned c;
+
+    for (i = 0; i < n_frames; i++)
+        for (c = 0; c < channels; c++) {
+            double v = 0;
+
+            switch (signal) {
+                case SIGNAL_SINE:
+                    v = 20000 * sin(2 * M_PI * 440 * (c + 1) * i / RATE);
+                    break;
+                case SIGNAL_SINE_NOISE:
+                    v = 20000 * sin(2 * M_PI * 440 * (c + 1) * i / RATE) + (rand() % 201) - 100;
+                    break;
+                case SIGNAL_NOISE:
+                    v = (rand() % 65536) - 32768;
+                    break;
+                case SIGNAL_EXTREMES:
+                    v = ((i / (c + 1)) % 2) ? 32767 : -32768;
+                    break;
+            }
+
+            d[i * channels + c] = (int16_t) v;
+        }
+}
+
+/* Returns the encoded size */
+static size_t round_trip(const int16_t *src, size_t n_frames, unsigned channels) {
+    uint8_t *packet;
+    int16_t *decoded;
+    size_t length;
+
+    packet = pa_xmalloc(pa_lpc_encode_bound(n_frames, channels));
+    decoded = pa_xnew0(int16_t, PA_MAX(n_frames * channels, 1U));
+
+    length = pa_lpc_encode(src, n_frames, channels, packet);
+    pa_assert_se(length <= pa_lpc_encode_bound(n_frames, channels));
+
+    pa_assert_se(pa_lpc_decoded_frames(packet, length, channels) == n_frames);
+    pa_assert_se(pa_lpc_decode(packet, length, channels, decoded) == 0);
+    pa_assert_se(memcmp(src, decoded, n_frames * channels * sizeof(int16_t)) == 0);
+
+    /* A truncated packet must be rejected, not crash */
+    if (length > 4)
+        pa_assert_se(pa_lpc_decode(packet, length - 1, channels, decoded) < 0);
+
+    /* So must a packet for the wrong channel count */
+    pa_assert_se(pa_lpc_decoded_frames(packet, length, channels + 1) == (size_t) -1);
+
+    pa_xfree(packet);
+    pa_xfree(decoded);
+
+    return length;
+}
+
+static void put_bits(uint8_t *d, size_t *pos, uint32_t v, unsigned bits) {
+    while (bits-- > 0) {
+        if ((v >> bits) & 1)
+            d[*pos / 8] |= (uint8_t) (0x80 >> (*pos % 8));
+        (*pos)++;
+    }
+}
+
+/* Builds a mono packet with a first order predictor starting at 'first'
+ * and a single residual coded with Rice parameter k and quotient q, and
+ * checks that it is rejected */
+static void check_rejected(uint32_t first, uint32_t k, uint32_t q, uint32_t low) {
+    uint8_t packet[32];
+    int16_t decoded[2];
+    size_t pos = 0;
+
+    memset(packet, 0, sizeof(packet));
+    packet[0] = 1;
+    packet[1] = 1;
+    packet[2] = 2;
+    packet[3] = 0;
+
+    pos = 4 * 8;
+    put_bits(packet, &pos, 1, 3);
+    put_bits(packet, &pos, first, 16);
+    put_bits(packet, &pos, k, 5);
+    put_bits(packet, &pos, 1, q + 1);
+    put_bits(packet, &pos, low, k);
+
+    pa_assert_se(pos <= sizeof(packet) * 8);
+    pa_assert_se(pa_lpc_decode(packet, sizeof(packet), 1, decoded) < 0);
+}
+
+int main(int argc, char *argv[]) {
+    static const size_t sizes[] = { 0, 1, 3, 4, 5, 255, 256, 257, N_FRAMES, PA_LPC_MAX_FRAMES };
+    int16_t *buf;
+    unsigned channels;
+    int signal;
+    size_t i;
+
+    srand(0);
+
+    if (!getenv("MAKE_CHECK"))
+        pa_log_set_level(PA_LOG_DEBUG);
+
+    buf = pa_xnew(int16_t, PA_LPC_MAX_FRAMES * CHANNELS);
+
+    for (signal = 0; signal < SIGNAL_MAX; signal++)
+        for (channels = 1; channels <= CHANNELS; channels++)
+            for (i = 0; i < PA_ELEMENTSOF(sizes); i++) {
+                size_t length, raw;
+
+                generate(buf, sizes[i], channels, signal);
+
+                length = round_trip(buf, sizes[i], channels);
+                raw = sizes[i] * channels * sizeof(int16_t);
+
+                if (sizes[i] == N_FRAMES)
+                    pa_log_info("%s, %u channels: %lu -> %lu bytes (%0.1f%%)",
+                                signal_names[signal], channels,
+                                (unsigned long) raw, (unsigned long) length,
+                                100.0 * length / raw);
+
+                /* Smooth signals must actually get smaller */
+                if (sizes[i] == N_FRAMES && signal != SIGNAL_NOISE && signal != SIGNAL_EXTREMES)
+                    pa_assert_se(length < raw * 3 / 4);
+            }
+
+    /* Garbage must never decode into something out of range or
+     * overrun the output buffer */
+    for (i = 0; i < 10000; i++) {
+        uint8_t garbage[64];
+        size_t j, n;
+
+        for (j = 0; j < sizeof(garbage); j++)
+            garbage[j] = (uint8_t) rand();
+
+        garbage[0] = 1;
+        garbage[1] = 1;
+        garbage[2] = (uint8_t) (rand() % 32);
+        garbage[3] = 0;
+
+        n = pa_lpc_decoded_frames(garbage, sizeof(garbage), 1);
+        pa_assert_se(n <= 31);
+
+        pa_lpc_decode(garbage, sizeof(garbage), 1, buf);
+    }
+
+    /* Rice parameters the encoder never emits, which would make the
+     * residual wrap around in 32 bit arithmetic */
+    check_rejected(0x7FFF, 31, 1, 0x7FFFFFFE);
+    check_rejected(0x7FFF, 21, 0, 0);
+
+    /* A residual that pushes the sample just out of range */
+    check_rejected(0x7FFF, 1, 1, 0);
+    check_rejected(0x8000, 0, 1, 0);
+
+    pa_xfree(buf);
+
+    return 0;
+}
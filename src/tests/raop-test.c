@@ -0,0 +1,215 @@
+/***
+  This file is part of PulseAudio.
+
+  PulseAudio is free software; you can redistribute it and/or modify
+  it under the terms of the GNU Lesser General Public License as published
+  by the Free Software Foundation; either version 2.1 of the License,
+  or (at your option) any later version.
+
+  PulseAudio is distributed in the hope that it will be useful, but
+  WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+  General Public License for more details.
+
+  You should have received a copy of the GNU Lesser General Public License
+  along with PulseAudio; if not, write to the Free Software
+  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307
+  USA.
+***/
+
+/* Plays the receiver side of RAOP audio packets: everything the sink
+ * packs and encrypts is decrypted and unpacked again and must come out
+ * unchanged. Packing and encryption are also compared against bit by bit
+ * and block by block reference implementations, and timed. */
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include <stdlib.h>
+#include <string.h>
+
+#include <openssl/evp.h>
+
+#include <pulse/rtclock.h>
+#include <pulse/xmalloc.h>
+
+#include <pulsecore/log.h>
+#include <pulsecore/macro.h>
+
+#include <modules/raop/raop_packet.h>
+
+/* One RAOP packet worth of frames, as sent by module-raop-sink */
+#define N_FRAMES 1024
+#define N_PACKETS 2000
+
+static void put_bits(uint8_t *b, size_t *pos, uint32_t v, unsigned n) {
+    while (n-- > 0) {
+        if (!(*pos % 8))
+            b[*pos / 8] = 0;
+
+        if ((v >> n) & 1)
+            b[*pos / 8] |= (uint8_t) (0x80 >> (*pos % 8));
+
+        (*pos)++;
+    }
+}
+
+static uint32_t get_bits(const uint8_t *b, size_t *pos, unsigned n) {
+    uint32_t v = 0;
+
+    while (n-- > 0) {
+        v = (v << 1) | ((b[*pos / 8] >> (7 - *pos % 8)) & 1);
+        (*pos)++;
+    }
+
+    return v;
+}
+
+static size_t reference_pack(const uint8_t *pcm, size_t n_frames, uint8_t *out) {
+    size_t pos = 0, i;
+
+    put_bits(out, &pos, 1, 3);
+    put_bits(out, &pos, 0, 4);
+    put_bits(out, &pos, 0, 8);
+    put_bits(out, &pos, 0, 4);
+    put_bits(out, &pos, 1, 1);
+    put_bits(out, &pos, 0, 2);
+    put_bits(out, &pos, 1, 1);
+    put_bits(out, &pos, (uint32_t) n_frames, 32);
+
+    for (i = 0; i < n_frames * 4; i += 2)
+        put_bits(out, &pos, ((uint32_t) pcm[i + 1] << 8) | pcm[i], 16);
+
+    return (pos + 7) / 8;
+}
+
+/* CBC done by hand, one block at a time */
+static void reference_encrypt(EVP_CIPHER_CTX *ecb, const uint8_t *iv, uint8_t *data, size_t size) {
+    uint8_t nv[PA_RAOP_AES_CHUNKSIZE];
+    size_t i, j;
+    int n;
+
+    memcpy(nv, iv, sizeof(nv));
+
+    for (i = 0; i + PA_RAOP_AES_CHUNKSIZE <= size; i += PA_RAOP_AES_CHUNKSIZE) {
+        for (j = 0; j < PA_RAOP_AES_CHUNKSIZE; j++)
+            data[i + j] ^= nv[j];
+
+        pa_assert_se(EVP_EncryptUpdate(ecb, data + i, &n, data + i, PA_RAOP_AES_CHUNKSIZE));
+        memcpy(nv, data + i, sizeof(nv));
+    }
+}
+
+/* What an AirPort does with a packet: decrypt and unpack */
+static void receive(EVP_CIPHER_CTX *dec, const uint8_t *iv, uint8_t *data, size_t size, uint8_t *pcm, size_t n_frames) {
+    size_t pos = 0, i, encrypted;
+    int n;
+
+    encrypted = size & ~(size_t) (PA_RAOP_AES_CHUNKSIZE - 1);
+    pa_assert_se(EVP_DecryptInit_ex(dec, NULL, NULL, NULL, iv));
+    pa_assert_se(EVP_DecryptUpdate(dec, data, &n, data, (int) encrypted));
+
+    pa_assert_se(get_bits(data, &pos, 3) == 1);
+    pa_assert_se(get_bits(data, &pos, 16) == 0);
+    pa_assert_se(get_bits(data, &pos, 1) == 1);
+    pa_assert_se(get_bits(data, &pos, 2) == 0);
+    pa_assert_se(get_bits(data, &pos, 1) == 1);
+    pa_assert_se(get_bits(data, &pos, 32) == n_frames);
+
+    for (i = 0; i < n_frames * 2; i++) {
+        uint32_t v = get_bits(data, &pos, 16);
+
+        pcm[i * 2] = (uint8_t) v;
+        pcm[i * 2 + 1] = (uint8_t) (v >> 8);
+    }
+}
+
+int main(int argc, char *argv[]) {
+    static const size_t sizes[] = { 0, 1, 2, 3, 4, 5, 7, 8, 9, 351, 352, N_FRAMES };
+    uint8_t key[PA_RAOP_AES_CHUNKSIZE], iv[PA_RAOP_AES_CHUNKSIZE];
+    uint8_t *pcm, *a, *b, *decoded;
+    EVP_CIPHER_CTX *cbc, *ecb, *dec;
+    pa_usec_t t, t_reference;
+    size_t i, j;
+
+    srand(0);
+
+    if (!getenv("MAKE_CHECK"))
+        pa_log_set_level(PA_LOG_DEBUG);
+
+    for (i = 0; i < sizeof(key); i++) {
+        key[i] = (uint8_t) rand();
+        iv[i] = (uint8_t) rand();
+    }
+
+    pa_assert_se(cbc = EVP_CIPHER_CTX_new());
+    pa_assert_se(EVP_EncryptInit_ex(cbc, EVP_aes_128_cbc(), NULL, key, iv));
+    EVP_CIPHER_CTX_set_padding(cbc, 0);
+
+    pa_assert_se(ecb = EVP_CIPHER_CTX_new());
+    pa_assert_se(EVP_EncryptInit_ex(ecb, EVP_aes_128_ecb(), NULL, key, NULL));
+    EVP_CIPHER_CTX_set_padding(ecb, 0);
+
+    pa_assert_se(dec = EVP_CIPHER_CTX_new());
+    pa_assert_se(EVP_DecryptInit_ex(dec, EVP_aes_128_cbc(), NULL, key, iv));
+    EVP_CIPHER_CTX_set_padding(dec, 0);
+
+    pcm = pa_xmalloc(N_FRAMES * 4);
+    decoded = pa_xmalloc(N_FRAMES * 4);
+    a = pa_xmalloc(PA_RAOP_ALAC_FRAME_SIZE(N_FRAMES));
+    b = pa_xmalloc(PA_RAOP_ALAC_FRAME_SIZE(N_FRAMES));
+
+    for (i = 0; i < PA_ELEMENTSOF(sizes); i++) {
+        size_t n = sizes[i], size;
+
+        for (j = 0; j < n * 4; j++)
+            pcm[j] = (uint8_t) rand();
+
+        /* Packing */
+        size = pa_raop_alac_pack(pcm, n, a);
+        pa_assert_se(size == PA_RAOP_ALAC_FRAME_SIZE(n));
+        pa_assert_se(reference_pack(pcm, n, b) == size);
+        pa_assert_se(memcmp(a, b, size) == 0);
+
+        /* Encryption, the unencrypted tail must stay as it is */
+        pa_assert_se(pa_raop_aes_encrypt(cbc, iv, a, size) == (size & ~(size_t) 15));
+        reference_encrypt(ecb, iv, b, size);
+        pa_assert_se(memcmp(a, b, size) == 0);
+
+        /* And back again */
+        receive(dec, iv, a, size, decoded, n);
+        pa_assert_se(memcmp(pcm, decoded, n * 4) == 0);
+    }
+
+    /* Throughput */
+    t_reference = pa_rtclock_now();
+    for (i = 0; i < N_PACKETS; i++) {
+        size_t size = reference_pack(pcm, N_FRAMES, b);
+        reference_encrypt(ecb, iv, b, size);
+    }
+    t_reference = pa_rtclock_now() - t_reference;
+
+    t = pa_rtclock_now();
+    for (i = 0; i < N_PACKETS; i++) {
+        size_t size = pa_raop_alac_pack(pcm, N_FRAMES, a);
+        pa_raop_aes_encrypt(cbc, iv, a, size);
+    }
+    t = pa_rtclock_now() - t;
+
+    pa_assert_se(memcmp(a, b, PA_RAOP_ALAC_FRAME_SIZE(N_FRAMES)) == 0);
+
+    pa_log_info("%u packets of %u frames: %llu usec, reference %llu usec",
+                N_PACKETS, N_FRAMES, (unsigned long long) t, (unsigned long long) t_reference);
+
+    EVP_CIPHER_CTX_free(cbc);
+    EVP_CIPHER_CTX_free(ecb);
+    EVP_CIPHER_CTX_free(dec);
+
+    pa_xfree(pcm);
+    pa_xfree(decoded);
+    pa_xfree(a);
+    pa_xfree(b);
+
+    return 0;
+}
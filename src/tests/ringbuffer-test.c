@@ -0,0 +1,153 @@
+/***
+  This file is part of PulseAudio.
+
+  PulseAudio is free software; you can redistribute it and/or modify
+  it under the terms of the GNU Lesser General Public License as published
+  by the Free Software Foundation; either version 2.1 of the License,
+  or (at your option) any later version.
+
+  PulseAudio is distributed in the hope that it will be useful, but
+  WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+  General Public License for more details.
+
+  You should have received a copy of the GNU Lesser General Public License
+  along with PulseAudio; if not, write to the Free Software
+  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307
+  USA.
+***/
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+
+#include <pulsecore/ringbuffer.h>
+#include <pulsecore/thread.h>
+#include <pulsecore/log.h>
+#include <pulsecore/macro.h>
+
+/* Odd sizes, so that the transfers wrap around the end of the ring at
+ * all kinds of offsets */
+#define CAPACITY 1021
+#define TOTAL (4*1024*1024)
+
+static void producer(void *_r) {
+    pa_ringbuffer *r = _r;
+    unsigned i = 0, chunk = 1;
+
+    while (i < TOTAL) {
+        uint8_t *p;
+        size_t n, j;
+
+        p = pa_ringbuffer_begin_write(r, &n);
+        n = PA_MIN(n, PA_MIN(chunk, TOTAL - i));
+
+        if (n <= 0) {
+            pa_thread_yield();
+            continue;
+        }
+
+        for (j = 0; j < n; j++)
+            p[j] = (uint8_t) (i + j);
+
+        pa_ringbuffer_end_write(r, n);
+        i += n;
+        chunk = chunk % 97 + 13;
+    }
+
+    pa_log_debug("pushed %u bytes", i);
+}
+
+static void consumer(void *_r) {
+    pa_ringbuffer *r = _r;
+    unsigned i = 0, chunk = 1;
+
+    while (i < TOTAL) {
+        const uint8_t *p;
+        size_t n, j;
+
+        p = pa_ringbuffer_peek(r, &n);
+        n = PA_MIN(n, chunk);
+
+        if (n <= 0) {
+            pa_thread_yield();
+            continue;
+        }
+
+        for (j = 0; j < n; j++)
+            pa_assert_se(p[j] == (uint8_t) (i + j));
+
+        pa_ringbuffer_drop(r, n);
+        i += n;
+        chunk = chunk % 89 + 7;
+    }
+
+    pa_log_debug("popped %u bytes", i);
+}
+
+int main(int argc, char *argv[]) {
+    pa_ringbuffer *r;
+    pa_thread *t1, *t2;
+    size_t n;
+    void *p;
+
+    if (!getenv("MAKE_CHECK"))
+        pa_log_set_level(PA_LOG_DEBUG);
+
+    pa_assert_se(r = pa_ringbuffer_new(CAPACITY));
+
+    /* Single threaded: the space offered never exceeds what is free,
+     * nor what is left up to the end of the ring */
+    p = pa_ringbuffer_begin_write(r, &n);
+    pa_assert_se(n == CAPACITY);
+    memset(p, 0, 1000);
+    pa_ringbuffer_end_write(r, 1000);
+    pa_assert_se(pa_ringbuffer_fill(r) == 1000);
+
+    pa_ringbuffer_begin_write(r, &n);
+    pa_assert_se(n == CAPACITY - 1000);
+
+    pa_ringbuffer_peek(r, &n);
+    pa_assert_se(n == 1000);
+    pa_ringbuffer_drop(r, 990);
+
+    pa_ringbuffer_begin_write(r, &n);
+    pa_assert_se(n == CAPACITY - 1000);
+    pa_ringbuffer_end_write(r, n);
+
+    p = pa_ringbuffer_begin_write(r, &n);
+    pa_assert_se(n == 990);
+    pa_ringbuffer_end_write(r, n);
+    pa_assert_se(pa_ringbuffer_fill(r) == CAPACITY);
+
+    pa_ringbuffer_begin_write(r, &n);
+    pa_assert_se(n == 0);
+
+    pa_ringbuffer_peek(r, &n);
+    pa_assert_se(n == 10 + CAPACITY - 1000);
+    pa_ringbuffer_drop(r, n);
+    pa_ringbuffer_peek(r, &n);
+    pa_assert_se(n == 990);
+    pa_ringbuffer_drop(r, n);
+    pa_assert_se(pa_ringbuffer_fill(r) == 0);
+
+    pa_ringbuffer_free(r);
+
+    /* And now with one thread on each side */
+    pa_assert_se(r = pa_ringbuffer_new(CAPACITY));
+
+    pa_assert_se(t1 = pa_thread_new("producer", producer, r));
+    pa_assert_se(t2 = pa_thread_new("consumer", consumer, r));
+
+    pa_thread_free(t1);
+    pa_thread_free(t2);
+
+    pa_assert_se(pa_ringbuffer_fill(r) == 0);
+    pa_ringbuffer_free(r);
+
+    return 0;
+}
@@ -0,0 +1,272 @@
+/***
+  This file is part of PulseAudio.
+
+  PulseAudio is free software; you can redistribute it and/or modify
+  it under the terms of the GNU Lesser General Public License as published
+  by the Free Software Foundation; either version 2.1 of the License,
+  or (at your option) any later version.
+
+  PulseAudio is distributed in the hope that it will be useful, but
+  WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+  General Public License for more details.
+
+  You should have received a copy of the GNU Lesser General Public License
+  along with PulseAudio; if not, write to the Free Software
+  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307
+  USA.
+***/
+
+/* Checks that all SBC encoder implementations this CPU supports produce
+ * the same bitstream as the generic C code, and measures encoder and
+ * decoder throughput. Runs on a synthetic signal, or on a WAV file given
+ * on the command line. */
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+
+#include <sndfile.h>
+
+#include <pulse/rtclock.h>
+#include <pulse/timeval.h>
+#include <pulse/xmalloc.h>
+
+#include <pulsecore/log.h>
+#include <pulsecore/macro.h>
+#include <pulsecore/core-util.h>
+
+#include <modules/bluetooth/sbc/sbc.h>
+
+#define RATE 44100
+#define SECONDS 10
+
+struct config {
+    uint8_t subbands;
+    uint8_t mode;
+    uint8_t bitpool;
+};
+
+static const struct config configs[] = {
+    { SBC_SB_4, SBC_MODE_MONO, 31 },
+    { SBC_SB_8, SBC_MODE_MONO, 31 },
+    { SBC_SB_4, SBC_MODE_STEREO, 35 },
+    { SBC_SB_8, SBC_MODE_STEREO, 35 },
+    { SBC_SB_4, SBC_MODE_JOINT_STEREO, 53 },
+    { SBC_SB_8, SBC_MODE_JOINT_STEREO, 53 },
+};
+
+/* From slowest to fastest; implementations the CPU doesn't have are
+ * skipped because they report the same name as the previous one */
+static const unsigned long impl_flags[] = {
+    SBC_FLAG_NO_SIMD,
+    SBC_FLAG_NO_SSE2 | SBC_FLAG_NO_AVX2,
+    SBC_FLAG_NO_AVX2,
+    0
+};
+
+static void generate(int16_t *d, size_t n_frames) {
+    size_t i;
+
+    /* Some tones, some noise and now and then a full scale square wave
+     * to exercise saturation */
+    for (i = 0; i < n_frames; i++) {
+        double l = 12000 * sin(2 * M_PI * 440 * i / RATE) + 4000 * sin(2 * M_PI * 7919 * i / RATE) + (rand() % 2001) - 1000;
+        double r = 16000 * sin(2 * M_PI * 660 * i / RATE) + (rand() % 8001) - 4000;
+
+        if ((i / (RATE / 4)) % 4 == 3) {
+            l = (i / 50) % 2 ? 32767 : -32768;
+            r = -l - 1;
+        }
+
+        d[i * 2] = (int16_t) l;
+        d[i * 2 + 1] = (int16_t) r;
+    }
+}
+
+static int16_t *load(const char *fn, size_t *n_frames) {
+    SNDFILE *f;
+    SF_INFO info;
+    int16_t *d;
+    sf_count_t i;
+
+    pa_zero(info);
+
+    if (!(f = sf_open(fn, SFM_READ, &info))) {
+        pa_log("Failed to open %s: %s", fn, sf_strerror(NULL));
+        return NULL;
+    }
+
+    if (info.channels < 1 || info.channels > 2) {
+        pa_log("%s has %i channels, only mono and stereo are supported.", fn, info.channels);
+        sf_close(f);
+        return NULL;
+    }
+
+    /* The encoder configurations need stereo input; mono files are
+     * duplicated to both channels */
+    d = pa_xnew(int16_t, info.frames * 2);
+    *n_frames = (size_t) sf_readf_short(f, d, info.frames);
+    sf_close(f);
+
+    if (info.channels == 1)
+        for (i = (sf_count_t) *n_frames - 1; i >= 0; i--)
+            d[i * 2] = d[i * 2 + 1] = d[i];
+
+    return d;
+}
+
+/* Encodes all of the input and returns the bitstream; input for mono
+ * configurations is taken from the left channel only */
+static uint8_t *encode(const struct config *c, unsigned long flags, const int16_t *src, size_t n_frames,
+                       size_t *length, const char **impl, pa_usec_t *usec) {
+    sbc_t sbc;
+    int16_t *pcm;
+    uint8_t *out;
+    size_t codesize, frame_length, n_sbc_frames, i, pcm_size;
+    unsigned channels;
+    pa_usec_t start;
+
+    pa_assert_se(sbc_init(&sbc, flags) == 0);
+    sbc.frequency = SBC_FREQ_44100;
+    sbc.subbands = c->subbands;
+    sbc.mode = c->mode;
+    sbc.blocks = SBC_BLK_16;
+    sbc.allocation = SBC_AM_LOUDNESS;
+    sbc.bitpool = c->bitpool;
+
+    channels = c->mode == SBC_MODE_MONO ? 1 : 2;
+    codesize = sbc_get_codesize(&sbc);
+    frame_length = sbc_get_frame_length(&sbc);
+    n_sbc_frames = n_frames * channels * sizeof(int16_t) / codesize;
+
+    pcm_size = n_sbc_frames * codesize;
+    pcm = pa_xmalloc(PA_MAX(pcm_size, 1U));
+    for (i = 0; i < pcm_size / sizeof(int16_t); i++)
+        pcm[i] = channels == 1 ? src[i * 2] : src[i];
+
+    out = pa_xmalloc(PA_MAX(n_sbc_frames * frame_length, 1U));
+    *length = 0;
+
+    start = pa_rtclock_now();
+
+    for (i = 0; i < n_sbc_frames; i++) {
+        ssize_t written;
+
+        pa_assert_se(sbc_encode(&sbc, (uint8_t *) pcm + i * codesize, codesize,
+                                out + *length, frame_length, &written) == (ssize_t) codesize);
+        *length += (size_t) written;
+    }
+
+    *usec = pa_rtclock_now() - start;
+
+    /* Only known after the first sbc_encode() */
+    *impl = sbc_get_implementation_info(&sbc);
+
+    sbc_finish(&sbc);
+    pa_xfree(pcm);
+
+    return out;
+}
+
+static pa_usec_t decode(const uint8_t *data, size_t length) {
+    sbc_t sbc;
+    uint8_t pcm[512];
+    pa_usec_t start;
+
+    pa_assert_se(sbc_init(&sbc, 0) == 0);
+
+    start = pa_rtclock_now();
+
+    while (length > 0) {
+        ssize_t consumed;
+        size_t written;
+
+        pa_assert_se((consumed = sbc_decode(&sbc, data, length, pcm, sizeof(pcm), &written)) > 0);
+        data += consumed;
+        length -= (size_t) consumed;
+    }
+
+    start = pa_rtclock_now() - start;
+    sbc_finish(&sbc);
+
+    return start;
+}
+
+int main(int argc, char *argv[]) {
+    int16_t *src;
+    size_t n_frames;
+    pa_usec_t duration;
+    unsigned i, j;
+
+    srand(0);
+
+    if (!getenv("MAKE_CHECK"))
+        pa_log_set_level(PA_LOG_DEBUG);
+
+    if (argc > 1) {
+        if (!(src = load(argv[1], &n_frames)))
+            return 1;
+    } else {
+        n_frames = getenv("MAKE_CHECK") ? RATE : SECONDS * RATE;
+        src = pa_xnew(int16_t, n_frames * 2);
+        generate(src, n_frames);
+    }
+
+    duration = n_frames * PA_USEC_PER_SEC / RATE;
+
+    for (i = 0; i < PA_ELEMENTSOF(configs); i++) {
+        const struct config *c = configs + i;
+        uint8_t *reference = NULL;
+        size_t reference_length = 0;
+        const char *previous = NULL;
+        pa_usec_t usec;
+
+        for (j = 0; j < PA_ELEMENTSOF(impl_flags); j++) {
+            uint8_t *out;
+            size_t length;
+            const char *impl;
+
+            out = encode(c, impl_flags[j], src, n_frames, &length, &impl, &usec);
+
+            if (previous && pa_streq(impl, previous)) {
+                pa_xfree(out);
+                continue;
+            }
+
+            pa_log_info("%u subbands, %s, bitpool %u: %-9s encodes at %7.1fx realtime",
+                        c->subbands == SBC_SB_8 ? 8 : 4,
+                        c->mode == SBC_MODE_MONO ? "mono" : c->mode == SBC_MODE_STEREO ? "stereo" : "joint stereo",
+                        c->bitpool, impl, (double) duration / PA_MAX(usec, 1U));
+
+            if (!reference) {
+                reference = out;
+                reference_length = length;
+            } else {
+                /* SIMD code must be bit exact */
+                pa_assert_se(length == reference_length);
+                pa_assert_se(memcmp(out, reference, length) == 0);
+                pa_xfree(out);
+            }
+
+            previous = impl;
+        }
+
+        usec = decode(reference, reference_length);
+        pa_log_info("%u subbands, %s, bitpool %u: decodes at %7.1fx realtime",
+                    c->subbands == SBC_SB_8 ? 8 : 4,
+                    c->mode == SBC_MODE_MONO ? "mono" : c->mode == SBC_MODE_STEREO ? "stereo" : "joint stereo",
+                    c->bitpool, (double) duration / PA_MAX(usec, 1U));
+
+        pa_xfree(reference);
+    }
+
+    pa_xfree(src);
+
+    return 0;
+}
@@ -0,0 +1,119 @@
+/***
+  This file is part of PulseAudio.
+
+  PulseAudio is free software; you can redistribute it and/or modify
+  it under the terms of the GNU Lesser General Public License as published
+  by the Free Software Foundation; either version 2.1 of the License,
+  or (at your option) any later version.
+
+  PulseAudio is distributed in the hope that it will be useful, but
+  WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+  General Public License for more details.
+
+  You should have received a copy of the GNU Lesser General Public License
+  along with PulseAudio; if not, write to the Free Software
+  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307
+  USA.
+***/
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include <stdlib.h>
+
+#include <pulsecore/log.h>
+#include <pulsecore/macro.h>
+#include <pulsecore/thread.h>
+#include <pulsecore/telemetry.h>
+
+#define N_SAMPLES 1000000
+
+static int evaluated;
+
+static uint64_t value(uint64_t v) {
+    evaluated++;
+    return v;
+}
+
+static void producer(void *userdata) {
+    pa_telemetry *t = userdata;
+    unsigned i;
+
+    for (i = 0; i < N_SAMPLES; i++)
+        pa_telemetry_record(t, PA_TELEMETRY_RENDER_TIME, i % 4096);
+}
+
+int main(int argc, char *argv[]) {
+    pa_telemetry *t;
+    const pa_telemetry_histogram *h;
+    pa_thread *thread;
+    uint64_t total;
+    unsigned i;
+
+    if (!getenv("MAKE_CHECK"))
+        pa_log_set_level(PA_LOG_DEBUG);
+
+    t = pa_telemetry_new();
+
+    /* Nothing is recorded, nor even computed, while disabled */
+    pa_telemetry_record(t, PA_TELEMETRY_XRUN, value(1));
+    pa_assert_se(evaluated == 0);
+    pa_telemetry_collect(t);
+    pa_assert_se(pa_telemetry_get_histogram(t, PA_TELEMETRY_XRUN)->count == 0);
+
+    pa_telemetry_set_enabled(t, TRUE);
+
+    /* Bucket boundaries */
+    pa_telemetry_record(t, PA_TELEMETRY_XRUN, value(0));
+    pa_telemetry_record(t, PA_TELEMETRY_XRUN, value(1));
+    pa_telemetry_record(t, PA_TELEMETRY_XRUN, value(2));
+    pa_telemetry_record(t, PA_TELEMETRY_XRUN, value(3));
+    pa_telemetry_record(t, PA_TELEMETRY_XRUN, value(4));
+    pa_telemetry_record(t, PA_TELEMETRY_XRUN, value((uint64_t) -1));
+    pa_assert_se(evaluated == 6);
+    pa_telemetry_collect(t);
+
+    h = pa_telemetry_get_histogram(t, PA_TELEMETRY_XRUN);
+    pa_assert_se(h->count == 6);
+    pa_assert_se(h->buckets[0] == 1);
+    pa_assert_se(h->buckets[1] == 1);
+    pa_assert_se(h->buckets[2] == 2);
+    pa_assert_se(h->buckets[3] == 1);
+    pa_assert_se(h->buckets[29] == 1);
+    pa_assert_se(h->max == (1U << 29) - 1);
+    pa_assert_se(pa_telemetry_get_histogram(t, PA_TELEMETRY_REWIND)->count == 0);
+
+    /* A full ring drops samples instead of overwriting them */
+    pa_telemetry_reset(t);
+    for (i = 0; i < PA_TELEMETRY_RING_SIZE + 10; i++)
+        pa_telemetry_record(t, PA_TELEMETRY_REWIND, 5);
+    pa_assert_se(pa_telemetry_get_dropped(t) == 10);
+    pa_telemetry_collect(t);
+    h = pa_telemetry_get_histogram(t, PA_TELEMETRY_REWIND);
+    pa_assert_se(h->count == PA_TELEMETRY_RING_SIZE);
+    pa_assert_se(h->sum == 5 * PA_TELEMETRY_RING_SIZE);
+
+    /* One IO thread recording while the main thread collects: nothing
+     * may be counted twice or lost without being accounted for */
+    pa_telemetry_reset(t);
+    pa_assert_se(thread = pa_thread_new("producer", producer, t));
+
+    while (pa_thread_is_running(thread))
+        pa_telemetry_collect(t);
+
+    pa_thread_free(thread);
+    pa_telemetry_collect(t);
+
+    h = pa_telemetry_get_histogram(t, PA_TELEMETRY_RENDER_TIME);
+    total = h->count + pa_telemetry_get_dropped(t);
+    pa_log_info("%llu samples collected, %u dropped",
+                (unsigned long long) h->count, pa_telemetry_get_dropped(t));
+    pa_assert_se(total == N_SAMPLES);
+    pa_assert_se(h->max <= 4095);
+
+    pa_telemetry_free(t);
+
+    return 0;
+}
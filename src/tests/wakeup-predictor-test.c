@@ -0,0 +1,155 @@
+/***
+  This file is part of PulseAudio.
+
+  PulseAudio is free software; you can redistribute it and/or modify
+  it under the terms of the GNU Lesser General Public License as published
+  by the Free Software Foundation; either version 2.1 of the License,
+  or (at your option) any later version.
+
+  PulseAudio is distributed in the hope that it will be useful, but
+  WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+  General Public License for more details.
+
+  You should have received a copy of the GNU Lesser General Public License
+  along with PulseAudio; if not, write to the Free Software
+  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307
+  USA.
+***/
+
+/* Feeds the wakeup predictor with known distributions and checks that
+ * the predicted margins cover them, and that it follows a change of
+ * conditions. Then simulates a timer-scheduled sink with a 50ms buffer
+ * and compares the wakeup and underrun counts of the default fixed
+ * 20ms watermark with the predicted one. */
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include <stdlib.h>
+
+#include <pulse/timeval.h>
+
+#include <pulsecore/log.h>
+#include <pulsecore/macro.h>
+#include <pulsecore/wakeup-predictor.h>
+
+#define BUFFER_USEC (50*PA_USEC_PER_MSEC)
+#define FIXED_WATERMARK_USEC (20*PA_USEC_PER_MSEC)
+#define HEADROOM_USEC (2*PA_USEC_PER_MSEC)
+#define SIMULATED_USEC (600*PA_USEC_PER_SEC)
+
+/* Our own generator, so that the simulation comes out the same
+ * everywhere */
+static uint32_t random_state = 1;
+
+static uint32_t random_next(void) {
+    random_state ^= random_state << 13;
+    random_state ^= random_state >> 17;
+    random_state ^= random_state << 5;
+    return random_state;
+}
+
+/* Mostly a few hundred usec late, now and then a lot more */
+static pa_usec_t random_late(void) {
+    if (random_next() % 1000 == 0)
+        return 3000 + random_next() % 5000;
+
+    return 100 + random_next() % 400;
+}
+
+/* Mirrors what alsa-sink does: an underrun raises the watermark right
+ * away and keeps the prediction from lowering it for a while */
+static void simulate(pa_wakeup_predictor *p, unsigned *wakeups, unsigned *underruns) {
+    pa_usec_t t = 0, watermark = FIXED_WATERMARK_USEC, not_before = 0;
+
+    *wakeups = *underruns = 0;
+
+    while (t < SIMULATED_USEC) {
+        pa_usec_t late = random_late(), work = 200, margin;
+
+        /* We sleep until the watermark is left in the buffer, wake up
+         * late, render and fill the buffer up again */
+        t += BUFFER_USEC - watermark + late + work;
+        (*wakeups)++;
+
+        if (!p)
+            continue;
+
+        pa_wakeup_predictor_add(p, late, work);
+
+        if (late + work > watermark) {
+            (*underruns)++;
+            watermark = PA_MIN(watermark * 2, watermark + 10*PA_USEC_PER_MSEC);
+            not_before = t + 20*PA_USEC_PER_SEC;
+        }
+
+        if (pa_wakeup_predictor_get_margin(p, &margin))
+            if (margin + HEADROOM_USEC > watermark || t >= not_before)
+                watermark = margin + HEADROOM_USEC;
+    }
+}
+
+int main(int argc, char *argv[]) {
+    pa_wakeup_predictor *p;
+    pa_usec_t margin;
+    unsigned i, wakeups, fixed_wakeups, underruns;
+
+    if (!getenv("MAKE_CHECK"))
+        pa_log_set_level(PA_LOG_DEBUG);
+
+    /* 99% of all wakeups need 1ms, 1% need 8ms */
+    pa_assert_se(p = pa_wakeup_predictor_new(999000));
+
+    for (i = 0; i < 2000; i++) {
+        if (i < 100)
+            pa_assert_se(!pa_wakeup_predictor_get_margin(p, &margin));
+
+        if (i % 100 == 50)
+            pa_wakeup_predictor_add(p, 7000, 1000);
+        else
+            pa_wakeup_predictor_add(p, 800, 200);
+    }
+
+    pa_assert_se(pa_wakeup_predictor_get_margin(p, &margin));
+    pa_log_debug("99.9%% margin: %llu usec", (unsigned long long) margin);
+    pa_assert_se(margin > 8000 && margin <= 8100);
+    pa_wakeup_predictor_free(p);
+
+    pa_assert_se(p = pa_wakeup_predictor_new(900000));
+
+    for (i = 0; i < 2000; i++)
+        pa_wakeup_predictor_add(p, i % 100 == 50 ? 7000 : 800, 200);
+
+    pa_assert_se(pa_wakeup_predictor_get_margin(p, &margin));
+    pa_log_debug("90%% margin: %llu usec", (unsigned long long) margin);
+    pa_assert_se(margin > 1000 && margin <= 1100);
+
+    /* Things calm down, the old history must fade out */
+    for (i = 0; i < 20000; i++)
+        pa_wakeup_predictor_add(p, 100, 100);
+
+    pa_assert_se(pa_wakeup_predictor_get_margin(p, &margin));
+    pa_log_debug("90%% margin after calming down: %llu usec", (unsigned long long) margin);
+    pa_assert_se(margin <= 300);
+
+    pa_wakeup_predictor_reset(p);
+    pa_assert_se(!pa_wakeup_predictor_get_margin(p, &margin));
+    pa_wakeup_predictor_free(p);
+
+    /* And now the sink */
+    simulate(NULL, &fixed_wakeups, &underruns);
+    pa_log_info("Fixed watermark: %u wakeups", fixed_wakeups);
+
+    pa_assert_se(p = pa_wakeup_predictor_new(999900));
+    simulate(p, &wakeups, &underruns);
+    pa_log_info("Predicted watermark: %u wakeups, %u underruns", wakeups, underruns);
+    pa_wakeup_predictor_free(p);
+
+    /* Only the outliers before it learned about them may hurt */
+    pa_assert_se(underruns <= 2);
+    pa_assert_se(wakeups < fixed_wakeups * 9 / 10);
+
+    return 0;
+}
@@ -0,0 +1,241 @@
+/***
+  This file is part of PulseAudio.
+
+  PulseAudio is free software; you can redistribute it and/or modify
+  it under the terms of the GNU Lesser General Public License as
+  published by the Free Software Foundation; either version 2.1 of the
+  License, or (at your option) any later version.
+
+  PulseAudio is distributed in the hope that it will be useful, but
+  WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+  Lesser General Public License for more details.
+
+  You should have received a copy of the GNU Lesser General Public
+  License along with PulseAudio; if not, write to the Free Software
+  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307
+  USA.
+***/
+
+
+/* Plays the backend domain of module-xenpv-sink: the ring pages are a
+ * plain shared memory mapping, the event channel is a pa_fdsem and the
+ * consumer is a thread of its own. Checks that everything arrives in
+ * order and measures throughput and how many events the batched updates
+ * save over notifying the backend on every write. */
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+
+#include <pulse/rtclock.h>
+#include <pulse/timeval.h>
+#include <pulse/xmalloc.h>
+
+#include <pulsecore/atomic.h>
+#include <pulsecore/fdsem.h>
+#include <pulsecore/log.h>
+#include <pulsecore/macro.h>
+#include <pulsecore/thread.h>
+
+#include <modules/xen/xenpv-ring.h>
+
+#define RING_PAGES 9
+#define TOTAL (64*1024*1024)
+
+struct backend {
+    pa_xenpv_ring_header *header;
+    const uint8_t *data;
+    pa_fdsem *event;
+    uint64_t n_events;
+};
+
+static void backend_thread(void *userdata) {
+    struct backend *b = userdata;
+    uint32_t cons = 0, size = b->header->size;
+
+    while (cons < TOTAL) {
+        uint32_t prod = pa_xenpv_load(&b->header->prod_indx);
+
+        if (prod == cons) {
+            /* Going to sleep: ask for an event, then look once more */
+            pa_xenpv_store(&b->header->prod_event, cons + 1);
+            pa_xenpv_mb();
+
+            if (pa_xenpv_load(&b->header->prod_indx) == cons) {
+                pa_fdsem_wait(b->event);
+                b->n_events++;
+            }
+
+            continue;
+        }
+
+        pa_assert_se(prod - cons <= size);
+
+        for (; cons != prod; cons++)
+            pa_assert_se(b->data[cons & (size - 1)] == (uint8_t) (cons % 251));
+
+        pa_xenpv_store(&b->header->cons_indx, cons);
+    }
+}
+
+static void fill(uint8_t *p, uint32_t pos, size_t n) {
+    size_t i;
+
+    for (i = 0; i < n; i++)
+        p[i] = (uint8_t) ((pos + i) % 251);
+}
+
+/* Single threaded: nothing is visible before it is pushed, and only the
+ * first push into an idle ring asks for an event */
+static void test_batching(void *pages) {
+    pa_xenpv_ring r;
+    uint8_t buf[5000];
+
+    pa_xenpv_ring_init(&r, pages, RING_PAGES, 4);
+    pa_assert_se(r.size == (RING_PAGES - 1) * PA_XENPV_RING_PAGE_SIZE);
+
+    fill(buf, 0, sizeof(buf));
+    pa_assert_se(pa_xenpv_ring_write(&r, buf, sizeof(buf)) == sizeof(buf));
+    pa_assert_se(pa_xenpv_ring_fill(&r) == sizeof(buf));
+    pa_assert_se(r.header->prod_indx == 0);
+
+    pa_assert_se(pa_xenpv_ring_push(&r));
+    pa_assert_se(r.header->prod_indx == sizeof(buf));
+
+    /* Nothing new, and the backend is still busy */
+    pa_assert_se(!pa_xenpv_ring_push(&r));
+    pa_assert_se(pa_xenpv_ring_write(&r, buf, 100) == 100);
+    pa_assert_se(!pa_xenpv_ring_push(&r));
+
+    /* Full ring */
+    pa_assert_se(pa_xenpv_ring_write(&r, buf, sizeof(buf)) == sizeof(buf));
+    pa_assert_se(pa_xenpv_ring_write(&r, buf, sizeof(buf)) == sizeof(buf));
+    pa_assert_se(pa_xenpv_ring_write(&r, buf, sizeof(buf)) == sizeof(buf));
+    pa_assert_se(pa_xenpv_ring_write(&r, buf, sizeof(buf)) == sizeof(buf));
+    pa_assert_se(pa_xenpv_ring_write(&r, buf, sizeof(buf)) == sizeof(buf));
+    pa_assert_se(pa_xenpv_ring_write(&r, buf, sizeof(buf)) == r.size - 6 * sizeof(buf) - 100);
+    pa_assert_se(pa_xenpv_ring_free(&r) == 0);
+    pa_assert_se(pa_xenpv_ring_write(&r, buf, sizeof(buf)) == 0);
+    pa_assert_se(!pa_xenpv_ring_push(&r));
+
+    /* The backend drained everything and went to sleep */
+    r.header->cons_indx = r.size;
+    r.header->prod_event = r.size + 1;
+    pa_assert_se(pa_xenpv_ring_write(&r, buf, sizeof(buf)) == sizeof(buf));
+    pa_assert_se(pa_xenpv_ring_push(&r));
+    pa_assert_se(pa_xenpv_ring_write(&r, buf, sizeof(buf)) == sizeof(buf));
+    pa_assert_se(!pa_xenpv_ring_push(&r));
+}
+
+/* A backend that doesn't advertise feature-multi-page-ring gets the
+ * original single-page ring, notified on every update */
+static void test_legacy(void *pages) {
+    pa_xenpv_ring r;
+    pa_xenpv_ring_legacy_header *h;
+    uint8_t buf[1500];
+
+    pa_xenpv_ring_init(&r, pages, 1, 6);
+    pa_assert_se(!r.header);
+    pa_assert_se(h = r.legacy);
+    pa_assert_se(r.size == PA_XENPV_RING_LEGACY_BUFSIZE - PA_XENPV_RING_LEGACY_BUFSIZE % 6);
+    pa_assert_se(h->usable_buffer_space == r.size);
+    pa_assert_se(r.data == (uint8_t*) pages + 3 * sizeof(uint32_t));
+
+    fill(buf, 0, sizeof(buf));
+    pa_assert_se(pa_xenpv_ring_write(&r, buf, sizeof(buf)) == sizeof(buf));
+    pa_assert_se(h->prod_indx == 0);
+    pa_assert_se(pa_xenpv_ring_push(&r));
+    pa_assert_se(h->prod_indx == sizeof(buf));
+    pa_assert_se(!pa_xenpv_ring_push(&r));
+
+    /* One byte always stays free */
+    pa_assert_se(pa_xenpv_ring_write(&r, buf, sizeof(buf)) == r.size - 1 - sizeof(buf));
+    pa_assert_se(pa_xenpv_ring_free(&r) == 0);
+    pa_assert_se(pa_xenpv_ring_push(&r));
+    pa_assert_se(h->prod_indx == r.size - 1);
+
+    /* The backend consumed some; the index wraps at usable_buffer_space */
+    h->cons_indx = 1000;
+    pa_assert_se(pa_xenpv_ring_fill(&r) == r.size - 1 - 1000);
+    pa_assert_se(pa_xenpv_ring_write(&r, buf, sizeof(buf)) == 1000);
+    pa_assert_se(pa_xenpv_ring_push(&r));
+    pa_assert_se(h->prod_indx == 999);
+    pa_assert_se(r.data[r.size - 1] == buf[0]);
+    pa_assert_se(r.data[0] == buf[1]);
+}
+
+int main(int argc, char *argv[]) {
+    void *pages;
+    pa_xenpv_ring r;
+    struct backend b;
+    pa_thread *t;
+    uint8_t *buf;
+    uint32_t pos = 0;
+    uint64_t n_writes = 0, n_notifies = 0;
+    size_t chunk = 1;
+    pa_usec_t usec;
+
+    if (!getenv("MAKE_CHECK"))
+        pa_log_set_level(PA_LOG_DEBUG);
+
+    pages = mmap(NULL, RING_PAGES * PA_XENPV_RING_PAGE_SIZE, PROT_READ|PROT_WRITE, MAP_SHARED|MAP_ANONYMOUS, -1, 0);
+    pa_assert_se(pages != MAP_FAILED);
+
+    test_legacy(pages);
+    test_batching(pages);
+
+    pa_xenpv_ring_init(&r, pages, RING_PAGES, 4);
+
+    b.header = r.header;
+    b.data = r.data;
+    b.event = pa_fdsem_new();
+    b.n_events = 0;
+
+    buf = pa_xmalloc(r.size);
+
+    usec = pa_rtclock_now();
+    pa_assert_se(t = pa_thread_new("backend", backend_thread, &b));
+
+    while (pos < TOTAL) {
+        size_t n;
+
+        /* Render into the ring in chunks of varying size, like the sink
+         * does, then publish them all at once */
+        while ((n = PA_MIN(PA_MIN(pa_xenpv_ring_free(&r), chunk), TOTAL - pos)) > 0) {
+            fill(buf, pos, n);
+            pa_assert_se(pa_xenpv_ring_write(&r, buf, n) == n);
+
+            pos += (uint32_t) n;
+            n_writes++;
+            chunk = chunk % 4093 + 509;
+        }
+
+        if (pa_xenpv_ring_push(&r)) {
+            pa_fdsem_post(b.event);
+            n_notifies++;
+        } else
+            pa_thread_yield();
+    }
+
+    pa_thread_free(t);
+    usec = pa_rtclock_now() - usec;
+
+    pa_log_info("%u MiB in %llu usec (%0.1f MiB/s): %llu writes, %llu events sent, %llu waited for",
+                TOTAL / 1024 / 1024, (unsigned long long) usec,
+                (double) TOTAL / 1024 / 1024 * PA_USEC_PER_SEC / PA_MAX(usec, 1U),
+                (unsigned long long) n_writes, (unsigned long long) n_notifies, (unsigned long long) b.n_events);
+
+    pa_assert_se(n_notifies < n_writes);
+    pa_assert_se(b.n_events <= n_notifies);
+
+    pa_fdsem_free(b.event);
+    pa_xfree(buf);
+    munmap(pages, RING_PAGES * PA_XENPV_RING_PAGE_SIZE);
+
+    return 0;
+}
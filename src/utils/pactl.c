@@ -37,6 +37,7 @@
 
 #include <pulse/pulseaudio.h>
 #include <pulse/ext-device-restore.h>
+#include <pulse/ext-telemetry.h>
 
 #include <pulsecore/i18n.h>
 #include <pulsecore/macro.h>
@@ -57,7 +58,8 @@ static char
     *card_name = NULL,
     *profile_name = NULL,
     *port_name = NULL,
-    *formats = NULL;
+    *formats = NULL,
+    *telemetry_command = NULL;
 
 static uint32_t
     sink_input_idx = PA_INVALID_INDEX,
@@ -116,6 +118,7 @@ static enum {
     SET_SINK_INPUT_MUTE,
     SET_SOURCE_OUTPUT_MUTE,
     SET_SINK_FORMATS,
+    TELEMETRY,
     SUBSCRIBE
 } action = NONE;
 
@@ -1056,6 +1059,82 @@ static const char *subscription_event_facility_to_string(pa_subscription_event_t
     return _("unknown");
 }
 
+/* Returns the smallest bucket bound below which the given fraction
+ * of all samples lie */
+static uint32_t histogram_percentile(const pa_ext_telemetry_histogram *h, double fraction) {
+    uint64_t n = 0;
+    unsigned b;
+
+    for (b = 0; b < PA_EXT_TELEMETRY_BUCKETS - 1; b++) {
+        n += h->buckets[b];
+
+        if (n >= fraction * h->count)
+            return b == 0 ? 0 : (1U << b) - 1;
+    }
+
+    return h->max;
+}
+
+static void telemetry_read_callback(pa_context *c, const pa_ext_telemetry_info *i, int is_last, void *userdata) {
+
+    static const char *type_table[] = {
+        [PA_EXT_TELEMETRY_SINK] = "Sink",
+        [PA_EXT_TELEMETRY_SOURCE] = "Source",
+        [PA_EXT_TELEMETRY_SINK_INPUT] = "Sink Input",
+        [PA_EXT_TELEMETRY_SOURCE_OUTPUT] = "Source Output"
+    };
+
+    static const char *metric_table[PA_EXT_TELEMETRY_METRIC_MAX] = {
+        [PA_EXT_TELEMETRY_RENDER_TIME] = "render time",
+        [PA_EXT_TELEMETRY_BUFFER_FILL] = "buffer fill",
+        [PA_EXT_TELEMETRY_WAKEUP_LATENESS] = "wakeup lateness",
+        [PA_EXT_TELEMETRY_REWIND] = "rewind",
+        [PA_EXT_TELEMETRY_XRUN] = "xrun"
+    };
+
+    unsigned m;
+
+    if (is_last < 0) {
+        pa_log(_("Failed to get telemetry: %s"), pa_strerror(pa_context_errno(c)));
+        quit(1);
+        return;
+    }
+
+    if (is_last) {
+        complete_action();
+        return;
+    }
+
+    pa_assert(i);
+
+    if (nl)
+        printf("\n");
+    nl = TRUE;
+
+    printf(_("%s #%u (%s)\n"),
+           i->type < PA_ELEMENTSOF(type_table) ? _(type_table[i->type]) : _("Unknown"),
+           i->index,
+           pa_strnull(i->name));
+
+    if (i->dropped > 0)
+        printf(_("\tDropped samples: %u\n"), i->dropped);
+
+    for (m = 0; m < PA_EXT_TELEMETRY_METRIC_MAX; m++) {
+        const pa_ext_telemetry_histogram *h = &i->histograms[m];
+
+        if (h->count <= 0)
+            continue;
+
+        printf(_("\t%s: %llu samples, avg %llu usec, p50 < %u usec, p99 < %u usec, max %u usec\n"),
+               _(metric_table[m]),
+               (unsigned long long) h->count,
+               (unsigned long long) (h->sum / h->count),
+               histogram_percentile(h, 0.5),
+               histogram_percentile(h, 0.99),
+               h->max);
+    }
+}
+
 static void context_subscribe_callback(pa_context *c, pa_subscription_event_type_t t, uint32_t idx, void *userdata) {
     pa_assert(c);
 
@@ -1241,6 +1320,15 @@ static void context_state_callback(pa_context *c, void *userdata) {
                     set_sink_formats(c, sink_idx, formats);
                     break;
 
+                case TELEMETRY:
+                    if (!telemetry_command)
+                        pa_operation_unref(pa_ext_telemetry_read(c, telemetry_read_callback, NULL));
+                    else if (pa_streq(telemetry_command, "reset"))
+                        pa_operation_unref(pa_ext_telemetry_reset(c, simple_callback, NULL));
+                    else
+                        pa_operation_unref(pa_ext_telemetry_enable(c, pa_streq(telemetry_command, "on"), simple_callback, NULL));
+                    break;
+
                 case SUBSCRIBE:
                     pa_context_set_subscribe_callback(c, context_subscribe_callback, NULL);
 
@@ -1355,6 +1443,7 @@ static void help(const char *argv0) {
     printf("%s %s %s %s\n", argv0, _("[options]"), "set-(sink|source)-mute", _("NAME|#N 1|0"));
     printf("%s %s %s %s\n", argv0, _("[options]"), "set-(sink-input|source-output)-mute", _("#N 1|0"));
     printf("%s %s %s %s\n", argv0, _("[options]"), "set-sink-formats", _("#N FORMATS"));
+    printf("%s %s %s\n",    argv0, _("[options]"), "telemetry [on|off|reset]");
     printf("%s %s %s\n",    argv0, _("[options]"), "subscribe");
 
     printf(_("\n"
@@ -1766,6 +1855,26 @@ int main(int argc, char *argv[]) {
 
             mute = b;
 
+        } else if (pa_streq(argv[optind], "telemetry")) {
+
+            if (argc > optind+2) {
+                pa_log(_("Too many arguments."));
+                goto quit;
+            }
+
+            if (argc == optind+2) {
+                if (!pa_streq(argv[optind+1], "on") &&
+                    !pa_streq(argv[optind+1], "off") &&
+                    !pa_streq(argv[optind+1], "reset")) {
+                    pa_log(_("Invalid telemetry command, expected on, off or reset"));
+                    goto quit;
+                }
+
+                telemetry_command = pa_xstrdup(argv[optind+1]);
+            }
+
+            action = TELEMETRY;
+
         } else if (pa_streq(argv[optind], "subscribe"))
 
             action = SUBSCRIBE;
@@ -1844,6 +1953,7 @@ quit:
     pa_xfree(profile_name);
     pa_xfree(port_name);
     pa_xfree(formats);
+    pa_xfree(telemetry_command);
 
     if (sndfile)
         sf_close(sndfile);